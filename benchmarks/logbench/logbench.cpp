@@ -0,0 +1,378 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include <QtTest>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "canlogfile.h"
+#include "canlogblock.h"
+#include "canjournal.h"
+#include "canpacketmodel.h"
+#include "canthread.h"
+#include "cantrigger.h"
+
+/*!
+ * Benchmarks of the canlogfile hot paths with synthetic captures.
+ * Besides the QTestLib result, every benchmark prints one line
+ *   PERFRAME <benchmark> <frames> <ns/frame> <bytes/frame>
+ * where bytes/frame is the resident memory (or file size for writeFile) per
+ * frame. The capture sizes can be set with LOGBENCH_SIZES=10000,1000000.
+ */
+class tst_logbench: public QObject {
+Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void adddataitem_data();
+  void adddataitem();
+  void writeFile_data();
+  void writeFile();
+  void readFile_data();
+  void readFile();
+  void roundtrip_data();
+  void roundtrip();
+  void clear_data();
+  void clear();
+  void sort_data();
+  void sort();
+  void sortties();
+  void setfilter_data();
+  void setfilter();
+
+private:
+  QList<int> sizes;                       //!< Capture sizes to be measured
+  QMap<int, QString> files;               //!< Written capture per size
+  QString tempdir;                        //!< Directory for the captures
+
+  void addsizes();                        //!< One data row per capture size
+  QString capturefile(int count);         //!< Capture file with count frames (written once)
+};
+
+/*!
+ * Synthetic capture resembling a vehicle bus: 56 standard and 8 extended IDs
+ * in round robin, 100 us apart, counters and slowly changing values in the
+ * payload and an error frame now and then.
+ * @param count Number of frames
+ * @return the frames
+ */
+static QVector<canpacket> syntheticcapture(int count) {
+  QVector<canpacket> packets(count);
+  for (int i = 0; i < count; i++) {
+    canpacket &packet = packets[i];
+    bzero(&packet, sizeof(packet));
+    int id = i % 64;
+    packet.direction = true;
+    packet.ide = id >= 56;
+    packet.identifier = packet.ide ? 0x18DA00F1 + (id - 56) * 0x100 : 0x100 + id * 0x10;
+    packet.err = (i % 100000) == 99999;
+    packet.dlc = (id % 7) ? 8 : 4;
+    packet.data[0] = i / 64;
+    packet.data[1] = id;
+    packet.data[2] = (i / 6400) & 0xFF;
+    packet.data[3] = (i / 640) & 0xFF;
+    packet.data[4] = 0x7F;
+    packet.tv.tv_sec = 1262304000 + i / 10000;
+    packet.tv.tv_usec = (i % 10000) * 100;
+  }
+  return packets;
+}
+
+/*!
+ * Resident memory of the process.
+ * @return bytes
+ */
+static qint64 residentbytes() {
+  QFile statm("/proc/self/statm");
+  if (!statm.open(QIODevice::ReadOnly)) return 0;
+  QList<QByteArray> fields = statm.readAll().split(' ');
+  return fields.size() > 1 ? fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) : 0;
+}
+
+/*!
+ * Prints the per frame result of a benchmark.
+ * @param name Name of the benchmark
+ * @param count Number of frames
+ * @param usec Time taken (microseconds)
+ * @param bytes Memory or file size
+ */
+static void report(const QString &name, int count, qint64 usec, qint64 bytes) {
+  printf("PERFRAME %s %d %.1f %.1f\n", name.toAscii().constData(), count,
+         usec * 1000.0 / qMax(count, 1), (double)bytes / qMax(count, 1));
+  fflush(stdout);
+}
+
+/*!
+ * Reads the capture sizes and creates the directory for the captures.
+ */
+void tst_logbench::initTestCase() {
+  QString env = QString::fromLocal8Bit(qgetenv("LOGBENCH_SIZES"));
+  if (env.isEmpty()) env = "10000,1000000,10000000";
+  foreach (const QString &size, env.split(",", QString::SkipEmptyParts)) sizes.append(size.toInt());
+  tempdir = QDir::temp().absoluteFilePath(QString("logbench-%1").arg(getpid()));
+  QVERIFY(QDir().mkpath(tempdir));
+}
+
+/*!
+ * Removes the captures.
+ */
+void tst_logbench::cleanupTestCase() {
+  QDir dir(tempdir);
+  foreach (const QString &file, dir.entryList(QDir::Files)) dir.remove(file);
+  QDir().rmdir(tempdir);
+}
+
+/*!
+ * One data row per capture size.
+ */
+void tst_logbench::addsizes() {
+  QTest::addColumn<int>("count");
+  foreach (int count, sizes) QTest::newRow(QByteArray::number(count)) << count;
+}
+
+/*!
+ * Capture file with count frames, written by canlogfile once per size.
+ * @param count Number of frames
+ * @return file name
+ */
+QString tst_logbench::capturefile(int count) {
+  if (!files.contains(count)) {
+    canlogfile clf;
+    foreach (const canpacket &packet, syntheticcapture(count)) clf.adddataitem(packet);
+    QString fileName = QString("%1/capture-%2.clf").arg(tempdir).arg(count);
+    clf.writeFile(fileName);
+    files.insert(count, fileName);
+  }
+  return files.value(count);
+}
+
+void tst_logbench::adddataitem_data() {
+  addsizes();
+}
+
+/*!
+ * Frames added one by one, as during a live capture.
+ */
+void tst_logbench::adddataitem() {
+  QFETCH(int, count);
+  QVector<canpacket> packets = syntheticcapture(count);
+  canlogfile clf;
+  qint64 memory = residentbytes();
+  qint64 start = cantriggerengine::monotonicnow();
+  QBENCHMARK_ONCE {
+    for (int i = 0; i < count; i++) clf.adddataitem(packets.at(i));
+  }
+  report("adddataitem", count, cantriggerengine::monotonicnow() - start, residentbytes() - memory);
+  QCOMPARE(clf.getdataitemcount(), count);
+}
+
+void tst_logbench::writeFile_data() {
+  addsizes();
+}
+
+/*!
+ * Saving a capture; bytes/frame is the file size.
+ */
+void tst_logbench::writeFile() {
+  QFETCH(int, count);
+  canlogfile clf;
+  QVERIFY(clf.readFile(capturefile(count)));
+  QString fileName = QString("%1/written-%2.clf").arg(tempdir).arg(count);
+  qint64 start = cantriggerengine::monotonicnow();
+  QBENCHMARK_ONCE {
+    QVERIFY(clf.writeFile(fileName));
+  }
+  report("writeFile", count, cantriggerengine::monotonicnow() - start, QFileInfo(fileName).size());
+  QFile::remove(fileName);
+}
+
+void tst_logbench::readFile_data() {
+  addsizes();
+}
+
+/*!
+ * Loading a capture; bytes/frame is the memory held afterwards.
+ */
+void tst_logbench::readFile() {
+  QFETCH(int, count);
+  QString fileName = capturefile(count);
+  canlogfile clf;
+  qint64 memory = residentbytes();
+  qint64 start = cantriggerengine::monotonicnow();
+  QBENCHMARK_ONCE {
+    QVERIFY(clf.readFile(fileName));
+  }
+  report("readFile", count, cantriggerengine::monotonicnow() - start, residentbytes() - memory);
+  QCOMPARE(clf.getdataitemcount(), count);
+}
+
+void tst_logbench::roundtrip_data() {
+  addsizes();
+}
+
+/*!
+ * Whether a canpacket has been saved and read back unchanged.
+ * @param read The canpacket read
+ * @param written The canpacket written
+ * @return true if all saved fields match
+ */
+static bool samepacket(const canpacket &read, const canpacket &written) {
+  return read.interface == written.interface && read.direction == written.direction
+      && read.identifier == written.identifier && read.rtr == written.rtr && read.ide == written.ide
+      && read.err == written.err && read.dlc == written.dlc && !memcmp(read.data, written.data, written.dlc)
+      && read.tv.tv_sec == written.tv.tv_sec && read.tv.tv_usec == written.tv.tv_usec
+      && read.bookmark == written.bookmark && read.marker == written.marker;
+}
+
+/*!
+ * A saved capture reads back unchanged, both via the index and, with the
+ * index cut off (as after an aborted write), by walking the blocks. So do
+ * a capture journal (with a short block now and then, as by its syncs) and
+ * the file saved from it. Checks the file format rather than measuring it.
+ */
+void tst_logbench::roundtrip() {
+  QFETCH(int, count);
+  QVector<canpacket> written = syntheticcapture(count);
+  canlogfile clf;
+  QVERIFY(clf.readFile(capturefile(count)));
+  QCOMPARE(clf.getdataitemcount(), count);
+
+  QFile file(capturefile(count));
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  QByteArray contents = file.readAll();
+  file.close();
+  QString cutName = QString("%1/noindex-%2.clf").arg(tempdir).arg(count);
+  QFile cut(cutName);
+  QVERIFY(cut.open(QIODevice::WriteOnly));
+  cut.write(contents.left(contents.size() - canblockcodec::TrailerSize));
+  cut.close();
+
+  QString journalName = QString("%1/journal-%2.clf").arg(tempdir).arg(count);
+  QString savedName = QString("%1/saved-%2.clf").arg(tempdir).arg(count);
+  canjournal journal;
+  QVERIFY(journal.start(journalName));
+  for (int i = 0; i < count; i++) {
+    QVERIFY(journal.append(written.at(i)));
+    if (i % 10000 == 9999) QVERIFY(journal.sync());
+  }
+  QVERIFY(journal.saveas(savedName));
+  QVERIFY(journal.sync());
+
+  QStringList unfinished = QStringList() << cutName << journalName;
+  foreach (const QString &fileName, QStringList() << capturefile(count) << cutName << journalName << savedName) {
+    QFile in(fileName);
+    QVERIFY(in.open(QIODevice::ReadOnly));
+    canblockreader reader(&in);
+    QVERIFY(reader.open());
+    QCOMPARE(reader.truncated(), unfinished.contains(fileName));
+    QCOMPARE(reader.packetcount(), (quint64)count);
+    QVector<canpacket> read;
+    for (int i = 0; i < reader.blockcount(); i++) QVERIFY2(reader.readblock(i, &read), qPrintable(reader.errorstring()));
+    QCOMPARE(read.size(), count);
+    for (int i = 0; i < count; i++) QVERIFY2(samepacket(read.at(i), written.at(i)), qPrintable(QString("packet %1").arg(i)));
+  }
+  journal.stop(true);
+  QFile::remove(cutName);
+  QFile::remove(savedName);
+}
+
+void tst_logbench::clear_data() {
+  addsizes();
+}
+
+/*!
+ * Clearing a capture; bytes/frame is the memory given back.
+ */
+void tst_logbench::clear() {
+  QFETCH(int, count);
+  canlogfile clf;
+  QVERIFY(clf.readFile(capturefile(count)));
+  qint64 memory = residentbytes();
+  qint64 start = cantriggerengine::monotonicnow();
+  QBENCHMARK_ONCE {
+    clf.clear();
+  }
+  report("clear", count, cantriggerengine::monotonicnow() - start, memory - residentbytes());
+  QCOMPARE(clf.getdataitemcount(), 0);
+}
+
+void tst_logbench::sort_data() {
+  QTest::addColumn<int>("count");
+  QTest::addColumn<int>("column");
+  QTest::addColumn<int>("order");
+  foreach (int count, sizes) {
+    QTest::newRow(QByteArray::number(count) + " id") << count << (int)canpacketmodel::ColID << (int)Qt::AscendingOrder;
+    QTest::newRow(QByteArray::number(count) + " data") << count << (int)canpacketmodel::ColData << (int)Qt::AscendingOrder;
+    QTest::newRow(QByteArray::number(count) + " timestamp desc") << count << (int)canpacketmodel::ColTimestamp << (int)Qt::DescendingOrder;
+  }
+}
+
+/*!
+ * Sorting a loaded capture by a column, as by a click on the header.
+ */
+void tst_logbench::sort() {
+  QFETCH(int, count);
+  QFETCH(int, column);
+  QFETCH(int, order);
+  canlogfile clf;
+  QVERIFY(clf.readFile(capturefile(count)));
+  qint64 memory = residentbytes();
+  qint64 start = cantriggerengine::monotonicnow();
+  QBENCHMARK_ONCE {
+    clf.sortByColumn(column, (Qt::SortOrder)order);
+  }
+  report(QString("sort-%1-%2").arg(column).arg(order), count, cantriggerengine::monotonicnow() - start, residentbytes() - memory);
+}
+
+/*!
+ * Rows with equal keys stay in arrival order whichever way the rows got
+ * sorted: after a change of direction and a live packet the rows are the
+ * same as a fresh sort gives. Checks the order rather than measuring it.
+ */
+void tst_logbench::sortties() {
+  QSharedPointer<canpacketstore> store(new canpacketstore);
+  canpacketmodel model(store);
+  QVector<canpacket> packets = syntheticcapture(10000);
+  foreach (const canpacket &packet, packets) store->append(packet);
+
+  for (int direction = Qt::AscendingOrder; direction <= Qt::DescendingOrder; direction++) {
+    Qt::SortOrder first = (Qt::SortOrder)(Qt::DescendingOrder - direction);
+    model.sort(canpacketmodel::ColID, first);
+    model.sort(canpacketmodel::ColID, (Qt::SortOrder)direction);
+    store->append(packets.at(direction));
+
+    canpacketmodel fresh(store);
+    fresh.sort(canpacketmodel::ColID, (Qt::SortOrder)direction);
+    QCOMPARE(model.rowCount(), fresh.rowCount());
+    for (int row = 0; row < model.rowCount(); row++) QCOMPARE(model.arrivalatrow(row), fresh.arrivalatrow(row));
+  }
+}
+
+void tst_logbench::setfilter_data() {
+  QTest::addColumn<QStringList>("hwfilter");
+  QTest::newRow("none") << (QStringList() << "" << "" << "" << "");
+  QTest::newRow("ids") << (QStringList() << "123:7FF" << "200~700" << "18DA00F1:1FFFFFFF" << "");
+  QTest::newRow("ids and errors") << (QStringList() << "123:7FF" << "200~700" << "18DA00F1:1FFFFFFF" << "#FFFFFFFF");
+}
+
+/*!
+ * Parsing the hardware filters (the thread is not running, so the socket
+ * calls fail right away).
+ */
+void tst_logbench::setfilter() {
+  QFETCH(QStringList, hwfilter);
+  canthread thread;
+  QBENCHMARK {
+    thread.setfilter(hwfilter);
+  }
+}
+
+QTEST_MAIN(tst_logbench)
+#include "logbench.moc"
@@ -0,0 +1,34 @@
+TARGET = logbench
+TEMPLATE = app
+QT += testlib
+CONFIG += console
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+DEPENDPATH += ../..
+SOURCES += logbench.cpp \
+    ../../canthread.cpp \
+    ../../canlogfile.cpp \
+    ../../canpacketmodel.cpp \
+    ../../canpacketstore.cpp \
+    ../../canpacketfilter.cpp \
+    ../../cantrigger.cpp \
+    ../../canlatency.cpp \
+    ../../cancycle.cpp \
+    ../../candbc.cpp \
+    ../../canlogblock.cpp \
+    ../../canjournal.cpp
+HEADERS += ../../canthread.h \
+    ../../canlogfile.h \
+    ../../canpacketmodel.h \
+    ../../canpacketstore.h \
+    ../../canpacketfilter.h \
+    ../../cantrigger.h \
+    ../../canlatency.h \
+    ../../cancycle.h \
+    ../../candbc.h \
+    ../../canlogblock.h \
+    ../../canjournal.h
+lz4 {
+    DEFINES += HAVE_LZ4
+    LIBS += -llz4
+}
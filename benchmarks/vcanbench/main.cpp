@@ -0,0 +1,74 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include <QtCore/QCoreApplication>
+
+#include <iostream>
+
+#include "vcanbench.h"
+
+using namespace std;
+
+/*!
+ * End-to-end benchmark of the capture path on a vcan interface.
+ * Usage: vcanbench [-i vcan0] [-r 1000,10000,100000] [-s 5] [-o results.json]
+ * Prints one line of JSON per rate.
+ * @param argc Command line parameter count
+ * @param argv Vector to the command line arguments
+ * @return 0 on success
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    qRegisterMetaType<canpacket>("canpacket");
+    qRegisterMetaType<threadstatus>("threadstatus");
+
+    QString ifname = "vcan0";
+    QStringList rates = QStringList() << "1000" << "10000" << "50000" << "100000";
+    double seconds = 5;
+    QString output;
+
+    QStringList args = a.arguments();
+    for (int i = 1; i + 1 < args.size(); i += 2) {
+        if (args.at(i) == "-i") {
+            ifname = args.at(i + 1);
+        } else if (args.at(i) == "-r") {
+            rates = args.at(i + 1).split(",", QString::SkipEmptyParts);
+        } else if (args.at(i) == "-s") {
+            seconds = args.at(i + 1).toDouble();
+        } else if (args.at(i) == "-o") {
+            output = args.at(i + 1);
+        } else {
+            cerr << "Usage: vcanbench [-i interface] [-r rate,rate,...] [-s seconds] [-o file]" << endl;
+            return 1;
+        }
+    }
+
+    QString error;
+    if (!ensureinterface(ifname, &error)) {
+        cerr << error.toLocal8Bit().constData() << endl;
+        return 1;
+    }
+
+    QFile file;
+    if (output.isEmpty()) {
+        file.open(stdout, QIODevice::WriteOnly);
+    } else {
+        file.setFileName(output);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            cerr << "Cannot write " << output.toLocal8Bit().constData() << endl;
+            return 1;
+        }
+    }
+    QTextStream out(&file);
+
+    foreach (const QString &rate, rates) {
+        out << runbenchmark(ifname, rate.toInt(), seconds) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,288 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "vcanbench.h"
+#include "canthread.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+
+/*!
+ * Monotonic time in microseconds.
+ * @return current time
+ */
+static qint64 monotonicnow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (qint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*!
+ * CPU time (user + system) of the process or of the calling thread.
+ * @param who RUSAGE_SELF or RUSAGE_THREAD
+ * @return CPU time in microseconds
+ */
+static qint64 cputimeof(int who) {
+  struct rusage usage;
+  getrusage(who, &usage);
+  return (qint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+         + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/*!
+ * Runs an event loop for some time, delivering the queued canpackets.
+ * @param msec Time in milliseconds
+ */
+static void waitevents(int msec) {
+  QEventLoop loop;
+  QTimer::singleShot(msec, &loop, SLOT(quit()));
+  loop.exec();
+}
+
+/*!
+ * Constructor.
+ */
+vcangenerator::vcangenerator() {
+  rate = 0;
+  seconds = 0;
+  sent = 0;
+  stalls = 0;
+  cpu = 0;
+  error = false;
+}
+
+/*!
+ * Sets interface, rate and duration of the next run.
+ * @param newifname Interface to write to
+ * @param newrate Frames per second
+ * @param newseconds Duration in seconds
+ */
+void vcangenerator::setup(const QString &newifname, int newrate, double newseconds) {
+  ifname = newifname;
+  rate = newrate;
+  seconds = newseconds;
+}
+
+/*!
+ * Frames written.
+ * @return number of frames
+ */
+quint64 vcangenerator::sentcount() const {
+  return sent;
+}
+
+/*!
+ * Writes that had to wait for room in the tx queue.
+ * @return number of stalls
+ */
+quint64 vcangenerator::stallcount() const {
+  return stalls;
+}
+
+/*!
+ * CPU time used by the thread, to be subtracted from the process' CPU time.
+ * @return CPU time in microseconds
+ */
+qint64 vcangenerator::cputime() const {
+  return cpu;
+}
+
+/*!
+ * The socket could not be opened or bound.
+ * @return whether the run failed
+ */
+bool vcangenerator::failed() const {
+  return error;
+}
+
+/*!
+ * Writes the frames. The number of frames due is computed from the elapsed
+ * time, so short hiccups are caught up and the average rate is exact.
+ */
+void vcangenerator::run() {
+  struct sockaddr_can addr;
+  struct can_frame frame;
+  struct pollfd pfd;
+
+  sent = 0;
+  stalls = 0;
+  error = false;
+  qint64 cpustart = cputimeof(RUSAGE_THREAD);
+
+  int sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = if_nametoindex(ifname.toLocal8Bit().constData());
+  if (sockfd < 0 || !addr.can_ifindex || bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    error = true;
+    if (sockfd >= 0) close(sockfd);
+    return;
+  }
+  pfd.fd = sockfd;
+  pfd.events = POLLOUT;
+
+  bzero(&frame, sizeof(frame));
+  frame.can_dlc = 8;
+  quint64 total = (quint64)(rate * seconds);
+  qint64 start = monotonicnow();
+
+  while (sent < total) {
+    quint64 due = qMin(total, (quint64)((monotonicnow() - start) * (double)rate / 1000000) + 1);
+    if (sent >= due) {
+      struct timespec pause = {0, 50000};
+      nanosleep(&pause, NULL);
+      continue;
+    }
+    while (sent < due) {
+      frame.can_id = 0x100 + (sent & 0xFF);
+      memcpy(frame.data, &sent, sizeof(sent));
+      if (write(sockfd, &frame, sizeof(frame)) == sizeof(frame)) {
+        sent++;
+      } else if (errno == ENOBUFS || errno == EAGAIN) {
+        stalls++;
+        poll(&pfd, 1, 10);
+      } else {
+        error = true;
+        break;
+      }
+    }
+    if (error) break;
+  }
+
+  close(sockfd);
+  cpu = cputimeof(RUSAGE_THREAD) - cpustart;
+}
+
+/*!
+ * Constructor, reserves room for the latencies so taking them does not
+ * allocate during the run.
+ * @param expected Number of frames expected
+ */
+vcansink::vcansink(int expected) :
+        store(new canpacketstore), model(store) {
+  latencies.reserve(expected);
+  sorted = false;
+}
+
+/*!
+ * Frames appended to the model.
+ * @return number of frames
+ */
+quint64 vcansink::receivedcount() const {
+  return latencies.size();
+}
+
+/*!
+ * Latency percentile.
+ * @param fraction 0.5 for the median, 1.0 for the maximum
+ * @return latency in microseconds (-1 if nothing has been received)
+ */
+qint64 vcansink::percentile(double fraction) {
+  if (latencies.isEmpty()) return -1;
+  if (!sorted) {
+    std::sort(latencies.begin(), latencies.end());
+    sorted = true;
+  }
+  int index = qMin(latencies.size() - 1, (int)(fraction * latencies.size()));
+  return latencies.at(index);
+}
+
+/*!
+ * Appends a canpacket to the model and takes the time from the kernel
+ * timestamp to now.
+ * @param packet The canpacket from canthread
+ */
+void vcansink::adddataitem(canpacket packet) {
+  store->append(packet);
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  latencies.append((qint64)(now.tv_sec - packet.tv.tv_sec) * 1000000 + now.tv_usec - packet.tv.tv_usec);
+}
+
+/*!
+ * Uses an existing interface or creates a vcan interface with the name
+ * (needs root and the vcan kernel module).
+ * @param ifname Name of the interface
+ * @param error Receives a description of the problem
+ * @return whether the interface is there and up
+ */
+bool ensureinterface(const QString &ifname, QString *error) {
+  if (!if_nametoindex(ifname.toLocal8Bit().constData())) {
+    QProcess::execute("ip", QStringList() << "link" << "add" << "dev" << ifname << "type" << "vcan");
+    if (!if_nametoindex(ifname.toLocal8Bit().constData())) {
+      *error = QString("interface %1 does not exist and cannot be created (needs root and the vcan module)").arg(ifname);
+      return false;
+    }
+  }
+  if (QProcess::execute("ip", QStringList() << "link" << "set" << "up" << ifname) != 0) {
+    *error = QString("cannot bring %1 up").arg(ifname);
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * One run at one rate through the real capture path: the generator writes
+ * to the interface, canthread receives and emits the canpackets, the sink
+ * appends them to a canpacketmodel in this (the main) thread.
+ * @param ifname Interface to use
+ * @param rate Frames per second
+ * @param seconds Duration of the run
+ * @return result as one line of JSON
+ */
+QString runbenchmark(const QString &ifname, int rate, double seconds) {
+  canthread capture;
+  vcangenerator generator;
+  vcansink sink((int)(rate * seconds));
+  QObject::connect(&capture, SIGNAL(dataarrived(canpacket)), &sink, SLOT(adddataitem(canpacket)));
+
+  capture.setifname(ifname);
+  capture.start();
+  waitevents(200);
+
+  generator.setup(ifname, rate, seconds);
+  qint64 cpustart = cputimeof(RUSAGE_SELF);
+  qint64 start = monotonicnow();
+  QEventLoop loop;
+  QObject::connect(&generator, SIGNAL(finished()), &loop, SLOT(quit()));
+  generator.start();
+  loop.exec();
+  generator.wait();
+  qint64 elapsed = monotonicnow() - start;
+
+  // Give canthread and the event loop time to catch up, then stop
+  waitevents(500);
+  capture.stop();
+  capture.wait();
+  QCoreApplication::processEvents();
+  qint64 cpu = cputimeof(RUSAGE_SELF) - cpustart - generator.cputime();
+
+  quint64 sent = generator.sentcount();
+  quint64 received = sink.receivedcount();
+  QString json = QString("{\"benchmark\":\"vcan\",\"qt\":\"%1\",\"interface\":\"%2\",\"rate\":%3,\"seconds\":%4,")
+                 .arg(qVersion()).arg(ifname).arg(rate).arg(seconds);
+  if (generator.failed()) return json + "\"error\":\"cannot write to the interface\"}";
+  json += QString("\"sent\":%1,\"received\":%2,\"dropped\":%3,\"tx_stalls\":%4,")
+          .arg(sent).arg(received).arg(sent > received ? sent - received : 0).arg(generator.stallcount());
+  json += QString("\"frames_per_s\":%1,\"cpu_us_per_frame\":%2,")
+          .arg(received * 1000000.0 / qMax(elapsed, (qint64)1), 0, 'f', 1)
+          .arg(received ? (double)cpu / received : 0.0, 0, 'f', 3);
+  json += QString("\"latency_us\":{\"p50\":%1,\"p90\":%2,\"p99\":%3,\"p999\":%4,\"max\":%5}}")
+          .arg(sink.percentile(0.5)).arg(sink.percentile(0.9)).arg(sink.percentile(0.99))
+          .arg(sink.percentile(0.999)).arg(sink.percentile(1.0));
+  return json;
+}
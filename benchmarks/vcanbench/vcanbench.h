@@ -0,0 +1,70 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef VCANBENCH_H
+#define VCANBENCH_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+#include "canpacketmodel.h"
+#include "canpacketstore.h"
+
+/*!
+ * Thread writing frames to a (virtual) CAN interface at a fixed rate.
+ * The frames carry a sequence number in their payload.
+ */
+class vcangenerator: public QThread {
+
+public:
+  vcangenerator();                        //!< Constructor
+  void setup(const QString &newifname, int newrate, double newseconds); //!< Sets interface, rate and duration
+  quint64 sentcount() const;              //!< Frames written
+  quint64 stallcount() const;             //!< Writes that had to wait for room in the tx queue
+  qint64 cputime() const;                 //!< CPU time used by the thread (microseconds)
+  bool failed() const;                    //!< The socket could not be opened or bound
+
+protected:
+  void run();                             //!< Writes the frames
+
+private:
+  QString ifname;                         //!< Interface to write to
+  int rate;                               //!< Frames per second
+  double seconds;                         //!< Duration
+  quint64 sent;                           //!< Frames written
+  quint64 stalls;                         //!< Writes that had to wait
+  qint64 cpu;                             //!< CPU time of the thread (microseconds)
+  bool error;                             //!< Socket error
+};
+
+/*!
+ * Receiving end of the benchmark: takes the frames from canthread exactly
+ * like the canlogfile does and measures the kernel-to-model latency.
+ */
+class vcansink: public QObject {
+Q_OBJECT
+
+public:
+  explicit vcansink(int expected);        //!< Constructor, reserves room for the latencies
+  quint64 receivedcount() const;          //!< Frames appended to the model
+  qint64 percentile(double fraction);     //!< Latency percentile (microseconds)
+
+public slots:
+  void adddataitem(canpacket packet);     //!< Appends a canpacket to the model and takes its latency
+
+private:
+  QSharedPointer<canpacketstore> store;   //!< Same store as used by the canlogfile
+  canpacketmodel model;                   //!< Same view as the canlogfile shows
+  QVector<qint64> latencies;              //!< Kernel-to-model latency of every frame (microseconds)
+  bool sorted;                            //!< Whether latencies has been sorted
+};
+
+bool ensureinterface(const QString &ifname, QString *error); //!< Uses or creates a vcan interface
+QString runbenchmark(const QString &ifname, int rate, double seconds);  //!< One run at one rate, as JSON
+
+#endif // VCANBENCH_H
@@ -0,0 +1,35 @@
+TARGET = vcanbench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+DEPENDPATH += ../..
+SOURCES += main.cpp \
+    vcanbench.cpp \
+    ../../canthread.cpp \
+    ../../canlogfile.cpp \
+    ../../canpacketmodel.cpp \
+    ../../canpacketstore.cpp \
+    ../../canpacketfilter.cpp \
+    ../../cantrigger.cpp \
+    ../../canlatency.cpp \
+    ../../cancycle.cpp \
+    ../../candbc.cpp \
+    ../../canlogblock.cpp \
+    ../../canjournal.cpp
+HEADERS += vcanbench.h \
+    ../../canthread.h \
+    ../../canlogfile.h \
+    ../../canpacketmodel.h \
+    ../../canpacketstore.h \
+    ../../canpacketfilter.h \
+    ../../cantrigger.h \
+    ../../canlatency.h \
+    ../../cancycle.h \
+    ../../candbc.h \
+    ../../canlogblock.h \
+    ../../canjournal.h
+lz4 {
+    DEFINES += HAVE_LZ4
+    LIBS += -llz4
+}
@@ -0,0 +1,141 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "cancapture.h"
+
+/*!
+ * Constructor. The file is opened by open().
+ * @param newfilename Name of the file to be read
+ */
+cancapturereader::cancapturereader(const QString &newfilename) : file(newfilename) {
+  blocks = 0;
+  block = 0;
+  position = 0;
+  total = 0;
+  done = 0;
+  damaged = false;
+}
+
+/*!
+ * Destructor, closes the file.
+ */
+cancapturereader::~cancapturereader() {
+  delete blocks;
+}
+
+/*!
+ * Opens the file and checks its format. A block encoded file without index
+ * (an aborted write) can be read as well; truncated() tells so.
+ * @return false if the file cannot be read or is no supported CAN logfile
+ */
+bool cancapturereader::open() {
+  if (!file.open(QIODevice::ReadOnly)) {
+    error = file.errorString();
+    return false;
+  }
+  stream.setDevice(&file);
+  stream.setVersion(QDataStream::Qt_4_4);
+
+  quint32 magic;
+  stream >> magic;
+  if (stream.status() != QDataStream::Ok) magic = 0;
+  if (magic == (quint32)canblockcodec::MagicNumber) {
+    blocks = new canblockreader(&file);
+    if (!blocks->open()) {
+      error = blocks->errorstring();
+      return false;
+    }
+    total = blocks->packetcount();
+    damaged = blocks->truncated();
+  } else if (magic == RecordMagicNumber) {
+    stream >> total;
+  } else if (magic == LegacyMagicNumber) {
+    error = QObject::tr("Files of the old string format cannot be read in pieces; open and save it once to convert it.");
+    return false;
+  } else {
+    error = QObject::tr("This is not a CAN logfile or the version does not match!");
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * Reads the next canpacket. A damaged block ends the file; truncated()
+ * tells so.
+ * @param packet Receives the canpacket
+ * @return false at the end of the file
+ */
+bool cancapturereader::next(canpacket *packet) {
+  if (blocks) {
+    while (position >= buffer.size()) {
+      if (block >= blocks->blockcount()) return false;
+      buffer.resize(0);
+      position = 0;
+      if (!blocks->readblock(block++, &buffer)) {
+        error = blocks->errorstring();
+        damaged = true;
+        block = blocks->blockcount();
+        return false;
+      }
+    }
+    *packet = buffer.at(position++);
+  } else {
+    if (done >= total) return false;
+    stream >> *packet;
+    if (stream.status() != QDataStream::Ok) {
+      error = QObject::tr("The file ends after %1 of %2 packets.").arg(done).arg(total);
+      damaged = true;
+      total = done;
+      return false;
+    }
+  }
+  done++;
+  return true;
+}
+
+/*!
+ * Number of canpackets in the file, as stated by its index or header. For
+ * a block encoded file without index it is found by walking the blocks.
+ * @return number of canpackets
+ */
+quint64 cancapturereader::packetcount() const {
+  return total;
+}
+
+/*!
+ * Number of canpackets read so far.
+ * @return number of canpackets
+ */
+quint64 cancapturereader::packetsread() const {
+  return done;
+}
+
+/*!
+ * Whether the file ended early or is damaged; the canpackets before that
+ * are read all the same.
+ * @return true if not all canpackets could be read
+ */
+bool cancapturereader::truncated() const {
+  return damaged;
+}
+
+/*!
+ * Name of the file.
+ * @return file name
+ */
+QString cancapturereader::filename() const {
+  return file.fileName();
+}
+
+/*!
+ * Description of the last error.
+ * @return error message
+ */
+QString cancapturereader::errorstring() const {
+  return error;
+}
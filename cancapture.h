@@ -0,0 +1,56 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANCAPTURE_H
+#define CANCAPTURE_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+#include "canlogblock.h"
+
+/*!
+ * Reads a CAN logfile canpacket by canpacket without loading it as a
+ * whole: a block encoded file (see canblockcodec) is decoded one block at a
+ * time, a file of typed records one record at a time. So the memory needed
+ * does not depend on the size of the file. Files of the legacy string
+ * format are not supported; opening and saving them once converts them.
+ */
+class cancapturereader {
+
+public:
+  explicit cancapturereader(const QString &newfilename); //!< Constructor
+  ~cancapturereader();                    //!< Destructor, closes the file
+
+  bool open();                            //!< Opens the file and checks its format
+  bool next(canpacket *packet);           //!< Reads the next canpacket
+  quint64 packetcount() const;            //!< Number of canpackets in the file (as far as known)
+  quint64 packetsread() const;            //!< Number of canpackets read so far
+  bool truncated() const;                 //!< Whether the file ended early or is damaged
+  QString filename() const;               //!< Name of the file
+  QString errorstring() const;            //!< Description of the last error
+
+private:
+  QFile file;                             //!< The file
+  QDataStream stream;                     //!< Reads the records (typed record format)
+  canblockreader *blocks;                 //!< Reads the blocks (block format, 0 otherwise)
+  int block;                              //!< Next block to be read
+  QVector<canpacket> buffer;              //!< canpackets of the current block
+  int position;                           //!< Next canpacket in buffer
+  quint64 total;                          //!< canpackets in the file
+  quint64 done;                           //!< canpackets read so far
+  bool damaged;                           //!< The file ended early or is damaged
+  QString error;                          //!< Last error
+
+  enum {
+    RecordMagicNumber = 0x636C6604,       /*!< = "clf" + versionbyte; typed canpacket records */
+    LegacyMagicNumber = 0x636C6603        /*!< = "clf" + versionbyte; one string per cell */
+  };
+};
+
+#endif // CANCAPTURE_H
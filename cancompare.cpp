@@ -0,0 +1,248 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "cancompare.h"
+#include "cancapture.h"
+
+#include <string.h>
+
+/*!
+ * Orders results by key.
+ * @param a First result
+ * @param b Second result
+ * @return true if a comes first
+ */
+static bool keylessthan(const cancompareid &a, const cancompareid &b) {
+  return a.key < b.key;
+}
+
+/*!
+ * Constructor, aligns by sequence.
+ */
+cancompare::cancompare() {
+  alignment = BySequence;
+  window = 0;
+  frames[0] = 0;
+  frames[1] = 0;
+}
+
+/*!
+ * Sets how the frames of an ID are aligned.
+ * @param newalignment BySequence or ByTime
+ * @param newwindow Largest time difference of two aligned frames in microseconds (ByTime only)
+ */
+void cancompare::setalignment(int newalignment, qint64 newwindow) {
+  alignment = newalignment;
+  window = newwindow;
+}
+
+/*!
+ * Compares two files. Both are read at once, frame by frame; a file that
+ * ends early is compared as far as it could be read (see warnings()).
+ * @param reference Name of the reference capture (e.g. the good run)
+ * @param compared Name of the capture compared with it
+ * @return false if a file cannot be read
+ */
+bool cancompare::run(const QString &reference, const QString &compared) {
+  cancapturereader first(reference);
+  cancapturereader second(compared);
+  cancapturereader *readers[2] = {&first, &second};
+
+  states.clear();
+  finished.clear();
+  problems.clear();
+  error.clear();
+  frames[0] = 0;
+  frames[1] = 0;
+  for (int side = 0; side < 2; side++) {
+    if (!readers[side]->open()) {
+      error = QObject::tr("Cannot read file %1:\n%2").arg(readers[side]->filename()).arg(readers[side]->errorstring());
+      return false;
+    }
+  }
+
+  // Always take the frame that comes next relative to the start of its file
+  canpacket packets[2];
+  qint64 stamps[2];
+  qint64 starts[2] = {-1, -1};
+  bool more[2];
+  for (int side = 0; side < 2; side++) more[side] = readnext(*readers[side], &packets[side], &stamps[side], &starts[side]);
+  while (more[0] || more[1]) {
+    int side = (!more[1] || (more[0] && stamps[0] <= stamps[1])) ? 0 : 1;
+    add(side, packets[side], stamps[side]);
+    frames[side]++;
+    more[side] = readnext(*readers[side], &packets[side], &stamps[side], &starts[side]);
+  }
+
+  // Frames still waiting have no counterpart
+  finished.reserve(states.size());
+  for (QHash<quint32, idstate>::iterator it = states.begin(); it != states.end(); ++it) {
+    for (int side = 0; side < 2; side++) it.value().result.unmatched[side] += it.value().pending[side].size();
+    finished.append(it.value().result);
+  }
+  states.clear();
+  qSort(finished.begin(), finished.end(), keylessthan);
+
+  for (int side = 0; side < 2; side++) {
+    if (readers[side]->truncated()) {
+      problems += QObject::tr("File %1 is truncated, compared %2 packets.\n").arg(readers[side]->filename()).arg(frames[side]);
+    }
+  }
+  return true;
+}
+
+/*!
+ * Result per CAN ID of the last run, sorted by key.
+ * @return results
+ */
+const QVector<cancompareid> &cancompare::results() const {
+  return finished;
+}
+
+/*!
+ * Frames read from a capture in the last run.
+ * @param side 0 = reference, 1 = compared capture
+ * @return number of frames
+ */
+quint64 cancompare::framecount(int side) const {
+  return frames[side];
+}
+
+/*!
+ * Problems found while reading, e.g. truncated files (one per line).
+ * @return empty if there were none
+ */
+QString cancompare::warnings() const {
+  return problems;
+}
+
+/*!
+ * Description of the last error.
+ * @return error message
+ */
+QString cancompare::errorstring() const {
+  return error;
+}
+
+/*!
+ * Reads the next frame of a capture and its time since the first frame.
+ * @param reader The capture
+ * @param packet Receives the frame
+ * @param stamp Receives its time in microseconds
+ * @param start Timestamp of the first frame (-1 before the first frame, set then)
+ * @return false at the end of the capture
+ */
+bool cancompare::readnext(cancapturereader &reader, canpacket *packet, qint64 *stamp, qint64 *start) {
+  // Markers of missing IDs are no frames to be compared
+  do {
+    if (!reader.next(packet)) return false;
+  } while (packet->marker);
+  qint64 absolute = canblockcodec::stampof(*packet);
+  if (*start < 0) *start = absolute;
+  *stamp = absolute - *start;
+  return true;
+}
+
+/*!
+ * Counts one frame and aligns it with a waiting frame of the other capture,
+ * or lets it wait for one. When too many frames of an ID wait, the oldest
+ * one is given up.
+ * @param side 0 = reference, 1 = compared capture
+ * @param packet The frame
+ * @param stamp Its time since the start of the capture
+ */
+void cancompare::add(int side, const canpacket &packet, qint64 stamp) {
+  quint32 key = packet.identifier | (packet.ide ? 0x80000000 : 0) | (packet.rtr ? 0x40000000 : 0) | (packet.err ? 0x20000000 : 0);
+  QHash<quint32, idstate>::iterator it = states.find(key);
+  if (it == states.end()) {
+    it = states.insert(key, idstate());
+    cancompareid &result = it.value().result;
+    memset(&result, 0, sizeof(result));
+    result.key = key;
+    result.firstdifference = -1;
+  }
+  idstate &state = it.value();
+  cancompareid &result = state.result;
+
+  if (result.count[side]) {
+    qint64 interval = stamp - result.last[side];
+    if (result.count[side] == 1 || interval < result.minimum[side]) result.minimum[side] = interval;
+    if (interval > result.maximum[side]) result.maximum[side] = interval;
+  } else {
+    result.first[side] = stamp;
+  }
+  result.count[side]++;
+  result.last[side] = stamp;
+
+  pendingframe frame;
+  frame.stamp = stamp;
+  frame.dlc = packet.dlc;
+  memcpy(frame.data, packet.data, 8);
+
+  int other = 1 - side;
+  if (alignment == ByTime) {
+    expire(state, other, stamp);
+    expire(state, side, stamp);
+  }
+  if (!state.pending[other].isEmpty()) {
+    pendingframe counterpart = state.pending[other].dequeue();
+    if (side == 0) compare(result, frame, counterpart); else compare(result, counterpart, frame);
+  } else {
+    if (state.pending[side].size() >= MaxPending) {
+      state.pending[side].dequeue();
+      result.unmatched[side]++;
+    }
+    state.pending[side].enqueue(frame);
+  }
+}
+
+/*!
+ * Drops the waiting frames of a capture that are too old to be aligned with
+ * a frame of the other capture any more (ByTime only).
+ * @param state State of the ID
+ * @param side 0 = reference, 1 = compared capture
+ * @param now Time of the frame being aligned
+ */
+void cancompare::expire(idstate &state, int side, qint64 now) {
+  while (!state.pending[side].isEmpty() && state.pending[side].head().stamp < now - window) {
+    state.pending[side].dequeue();
+    state.result.unmatched[side]++;
+  }
+}
+
+/*!
+ * Compares an aligned pair of frames. The bits that differ are added to
+ * the mask; bytes present in only one of them count as differing entirely.
+ * @param result Result of the ID
+ * @param reference Frame of the reference capture
+ * @param compared Frame of the compared capture
+ */
+void cancompare::compare(cancompareid &result, const pendingframe &reference, const pendingframe &compared) {
+  bool differs = false;
+  int common = qMin(qMin(reference.dlc, compared.dlc), (quint8)8);
+  int longest = qMin(qMax(reference.dlc, compared.dlc), (quint8)8);
+
+  result.matched++;
+  if (reference.dlc != compared.dlc) {
+    result.dlcdiffering++;
+    differs = true;
+  }
+  for (int i = 0; i < common; i++) {
+    quint8 bits = reference.data[i] ^ compared.data[i];
+    if (bits) {
+      result.mask[i] |= bits;
+      differs = true;
+    }
+  }
+  for (int i = common; i < longest; i++) result.mask[i] = 0xFF;
+
+  if (differs) {
+    result.differing++;
+    if (result.firstdifference < 0) result.firstdifference = reference.stamp;
+  }
+}
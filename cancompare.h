@@ -0,0 +1,116 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANCOMPARE_H
+#define CANCOMPARE_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+
+class cancapturereader;
+
+/*!
+ * Result of the comparison of one CAN ID. Index 0 refers to the reference
+ * capture, index 1 to the compared one; times are in microseconds.
+ */
+struct cancompareid {
+  quint32 key;                //!< Identifier, EFF (0x80000000), RTR (0x40000000) and ERR (0x20000000) bit
+  quint64 count[2];           //!< Frames per capture
+  qint64 first[2];            //!< Time of the first frame since the start of the capture
+  qint64 last[2];             //!< Time of the latest frame since the start of the capture
+  qint64 minimum[2];          //!< Shortest interval per capture
+  qint64 maximum[2];          //!< Longest interval per capture
+  quint64 matched;            //!< Frames aligned with a frame of the other capture
+  quint64 differing;          //!< Aligned pairs whose payload or dlc differ
+  quint64 dlcdiffering;       //!< Aligned pairs whose dlc differs
+  quint64 unmatched[2];       //!< Frames per capture without counterpart
+  quint8 mask[8];             //!< Bits that differed in any aligned pair, per payload byte
+  qint64 firstdifference;     //!< Time of the first differing pair in the reference capture (-1 = none)
+
+  /*!
+   * Mean interval of the frames in one capture.
+   * @param side 0 = reference, 1 = compared capture
+   * @return interval (-1 = less than two frames)
+   */
+  inline qint64 meaninterval(int side) const {
+    if (count[side] < 2) return -1;
+    return (last[side] - first[side]) / (qint64)(count[side] - 1);
+  }
+};
+
+/*!
+ * Compares two captures (e.g. a good and a bad run) per CAN ID.
+ *
+ * Both files are streamed side by side in the order of their timestamps,
+ * each taken relative to the first frame of its file. The frames of every
+ * ID are aligned either by sequence (the n-th frame of an ID with the n-th
+ * one in the other capture) or by time (a frame with the first one of the
+ * other capture within a window). Aligned pairs are compared byte by byte;
+ * the bits that ever differed are collected in a mask per byte. Per ID the
+ * frame counts, cycle times and frames without counterpart are reported,
+ * so IDs only present in one capture show up as added or missing.
+ *
+ * Only frames waiting for their counterpart are held, at most MaxPending
+ * per ID and capture, so the memory depends on the number of IDs and not
+ * on the length of the captures.
+ */
+class cancompare {
+
+public:
+  //! How frames of an ID are aligned
+  enum Alignment {
+    BySequence = 0,           //!< n-th frame with n-th frame
+    ByTime                    //!< Frames within a time window
+  };
+  enum {
+    MaxPending = 256          /*!< Frames per ID and capture waiting for their counterpart */
+  };
+
+  cancompare();                           //!< Constructor, aligns by sequence
+
+  void setalignment(int newalignment, qint64 newwindow); //!< Sets how frames are aligned
+  bool run(const QString &reference, const QString &compared); //!< Compares two files
+  const QVector<cancompareid> &results() const; //!< Result per CAN ID, sorted by ID
+  quint64 framecount(int side) const;     //!< Frames read from a capture
+  QString warnings() const;               //!< Problems found while reading (e.g. truncated files)
+  QString errorstring() const;            //!< Description of the last error
+
+private:
+  /*!
+   * Frame waiting for its counterpart.
+   */
+  struct pendingframe {
+    qint64 stamp;             //!< Time since the start of the capture
+    quint8 dlc;               //!< Data length code
+    quint8 data[8];           //!< Payload
+  };
+
+  /*!
+   * Comparison state of one CAN ID.
+   */
+  struct idstate {
+    cancompareid result;                  //!< Result so far
+    QQueue<pendingframe> pending[2];      //!< Frames per capture waiting for their counterpart
+  };
+
+  int alignment;                          //!< Alignment
+  qint64 window;                          //!< Time window of ByTime
+  QHash<quint32, idstate> states;         //!< State per key
+  QVector<cancompareid> finished;         //!< Results of the last run
+  quint64 frames[2];                      //!< Frames read per capture
+  QString problems;                       //!< Problems found while reading
+  QString error;                          //!< Last error
+
+  void add(int side, const canpacket &packet, qint64 stamp); //!< Aligns one frame
+  void compare(cancompareid &result, const pendingframe &reference, const pendingframe &compared); //!< Compares an aligned pair
+  void expire(idstate &state, int side, qint64 now); //!< Drops the frames of a capture that can no longer be aligned
+  bool readnext(cancapturereader &reader, canpacket *packet, qint64 *stamp, qint64 *start); //!< Reads the next frame and its time
+};
+
+#endif // CANCOMPARE_H
@@ -0,0 +1,374 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "cancycle.h"
+
+#include <time.h>
+
+#include <linux/can.h>
+
+/*!
+ * Parses a hexadecimal CAN ID.
+ * @param str String to be parsed
+ * @param identifier Parsed ID
+ * @param ide Set if the ID is an extended one (more than 3 digits or > 0x7FF)
+ * @return success of the operation
+ */
+static bool parseid(const QString &str, quint32 &identifier, bool &ide) {
+  bool ok;
+  identifier = str.toULong(&ok, 16);
+  if (!ok || identifier > CAN_EFF_MASK) return false;
+  ide = str.length() > 3 || identifier > CAN_SFF_MASK;
+  return true;
+}
+
+/*!
+ * Parses a period like "100ms", "500us", "1s" or "100" (milliseconds).
+ * @param str String to be parsed
+ * @param usec Parsed period in microseconds
+ * @return success of the operation
+ */
+static bool parseperiod(QString str, qint64 &usec) {
+  bool ok;
+  qint64 factor = 1000;
+  if (str.endsWith("us")) {
+    factor = 1;
+    str.chop(2);
+  } else if (str.endsWith("ms")) {
+    str.chop(2);
+  } else if (str.endsWith("s")) {
+    factor = 1000000;
+    str.chop(1);
+  }
+  usec = str.toLongLong(&ok) * factor;
+  return ok && usec > 0;
+}
+
+/*!
+ * Forgets all values.
+ */
+void canquantile::reset() {
+  count = 0;
+}
+
+/*!
+ * Adds one value. The first five values are kept sorted; from then on the
+ * markers are moved towards their desired positions, their heights adjusted
+ * by piecewise parabolic (or, where that would break the order, linear)
+ * interpolation.
+ * @param value The value
+ * @param fraction Quantile estimated, e.g. 0.99 (the same with every call)
+ */
+void canquantile::add(double value, double fraction) {
+  int i;
+
+  if (count < 5) {
+    for (i = count; i > 0 && heights[i - 1] > value; i--) heights[i] = heights[i - 1];
+    heights[i] = value;
+    count++;
+    if (count == 5) {
+      for (i = 0; i < 5; i++) positions[i] = i + 1;
+      desired[0] = 1;
+      desired[1] = 1 + 2 * fraction;
+      desired[2] = 1 + 4 * fraction;
+      desired[3] = 3 + 2 * fraction;
+      desired[4] = 5;
+    }
+    return;
+  }
+
+  // Cell the value falls into; the extreme markers follow the extremes
+  int cell;
+  if (value < heights[0]) {
+    heights[0] = value;
+    cell = 0;
+  } else if (value >= heights[4]) {
+    heights[4] = value;
+    cell = 3;
+  } else {
+    for (cell = 0; value >= heights[cell + 1]; cell++);
+  }
+  for (i = cell + 1; i < 5; i++) positions[i]++;
+  desired[1] += fraction / 2;
+  desired[2] += fraction;
+  desired[3] += (1 + fraction) / 2;
+  desired[4] += 1;
+
+  // Move the inner markers that are off by one position or more
+  for (i = 1; i < 4; i++) {
+    double offset = desired[i] - positions[i];
+    if ((offset >= 1 && positions[i + 1] - positions[i] > 1) || (offset <= -1 && positions[i - 1] - positions[i] < -1)) {
+      int step = (offset >= 0) ? 1 : -1;
+      double below = positions[i] - positions[i - 1];
+      double above = positions[i + 1] - positions[i];
+      double height = heights[i] + step / (double)(positions[i + 1] - positions[i - 1])
+                      * ((below + step) * (heights[i + 1] - heights[i]) / above
+                         + (above - step) * (heights[i] - heights[i - 1]) / below);
+      if (heights[i - 1] < height && height < heights[i + 1]) {
+        heights[i] = height;
+      } else {
+        heights[i] += step * (heights[i + step] - heights[i]) / (positions[i + step] - positions[i]);
+      }
+      positions[i] += step;
+    }
+  }
+}
+
+/*!
+ * Current estimate of the quantile. With less than five values the nearest
+ * of the values seen is returned.
+ * @param fraction Quantile estimated (the one passed to add())
+ * @return estimate (-1 = no values)
+ */
+double canquantile::estimate(double fraction) const {
+  if (!count) return -1;
+  if (count < 5) return heights[(int)(fraction * (count - 1) + 0.5)];
+  return heights[2];
+}
+
+/*!
+ * Constructor, allocates the table. Nothing is allocated per frame later on.
+ */
+cancycleanalyzer::cancycleanalyzer() {
+  entries.resize(MaxIDs);
+  table.fill(-1, HashSize);
+  used = 0;
+  untracked = 0;
+  nextdue = -1;
+  nominalschanged = 0;
+  resetrequested = 0;
+}
+
+/*!
+ * Sets the nominal periods of some IDs; the other IDs are compared with
+ * their mean interval. The capture thread takes them over with the next
+ * frame or check. Nothing is changed if a definition is invalid.
+ * @param definitions Comma separated "<can_id>:<period>" entries, the period
+ *                    in milliseconds or with unit, e.g. "123:10, 18FEF100:100ms"
+ * @return false if a definition is invalid
+ */
+bool cancycleanalyzer::setnominals(const QString &definitions) {
+  QHash<quint32, qint64> newnominals;
+  foreach (const QString &definition, definitions.split(",", QString::SkipEmptyParts)) {
+    QStringList parts = definition.trimmed().split(":");
+    quint32 identifier;
+    bool ide;
+    qint64 period;
+    if (parts.size() != 2 || !parseid(parts.at(0).trimmed(), identifier, ide) || !parseperiod(parts.at(1).trimmed(), period)) return false;
+    newnominals.insert(identifier | (ide ? 0x80000000 : 0), period);
+  }
+
+  QMutexLocker locker(&pendingmutex);
+  pendingnominals = newnominals;
+  nominalschanged = 1;
+  return true;
+}
+
+/*!
+ * Asks the capture thread to forget all IDs with the next frame or check.
+ */
+void cancycleanalyzer::reset() {
+  resetrequested = 1;
+}
+
+/*!
+ * Copies the statistics of all IDs, in the order they were first seen. The
+ * capture thread goes on writing meanwhile, so a value may be one frame
+ * behind the others.
+ * @param out Receives the statistics
+ */
+void cancycleanalyzer::snapshot(QVector<cancycleentry> &out) const {
+  int count = used;
+  out.resize(count);
+  for (int i = 0; i < count; i++) out[i] = entries.at(i);
+}
+
+/*!
+ * Frames of IDs that did not fit into the table.
+ * @return number of frames
+ */
+quint64 cancycleanalyzer::untrackedcount() const {
+  return untracked;
+}
+
+/*!
+ * Fraction of a quantile of the jitter.
+ * @param quantile cancycleentry::Quantile
+ * @return fraction, e.g. 0.99
+ */
+double cancycleanalyzer::quantilefraction(int quantile) {
+  switch (quantile) {
+  case cancycleentry::P50: return 0.5;
+  case cancycleentry::P99: return 0.99;
+  default: return 0.999;
+  }
+}
+
+/*!
+ * Forgets all IDs. Called by the capture thread when the capture starts or
+ * the GUI asked for it.
+ */
+void cancycleanalyzer::restart() {
+  resetrequested = 0;
+  used = 0;
+  table.fill(-1);
+  untracked = 0;
+  nextdue = -1;
+  if (nominalschanged) installnominals();
+}
+
+/*!
+ * Takes over the periods set by the GUI. The jitter of the IDs whose
+ * reference period changes is measured anew.
+ */
+void cancycleanalyzer::installnominals() {
+  QMutexLocker locker(&pendingmutex);
+  nominals = pendingnominals;
+  nominalschanged = 0;
+  locker.unlock();
+
+  int count = used;
+  for (int i = 0; i < count; i++) {
+    cancycleentry &entry = entries[i];
+    qint64 nominal = nominals.value(entry.key, 0);
+    if (nominal == entry.nominal) continue;
+    entry.nominal = nominal;
+    for (int q = 0; q < cancycleentry::QuantileCount; q++) entry.jitter[q].reset();
+  }
+  // The times the IDs become missing have changed, the next sweep finds them
+  if (count) nextdue = 0;
+}
+
+/*!
+ * Entry of a key, added to the table if the key is new.
+ * @param key Identifier and the EFF bit
+ * @return the entry (0 if the table is full)
+ */
+cancycleentry *cancycleanalyzer::find(quint32 key) {
+  int slot = hashof(key);
+  for (;;) {
+    int number = table.at(slot);
+    if (number < 0) break;
+    if (entries.at(number).key == key) return &entries[number];
+    slot = (slot + 1) & (HashSize - 1);
+  }
+
+  int number = used;
+  if (number >= MaxIDs) return 0;
+  cancycleentry &entry = entries[number];
+  entry.key = key;
+  entry.nominal = nominals.value(key, 0);
+  entry.count = 0;
+  entry.last = 0;
+  entry.sum = 0;
+  entry.minimum = 0;
+  entry.maximum = 0;
+  for (int q = 0; q < cancycleentry::QuantileCount; q++) entry.jitter[q].reset();
+  entry.toofast = 0;
+  entry.lastfast = 0;
+  entry.missing = 0;
+  entry.missingnow = false;
+  table[slot] = number;
+  // Publish the entry only once it is filled in
+  used.fetchAndStoreRelease(number + 1);
+  return &entry;
+}
+
+/*!
+ * Measures one received frame: the interval since the previous frame of
+ * its ID, the jitter against the reference period and whether it came too
+ * early. Error frames are not measured.
+ * @param packet The frame (with its kernel timestamp)
+ */
+void cancycleanalyzer::record(const canpacket &packet) {
+  if (resetrequested) restart();
+  if (nominalschanged) installnominals();
+  if (packet.err) return;
+
+  cancycleentry *entry = find(packet.identifier | (packet.ide ? 0x80000000 : 0));
+  if (!entry) {
+    untracked++;
+    return;
+  }
+
+  qint64 stamp = (qint64)packet.tv.tv_sec * 1000000 + packet.tv.tv_usec;
+  if (entry->count) {
+    // A step of the system clock must not make the interval negative
+    qint64 interval = qMax((qint64)0, stamp - entry->last);
+    entry->sum += interval;
+    if (entry->count == 1 || interval < entry->minimum) entry->minimum = interval;
+    if (interval > entry->maximum) entry->maximum = interval;
+
+    entry->count++;
+    qint64 reference = entry->reference();
+    if (reference) {
+      double jitter = qAbs(interval - reference);
+      for (int q = 0; q < cancycleentry::QuantileCount; q++) entry->jitter[q].add(jitter, quantilefraction(q));
+      if (interval * 100 < reference * FastPercent) {
+        entry->toofast++;
+        entry->lastfast = stamp;
+      }
+    }
+  } else {
+    entry->count = 1;
+  }
+  entry->last = stamp;
+  entry->missingnow = false;
+  // A frame only postpones its ID, but the ID may be pending anew
+  if (entry->reference()) {
+    qint64 due = dueof(*entry);
+    if (nextdue < 0 || due < nextdue) nextdue = due;
+  }
+}
+
+/*!
+ * Flags the IDs not seen for MissingPercent of their reference period and
+ * finds the time the next ID becomes due. Each absence is counted once; the
+ * flag is cleared by the next frame.
+ * @param now Current time in microseconds (see realtimenow())
+ */
+void cancycleanalyzer::sweep(qint64 now) {
+  if (resetrequested) restart();
+  if (nominalschanged) installnominals();
+
+  nextdue = -1;
+  int count = used;
+  for (int i = 0; i < count; i++) {
+    cancycleentry &entry = entries[i];
+    if (entry.missingnow || !entry.reference()) continue;
+    qint64 due = dueof(entry);
+    if (now >= due) {
+      entry.missingnow = true;
+      entry.missing++;
+    } else if (nextdue < 0 || due < nextdue) {
+      nextdue = due;
+    }
+  }
+}
+
+/*!
+ * Time the next check for missing IDs is due: when the first ID not yet
+ * missing becomes missing, or right away if the GUI changed the settings.
+ * Frames only postpone their IDs, so the time may be early; sweep() then
+ * finds the real one.
+ * @return time in microseconds (see realtimenow()), -1 while nothing is pending
+ */
+qint64 cancycleanalyzer::nextsweep() const {
+  if (resetrequested || nominalschanged) return 0;
+  return nextdue;
+}
+
+/*!
+ * Current time on the clock of the kernel timestamps of the frames.
+ * @return microseconds since the epoch
+ */
+qint64 cancycleanalyzer::realtimenow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (qint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
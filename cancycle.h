@@ -0,0 +1,158 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANCYCLE_H
+#define CANCYCLE_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+
+/*!
+ * Streaming quantile estimator (P-square algorithm of Jain and Chlamtac):
+ * five markers follow the minimum, the quantile, the maximum and the two
+ * points halfway between, so the memory does not grow with the number of
+ * values. The estimate gets close once a few hundred values have been seen
+ * (a few thousand for the 99.9th percentile).
+ */
+class canquantile {
+
+public:
+  void reset();                           //!< Forgets all values
+  void add(double value, double fraction); //!< Adds one value
+  double estimate(double fraction) const; //!< Current estimate of the quantile (-1 = no values)
+
+private:
+  double heights[5];                      //!< Marker heights (the first values, sorted, while count < 5)
+  double desired[5];                      //!< Desired marker positions
+  qint64 positions[5];                    //!< Actual marker positions
+  int count;                              //!< Number of values added (counted up to 5)
+};
+
+/*!
+ * Cycle time statistics of one CAN ID. All times are in microseconds.
+ */
+struct cancycleentry {
+  //! Quantiles of the jitter
+  enum Quantile {
+    P50 = 0,          //!< Median
+    P99,              //!< 99th percentile
+    P999,             //!< 99.9th percentile
+    QuantileCount     //!< Number of quantiles
+  };
+
+  quint32 key;                //!< Identifier and the EFF bit (0x80000000)
+  qint64 nominal;             //!< Configured period (0 = the mean is used)
+  quint64 count;              //!< Frames seen
+  qint64 last;                //!< Timestamp of the latest frame
+  qint64 sum;                 //!< Sum of the intervals
+  qint64 minimum;             //!< Shortest interval
+  qint64 maximum;             //!< Longest interval
+  canquantile jitter[QuantileCount]; //!< |interval - reference period|
+  quint64 toofast;            //!< Frames that came too early
+  qint64 lastfast;            //!< Timestamp of the latest frame that came too early (0 = none)
+  quint64 missing;            //!< Times the ID went missing
+  bool missingnow;            //!< The ID is missing right now
+
+  /*!
+   * Period the intervals are compared with: the configured one, or the mean
+   * once enough intervals have been seen.
+   * @return period (0 = not known yet)
+   */
+  inline qint64 reference() const {
+    if (nominal) return nominal;
+    if (count <= (quint64)LearnIntervals) return 0;
+    return sum / (qint64)(count - 1);
+  }
+
+  enum {
+    LearnIntervals = 8        /*!< Intervals averaged before an ID without configured period is judged */
+  };
+};
+
+/*!
+ * Per-ID cycle time and jitter analysis, run in the capture thread.
+ *
+ * For every ID the interval between two frames is measured (kernel
+ * timestamps): mean, minimum, maximum and the quantiles of the jitter, the
+ * difference between interval and reference period (the configured one, or
+ * the mean). A frame arriving after less than FastPercent of the reference
+ * period is counted as too fast right away; an ID not seen for MissingPercent
+ * of its reference period is flagged as missing by sweep(), which the
+ * capture thread calls when the next ID becomes due (see nextsweep()), even
+ * while the bus is quiet. Once all IDs are missing nothing is due, so an
+ * idle bus causes no wakeups.
+ *
+ * The IDs live in a table of MaxIDs entries allocated once and found by
+ * open addressing, so a frame costs one hash probe and three quantile
+ * updates and never allocates. The capture thread is the only writer; the
+ * GUI copies the table with snapshot() (a value may be a frame behind).
+ * Settings and resets are handed over like the triggers of canthread.
+ */
+class cancycleanalyzer {
+
+public:
+  enum {
+    MaxIDs = 4096,            /*!< IDs tracked (further IDs are only counted) */
+    HashSize = 8192,          /*!< Slots of the hash table (a power of two) */
+    FastPercent = 50,         /*!< A frame after less than this share of the period is too fast */
+    MissingPercent = 300      /*!< An ID not seen for this share of its period is missing */
+  };
+
+  cancycleanalyzer();                     //!< Constructor, allocates the table
+
+  // GUI thread
+  bool setnominals(const QString &definitions); //!< Sets the nominal periods ("123:10, 18FEF100:100")
+  void reset();                           //!< Asks the capture thread to start anew
+  void snapshot(QVector<cancycleentry> &out) const; //!< Copies the statistics of all IDs
+  quint64 untrackedcount() const;         //!< Frames of IDs beyond MaxIDs
+  static double quantilefraction(int quantile); //!< Fraction of a cancycleentry::Quantile
+
+  // Capture thread
+  void restart();                         //!< Starts anew (capture started)
+  void record(const canpacket &packet);   //!< Measures one frame
+  void sweep(qint64 now);                 //!< Flags the IDs that are missing
+  qint64 nextsweep() const;               //!< Time sweep() is due (-1 = nothing pending)
+
+  static qint64 realtimenow();            //!< Current time in microseconds (clock of the frame timestamps)
+
+private:
+  QVector<cancycleentry> entries;         //!< Statistics per ID in the order the IDs were seen
+  QAtomicInt used;                        //!< Entries in use
+  QVector<qint32> table;                  //!< Hash table: entry number per slot (-1 = free)
+  quint64 untracked;                      //!< Frames of IDs beyond MaxIDs
+  qint64 nextdue;                         //!< Earliest time an ID may become missing (-1 = none; may be early)
+  QHash<quint32, qint64> nominals;        //!< Configured periods per key (capture thread)
+  QHash<quint32, qint64> pendingnominals; //!< Configured periods set by the GUI
+  QMutex pendingmutex;                    //!< Protects pendingnominals
+  QAtomicInt nominalschanged;             //!< Set when pendingnominals is to be taken over
+  QAtomicInt resetrequested;              //!< Set when the GUI asks to start anew
+
+  void installnominals();                 //!< Takes over the periods set by the GUI
+  cancycleentry *find(quint32 key);       //!< Entry of a key (added if new; 0 = table full)
+
+  /*!
+   * Time an ID becomes missing if no frame of it comes.
+   * @param entry The entry of the ID (with a reference period)
+   * @return time in microseconds (see realtimenow())
+   */
+  static inline qint64 dueof(const cancycleentry &entry) {
+    return entry.last + entry.reference() * MissingPercent / 100 + 1;
+  }
+
+  /*!
+   * Hash table slot of a key (Fibonacci hashing).
+   * @param key Identifier and the EFF bit
+   * @return first slot to probe
+   */
+  static inline int hashof(quint32 key) {
+    return (int)((key * 2654435761u) >> 19) & (HashSize - 1);
+  }
+};
+
+#endif // CANCYCLE_H
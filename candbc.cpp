@@ -0,0 +1,223 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "candbc.h"
+
+#include <linux/can.h>
+
+/*!
+ * Constructor, creates an empty database.
+ */
+candbc::candbc() {
+  sfftable.fill(-1, CAN_SFF_MASK + 1);
+}
+
+/*!
+ * Loads a DBC file. Only messages (BO_) and signals (SG_) are used, all other
+ * sections are skipped. The previous content is replaced on success.
+ * @param fileName Name of the DBC file
+ * @param error Receives a description of the problem on failure
+ * @return success of the operation
+ */
+bool candbc::load(const QString &fileName, QString *error) {
+  QFile dbcfile(fileName);
+  if (!dbcfile.open(QIODevice::ReadOnly)) {
+    if (error) *error = dbcfile.errorString();
+    return false;
+  }
+
+  QTextStream stream(&dbcfile);
+  QVector<candbcmessage> newmessages;
+  QRegExp messagerx("^BO_\\s+(\\d+)\\s+(\\w+)\\s*:\\s*(\\d+)\\s*(\\w*)");
+  QRegExp signalrx("^SG_\\s+(\\w+)\\s*(M|m\\d+)?\\s*:\\s*(\\d+)\\|(\\d+)@([01])([+-])\\s*"
+                   "\\(([^,]+),([^)]+)\\)\\s*\\[[^\\]]*\\]\\s*\"([^\"]*)\"");
+  int linenumber = 0;
+  QString line;
+
+  while (!(line = stream.readLine()).isNull()) {
+    linenumber++;
+    line = line.trimmed();
+
+    if (messagerx.indexIn(line) == 0) {
+      candbcmessage msg;
+      quint32 rawid = messagerx.cap(1).toULongLong();
+      msg.ide = rawid & CAN_EFF_FLAG;
+      msg.identifier = rawid & CAN_EFF_MASK;
+      msg.name = messagerx.cap(2);
+      msg.dlc = messagerx.cap(3).toInt();
+      msg.multiplexor = -1;
+      newmessages.append(msg);
+    } else if (signalrx.indexIn(line) == 0) {
+      if (newmessages.isEmpty()) {
+        if (error) *error = QString("line %1: signal outside of a message").arg(linenumber);
+        return false;
+      }
+      candbcsignal sig;
+      sig.name = signalrx.cap(1);
+      sig.multiplexor = (signalrx.cap(2) == "M");
+      sig.multiplexvalue = signalrx.cap(2).startsWith("m") ? signalrx.cap(2).mid(1).toInt() : -1;
+      sig.startbit = signalrx.cap(3).toInt();
+      sig.length = signalrx.cap(4).toInt();
+      sig.motorola = (signalrx.cap(5) == "0");
+      sig.issigned = (signalrx.cap(6) == "-");
+      sig.factor = signalrx.cap(7).trimmed().toDouble();
+      sig.offset = signalrx.cap(8).trimmed().toDouble();
+      sig.unit = signalrx.cap(9);
+      if (!compile(sig)) {
+        if (error) *error = QString("line %1: signal %2 does not fit into 8 bytes").arg(linenumber).arg(sig.name);
+        return false;
+      }
+      candbcmessage &msg = newmessages.last();
+      if (sig.multiplexor) msg.multiplexor = msg.siglist.size();
+      msg.siglist.append(sig);
+    }
+  }
+
+  // Build the lookup tables
+  messages = newmessages;
+  sfftable.fill(-1);
+  efftable.clear();
+  for (int i = 0; i < messages.size(); i++) {
+    if (messages.at(i).ide) {
+      efftable.insert(messages.at(i).identifier, i);
+    } else if (messages.at(i).identifier <= CAN_SFF_MASK) {
+      sfftable[messages.at(i).identifier] = i;
+    }
+  }
+  file = fileName;
+  return true;
+}
+
+/*!
+ * Name of the loaded file.
+ * @return file name (empty if nothing is loaded)
+ */
+QString candbc::fileName() const {
+  return file;
+}
+
+/*!
+ * Number of messages.
+ * @return number of messages
+ */
+int candbc::messagecount() const {
+  return messages.size();
+}
+
+/*!
+ * Message by index.
+ * @param index Index of the message
+ * @return the message
+ */
+const candbcmessage &candbc::messageat(int index) const {
+  return messages.at(index);
+}
+
+/*!
+ * Message by CAN ID.
+ * @param identifier CAN ID
+ * @param ide Whether the ID is an extended one
+ * @return the message or 0 if the ID is not in the database
+ */
+const candbcmessage *candbc::message(quint32 identifier, bool ide) const {
+  int index;
+  if (ide) {
+    index = efftable.value(identifier, -1);
+  } else {
+    index = sfftable.at(identifier & CAN_SFF_MASK);
+  }
+  return index < 0 ? 0 : &messages.at(index);
+}
+
+/*!
+ * Whether a signal is in the frame: always, unless it is multiplexed and
+ * the multiplexor selects another group.
+ * @param msg Message of the frame
+ * @param sig Index of the signal
+ * @param packet The frame
+ * @return whether the signal is present
+ */
+bool candbc::ispresent(const candbcmessage &msg, int sig, const canpacket &packet) const {
+  const candbcsignal &candidate = msg.siglist.at(sig);
+  if (candidate.multiplexvalue < 0 || msg.multiplexor < 0) return true;
+  return rawvalue(msg.siglist.at(msg.multiplexor), qFromLittleEndian<quint64>(packet.data)) == candidate.multiplexvalue;
+}
+
+/*!
+ * All signals of a frame as text, e.g. "EngineSpeed=1250 rpm, Gear=3".
+ * Called for the visible rows only.
+ * @param packet The frame
+ * @return description (empty if the ID is not in the database)
+ */
+QString candbc::describe(const canpacket &packet) const {
+  if (packet.err) return QString();
+  const candbcmessage *msg = message(packet.identifier, packet.ide);
+  if (!msg) return QString();
+
+  QString text = msg->name + ":";
+  for (int i = 0; i < msg->siglist.size(); i++) {
+    if (!ispresent(*msg, i, packet)) continue;
+    const candbcsignal &sig = msg->siglist.at(i);
+    text += QString(" %1=%2").arg(sig.name).arg(value(sig, packet));
+    if (!sig.unit.isEmpty()) text += " " + sig.unit;
+  }
+  return text;
+}
+
+/*!
+ * Decodes one signal of many frames (of the same message) at once.
+ * The payloads are given as one little endian 64 bit word per frame, so the
+ * loop has no branches and no table lookups and the compiler can vectorise it.
+ * @param sig The signal
+ * @param payloads Payload words of the frames
+ * @param count Number of frames
+ * @param values Receives the physical values
+ */
+void candbc::decodeseries(const candbcsignal &sig, const quint64 *payloads, int count, double *values) {
+  const int shift = sig.shift;
+  const quint64 mask = sig.mask;
+  const quint64 signbit = sig.signbit;
+  const double factor = sig.factor;
+  const double offset = sig.offset;
+
+  if (sig.motorola) {
+    for (int i = 0; i < count; i++) {
+      quint64 raw = (qbswap(payloads[i]) >> shift) & mask;
+      values[i] = (qint64)((raw ^ signbit) - signbit) * factor + offset;
+    }
+  } else {
+    for (int i = 0; i < count; i++) {
+      quint64 raw = (payloads[i] >> shift) & mask;
+      values[i] = (qint64)((raw ^ signbit) - signbit) * factor + offset;
+    }
+  }
+}
+
+/*!
+ * Computes shift, mask and sign bit of a signal.
+ * Intel signals are read from the little endian payload word, their start
+ * bit is the LSB. Motorola signals are read from the big endian word, their
+ * start bit is the MSB in the DBC "sawtooth" numbering (bit 7 of byte 0 first).
+ * @param sig Signal to be compiled
+ * @return false if the signal does not fit into 8 bytes
+ */
+bool candbc::compile(candbcsignal &sig) {
+  if (sig.length < 1 || sig.length > 64 || sig.startbit < 0 || sig.startbit > 63) return false;
+
+  if (sig.motorola) {
+    int msb = (7 - sig.startbit / 8) * 8 + sig.startbit % 8;
+    sig.shift = msb - sig.length + 1;
+  } else {
+    sig.shift = sig.startbit;
+  }
+  if (sig.shift < 0 || sig.shift + sig.length > 64) return false;
+
+  sig.mask = (sig.length == 64) ? ~Q_UINT64_C(0) : ((Q_UINT64_C(1) << sig.length) - 1);
+  sig.signbit = sig.issigned ? (Q_UINT64_C(1) << (sig.length - 1)) : 0;
+  return true;
+}
@@ -0,0 +1,103 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANDBC_H
+#define CANDBC_H
+
+#include <QtCore>
+#include <QtEndian>
+
+#include "canlogfile.h"
+
+/*!
+ * One signal of a message, compiled into shift/mask/scale operations when the
+ * database is loaded.
+ */
+struct candbcsignal {
+  QString name;               //!< Name of the signal
+  QString unit;               //!< Physical unit
+  int startbit;               //!< Start bit as given in the DBC file
+  int length;                 //!< Length in bits
+  bool motorola;              //!< Byte order: true = Motorola (big endian), false = Intel
+  bool issigned;              //!< Whether the raw value is two's complement
+  double factor;              //!< Physical value = raw * factor + offset
+  double offset;              //!< Physical value = raw * factor + offset
+  bool multiplexor;           //!< This signal selects the multiplexed signals
+  int multiplexvalue;         //!< Only present if the multiplexor has this value (-1 = always)
+
+  int shift;                  //!< Compiled: right shift of the 64 bit payload word
+  quint64 mask;               //!< Compiled: mask after shifting
+  quint64 signbit;            //!< Compiled: sign bit for sign extension (0 = unsigned)
+};
+
+/*!
+ * One message of the database with its signals.
+ */
+struct candbcmessage {
+  quint32 identifier;         //!< CAN ID
+  bool ide;                   //!< Whether the ID is an extended one
+  QString name;               //!< Name of the message
+  int dlc;                    //!< Data length code
+  int multiplexor;            //!< Index of the multiplexor signal (-1 = none)
+  QVector<candbcsignal> siglist;  //!< Signals of the message
+};
+
+/*!
+ * Signal database loaded from a DBC file.
+ * Every signal is compiled once into a shift and a mask of a 64 bit payload
+ * word (little endian for Intel, big endian for Motorola signals) plus a scale
+ * and offset. Messages are found by a table lookup with the CAN ID, so
+ * decoding a frame is one lookup plus a few integer operations per signal.
+ */
+class candbc {
+
+public:
+  candbc();                                 //!< Constructor, creates an empty database
+  bool load(const QString &fileName, QString *error = 0);  //!< Loads a DBC file
+  QString fileName() const;                 //!< Name of the loaded file
+  int messagecount() const;                 //!< Number of messages
+  const candbcmessage &messageat(int index) const;  //!< Message by index
+  const candbcmessage *message(quint32 identifier, bool ide) const; //!< Message by CAN ID (0 = unknown)
+  bool ispresent(const candbcmessage &msg, int sig, const canpacket &packet) const; //!< Whether a (multiplexed) signal is in the frame
+  QString describe(const canpacket &packet) const;  //!< All signals of a frame as text
+
+  /*!
+   * Raw value of a signal in a payload word.
+   * @param sig The signal
+   * @param payload Payload as little endian 64 bit word
+   * @return raw value, sign extended
+   */
+  static inline qint64 rawvalue(const candbcsignal &sig, quint64 payload) {
+    if (sig.motorola) payload = swapwords(payload);
+    quint64 raw = (payload >> sig.shift) & sig.mask;
+    return (qint64)((raw ^ sig.signbit) - sig.signbit);
+  }
+
+  /*!
+   * Physical value of a signal in a frame.
+   * @param sig The signal
+   * @param packet The frame
+   * @return raw * factor + offset
+   */
+  static inline double value(const candbcsignal &sig, const canpacket &packet) {
+    return rawvalue(sig, qFromLittleEndian<quint64>(packet.data)) * sig.factor + sig.offset;
+  }
+
+  static void decodeseries(const candbcsignal &sig, const quint64 *payloads, int count, double *values); //!< Decodes one signal of many frames
+
+private:
+  QString file;                             //!< Name of the loaded file
+  QVector<candbcmessage> messages;          //!< All messages
+  QVector<int> sfftable;                    //!< Message index per standard ID (-1 = unknown)
+  QHash<quint32, int> efftable;             //!< Message index per extended ID
+
+  static bool compile(candbcsignal &sig);   //!< Computes shift, mask and sign bit of a signal
+  static inline quint64 swapwords(quint64 payload) { return qbswap(payload); }  //!< Little to big endian
+};
+
+#endif // CANDBC_H
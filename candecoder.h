@@ -0,0 +1,103 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANDECODER_H
+#define CANDECODER_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+
+/*!
+ * Range of CAN IDs a decoder consumes.
+ */
+struct candecoderids {
+  quint32 first;              //!< First identifier
+  quint32 last;               //!< Last identifier (inclusive)
+  bool extended;              //!< true for 29 bit identifiers, false for 11 bit ones
+};
+
+/*!
+ * One annotation a decoder made.
+ */
+struct candecoded {
+  quint32 arrival;            //!< Arrival number of the canpacket annotated
+  canpacket packet;           //!< The canpacket (kept for display after the ring dropped it)
+  int decoder;                //!< Number of the decoder in the canpipeline (set by the pipeline)
+  QString text;               //!< Annotation
+};
+
+/*!
+ * Protocol decoder (J1939, CANopen, UDS, ...) run by a canpipeline.
+ *
+ * A decoder declares the CAN IDs it consumes and only ever sees canpackets
+ * with those IDs, in arrival order and always from the same worker thread,
+ * so it may keep state between canpackets without locking. It must not
+ * touch the GUI. Decoders are created in the GUI thread and handed over to
+ * the pipeline, which deletes them.
+ */
+class candecoder {
+
+public:
+  virtual ~candecoder() {}                        //!< Destructor
+
+  virtual QString name() const = 0;               //!< Name shown to the user, e.g. "J1939"
+  virtual QList<candecoderids> ids() const = 0;   //!< CAN IDs consumed (asked once, before the first canpacket)
+  virtual void reset() = 0;                       //!< Forgets all state, the capture starts anew
+
+  /*!
+   * Decodes one canpacket.
+   * @param packet The canpacket (its ID is one of ids())
+   * @param arrival Its arrival number
+   * @param out Receives the annotations made, for this or earlier canpackets
+   */
+  virtual void decode(const canpacket &packet, quint32 arrival, QVector<candecoded> &out) = 0;
+
+protected:
+  /*!
+   * Appends one annotation.
+   * @param out Annotations made
+   * @param packet The canpacket annotated
+   * @param arrival Its arrival number
+   * @param text Annotation
+   */
+  static inline void annotate(QVector<candecoded> &out, const canpacket &packet, quint32 arrival, const QString &text) {
+    candecoded result;
+    result.arrival = arrival;
+    result.packet = packet;
+    result.decoder = -1;
+    result.text = text;
+    out.append(result);
+  }
+
+  /*!
+   * Number as upper case hex string.
+   * @param value The number
+   * @param digits Digits (padded with 0)
+   * @return hex string
+   */
+  static inline QString hex(quint32 value, int digits) {
+    return QString("%1").arg(value, digits, 16, QChar('0')).toUpper();
+  }
+};
+
+/*!
+ * Interface of a Qt plugin providing decoders. A shared library in one of
+ * the decoder directories (see canpipeline::loadplugins()) that exports a
+ * QObject implementing this interface (Q_EXPORT_PLUGIN2) is loaded at start.
+ */
+class candecoderplugin {
+
+public:
+  virtual ~candecoderplugin() {}                  //!< Destructor
+  virtual QList<candecoder *> createdecoders() = 0; //!< Creates the decoders of the plugin (owned by the caller)
+};
+
+Q_DECLARE_INTERFACE(candecoderplugin, "net.kripserver.socketcangui.candecoderplugin/1.0")
+
+#endif // CANDECODER_H
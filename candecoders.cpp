@@ -0,0 +1,354 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "candecoders.h"
+
+/*!
+ * Name shown to the user.
+ * @return "J1939"
+ */
+QString canj1939decoder::name() const {
+  return "J1939";
+}
+
+/*!
+ * CAN IDs consumed.
+ * @return all 29 bit IDs
+ */
+QList<candecoderids> canj1939decoder::ids() const {
+  candecoderids all = { 0, 0x1FFFFFFF, true };
+  return QList<candecoderids>() << all;
+}
+
+/*!
+ * Forgets all state; the decoder has none.
+ */
+void canj1939decoder::reset() {
+}
+
+/*!
+ * Annotates a canpacket with its priority, PGN (and name), source address
+ * and, for PDU1 PGNs, destination address.
+ * @param packet The canpacket
+ * @param arrival Its arrival number
+ * @param out Receives the annotation
+ */
+void canj1939decoder::decode(const canpacket &packet, quint32 arrival, QVector<candecoded> &out) {
+  quint32 id = packet.identifier;
+  int priority = (id >> 26) & 0x07;
+  quint32 pf = (id >> 16) & 0xFF;
+  quint32 ps = (id >> 8) & 0xFF;
+  quint32 source = id & 0xFF;
+  quint32 pgn = (id >> 8) & 0x3FF00;
+  if (pf >= 240) pgn |= ps;
+
+  QString text = QString("PGN %1 (%2) SA %3").arg(pgn).arg(hex(pgn, 5)).arg(hex(source, 2));
+  if (pf < 240) text += QString(" DA %1").arg(hex(ps, 2));
+  text += QString(" P%1").arg(priority);
+  const char *known = pgnname(pgn);
+  if (known) text += QString(" ") + known;
+
+  // Transport protocol connection management
+  if (pgn == 0xEC00 && packet.dlc == 8) {
+    quint32 length = packet.data[1] | (packet.data[2] << 8);
+    quint32 carried = packet.data[5] | (packet.data[6] << 8) | (packet.data[7] << 16);
+    switch (packet.data[0]) {
+    case 16: text += QString(": RTS %1 bytes in %2 packets of PGN %3").arg(length).arg(packet.data[3]).arg(carried); break;
+    case 17: text += QString(": CTS %1 packets from %2").arg(packet.data[1]).arg(packet.data[2]); break;
+    case 19: text += QString(": EndOfMsgACK %1 bytes of PGN %2").arg(length).arg(carried); break;
+    case 32: text += QString(": BAM %1 bytes in %2 packets of PGN %3").arg(length).arg(packet.data[3]).arg(carried); break;
+    case 255: text += QString(": Abort reason %1 of PGN %2").arg(packet.data[1]).arg(carried); break;
+    }
+  } else if (pgn == 0xEB00 && packet.dlc >= 1) {
+    text += QString(": packet %1").arg(packet.data[0]);
+  } else if (pgn == 0xEA00 && packet.dlc >= 3) {
+    text += QString(": PGN %1").arg(packet.data[0] | (packet.data[1] << 8) | (packet.data[2] << 16));
+  }
+  annotate(out, packet, arrival, text);
+}
+
+/*!
+ * Name of a well-known PGN.
+ * @param pgn Parameter group number
+ * @return name (0 if unknown)
+ */
+const char *canj1939decoder::pgnname(quint32 pgn) {
+  switch (pgn) {
+  case 0xE800: return "Acknowledgement";
+  case 0xEA00: return "Request";
+  case 0xEB00: return "TP.DT";
+  case 0xEC00: return "TP.CM";
+  case 0xEE00: return "Address Claimed";
+  case 0xF003: return "EEC2";
+  case 0xF004: return "EEC1";
+  case 0xFECA: return "DM1";
+  case 0xFEEE: return "ET1";
+  case 0xFEEF: return "EFL/P1";
+  case 0xFEF1: return "CCVS1";
+  case 0xFEF2: return "LFE1";
+  case 0xFEF6: return "IC1";
+  case 0xFEE5: return "HOURS";
+  case 0xFEC1: return "VDHR";
+  }
+  return 0;
+}
+
+/*!
+ * Name shown to the user.
+ * @return "CANopen"
+ */
+QString cancanopendecoder::name() const {
+  return "CANopen";
+}
+
+/*!
+ * CAN IDs consumed: the COB-IDs of the predefined connection set.
+ * @return 11 bit ID ranges
+ */
+QList<candecoderids> cancanopendecoder::ids() const {
+  candecoderids nmt = { 0x000, 0x000, false };
+  candecoderids syncemcy = { 0x080, 0x0FF, false };
+  candecoderids time = { 0x100, 0x100, false };
+  candecoderids pdosdo = { 0x181, 0x67F, false };
+  candecoderids heartbeat = { 0x701, 0x77F, false };
+  return QList<candecoderids>() << nmt << syncemcy << time << pdosdo << heartbeat;
+}
+
+/*!
+ * Forgets all state; the decoder has none.
+ */
+void cancanopendecoder::reset() {
+}
+
+/*!
+ * Annotates a canpacket with its object and node and, where the object is
+ * known, its content.
+ * @param packet The canpacket
+ * @param arrival Its arrival number
+ * @param out Receives the annotation
+ */
+void cancanopendecoder::decode(const canpacket &packet, quint32 arrival, QVector<candecoded> &out) {
+  quint32 cobid = packet.identifier & 0x7FF;
+  int node = cobid & 0x7F;
+  int function = cobid >> 7;
+  QString text;
+
+  if (cobid == 0x000) {
+    if (packet.dlc < 2) return;
+    const char *command = 0;
+    switch (packet.data[0]) {
+    case 0x01: command = "Start"; break;
+    case 0x02: command = "Stop"; break;
+    case 0x80: command = "Enter pre-operational"; break;
+    case 0x81: command = "Reset node"; break;
+    case 0x82: command = "Reset communication"; break;
+    }
+    text = QString("NMT %1 ").arg(command ? command : "?");
+    text += packet.data[1] ? QString("node %1").arg(packet.data[1]) : QString("all nodes");
+  } else if (cobid == 0x080) {
+    text = "SYNC";
+    if (packet.dlc >= 1) text += QString(" counter %1").arg(packet.data[0]);
+  } else if (function == 1) {
+    text = QString("EMCY node %1").arg(node);
+    if (packet.dlc >= 3) {
+      text += QString(" error %1 register %2").arg(hex(packet.data[0] | (packet.data[1] << 8), 4)).arg(hex(packet.data[2], 2));
+    }
+  } else if (cobid == 0x100) {
+    text = "TIME";
+  } else if (function >= 3 && function <= 10) {
+    // 0x180 TPDO1, 0x200 RPDO1, 0x280 TPDO2, ...
+    text = QString("%1PDO%2 node %3").arg((function & 1) ? "T" : "R").arg((function - 1) / 2).arg(node);
+  } else if (function == 11 || function == 12) {
+    text = QString("SDO %1 node %2: ").arg(function == 11 ? "response" : "request").arg(node)
+           + sdotext(packet, function == 11);
+  } else if (function == 14) {
+    const char *state = "?";
+    if (packet.dlc >= 1) {
+      switch (packet.data[0] & 0x7F) {
+      case 0x00: state = "boot-up"; break;
+      case 0x04: state = "stopped"; break;
+      case 0x05: state = "operational"; break;
+      case 0x7F: state = "pre-operational"; break;
+      }
+    }
+    text = QString("Heartbeat node %1 %2").arg(node).arg(state);
+  } else {
+    return;
+  }
+  annotate(out, packet, arrival, text);
+}
+
+/*!
+ * Command and object of an SDO (expedited and segmented transfers).
+ * @param packet The SDO canpacket
+ * @param response true for server to client (0x580), false for client to server (0x600)
+ * @return description
+ */
+QString cancanopendecoder::sdotext(const canpacket &packet, bool response) {
+  if (packet.dlc < 1) return "?";
+  int command = packet.data[0] >> 5;
+  QString object;
+  if (packet.dlc >= 4) {
+    object = QString(" %1sub%2").arg(hex(packet.data[1] | (packet.data[2] << 8), 4)).arg(hex(packet.data[3], 2));
+  }
+  if (command == 4) {
+    quint32 code = packet.dlc >= 8 ? (packet.data[4] | (packet.data[5] << 8) | (packet.data[6] << 16) | ((quint32)packet.data[7] << 24)) : 0;
+    return QString("abort%1 code %2").arg(object).arg(hex(code, 8));
+  }
+  if (response) {
+    switch (command) {
+    case 0: return "upload segment";
+    case 1: return "download segment done";
+    case 2: return "upload" + object;
+    case 3: return "download done" + object;
+    }
+  } else {
+    switch (command) {
+    case 0: return "download segment";
+    case 1: return "download" + object;
+    case 2: return "upload" + object;
+    case 3: return "upload segment";
+    }
+  }
+  return QString("command %1").arg(command);
+}
+
+/*!
+ * Constructor, lets the reassembler follow the diagnostic IDs.
+ */
+canudsdecoder::canudsdecoder() {
+  canpacketfilter filter;
+  filter.setids(canisotp::defaultids());
+  reassembler.setids(filter);
+}
+
+/*!
+ * Name shown to the user.
+ * @return "UDS"
+ */
+QString canudsdecoder::name() const {
+  return "UDS";
+}
+
+/*!
+ * CAN IDs consumed: the diagnostic IDs of OBD/UDS, as canisotp::defaultids().
+ * @return ID ranges
+ */
+QList<candecoderids> canudsdecoder::ids() const {
+  candecoderids functional = { 0x7DF, 0x7DF, false };
+  candecoderids physical = { 0x7E0, 0x7EF, false };
+  candecoderids extended = { 0x18DA0000, 0x18DBFFFF, true };
+  return QList<candecoderids>() << functional << physical << extended;
+}
+
+/*!
+ * Forgets the messages in progress.
+ */
+void canudsdecoder::reset() {
+  reassembler.clear();
+}
+
+/*!
+ * Feeds a canpacket to the reassembler and annotates the last canpacket of
+ * every message it completes with the service.
+ * @param packet The canpacket
+ * @param arrival Its arrival number
+ * @param out Receives the annotations
+ */
+void canudsdecoder::decode(const canpacket &packet, quint32 arrival, QVector<candecoded> &out) {
+  reassembler.feed(packet, arrival, done);
+  foreach (const canisotpmessage &message, done) {
+    if (message.status != canisotp::Complete || message.payload.isEmpty()) continue;
+    quint8 sid = message.payload.at(0);
+    QString text;
+    if (sid == 0x7F && message.payload.size() >= 3) {
+      quint8 rejected = message.payload.at(1);
+      quint8 nrc = message.payload.at(2);
+      const char *service = servicename(rejected);
+      const char *reason = responsecodename(nrc);
+      text = QString("Negative response to %1: %2").arg(service ? QString(service) : "SID " + hex(rejected, 2))
+             .arg(reason ? QString(reason) : "NRC " + hex(nrc, 2));
+    } else {
+      // Positive responses are the service identifier + 0x40
+      bool positive = sid & 0x40;
+      quint8 base = positive ? (sid & ~0x40) : sid;
+      const char *service = servicename(base);
+      text = QString(positive ? "Response %1" : "Request %1").arg(service ? QString(service) : "SID " + hex(base, 2));
+      if ((base == 0x22 || base == 0x2E) && message.payload.size() >= 3) {
+        text += " DID " + hex(((quint8)message.payload.at(1) << 8) | (quint8)message.payload.at(2), 4);
+      } else if ((base == 0x10 || base == 0x11 || base == 0x19 || base == 0x27 || base == 0x31) && message.payload.size() >= 2) {
+        text += " sub " + hex((quint8)message.payload.at(1) & 0x7F, 2);
+      }
+    }
+    text += QString(" (%1 bytes)").arg(message.length);
+    // A message is complete with its latest canpacket
+    annotate(out, packet, arrival, text);
+  }
+  done.clear();
+}
+
+/*!
+ * Name of a UDS service (or OBD mode).
+ * @param sid Service identifier of the request
+ * @return name (0 if unknown)
+ */
+const char *canudsdecoder::servicename(quint8 sid) {
+  switch (sid) {
+  case 0x01: return "OBD current data";
+  case 0x02: return "OBD freeze frame";
+  case 0x03: return "OBD stored DTCs";
+  case 0x04: return "OBD clear DTCs";
+  case 0x09: return "OBD vehicle information";
+  case 0x10: return "DiagnosticSessionControl";
+  case 0x11: return "ECUReset";
+  case 0x14: return "ClearDiagnosticInformation";
+  case 0x19: return "ReadDTCInformation";
+  case 0x22: return "ReadDataByIdentifier";
+  case 0x23: return "ReadMemoryByAddress";
+  case 0x27: return "SecurityAccess";
+  case 0x28: return "CommunicationControl";
+  case 0x2E: return "WriteDataByIdentifier";
+  case 0x2F: return "InputOutputControlByIdentifier";
+  case 0x31: return "RoutineControl";
+  case 0x34: return "RequestDownload";
+  case 0x35: return "RequestUpload";
+  case 0x36: return "TransferData";
+  case 0x37: return "RequestTransferExit";
+  case 0x3D: return "WriteMemoryByAddress";
+  case 0x3E: return "TesterPresent";
+  case 0x85: return "ControlDTCSetting";
+  }
+  return 0;
+}
+
+/*!
+ * Name of a negative response code.
+ * @param nrc Negative response code
+ * @return name (0 if unknown)
+ */
+const char *canudsdecoder::responsecodename(quint8 nrc) {
+  switch (nrc) {
+  case 0x10: return "generalReject";
+  case 0x11: return "serviceNotSupported";
+  case 0x12: return "subFunctionNotSupported";
+  case 0x13: return "incorrectMessageLengthOrInvalidFormat";
+  case 0x21: return "busyRepeatRequest";
+  case 0x22: return "conditionsNotCorrect";
+  case 0x24: return "requestSequenceError";
+  case 0x31: return "requestOutOfRange";
+  case 0x33: return "securityAccessDenied";
+  case 0x35: return "invalidKey";
+  case 0x36: return "exceedNumberOfAttempts";
+  case 0x37: return "requiredTimeDelayNotExpired";
+  case 0x72: return "generalProgrammingFailure";
+  case 0x78: return "requestCorrectlyReceived-ResponsePending";
+  case 0x7E: return "subFunctionNotSupportedInActiveSession";
+  case 0x7F: return "serviceNotSupportedInActiveSession";
+  }
+  return 0;
+}
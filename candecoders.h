@@ -0,0 +1,69 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANDECODERS_H
+#define CANDECODERS_H
+
+#include "candecoder.h"
+#include "canisotp.h"
+
+/*!
+ * SAE J1939: priority, PGN, source and destination address of every
+ * extended frame; the transport protocol control messages are named.
+ */
+class canj1939decoder: public candecoder {
+
+public:
+  QString name() const;                           //!< "J1939"
+  QList<candecoderids> ids() const;               //!< All 29 bit IDs
+  void reset();                                   //!< Nothing to forget
+  void decode(const canpacket &packet, quint32 arrival, QVector<candecoded> &out); //!< Annotates every canpacket
+
+private:
+  static const char *pgnname(quint32 pgn);        //!< Name of a well-known PGN
+};
+
+/*!
+ * CANopen (CiA 301): NMT, SYNC, EMCY, TIME, PDOs, SDOs and heartbeats of
+ * the predefined connection set.
+ */
+class cancanopendecoder: public candecoder {
+
+public:
+  QString name() const;                           //!< "CANopen"
+  QList<candecoderids> ids() const;               //!< COB-IDs of the predefined connection set
+  void reset();                                   //!< Nothing to forget
+  void decode(const canpacket &packet, quint32 arrival, QVector<candecoded> &out); //!< Annotates every canpacket
+
+private:
+  static QString sdotext(const canpacket &packet, bool response); //!< Command and object of an SDO
+};
+
+/*!
+ * UDS (ISO 14229) and OBD on top of ISO-TP: the service of every request
+ * and response, annotated on the last canpacket of the message.
+ */
+class canudsdecoder: public candecoder {
+
+public:
+  canudsdecoder();                                //!< Constructor, sets the diagnostic IDs of the reassembler
+
+  QString name() const;                           //!< "UDS"
+  QList<candecoderids> ids() const;               //!< Diagnostic IDs (see canisotp::defaultids())
+  void reset();                                   //!< Forgets the messages in progress
+  void decode(const canpacket &packet, quint32 arrival, QVector<candecoded> &out); //!< Annotates completed messages
+
+private:
+  canisotp reassembler;                           //!< Messages in progress
+  QList<canisotpmessage> done;                    //!< Messages ended by the latest canpacket
+
+  static const char *servicename(quint8 sid);     //!< Name of a service
+  static const char *responsecodename(quint8 nrc); //!< Name of a negative response code
+};
+
+#endif // CANDECODERS_H
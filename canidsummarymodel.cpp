@@ -0,0 +1,176 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canidsummarymodel.h"
+#include "canpacketmodel.h"
+
+/*!
+ * Constructor, creates a summary of the packets in the store.
+ * @param newstore Store holding the packets, shared with the other views
+ * @param parent Parent of the model
+ */
+canidsummarymodel::canidsummarymodel(QSharedPointer<canpacketstore> newstore, QObject *parent) :
+        QAbstractTableModel(parent), store(newstore) {
+  connect(store.data(), SIGNAL(appended(quint32)), this, SLOT(packetappended(quint32)));
+  connect(store.data(), SIGNAL(evicting(int)), this, SLOT(packetsevicting(int)));
+  connect(store.data(), SIGNAL(abouttoreload()), this, SLOT(storeabouttoreload()));
+  connect(store.data(), SIGNAL(reloaded()), this, SLOT(storereloaded()));
+  for (int i = 0; i < store->packetcount(); i++) tally(store->oldestarrival() + i);
+}
+
+/*!
+ * Number of rows (IDs).
+ * @param parent Only the invisible root has children
+ * @return number of rows
+ */
+int canidsummarymodel::rowCount(const QModelIndex &parent) const {
+  if (parent.isValid()) return 0;
+  return ids.size();
+}
+
+/*!
+ * Number of columns.
+ * @param parent Only the invisible root has children
+ * @return number of columns
+ */
+int canidsummarymodel::columnCount(const QModelIndex &parent) const {
+  if (parent.isValid()) return 0;
+  return ColumnCount;
+}
+
+/*!
+ * Formats one cell.
+ * @param index Cell to be formatted
+ * @param role Only Qt::DisplayRole is provided
+ * @return display string of the cell
+ */
+QVariant canidsummarymodel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || role != Qt::DisplayRole) return QVariant();
+  if (index.row() >= ids.size() || index.column() >= ColumnCount) return QVariant();
+
+  const idsummary &summary = ids.at(index.row());
+  const canpacket &packet = store->packetbyarrival(summary.lastarrival);
+  switch (index.column()) {
+  case ColID: return canpacketmodel::celltext(packet, summary.lastarrival, canpacketmodel::ColID);
+  case ColCount: return QString::number(summary.count);
+  case ColPeriod: return summary.interval < 0 ? QString() : QString::number(summary.interval / 1000.0, 'f', 3);
+  case ColDLC: return canpacketmodel::celltext(packet, summary.lastarrival, canpacketmodel::ColDLC);
+  case ColData: return canpacketmodel::celltext(packet, summary.lastarrival, canpacketmodel::ColData);
+  }
+  return QVariant();
+}
+
+/*!
+ * Header labels.
+ * @param section Column number
+ * @param orientation Only horizontal headers are provided
+ * @param role Only Qt::DisplayRole is provided
+ * @return Label of the column
+ */
+QVariant canidsummarymodel::headerData(int section, Qt::Orientation orientation, int role) const {
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return QVariant();
+  switch (section) {
+  case ColID: return tr("CAN ID");
+  case ColCount: return tr("Count");
+  case ColPeriod: return tr("Period [ms]");
+  case ColDLC: return tr("DLC");
+  case ColData: return tr("Last data");
+  }
+  return QVariant();
+}
+
+/*!
+ * Called when the store has stored one packet; updates or adds the row of
+ * its ID.
+ * @param arrival Arrival number of the packet
+ */
+void canidsummarymodel::packetappended(quint32 arrival) {
+  if (store->packetbyarrival(arrival).marker) return;
+  quint32 key = keyof(store->packetbyarrival(arrival));
+  int row = find(key);
+  if (row < ids.size() && ids.at(row).key == key) {
+    tally(arrival);
+    emit dataChanged(index(row, ColCount), index(row, ColumnCount - 1));
+    return;
+  }
+  beginInsertRows(QModelIndex(), row, row);
+  tally(arrival);
+  endInsertRows();
+}
+
+/*!
+ * Called when the store is about to drop its oldest packets from the ring.
+ * Their IDs are counted down; IDs without stored packets lose their row.
+ * @param dropped Number of packets to be dropped
+ */
+void canidsummarymodel::packetsevicting(int dropped) {
+  for (int i = 0; i < dropped; i++) {
+    if (store->packetat(i).marker) continue;
+    int row = find(keyof(store->packetat(i)));
+    if (row < ids.size()) ids[row].count--;
+  }
+  for (int row = ids.size() - 1; row >= 0; row--) {
+    if (ids.at(row).count) continue;
+    beginRemoveRows(QModelIndex(), row, row);
+    ids.remove(row);
+    endRemoveRows();
+  }
+  if (!ids.isEmpty()) emit dataChanged(index(0, ColCount), index(ids.size() - 1, ColCount));
+}
+
+/*!
+ * Called when the store is about to replace all packets.
+ */
+void canidsummarymodel::storeabouttoreload() {
+  beginResetModel();
+  ids.clear();
+}
+
+/*!
+ * Called when the store has replaced all packets; all packets are counted
+ * again.
+ */
+void canidsummarymodel::storereloaded() {
+  for (int i = 0; i < store->packetcount(); i++) tally(store->oldestarrival() + i);
+  endResetModel();
+}
+
+/*!
+ * Row of a key (binary search).
+ * @param key Key of the ID (see keyof())
+ * @return row of the key, or the row it has to be inserted at
+ */
+int canidsummarymodel::find(quint32 key) const {
+  int low = 0;
+  int high = ids.size();
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (ids.at(mid).key < key) low = mid + 1; else high = mid;
+  }
+  return low;
+}
+
+/*!
+ * Counts one packet, adding an entry for a new ID, without telling the views.
+ * @param arrival Arrival number of the packet (the newest of its ID)
+ */
+void canidsummarymodel::tally(quint32 arrival) {
+  const canpacket &packet = store->packetbyarrival(arrival);
+  if (packet.marker) return;
+  quint32 key = keyof(packet);
+  int row = find(key);
+  if (row == ids.size() || ids.at(row).key != key) {
+    idsummary summary = { key, 0, arrival, -1 };
+    ids.insert(row, summary);
+  } else {
+    const canpacket &previous = store->packetbyarrival(ids.at(row).lastarrival);
+    ids[row].interval = (qint64)(packet.tv.tv_sec - previous.tv.tv_sec) * 1000000 + packet.tv.tv_usec - previous.tv.tv_usec;
+  }
+  ids[row].count++;
+  ids[row].lastarrival = arrival;
+}
@@ -0,0 +1,76 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANIDSUMMARYMODEL_H
+#define CANIDSUMMARYMODEL_H
+
+#include <QtGui>
+
+#include "canpacketstore.h"
+
+/*!
+ * Table model with one row per CAN ID of a canpacketstore: how many of its
+ * packets are stored, the time between its last two packets and its latest
+ * payload. The rows are sorted by ID. Only the arrival number of the latest
+ * packet of each ID is kept, the payload is read from the store.
+ */
+class canidsummarymodel: public QAbstractTableModel {
+Q_OBJECT
+
+public:
+  //! Columns of the model
+  enum Column {
+    ColID = 0,        //!< CAN ID
+    ColCount,         //!< Stored packets with this ID
+    ColPeriod,        //!< Time between the last two packets
+    ColDLC,           //!< Data length code of the latest packet
+    ColData,          //!< Payload of the latest packet
+    ColumnCount       //!< Number of columns
+  };
+
+  explicit canidsummarymodel(QSharedPointer<canpacketstore> newstore, QObject *parent = 0); //!< Constructor, creates a summary of the store
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const;    //!< Number of rows (IDs)
+  int columnCount(const QModelIndex &parent = QModelIndex()) const; //!< Number of columns
+  QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;  //!< Formats one cell
+  QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const; //!< Header labels
+
+private slots:
+  void packetappended(quint32 arrival);           //!< The store has stored one packet
+  void packetsevicting(int dropped);              //!< The store is about to drop its oldest packets
+  void storeabouttoreload();                      //!< The store is about to replace all packets
+  void storereloaded();                           //!< The store has replaced all packets
+
+private:
+  /*!
+   * Summary of one CAN ID.
+   */
+  struct idsummary {
+    quint32 key;              //!< Identifier and the EFF and ERR bits (see keyof())
+    quint32 count;            //!< Stored packets with this ID
+    quint32 lastarrival;      //!< Arrival number of the latest packet
+    qint64 interval;          //!< Microseconds between the last two packets (-1 = only one seen)
+  };
+
+  QSharedPointer<canpacketstore> store; //!< Store holding the packets, shared with the other views
+  QVector<idsummary> ids;         //!< One entry per ID, sorted by key
+
+  int find(quint32 key) const;    //!< Row of a key or the row it belongs to
+  void tally(quint32 arrival);    //!< Counts one packet without telling the views
+
+  /*!
+   * Sort key of the ID of a packet; standard IDs come before extended ones.
+   * @param packet The packet
+   * @return key
+   */
+  static inline quint32 keyof(const canpacket &packet) {
+    return (packet.identifier & 0x1FFFFFFF) | (packet.ide ? 0x80000000 : 0) | (packet.err ? 0x40000000 : 0);
+  }
+};
+
+#endif // CANIDSUMMARYMODEL_H
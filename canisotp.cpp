@@ -0,0 +1,269 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canisotp.h"
+
+#include <string.h>
+
+/*!
+ * Constructor, allocates the session table. The canpackets of defaultids()
+ * are reassembled.
+ */
+canisotp::canisotp() {
+  sessions.resize(Sessions);
+  canpacketfilter ids;
+  ids.setids(defaultids());
+  setids(ids);
+}
+
+/*!
+ * Forgets all sessions and restarts the message numbers.
+ */
+void canisotp::clear() {
+  for (int i = 0; i < sessions.size(); i++) sessions[i].active = false;
+  serial = 0;
+}
+
+/*!
+ * Sets the canpackets that carry ISO-TP. Error and remote frames never do.
+ * @param newfilter canpackets to be reassembled (usually just IDs)
+ */
+void canisotp::setids(const canpacketfilter &newfilter) {
+  filter = newfilter;
+  filter.seterrors(canpacketfilter::NoErrors);
+  clear();
+}
+
+/*!
+ * Feeds one canpacket. Messages ending with it (completed or failed) are
+ * appended to done; that is the only place memory is allocated.
+ * @param packet The canpacket
+ * @param arrival Its arrival number
+ * @param done Receives the messages that have ended
+ */
+void canisotp::feed(const canpacket &packet, quint32 arrival, QList<canisotpmessage> &done) {
+  if (packet.rtr || packet.marker || !filter.matches(packet)) return;
+  quint32 key = keyof(packet);
+  session *entry;
+
+  switch (frametype(packet)) {
+  case SingleFrame: {
+    if ((entry = find(packet.interface, key))) finish(entry, Interrupted, done);
+    entry = allocate(done);
+    begin(entry, packet, key, packet.data[0] & 0x0F);
+    addframe(entry, packet, arrival);
+    addpayload(entry, packet.data + 1, entry->length);
+    finish(entry, Complete, done);
+    break;
+  }
+  case FirstFrame: {
+    quint32 length = ((packet.data[0] & 0x0F) << 8) | packet.data[1];
+    int offset = 2;
+    if (!length) {
+      // Escape sequence: 32 bit length (ISO 15765-2:2016)
+      length = ((quint32)packet.data[2] << 24) | ((quint32)packet.data[3] << 16) | ((quint32)packet.data[4] << 8) | packet.data[5];
+      offset = 6;
+      if (length <= MaxPayload) return;
+    } else if (length < 8) {
+      return;
+    }
+    if ((entry = find(packet.interface, key))) finish(entry, Interrupted, done);
+    entry = allocate(done);
+    begin(entry, packet, key, length);
+    addframe(entry, packet, arrival);
+    addpayload(entry, packet.data + offset, 8 - offset);
+    break;
+  }
+  case ConsecutiveFrame: {
+    entry = find(packet.interface, key);
+    if (!entry) return;
+    if (elapsedus(entry->last, packet.tv) > (qint64)TimeoutMs * 1000) {
+      finish(entry, TimedOut, done);
+      return;
+    }
+    addframe(entry, packet, arrival);
+    if ((packet.data[0] & 0x0F) != entry->sequence) {
+      finish(entry, SequenceError, done);
+      return;
+    }
+    entry->sequence = (entry->sequence + 1) & 0x0F;
+    addpayload(entry, packet.data + 1, qMin((quint32)(packet.dlc - 1), entry->length - entry->received));
+    if (entry->received >= entry->length) finish(entry, Complete, done);
+    break;
+  }
+  case FlowControl: {
+    // The session this answers: the one already paired with this ID, else
+    // the latest first frame on the interface that has not been answered yet
+    session *answered = 0;
+    for (int i = 0; i < sessions.size(); i++) {
+      session *candidate = &sessions[i];
+      if (!candidate->active || candidate->interface != packet.interface || candidate->key == key) continue;
+      if (candidate->flowkey == key) {
+        answered = candidate;
+        break;
+      }
+      if (candidate->flowkey == (quint32)NoFlowKey && (!answered || elapsedus(answered->start, candidate->start) > 0)) {
+        answered = candidate;
+      }
+    }
+    if (!answered) return;
+    answered->flowkey = key;
+    addframe(answered, packet, arrival);
+    if ((packet.data[0] & 0x0F) == 2) finish(answered, Aborted, done);
+    break;
+  }
+  case NoFrame:
+    break;
+  }
+}
+
+/*!
+ * Type of a canpacket by its PCI. Only the PCI and the DLC are checked, the
+ * canpacket may still be ignored (e.g. a first frame with a bad length).
+ * @param packet The canpacket
+ * @return type of the canpacket
+ */
+canisotp::FrameType canisotp::frametype(const canpacket &packet) {
+  if (packet.err || packet.rtr || packet.dlc < 1) return NoFrame;
+  switch (packet.data[0] >> 4) {
+  case 0: {
+    int length = packet.data[0] & 0x0F;
+    return (length >= 1 && length < packet.dlc) ? SingleFrame : NoFrame;
+  }
+  case 1: return packet.dlc == 8 ? FirstFrame : NoFrame;
+  case 2: return packet.dlc >= 2 ? ConsecutiveFrame : NoFrame;
+  case 3: return packet.dlc >= 3 && (packet.data[0] & 0x0F) <= 2 ? FlowControl : NoFrame;
+  }
+  return NoFrame;
+}
+
+/*!
+ * IDs carrying ISO-TP by default: the diagnostic IDs of OBD/UDS with 11 bit
+ * (7DF, 7E0-7EF) and 29 bit (18DA....) identifiers.
+ * @return ID list for canpacketfilter::setids()
+ */
+QString canisotp::defaultids() {
+  return "7DF, 7E0-7EF, 18DA0000-18DBFFFF";
+}
+
+/*!
+ * Display name of a Status.
+ * @param status canisotp::Status
+ * @return name
+ */
+QString canisotp::statusname(int status) {
+  switch (status) {
+  case Complete: return QObject::tr("Complete");
+  case SequenceError: return QObject::tr("Sequence error");
+  case TimedOut: return QObject::tr("Timed out");
+  case Interrupted: return QObject::tr("Interrupted");
+  case Aborted: return QObject::tr("Aborted (overflow)");
+  }
+  return QString();
+}
+
+/*!
+ * Active session of a sender.
+ * @param interface Interface
+ * @param key CAN ID of the data frames and the EFF bit
+ * @return the session (0 = none)
+ */
+canisotp::session *canisotp::find(int interface, quint32 key) {
+  for (int i = 0; i < sessions.size(); i++) {
+    session *entry = &sessions[i];
+    if (entry->active && entry->key == key && entry->interface == interface) return entry;
+  }
+  return 0;
+}
+
+/*!
+ * Free entry of the session table. When all are in use, the session that
+ * has been quiet for the longest time is ended as timed out.
+ * @param done Receives the message of an ended session
+ * @return the entry (not active yet)
+ */
+canisotp::session *canisotp::allocate(QList<canisotpmessage> &done) {
+  session *oldest = &sessions[0];
+  for (int i = 0; i < sessions.size(); i++) {
+    session *entry = &sessions[i];
+    if (!entry->active) return entry;
+    if (elapsedus(entry->last, oldest->last) > 0) oldest = entry;
+  }
+  finish(oldest, TimedOut, done);
+  return oldest;
+}
+
+/*!
+ * Starts a session.
+ * @param entry Free entry of the session table
+ * @param packet Single or first frame
+ * @param key CAN ID of the data frames and the EFF bit
+ * @param length Announced length
+ */
+void canisotp::begin(session *entry, const canpacket &packet, quint32 key, quint32 length) {
+  entry->active = true;
+  entry->interface = packet.interface;
+  entry->key = key;
+  entry->flowkey = NoFlowKey;
+  entry->length = length;
+  entry->received = 0;
+  entry->sequence = 1;
+  entry->framecount = 0;
+  entry->start = packet.tv;
+  entry->last = packet.tv;
+}
+
+/*!
+ * Records a canpacket of a session.
+ * @param entry The session
+ * @param packet The canpacket
+ * @param arrival Its arrival number
+ */
+void canisotp::addframe(session *entry, const canpacket &packet, quint32 arrival) {
+  if (entry->framecount < (quint32)MaxFrames) entry->frames[entry->framecount] = arrival;
+  entry->framecount++;
+  entry->last = packet.tv;
+}
+
+/*!
+ * Appends payload bytes; bytes beyond MaxPayload are counted but not kept.
+ * @param entry The session
+ * @param data The bytes
+ * @param count Number of bytes
+ */
+void canisotp::addpayload(session *entry, const unsigned char *data, int count) {
+  if (entry->received < (quint32)MaxPayload) {
+    memcpy(entry->payload + entry->received, data, qMin((quint32)count, MaxPayload - entry->received));
+  }
+  entry->received += count;
+}
+
+/*!
+ * Ends a session and copies it out as a message.
+ * @param entry The session; its entry is free afterwards
+ * @param status How the message ended
+ * @param done Receives the message
+ */
+void canisotp::finish(session *entry, int status, QList<canisotpmessage> &done) {
+  canisotpmessage message;
+  message.serial = serial++;
+  message.interface = entry->interface;
+  message.key = entry->key;
+  message.flowkey = entry->flowkey;
+  message.length = entry->length;
+  message.payload = QByteArray((const char *)entry->payload, qMin(entry->received, (quint32)MaxPayload));
+  int kept = qMin(entry->framecount, (quint32)MaxFrames);
+  message.frames.resize(kept);
+  memcpy(message.frames.data(), entry->frames, kept * sizeof(quint32));
+  message.framecount = entry->framecount;
+  message.start = entry->start;
+  message.end = entry->last;
+  message.status = status;
+  done.append(message);
+  entry->active = false;
+}
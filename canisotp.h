@@ -0,0 +1,139 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANISOTP_H
+#define CANISOTP_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+#include "canpacketfilter.h"
+
+/*!
+ * One ISO-TP message (ISO 15765-2) put together from its canpackets.
+ */
+struct canisotpmessage {
+  quint32 serial;             //!< Number of the message (counted from 0 since the last clear())
+  int interface;              //!< Interface the message was seen on
+  quint32 key;                //!< CAN ID of the data frames and the EFF bit (0x80000000)
+  quint32 flowkey;            //!< CAN ID of the flow control frames (canisotp::NoFlowKey = none seen)
+  quint32 length;             //!< Length announced by the sender
+  QByteArray payload;         //!< Reassembled payload (at most canisotp::MaxPayload bytes)
+  QVector<quint32> frames;    //!< Arrival numbers of the canpackets (at most canisotp::MaxFrames)
+  quint32 framecount;         //!< Number of canpackets, including those not in frames
+  struct timeval start;       //!< Time of the first canpacket
+  struct timeval end;         //!< Time of the last canpacket
+  int status;                 //!< canisotp::Status
+};
+
+/*!
+ * Streaming ISO-TP reassembler. Every canpacket of the capture is fed in
+ * arrival order; single frames give a message at once, first and
+ * consecutive frames are collected per session until the announced length
+ * is complete. A session belongs to one interface and the CAN ID of its data
+ * frames; the CAN ID answering with flow control frames is learnt from the
+ * first flow control frame that follows the first frame, so both directions
+ * of a request/response pair (e.g. 7E0/7E8) are tracked as two sessions.
+ *
+ * The sessions live in a table of Sessions entries that is allocated once,
+ * each with room for MaxPayload bytes and MaxFrames arrival numbers, so
+ * feeding a canpacket never allocates memory; only a completed message is
+ * copied out. Longer messages (first frame with the 32 bit length escape)
+ * are followed to their end but only the first MaxPayload bytes are kept.
+ * Only normal addressing is understood (the first data byte is the PCI).
+ */
+class canisotp {
+
+public:
+  enum {
+    MaxPayload = 4095,        /*!< Payload bytes kept per message (the 12 bit length of a first frame) */
+    MaxFrames = 1200,         /*!< Arrival numbers kept per message (FF + 585 CF + a flow control each) */
+    Sessions = 64,            /*!< Messages that can be in progress at the same time */
+    TimeoutMs = 1000,         /*!< N_Cr: a session without canpackets for longer has failed */
+    NoFlowKey = 0xFFFFFFFF    /*!< canisotpmessage::flowkey: no flow control seen */
+  };
+
+  //! How a message ended
+  enum Status {
+    Complete = 0,     //!< All announced bytes received
+    SequenceError,    //!< A consecutive frame with the wrong sequence number arrived
+    TimedOut,         //!< No consecutive frame for TimeoutMs
+    Interrupted,      //!< A new first or single frame replaced the message
+    Aborted           //!< The receiver answered with flow control "overflow"
+  };
+
+  //! Type of a canpacket (its PCI)
+  enum FrameType {
+    SingleFrame = 0,  //!< SF: a whole message
+    FirstFrame,       //!< FF: length and the first bytes
+    ConsecutiveFrame, //!< CF: the next bytes
+    FlowControl,      //!< FC: receiver tells the block size and separation time
+    NoFrame           //!< Not an ISO-TP canpacket
+  };
+
+  canisotp();                                     //!< Constructor, creates the session table
+
+  void clear();                                   //!< Forgets all sessions and restarts the message numbers
+  void setids(const canpacketfilter &newfilter);  //!< Sets the canpackets that carry ISO-TP
+  void feed(const canpacket &packet, quint32 arrival, QList<canisotpmessage> &done); //!< Feeds one canpacket
+
+  static FrameType frametype(const canpacket &packet); //!< Type of a canpacket by its PCI
+  static QString defaultids();                    //!< IDs carrying ISO-TP by default
+  static QString statusname(int status);          //!< Display name of a Status
+
+private:
+  /*!
+   * One message in progress (or a free entry of the table).
+   */
+  struct session {
+    bool active;              //!< In use
+    int interface;            //!< Interface
+    quint32 key;              //!< CAN ID of the data frames and the EFF bit
+    quint32 flowkey;          //!< CAN ID of the flow control frames (NoFlowKey = none seen)
+    quint32 length;           //!< Announced length
+    quint32 received;         //!< Payload bytes received
+    quint8 sequence;          //!< Sequence number expected in the next consecutive frame
+    quint32 framecount;       //!< canpackets so far
+    struct timeval start;     //!< Time of the first frame
+    struct timeval last;      //!< Time of the latest canpacket
+    quint32 frames[MaxFrames];        //!< Arrival numbers of the canpackets
+    unsigned char payload[MaxPayload]; //!< Payload received so far
+  };
+
+  QVector<session> sessions;      //!< Table of Sessions entries, allocated once
+  canpacketfilter filter;         //!< canpackets carrying ISO-TP
+  quint32 serial;                 //!< Number of the next message
+
+  session *find(int interface, quint32 key);      //!< Active session of a sender
+  session *allocate(QList<canisotpmessage> &done); //!< Free entry (ending the oldest session if needed)
+  void begin(session *entry, const canpacket &packet, quint32 key, quint32 length); //!< Starts a session
+  void addframe(session *entry, const canpacket &packet, quint32 arrival); //!< Records a canpacket of a session
+  void addpayload(session *entry, const unsigned char *data, int count); //!< Appends payload bytes
+  void finish(session *entry, int status, QList<canisotpmessage> &done); //!< Ends a session with a message
+
+  /*!
+   * Key of the CAN ID of a packet.
+   * @param packet The packet
+   * @return identifier and the EFF bit
+   */
+  static inline quint32 keyof(const canpacket &packet) {
+    return (packet.identifier & 0x1FFFFFFF) | (packet.ide ? 0x80000000 : 0);
+  }
+
+  /*!
+   * Microseconds between two times.
+   * @param from Earlier time
+   * @param to Later time
+   * @return microseconds (negative if to is earlier)
+   */
+  static inline qint64 elapsedus(const struct timeval &from, const struct timeval &to) {
+    return (qint64)(to.tv_sec - from.tv_sec) * 1000000 + to.tv_usec - from.tv_usec;
+  }
+};
+
+#endif // CANISOTP_H
@@ -0,0 +1,292 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canisotpmodel.h"
+#include "canpacketmodel.h"
+
+/*!
+ * Constructor, reassembles the packets already in the store.
+ * @param newstore Store holding the packets, shared with the other views
+ * @param parent Parent of the model
+ */
+canisotpmodel::canisotpmodel(QSharedPointer<canpacketstore> newstore, QObject *parent) :
+        QAbstractItemModel(parent), store(newstore) {
+  connect(store.data(), SIGNAL(appended(quint32)), this, SLOT(packetappended(quint32)));
+  connect(store.data(), SIGNAL(evicting(int)), this, SLOT(packetsevicting(int)));
+  connect(store.data(), SIGNAL(abouttoreload()), this, SLOT(storeabouttoreload()));
+  connect(store.data(), SIGNAL(reloaded()), this, SLOT(storereloaded()));
+  reassemble();
+}
+
+/*!
+ * Index of a cell. Message rows have the internal id 0, packet rows the
+ * serial number of their message + 1 (stable while older messages leave).
+ * @param row Row
+ * @param column Column
+ * @param parent Invisible root for a message, a message for a packet
+ * @return the index (invalid if there is no such cell)
+ */
+QModelIndex canisotpmodel::index(int row, int column, const QModelIndex &parent) const {
+  if (row < 0 || column < 0 || column >= ColumnCount || row >= rowCount(parent)) return QModelIndex();
+  if (!parent.isValid()) return createIndex(row, column, 0);
+  return createIndex(row, column, messages.at(parent.row()).serial + 1);
+}
+
+/*!
+ * Message row of a packet row.
+ * @param child Index of a row
+ * @return the message (invalid for a message row)
+ */
+QModelIndex canisotpmodel::parent(const QModelIndex &child) const {
+  if (!child.isValid() || !child.internalId()) return QModelIndex();
+  int row = rowofserial(child.internalId() - 1);
+  if (row < 0) return QModelIndex();
+  return createIndex(row, 0, 0);
+}
+
+/*!
+ * Number of messages, or number of packets of a message.
+ * @param parent Invisible root or a message
+ * @return number of rows
+ */
+int canisotpmodel::rowCount(const QModelIndex &parent) const {
+  if (!parent.isValid()) return messages.size();
+  if (parent.internalId() || parent.column() != 0 || parent.row() >= messages.size()) return 0;
+  return messages.at(parent.row()).frames.size();
+}
+
+/*!
+ * Number of columns.
+ * @param parent Not used; messages and packets have the same columns
+ * @return number of columns
+ */
+int canisotpmodel::columnCount(const QModelIndex &parent) const {
+  Q_UNUSED(parent);
+  return ColumnCount;
+}
+
+/*!
+ * Formats one cell.
+ * @param index Cell to be formatted
+ * @param role Qt::DisplayRole, Qt::ToolTipRole for the whole payload of a message
+ * @return display string of the cell
+ */
+QVariant canisotpmodel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::ToolTipRole)) return QVariant();
+
+  if (!index.internalId()) {
+    if (index.row() >= messages.size()) return QVariant();
+    const canisotpmessage &message = messages.at(index.row());
+    if (role == Qt::ToolTipRole) {
+      return index.column() == ColData ? payloadtext(message.payload, message.payload.size()) : QVariant();
+    }
+    switch (index.column()) {
+    case ColNumber: return message.frames.isEmpty() ? QString() : QString::number(message.frames.first());
+    case ColTimestamp: {
+      QDateTime timestamp = QDateTime::fromTime_t(message.start.tv_sec);
+      timestamp = timestamp.addMSecs(message.start.tv_usec / 1000);
+      return timestamp.toString(tr("dd.MM.yyyy hh:mm:ss.zzz"));
+    }
+    case ColID: return keytext(message.key);
+    case ColFlowID: return message.flowkey == (quint32)canisotp::NoFlowKey ? QString() : keytext(message.flowkey);
+    case ColLength: return QString::number(message.length);
+    case ColFrames: return QString::number(message.framecount);
+    case ColStatus: return canisotp::statusname(message.status);
+    case ColData: {
+      QString text = payloadtext(message.payload, PayloadShown);
+      if (message.length > (quint32)PayloadShown) text += " ...";
+      return text;
+    }
+    }
+    return QVariant();
+  }
+
+  // A packet of a message
+  if (role != Qt::DisplayRole) return QVariant();
+  int row = rowofserial(index.internalId() - 1);
+  if (row < 0 || index.row() >= messages.at(row).frames.size()) return QVariant();
+  quint32 arrival = messages.at(row).frames.at(index.row());
+  if (!store->isstored(arrival)) {
+    if (index.column() == ColNumber) return QString::number(arrival);
+    if (index.column() == ColData) return tr("(dropped from the ring)");
+    return QVariant();
+  }
+  const canpacket &packet = store->packetbyarrival(arrival);
+  switch (index.column()) {
+  case ColNumber: return canpacketmodel::celltext(packet, arrival, canpacketmodel::ColNumber);
+  case ColTimestamp: return canpacketmodel::celltext(packet, arrival, canpacketmodel::ColTimestamp);
+  case ColID: return canpacketmodel::celltext(packet, arrival, canpacketmodel::ColID);
+  case ColLength: return canpacketmodel::celltext(packet, arrival, canpacketmodel::ColDLC);
+  case ColStatus: {
+    switch (canisotp::frametype(packet)) {
+    case canisotp::SingleFrame: return tr("Single frame");
+    case canisotp::FirstFrame: return tr("First frame");
+    case canisotp::ConsecutiveFrame: return tr("Consecutive frame");
+    case canisotp::FlowControl: return tr("Flow control");
+    case canisotp::NoFrame: break;
+    }
+    return QVariant();
+  }
+  case ColData: return canpacketmodel::celltext(packet, arrival, canpacketmodel::ColData);
+  }
+  return QVariant();
+}
+
+/*!
+ * Header labels.
+ * @param section Column number
+ * @param orientation Only horizontal headers are provided
+ * @param role Only Qt::DisplayRole is provided
+ * @return Label of the column
+ */
+QVariant canisotpmodel::headerData(int section, Qt::Orientation orientation, int role) const {
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return QVariant();
+  switch (section) {
+  case ColNumber: return tr("#");
+  case ColTimestamp: return tr("Timestamp");
+  case ColID: return tr("CAN ID");
+  case ColFlowID: return tr("FC ID");
+  case ColLength: return tr("Length");
+  case ColFrames: return tr("Frames");
+  case ColStatus: return tr("Status");
+  case ColData: return tr("Data");
+  }
+  return QVariant();
+}
+
+/*!
+ * Sets the packets that carry ISO-TP; all stored packets are reassembled
+ * again.
+ * @param filter Packets to be reassembled (usually just IDs)
+ */
+void canisotpmodel::setids(const canpacketfilter &filter) {
+  beginResetModel();
+  messages.clear();
+  reassembler.setids(filter);
+  reassemble();
+  endResetModel();
+}
+
+/*!
+ * Arrival number of the packet of a row; for a message row that is its
+ * first packet.
+ * @param index Any cell of the row
+ * @param arrival Set to the arrival number
+ * @return false if the row has no packet
+ */
+bool canisotpmodel::arrivalat(const QModelIndex &index, quint32 *arrival) const {
+  if (!index.isValid()) return false;
+  if (!index.internalId()) {
+    if (index.row() >= messages.size() || messages.at(index.row()).frames.isEmpty()) return false;
+    *arrival = messages.at(index.row()).frames.first();
+    return true;
+  }
+  int row = rowofserial(index.internalId() - 1);
+  if (row < 0 || index.row() >= messages.at(row).frames.size()) return false;
+  *arrival = messages.at(row).frames.at(index.row());
+  return true;
+}
+
+/*!
+ * Called when the store has stored one packet; feeds it to the reassembler
+ * and adds the messages it ended.
+ * @param arrival Arrival number of the packet
+ */
+void canisotpmodel::packetappended(quint32 arrival) {
+  QList<canisotpmessage> done;
+  reassembler.feed(store->packetbyarrival(arrival), arrival, done);
+  if (done.isEmpty()) return;
+  beginInsertRows(QModelIndex(), messages.size(), messages.size() + done.size() - 1);
+  messages.append(done);
+  endInsertRows();
+}
+
+/*!
+ * Called when the store is about to drop its oldest packets from the ring.
+ * Messages whose first packet is dropped leave the model; they are ended in
+ * about the order they started, so only the oldest ones are checked.
+ * @param count Number of packets to be dropped
+ */
+void canisotpmodel::packetsevicting(int count) {
+  quint32 oldest = store->oldestarrival();
+  int remove = 0;
+  while (remove < messages.size()) {
+    const canisotpmessage &message = messages.at(remove);
+    if (!message.frames.isEmpty() && message.frames.first() - oldest >= (quint32)count) break;
+    remove++;
+  }
+  if (!remove) return;
+  beginRemoveRows(QModelIndex(), 0, remove - 1);
+  messages.erase(messages.begin(), messages.begin() + remove);
+  endRemoveRows();
+}
+
+/*!
+ * Called when the store is about to replace all packets.
+ */
+void canisotpmodel::storeabouttoreload() {
+  beginResetModel();
+  messages.clear();
+}
+
+/*!
+ * Called when the store has replaced all packets; they are reassembled again.
+ */
+void canisotpmodel::storereloaded() {
+  reassemble();
+  endResetModel();
+}
+
+/*!
+ * Forgets the sessions in progress and feeds all stored packets, without
+ * telling the views.
+ */
+void canisotpmodel::reassemble() {
+  reassembler.clear();
+  for (int i = 0; i < store->packetcount(); i++) {
+    reassembler.feed(store->packetat(i), store->oldestarrival() + i, messages);
+  }
+}
+
+/*!
+ * Row of a message by its serial number.
+ * @param serial Serial number of the message
+ * @return row (-1 if the message is gone)
+ */
+int canisotpmodel::rowofserial(quint32 serial) const {
+  if (messages.isEmpty()) return -1;
+  quint32 row = serial - messages.first().serial;
+  return row < (quint32)messages.size() ? (int)row : -1;
+}
+
+/*!
+ * CAN ID of a key as displayed.
+ * @param key Identifier and the EFF bit
+ * @return hex string (8 digits for extended IDs)
+ */
+QString canisotpmodel::keytext(quint32 key) {
+  bool extended = key & 0x80000000;
+  return QString("%1").arg(key & 0x1FFFFFFF, extended ? 8 : 3, 16, QChar('0')).toUpper();
+}
+
+/*!
+ * Payload bytes as hex string.
+ * @param payload The payload
+ * @param count Number of bytes to show at most
+ * @return hex bytes separated by spaces
+ */
+QString canisotpmodel::payloadtext(const QByteArray &payload, int count) {
+  QString text;
+  int shown = qMin(count, payload.size());
+  text.reserve(shown * 3);
+  for (int i = 0; i < shown; i++) {
+    if (i) text += ' ';
+    text += QString("%1").arg((unsigned char)payload.at(i), 2, 16, QChar('0')).toUpper();
+  }
+  return text;
+}
@@ -0,0 +1,75 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANISOTPMODEL_H
+#define CANISOTPMODEL_H
+
+#include <QtGui>
+
+#include "canisotp.h"
+#include "canpacketstore.h"
+
+/*!
+ * Tree model with one row per ISO-TP message reassembled from the packets
+ * of a canpacketstore; the children of a message are its packets (by arrival
+ * number, read from the store). The reassembler follows the store like the
+ * other views: every appended packet is fed once, and the messages are
+ * rebuilt when the store is reloaded. A message leaves the model when the
+ * ring drops its first packet.
+ */
+class canisotpmodel: public QAbstractItemModel {
+Q_OBJECT
+
+public:
+  //! Columns of the model
+  enum Column {
+    ColNumber = 0,    //!< Arrival number of the (first) packet
+    ColTimestamp,     //!< Timestamp of the (first) packet
+    ColID,            //!< CAN ID of the data frames
+    ColFlowID,        //!< CAN ID of the flow control frames
+    ColLength,        //!< Message length (DLC for a packet)
+    ColFrames,        //!< Number of packets
+    ColStatus,        //!< How the message ended (frame type for a packet)
+    ColData,          //!< Payload
+    ColumnCount       //!< Number of columns
+  };
+
+  explicit canisotpmodel(QSharedPointer<canpacketstore> newstore, QObject *parent = 0); //!< Constructor, reassembles the packets of the store
+
+  QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const; //!< Index of a cell
+  QModelIndex parent(const QModelIndex &child) const;               //!< Message row of a packet row
+  int rowCount(const QModelIndex &parent = QModelIndex()) const;    //!< Number of messages or packets of a message
+  int columnCount(const QModelIndex &parent = QModelIndex()) const; //!< Number of columns
+  QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;  //!< Formats one cell
+  QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const; //!< Header labels
+
+  void setids(const canpacketfilter &filter);     //!< Sets the packets that carry ISO-TP and reassembles again
+  bool arrivalat(const QModelIndex &index, quint32 *arrival) const; //!< Arrival number of the packet of a row
+
+private slots:
+  void packetappended(quint32 arrival);           //!< The store has stored one packet
+  void packetsevicting(int count);                //!< The store is about to drop its oldest packets
+  void storeabouttoreload();                      //!< The store is about to replace all packets
+  void storereloaded();                           //!< The store has replaced all packets
+
+private:
+  enum {
+    PayloadShown = 64         /*!< Payload bytes displayed (the tooltip shows all) */
+  };
+
+  QSharedPointer<canpacketstore> store; //!< Store holding the packets, shared with the other views
+  canisotp reassembler;           //!< Sessions in progress
+  QList<canisotpmessage> messages; //!< Ended messages, oldest first (serial numbers without gaps)
+
+  void reassemble();              //!< Feeds all stored packets without telling the views
+  int rowofserial(quint32 serial) const;          //!< Row of a message by its serial number
+  static QString keytext(quint32 key);            //!< CAN ID of a key as displayed
+  static QString payloadtext(const QByteArray &payload, int count); //!< Payload bytes as hex string
+};
+
+#endif // CANISOTPMODEL_H
@@ -0,0 +1,402 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canjournal.h"
+#include "canlogblock.h"
+
+#include <iostream>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <QDesktopServices>
+
+using namespace std;
+
+/*!
+ * Constructor, the thread still has to be started.
+ * @param parent Parent object
+ */
+canjournalsyncer::canjournalsyncer(QObject *parent) :
+        QThread(parent) {
+  failures = 0;
+  stopping = false;
+}
+
+/*!
+ * Destructor, stops the thread after the syncs asked for.
+ */
+canjournalsyncer::~canjournalsyncer() {
+  stop();
+}
+
+/*!
+ * Asks for a sync of a file. A sync of the same segment that has not begun
+ * yet covers everything written up to now as well, so it is not repeated.
+ * @param fd File descriptor (duplicated, the file may be closed right after)
+ * @param segment Number of the journal file (see canjournal)
+ */
+void canjournalsyncer::request(int fd, quint64 segment) {
+  QMutexLocker locker(&lock);
+  if (segments.contains(segment)) return;
+  int copy = dup(fd);
+  if (copy < 0) {
+    failures++;
+    return;
+  }
+  pending.append(copy);
+  segments.append(segment);
+  wake.wakeOne();
+}
+
+/*!
+ * Syncs that failed since the last call.
+ * @return number of failed syncs
+ */
+int canjournalsyncer::takefailures() {
+  QMutexLocker locker(&lock);
+  int failed = failures;
+  failures = 0;
+  return failed;
+}
+
+/*!
+ * Stops the thread after the syncs asked for and waits for it.
+ */
+void canjournalsyncer::stop() {
+  lock.lock();
+  stopping = true;
+  wake.wakeAll();
+  lock.unlock();
+  wait();
+}
+
+/*!
+ * Syncs the files asked for, oldest request first.
+ */
+void canjournalsyncer::run() {
+  forever {
+    lock.lock();
+    while (pending.isEmpty() && !stopping) wake.wait(&lock);
+    if (pending.isEmpty()) {
+      lock.unlock();
+      return;
+    }
+    int fd = pending.takeFirst();
+    segments.removeFirst();
+    lock.unlock();
+
+    bool ok = fdatasync(fd) == 0;
+    close(fd);
+    if (!ok) {
+      lock.lock();
+      failures++;
+      lock.unlock();
+    }
+  }
+}
+
+/*!
+ * Constructor, creates an inactive journal.
+ * @param parent Parent object
+ */
+canjournal::canjournal(QObject *parent) :
+        QObject(parent) {
+  writer = 0;
+  packets = 0;
+  dirty = false;
+  rotation = 0;
+  segmentpackets = 0;
+  segment = 0;
+  rotated = false;
+  synctimer = new QTimer(this);
+  connect(synctimer, SIGNAL(timeout()), this, SLOT(sync()));
+  syncer = new canjournalsyncer(this);
+  syncer->start();
+}
+
+/*!
+ * Destructor, syncs and closes the journal. The file is kept; use
+ * stop(true) to remove it.
+ */
+canjournal::~canjournal() {
+  stop(false);
+  syncer->stop();
+}
+
+/*!
+ * Starts an empty journal in the file (an existing file is overwritten).
+ * @param fileName Name of the journal file
+ * @return success of the operation
+ */
+bool canjournal::start(const QString &fileName) {
+  stop(false);
+  QDir().mkpath(QFileInfo(fileName).absolutePath());
+  QFile::remove(oldsegment(fileName));
+  rotated = false;
+  packets = 0;
+  if (!open(fileName)) return false;
+  synctimer->start(SyncInterval);
+  return true;
+}
+
+/*!
+ * Opens an empty journal file (an existing file is overwritten) and writes
+ * its header.
+ * @param fileName Name of the journal file
+ * @return success of the operation; on failure the file is removed
+ */
+bool canjournal::open(const QString &fileName) {
+  file.setFileName(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    cerr << "Cannot open journal " << fileName.toLocal8Bit().constData() << ": "
+         << file.errorString().toLocal8Bit().constData() << endl;
+    return false;
+  }
+  writer = new canblockwriter(&file, true);
+  segment++;
+  segmentpackets = 0;
+  dirty = true;
+  if (!writer->begin() || !sync()) {
+    delete writer;
+    writer = 0;
+    file.close();
+    file.remove();
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * Makes the current file the older segment, replacing the one before, and
+ * starts a new file. The older segment is still synced by the syncer.
+ * @return success of the operation; on failure the journal stops
+ */
+bool canjournal::rotate() {
+  QString name = file.fileName();
+  QString older = oldsegment(name);
+  bool ok = writer->flush() && file.flush();
+  if (ok) syncer->request(file.handle(), segment);
+  delete writer;
+  writer = 0;
+  file.close();
+
+  if (ok) {
+    QFile::remove(older);
+    ok = rename(QFile::encodeName(name).constData(), QFile::encodeName(older).constData()) == 0;
+  }
+  if (!ok || !open(name)) {
+    cerr << "Cannot rotate journal " << name.toLocal8Bit().constData() << "; journaling stopped" << endl;
+    synctimer->stop();
+    return false;
+  }
+  rotated = true;
+  return true;
+}
+
+/*!
+ * Empties the journal (e.g. when the canlogfile has been cleared).
+ * @return success of the operation (false if the journal is inactive)
+ */
+bool canjournal::restart() {
+  if (!writer) return false;
+  return start(file.fileName());
+}
+
+/*!
+ * Closes the journal.
+ * @param remove Whether the file shall be removed as well
+ */
+void canjournal::stop(bool remove) {
+  synctimer->stop();
+  if (!writer) return;
+  sync();
+  delete writer;
+  writer = 0;
+  file.close();
+  if (remove) {
+    file.remove();
+    QFile::remove(oldsegment(file.fileName()));
+  }
+}
+
+/*!
+ * Whether canpackets are journaled.
+ * @return true if the journal has been started
+ */
+bool canjournal::isactive() const {
+  return writer;
+}
+
+/*!
+ * canpackets journaled since the start.
+ * @return number of canpackets
+ */
+quint64 canjournal::count() const {
+  return packets;
+}
+
+/*!
+ * Journals one canpacket. It reaches the disk with the next full block or
+ * sync(), whatever comes first.
+ * @param packet The canpacket
+ * @return success of the operation; on a write error the journal stops
+ */
+bool canjournal::append(const canpacket &packet) {
+  if (!writer) return false;
+  if (rotation && segmentpackets >= rotation && !rotate()) return false;
+  if (!writer->append(packet)) {
+    cerr << "Cannot write journal " << file.fileName().toLocal8Bit().constData() << "; journaling stopped" << endl;
+    stop(false);
+    return false;
+  }
+  packets++;
+  segmentpackets++;
+  dirty = true;
+  return true;
+}
+
+/*!
+ * Writes the pending canpackets as a short block and has the syncer sync
+ * the journal to the disk. Called every SyncInterval. Failed syncs are
+ * reported with the next call.
+ * @return success of the operation
+ */
+bool canjournal::sync() {
+  if (!writer || !dirty) return writer;
+  if (!writer->flush() || !file.flush()) {
+    cerr << "Cannot write journal " << file.fileName().toLocal8Bit().constData() << endl;
+    return false;
+  }
+  syncer->request(file.handle(), segment);
+  dirty = false;
+  if (syncer->takefailures()) cerr << "Cannot sync journal " << file.fileName().toLocal8Bit().constData() << endl;
+  return true;
+}
+
+/*!
+ * Bounds the journal: once the current file holds this many canpackets, it
+ * becomes the older segment and a new file is started. With the number of
+ * canpackets a ring holds at most, the two segments always hold all of
+ * them, and the journal never exceeds about twice the ring.
+ * @param packets canpackets per segment (0 = unbounded)
+ */
+void canjournal::setrotation(quint64 packets) {
+  rotation = packets;
+}
+
+/*!
+ * Writes the journal as a finished file: the blocks are copied and the
+ * index is appended. The copy is written next to the target and renamed
+ * when it is complete, so a crash never leaves a half written file behind.
+ * The journal goes on.
+ * @param fileName Name of the file to be written
+ * @return success of the operation (false as well once the journal has
+ *         been rotated, as the current file then lacks the older canpackets)
+ */
+bool canjournal::saveas(const QString &fileName) {
+  if (rotated || !sync()) return false;
+
+  QString partName = fileName + ".part";
+  QFile source(file.fileName());
+  QFile target(partName);
+  if (!source.open(QIODevice::ReadOnly) || !target.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+  qint64 remaining = file.size();
+  bool ok = true;
+  while (ok && remaining > 0) {
+    QByteArray chunk = source.read(qMin(remaining, (qint64)(1 << 20)));
+    ok = !chunk.isEmpty() && target.write(chunk) == chunk.size();
+    remaining -= chunk.size();
+  }
+  ok = ok && writer->writeindex(&target) && target.flush() && fdatasync(target.handle()) == 0;
+  target.close();
+  if (!ok || rename(QFile::encodeName(partName).constData(), QFile::encodeName(fileName).constData()) < 0) {
+    QFile::remove(partName);
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * Directory of the journals.
+ * @return absolute path
+ */
+QString canjournal::directory() {
+  QString data = QDesktopServices::storageLocation(QDesktopServices::DataLocation);
+  if (data.isEmpty()) data = QDir::home().absoluteFilePath(".socketcangui");
+  return QDir(data).absoluteFilePath("journal");
+}
+
+/*!
+ * Journal of this process.
+ * @return absolute file name
+ */
+QString canjournal::journalname() {
+  return QDir(directory()).absoluteFilePath(QString("journal-%1.clf").arg(getpid()));
+}
+
+/*!
+ * Journals left behind by processes no longer running, i.e. after a crash.
+ * The segments of a rotated journal are joined into one file first.
+ * @return absolute file names
+ */
+QStringList canjournal::orphans() {
+  QStringList result;
+  QDir dir(directory());
+  foreach (const QString &name, dir.entryList(QStringList() << "journal-*.clf", QDir::Files, QDir::Time)) {
+    bool older = name.endsWith(".old.clf");
+    QString newer = older ? name.left(name.length() - 8) + ".clf" : name;
+    bool ok;
+    int pid = newer.mid(8, newer.length() - 12).toInt(&ok);
+    if (!ok || pid == getpid()) continue;
+    if (kill(pid, 0) == 0 || errno == EPERM) continue;
+
+    QString path = dir.absoluteFilePath(newer);
+    if (older) {
+      // The newer segment goes behind the older one, which takes its name
+      QString olderpath = dir.absoluteFilePath(name);
+      if (QFile::exists(path) && !join(olderpath, path)) continue;
+      if (rename(QFile::encodeName(olderpath).constData(), QFile::encodeName(path).constData()) < 0) continue;
+    }
+    if (!result.contains(path)) result.append(path);
+  }
+  return result;
+}
+
+/*!
+ * Name of the older segment of a journal (see setrotation()).
+ * @param fileName Name of the journal file (ending in .clf)
+ * @return absolute file name
+ */
+QString canjournal::oldsegment(const QString &fileName) {
+  return fileName.left(fileName.length() - 4) + ".old.clf";
+}
+
+/*!
+ * Appends the blocks of a segment to the older segment. Both are block
+ * files without index, so the result is read like a single journal.
+ * @param older Name of the older segment, extended
+ * @param newer Name of the newer segment, kept
+ * @return success of the operation
+ */
+bool canjournal::join(const QString &older, const QString &newer) {
+  QFile source(newer);
+  QFile target(older);
+  if (!source.open(QIODevice::ReadOnly) || !target.open(QIODevice::WriteOnly | QIODevice::Append)) return false;
+  if (!source.seek(canblockcodec::HeaderSize)) return false;
+
+  bool ok = true;
+  while (ok && !source.atEnd()) {
+    QByteArray chunk = source.read(1 << 20);
+    ok = !chunk.isEmpty() && target.write(chunk) == chunk.size();
+  }
+  return ok && target.flush() && fdatasync(target.handle()) == 0;
+}
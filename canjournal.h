@@ -0,0 +1,104 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANJOURNAL_H
+#define CANJOURNAL_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+
+class canblockwriter;
+
+/*!
+ * Thread syncing journal files to the disk, so fdatasync() never blocks
+ * the GUI thread while the disk is busy. Every request works on its own
+ * duplicate of the file descriptor, so the journal may close or rotate the
+ * file meanwhile.
+ */
+class canjournalsyncer: public QThread {
+Q_OBJECT
+
+public:
+  explicit canjournalsyncer(QObject *parent = 0); //!< Constructor, the thread still has to be started
+  ~canjournalsyncer();                    //!< Destructor, stops the thread after the syncs asked for
+  void request(int fd, quint64 segment);  //!< Asks for a sync of a file
+  int takefailures();                     //!< Syncs that failed since the last call
+  void stop();                            //!< Stops the thread after the syncs asked for
+
+protected:
+  void run();                             //!< Syncs the files asked for
+
+private:
+  QMutex lock;                            //!< Protects everything below
+  QWaitCondition wake;                    //!< Signalled when a sync is asked for or the thread has to stop
+  QList<int> pending;                     //!< Duplicated descriptors still to be synced
+  QList<quint64> segments;                //!< Segment of each pending descriptor
+  int failures;                           //!< Syncs that failed since the last takefailures()
+  bool stopping;                          //!< The thread has to stop
+};
+
+/*!
+ * Append-only journal of the canpackets of a canlogfile, so a capture
+ * survives a crash or a power loss.
+ * The journal is a block encoded file (see canblockcodec) without index:
+ * full blocks are written as they fill up and every SyncInterval the
+ * pending canpackets are written as a short block and synced to the disk
+ * by a canjournalsyncer. After a crash it is read like any truncated block
+ * file, up to the last block whose CRC is intact. Saving copies the journal
+ * and appends the index, no canpacket is encoded again.
+ *
+ * With a ring (see setrotation()) the journal is bounded: when the file
+ * holds as many canpackets as the ring, it is renamed to the older segment
+ * (replacing the one before) and a new file is started. The two segments
+ * always hold every canpacket of the ring; after a crash orphans() joins
+ * them into one file.
+ */
+class canjournal: public QObject {
+Q_OBJECT
+
+public:
+  explicit canjournal(QObject *parent = 0); //!< Constructor, creates an inactive journal
+  ~canjournal();                          //!< Destructor, closes (but keeps) the journal
+  bool start(const QString &fileName);    //!< Starts an empty journal in the file
+  bool restart();                         //!< Empties the journal
+  void stop(bool remove);                 //!< Closes the journal
+  bool isactive() const;                  //!< Whether canpackets are journaled
+  quint64 count() const;                  //!< canpackets journaled since the start
+  bool append(const canpacket &packet);   //!< Journals one canpacket
+  bool saveas(const QString &fileName);   //!< Writes the journal as a finished file
+  void setrotation(quint64 packets);      //!< Bounds the journal to about twice this many canpackets
+
+  static QString directory();             //!< Directory of the journals
+  static QString journalname();           //!< Journal of this process
+  static QStringList orphans();           //!< Journals left behind by processes no longer running
+  static QString oldsegment(const QString &fileName); //!< Name of the older segment of a journal
+
+  enum {SyncInterval = 1000 /*!< milliseconds between two syncs */ };
+
+public slots:
+  bool sync();                            //!< Writes the pending canpackets and syncs them to the disk
+
+private:
+  QFile file;                             //!< The journal file
+  canblockwriter *writer;                 //!< Encodes the canpackets (0 = inactive)
+  quint64 packets;                        //!< canpackets journaled since the start
+  bool dirty;                             //!< Written since the last sync
+  QTimer *synctimer;                      //!< Calls sync()
+  canjournalsyncer *syncer;               //!< Syncs the file off the GUI thread
+  quint64 rotation;                       //!< canpackets per segment (0 = never rotated)
+  quint64 segmentpackets;                 //!< canpackets in the current file
+  quint64 segment;                        //!< Number of the current file, counted since the construction
+  bool rotated;                           //!< The older segment holds canpackets of this journal
+
+  bool open(const QString &fileName);     //!< Opens an empty file and writes its header
+  bool rotate();                          //!< Makes the current file the older segment and starts a new one
+  static bool join(const QString &older, const QString &newer); //!< Appends the blocks of a segment to the older one
+};
+
+#endif // CANJOURNAL_H
@@ -0,0 +1,138 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canlatency.h"
+
+/*!
+ * Constructor, creates an empty histogram.
+ */
+canhistogram::canhistogram() {
+  max = 0;
+}
+
+/*!
+ * Sets all counters to 0. Values recorded at the same time may get lost.
+ */
+void canhistogram::reset() {
+  for (int i = 0; i < Buckets; i++) counts[i] = 0;
+  max = 0;
+}
+
+/*!
+ * Copy of the counters for evaluation.
+ * @return count per bucket
+ */
+QVector<quint64> canhistogram::snapshot() const {
+  QVector<quint64> copy(Buckets);
+  for (int i = 0; i < Buckets; i++) copy[i] = (quint32)(int)counts[i];
+  return copy;
+}
+
+/*!
+ * Smallest value of a bucket.
+ * @param bucket Bucket number
+ * @return value in nanoseconds
+ */
+qint64 canhistogram::bucketvalue(int bucket) {
+  int shift = (bucket >> SubBits) - 1;
+  if (shift <= 0) return bucket;
+  return (qint64)((1 << SubBits) + (bucket & ((1 << SubBits) - 1))) << shift;
+}
+
+/*!
+ * Percentile of a snapshot.
+ * @param counts Snapshot of the counters
+ * @param fraction 0.5 for the median, 0.99 for the 99th percentile
+ * @return smallest value of the bucket holding the percentile (-1 if empty)
+ */
+qint64 canhistogram::percentile(const QVector<quint64> &counts, double fraction) {
+  quint64 total = 0;
+  for (int i = 0; i < counts.size(); i++) total += counts.at(i);
+  if (!total) return -1;
+
+  quint64 wanted = qMax((quint64)1, (quint64)(fraction * total + 0.5));
+  quint64 seen = 0;
+  for (int i = 0; i < counts.size(); i++) {
+    seen += counts.at(i);
+    if (seen >= wanted) return bucketvalue(i);
+  }
+  return bucketvalue(counts.size() - 1);
+}
+
+/*!
+ * Largest value recorded.
+ * @return value in nanoseconds
+ */
+qint64 canhistogram::maximum() const {
+  return max;
+}
+
+/*!
+ * Constructor, creates empty histograms.
+ */
+canlatency::canlatency() {
+}
+
+/*!
+ * Histogram of a stage.
+ * @param number Stage (see Stage)
+ * @return the histogram
+ */
+canhistogram &canlatency::stage(int number) {
+  return stages[number];
+}
+
+/*!
+ * Empties all histograms.
+ */
+void canlatency::reset() {
+  for (int i = 0; i < StageCount; i++) stages[i].reset();
+}
+
+/*!
+ * Writes all histograms to a text file: per stage a header line and one
+ * line "<bucket value ns> <count> <cumulative fraction>" per used bucket.
+ * @param fileName Name of the file
+ * @return success of the operation
+ */
+bool canlatency::dump(const QString &fileName) const {
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+  QTextStream out(&file);
+
+  for (int s = 0; s < StageCount; s++) {
+    QVector<quint64> counts = stages[s].snapshot();
+    quint64 total = 0;
+    for (int i = 0; i < counts.size(); i++) total += counts.at(i);
+    out << "# " << stagename(s) << ": " << total << " values, max " << stages[s].maximum() << " ns\n";
+    quint64 seen = 0;
+    for (int i = 0; i < counts.size(); i++) {
+      if (!counts.at(i)) continue;
+      seen += counts.at(i);
+      out << canhistogram::bucketvalue(i) << " " << counts.at(i) << " " << (double)seen / total << "\n";
+    }
+    out << "\n";
+  }
+  return out.status() == QTextStream::Ok;
+}
+
+/*!
+ * Description of a stage.
+ * @param number Stage (see Stage)
+ * @return description
+ */
+QString canlatency::stagename(int number) {
+  switch (number) {
+  case KernelToRecv: return "kernel -> recvmsg";
+  case RecvToEmit: return "recvmsg -> handover";
+  case Queue: return "queue";
+  case Model: return "model insert";
+  case Paint: return "model -> paint";
+  }
+  return QString();
+}
@@ -0,0 +1,103 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANLATENCY_H
+#define CANLATENCY_H
+
+#include <QtCore>
+
+#include <time.h>
+
+/*!
+ * Log-linear latency histogram (HDR style): 16 buckets per power of two, so
+ * every value is kept with a precision of about 6 % from 1 ns to centuries.
+ * Recording is one bucket computation and one increment, without locks.
+ * Every histogram has exactly one writing thread; other threads only read
+ * the counters (a reader may see a frame counted a bit late).
+ */
+class canhistogram {
+
+public:
+  enum {
+    SubBits = 4,                          /*!< 2^SubBits buckets per power of two */
+    Buckets = (64 - SubBits + 1) << SubBits /*!< number of buckets for 64 bit values */
+  };
+
+  canhistogram();                         //!< Constructor, creates an empty histogram
+  void reset();                           //!< Sets all counters to 0
+  QVector<quint64> snapshot() const;      //!< Copy of the counters
+  static qint64 bucketvalue(int bucket);  //!< Smallest value of a bucket
+  static qint64 percentile(const QVector<quint64> &counts, double fraction); //!< Percentile of a snapshot
+  qint64 maximum() const;                 //!< Largest value recorded
+
+  /*!
+   * Bucket of a value: the values below 2 * 2^SubBits have a bucket each,
+   * above that the top SubBits bits below the MSB select the bucket.
+   * @param value Value (negative values count as 0)
+   * @return bucket number
+   */
+  static inline int bucketof(qint64 value) {
+    if (value < (2 << SubBits)) return value < 0 ? 0 : (int)value;
+    int shift = 63 - __builtin_clzll(value) - SubBits;
+    return ((shift + 1) << SubBits) + (int)((value >> shift) & ((1 << SubBits) - 1));
+  }
+
+  /*!
+   * Records one value. Must only be called by the writing thread.
+   * @param value Latency in nanoseconds
+   */
+  inline void record(qint64 value) {
+    QAtomicInt &counter = counts[bucketof(value)];
+    counter = counter + 1;
+    if (value > max) max = value;
+  }
+
+private:
+  QAtomicInt counts[Buckets];             //!< Values per bucket
+  volatile qint64 max;                    //!< Largest value recorded
+};
+
+/*!
+ * Latency of every stage a frame passes from the kernel to the screen.
+ * All times are CLOCK_REALTIME in nanoseconds because the kernel timestamps
+ * of the frames use that clock.
+ */
+class canlatency {
+
+public:
+  //! Stages of the capture path
+  enum Stage {
+    KernelToRecv = 0,   //!< Kernel timestamp to recvmsg() returned (capture thread)
+    RecvToEmit,         //!< recvmsg() returned to handed over to the main thread (capture thread)
+    Queue,              //!< Handed over to taken by the canlogfile (queued signal)
+    Model,              //!< Inserting into the model (main thread)
+    Paint,              //!< Oldest unpainted frame to painted (main thread, once per paint)
+    StageCount          //!< Number of stages
+  };
+
+  canlatency();                           //!< Constructor, creates empty histograms
+  canhistogram &stage(int number);        //!< Histogram of a stage
+  void reset();                           //!< Empties all histograms
+  bool dump(const QString &fileName) const;  //!< Writes all histograms to a text file
+  static QString stagename(int number);   //!< Description of a stage
+
+  /*!
+   * Current time.
+   * @return CLOCK_REALTIME in nanoseconds
+   */
+  static inline qint64 now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (qint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  }
+
+private:
+  canhistogram stages[StageCount];        //!< Histogram per stage
+};
+
+#endif // CANLATENCY_H
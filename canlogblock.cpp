@@ -0,0 +1,617 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canlogblock.h"
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+/*!
+ * Writes an unsigned varint (7 bits per byte, low bits first).
+ * @param out Write position, advanced
+ * @param value Value to be written
+ */
+static inline void putvarint(char *&out, quint64 value) {
+  while (value >= 0x80) {
+    *out++ = (char)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (char)value;
+}
+
+/*!
+ * Reads an unsigned varint.
+ * @param in Read position, advanced
+ * @param end End of the data
+ * @param value Receives the value
+ * @return false if the data ends within the varint
+ */
+static inline bool getvarint(const char *&in, const char *end, quint64 &value) {
+  value = 0;
+  for (int shift = 0; in < end && shift < 64; shift += 7) {
+    quint8 byte = *in++;
+    value |= (quint64)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+/*!
+ * Maps signed to unsigned values so small negative values stay small.
+ * @param value Signed value
+ * @return zigzag coded value
+ */
+static inline quint64 zigzag(qint64 value) {
+  return ((quint64)value << 1) ^ (quint64)(value >> 63);
+}
+
+/*!
+ * Reverses zigzag().
+ * @param value zigzag coded value
+ * @return signed value
+ */
+static inline qint64 unzigzag(quint64 value) {
+  return (qint64)(value >> 1) ^ -(qint64)(value & 1);
+}
+
+/*!
+ * Dictionary key of a canpacket: the ID and the flags telling IDs apart.
+ * @param packet The canpacket
+ * @return key
+ */
+static inline quint64 keyof(const canpacket &packet) {
+  return ((quint64)packet.identifier << 3) | (packet.ide ? 4 : 0) | (packet.rtr ? 2 : 0) | (packet.err ? 1 : 0);
+}
+
+/*!
+ * Encodes canpackets (see the class description for the format).
+ * @param packets The canpackets
+ * @param count Number of canpackets
+ * @param firststamp Timestamp the first delta refers to
+ * @return raw bytes of the block
+ */
+QByteArray canblockcodec::encode(const canpacket *packets, int count, qint64 firststamp) {
+  QHash<quint64, int> dictionary;
+  QVector<quint64> keys;
+  QVector<int> numbers(count);
+  for (int i = 0; i < count; i++) {
+    quint64 key = keyof(packets[i]);
+    QHash<quint64, int>::const_iterator it = dictionary.constFind(key);
+    if (it == dictionary.constEnd()) {
+      it = dictionary.insert(key, keys.size());
+      keys.append(key);
+    }
+    numbers[i] = it.value();
+  }
+
+  // Worst case: 10 bytes per varint, 2 + 10 + 2 + 10 + 9 bytes per canpacket
+  QByteArray raw;
+  raw.resize(10 + keys.size() * 10 + count * 43);
+  char *out = raw.data();
+  putvarint(out, keys.size());
+  for (int k = 0; k < keys.size(); k++) putvarint(out, keys.at(k));
+
+  QVector<int> previous(keys.size(), -1);
+  qint64 stamp = firststamp;
+  int interface = 0;
+  for (int i = 0; i < count; i++) {
+    const canpacket &packet = packets[i];
+    int number = numbers.at(i);
+    int last = previous.at(number);
+    int length = qMin((int)packet.dlc, 8);
+    bool delta = last >= 0 && packets[last].dlc == packet.dlc;
+    quint8 extra = (packet.interface != interface ? 0x01 : 0) | (packet.crc ? 0x02 : 0) | (packet.marker ? 0x04 : 0);
+
+    putvarint(out, number);
+    *out++ = (char)((packet.dlc & 0x0F) | (packet.direction ? 0x10 : 0) | (packet.bookmark ? 0x20 : 0)
+                    | (delta ? 0x40 : 0) | (extra ? 0x80 : 0));
+    if (extra) {
+      *out++ = (char)extra;
+      if (extra & 0x01) putvarint(out, zigzag(packet.interface));
+      if (extra & 0x02) {
+        *out++ = (char)(packet.crc >> 8);
+        *out++ = (char)packet.crc;
+      }
+      interface = packet.interface;
+    }
+    qint64 current = stampof(packet);
+    putvarint(out, zigzag(current - stamp));
+    stamp = current;
+
+    if (delta) {
+      const unsigned char *before = packets[last].data;
+      quint8 mask = 0;
+      for (int b = 0; b < length; b++) {
+        if (packet.data[b] != before[b]) mask |= 1 << b;
+      }
+      *out++ = (char)mask;
+      for (int b = 0; b < length; b++) {
+        if (mask & (1 << b)) *out++ = (char)packet.data[b];
+      }
+    } else {
+      memcpy(out, packet.data, length);
+      out += length;
+    }
+    previous[number] = i;
+  }
+  raw.resize(out - raw.constData());
+  return raw;
+}
+
+/*!
+ * Decodes canpackets (see the class description for the format).
+ * @param raw Raw bytes of the block
+ * @param count Number of canpackets in the block
+ * @param firststamp Timestamp the first delta refers to
+ * @param packets The canpackets are appended here
+ * @return false if the bytes are damaged
+ */
+bool canblockcodec::decode(const QByteArray &raw, int count, qint64 firststamp, QVector<canpacket> *packets) {
+  const char *in = raw.constData();
+  const char *end = in + raw.size();
+  quint64 value;
+
+  if (!getvarint(in, end, value) || value > (quint64)count) return false;
+  QVector<quint64> keys(value);
+  for (int k = 0; k < keys.size(); k++) {
+    if (!getvarint(in, end, keys[k])) return false;
+  }
+
+  QVector<int> previous(keys.size(), -1);
+  int base = packets->size();
+  packets->resize(base + count);
+  canpacket *out = packets->data() + base;
+  bzero(out, count * sizeof(canpacket));
+  qint64 stamp = firststamp;
+  int interface = 0;
+  for (int i = 0; i < count; i++) {
+    canpacket &packet = out[i];
+    if (!getvarint(in, end, value) || value >= (quint64)keys.size() || in >= end) return false;
+    int number = value;
+    quint64 key = keys.at(number);
+    packet.identifier = key >> 3;
+    packet.ide = key & 4;
+    packet.rtr = key & 2;
+    packet.err = key & 1;
+
+    quint8 flags = *in++;
+    packet.dlc = flags & 0x0F;
+    packet.direction = flags & 0x10;
+    packet.bookmark = flags & 0x20;
+    if (flags & 0x80) {
+      if (in >= end) return false;
+      quint8 extra = *in++;
+      if (extra & 0x01) {
+        if (!getvarint(in, end, value)) return false;
+        interface = unzigzag(value);
+      }
+      if (extra & 0x02) {
+        if (end - in < 2) return false;
+        packet.crc = ((quint8)in[0] << 8) | (quint8)in[1];
+        in += 2;
+      }
+      packet.marker = extra & 0x04;
+    }
+    packet.interface = interface;
+    if (!getvarint(in, end, value)) return false;
+    stamp += unzigzag(value);
+    packet.tv.tv_sec = stamp / 1000000;
+    packet.tv.tv_usec = stamp % 1000000;
+    if (packet.tv.tv_usec < 0) {
+      packet.tv.tv_sec--;
+      packet.tv.tv_usec += 1000000;
+    }
+
+    int length = qMin((int)packet.dlc, 8);
+    if (flags & 0x40) {
+      int last = previous.at(number);
+      if (last < 0 || in >= end) return false;
+      memcpy(packet.data, out[last].data, 8);
+      quint8 mask = *in++;
+      for (int b = 0; b < length; b++) {
+        if (!(mask & (1 << b))) continue;
+        if (in >= end) return false;
+        packet.data[b] = *in++;
+      }
+    } else {
+      if (end - in < length) return false;
+      memcpy(packet.data, in, length);
+      in += length;
+    }
+    previous[number] = i;
+  }
+  return in == end;
+}
+
+/*!
+ * Whether the sizes in a block header stay within what the writer
+ * produces, so a damaged file cannot make the reader allocate gigabytes.
+ * A block is stored compressed only if that is smaller.
+ * @param count Number of canpackets
+ * @param rawsize Bytes of the encoded block
+ * @param storedsize Bytes of the block as stored
+ * @return false if the header is damaged
+ */
+bool canblockcodec::plausible(quint32 count, quint32 rawsize, quint32 storedsize) {
+  return count <= BlockPackets && rawsize <= BlockRawSize && storedsize <= rawsize;
+}
+
+/*!
+ * Whether LZ4 has been compiled in (qmake CONFIG+=lz4).
+ * @return true if blocks can be compressed and decompressed
+ */
+bool canblockcodec::compressionavailable() {
+#ifdef HAVE_LZ4
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*!
+ * CRC-32 with the polynomial of zlib and Ethernet.
+ * @param data Bytes to be checked
+ * @param size Number of bytes
+ * @param crc CRC of the bytes before (to check in pieces)
+ * @return CRC of all bytes so far
+ */
+quint32 canblockcodec::crc32(const char *data, int size, quint32 crc) {
+  static quint32 table[256];
+  static bool initialised = false;
+  if (!initialised) {
+    for (quint32 i = 0; i < 256; i++) {
+      quint32 value = i;
+      for (int bit = 0; bit < 8; bit++) value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+      table[i] = value;
+    }
+    initialised = true;
+  }
+
+  crc = ~crc;
+  for (int i = 0; i < size; i++) crc = table[(crc ^ (quint8)data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+/*!
+ * Constructor.
+ * @param newdevice Device to write to (open for writing)
+ * @param newcompress Whether blocks shall be compressed with LZ4 (ignored without LZ4)
+ */
+canblockwriter::canblockwriter(QIODevice *newdevice, bool newcompress) {
+  device = newdevice;
+  compress = newcompress && canblockcodec::compressionavailable();
+  written = 0;
+  pending.reserve(canblockcodec::BlockPackets);
+}
+
+/*!
+ * Writes the file header.
+ * @return success of the operation
+ */
+bool canblockwriter::begin() {
+  QDataStream out(device);
+  out.setVersion(QDataStream::Qt_4_4);
+  out << quint32(canblockcodec::MagicNumber) << quint32(0);
+  return out.status() == QDataStream::Ok;
+}
+
+/*!
+ * Adds a canpacket, writing a block when it is full.
+ * @param packet The canpacket
+ * @return success of the operation
+ */
+bool canblockwriter::append(const canpacket &packet) {
+  pending.append(packet);
+  if (pending.size() < canblockcodec::BlockPackets) return true;
+  return flush();
+}
+
+/*!
+ * Writes the pending canpackets as a block and notes it in the index.
+ * Called when a block is full, but also to get canpackets to the disk
+ * before the block is full.
+ * @return success of the operation
+ */
+bool canblockwriter::flush() {
+  if (pending.isEmpty()) return true;
+
+  canblockindex entry;
+  entry.offset = device->pos();
+  entry.firstpacket = written;
+  entry.count = pending.size();
+  entry.firststamp = canblockcodec::stampof(pending.first());
+  entry.laststamp = canblockcodec::stampof(pending.last());
+
+  QByteArray raw = canblockcodec::encode(pending.constData(), pending.size(), entry.firststamp);
+  QByteArray stored;
+  quint8 codec = canblockcodec::Raw;
+#ifdef HAVE_LZ4
+  if (compress) {
+    stored.resize(LZ4_compressBound(raw.size()));
+    int size = LZ4_compress_default(raw.constData(), stored.data(), raw.size(), stored.size());
+    if (size > 0 && size < raw.size()) {
+      stored.resize(size);
+      codec = canblockcodec::LZ4;
+    }
+  }
+#endif
+  if (codec == canblockcodec::Raw) stored = raw;
+
+  QByteArray header;
+  QDataStream headerstream(&header, QIODevice::WriteOnly);
+  headerstream.setVersion(QDataStream::Qt_4_4);
+  headerstream << quint32(canblockcodec::BlockMagic) << codec << quint32(entry.count) << quint32(raw.size())
+               << quint32(stored.size()) << qint64(entry.firststamp) << qint64(entry.laststamp);
+  Q_ASSERT(header.size() == canblockcodec::BlockHeaderSize);
+  quint32 crc = canblockcodec::crc32(header.constData(), header.size());
+  crc = canblockcodec::crc32(stored.constData(), stored.size(), crc);
+
+  QDataStream out(device);
+  out.setVersion(QDataStream::Qt_4_4);
+  if (out.writeRawData(header.constData(), header.size()) != header.size()) return false;
+  if (out.writeRawData(stored.constData(), stored.size()) != stored.size()) return false;
+  out << crc;
+
+  index.append(entry);
+  written += pending.size();
+  pending.clear();
+  return out.status() == QDataStream::Ok;
+}
+
+/*!
+ * Writes the last block, the index and the trailer.
+ * @return success of the operation
+ */
+bool canblockwriter::finish() {
+  if (!flush()) return false;
+  return writeindex(device);
+}
+
+/*!
+ * Writes the index of the blocks written so far and the trailer, either
+ * to the device itself or to the end of a copy of what has been written.
+ * @param target Device the index is written to
+ * @return success of the operation
+ */
+bool canblockwriter::writeindex(QIODevice *target) const {
+  QDataStream out(target);
+  out.setVersion(QDataStream::Qt_4_4);
+  quint64 indexoffset = target->pos();
+  foreach (const canblockindex &entry, index) {
+    out << quint64(entry.offset) << quint64(entry.firstpacket) << quint32(entry.count)
+        << qint64(entry.firststamp) << qint64(entry.laststamp);
+  }
+  out << indexoffset << quint32(canblockcodec::IndexMagic);
+  return out.status() == QDataStream::Ok;
+}
+
+/*!
+ * canpackets not written yet (see flush()).
+ * @return number of canpackets
+ */
+int canblockwriter::pendingcount() const {
+  return pending.size();
+}
+
+/*!
+ * Constructor.
+ * @param newdevice Device to read from (open for reading, seekable)
+ */
+canblockreader::canblockreader(QIODevice *newdevice) {
+  device = newdevice;
+  noindex = false;
+}
+
+/*!
+ * Reads the file header and the index. Without a valid index the blocks
+ * are found by walking their headers, see truncated().
+ * @return false if this is not a block encoded file
+ */
+bool canblockreader::open() {
+  quint32 magic;
+  quint32 flags;
+
+  index.clear();
+  noindex = false;
+  device->seek(0);
+  QDataStream in(device);
+  in.setVersion(QDataStream::Qt_4_4);
+  in >> magic >> flags;
+  if (in.status() != QDataStream::Ok || magic != (quint32)canblockcodec::MagicNumber) {
+    error = QObject::tr("This is not a block encoded CAN logfile.");
+    return false;
+  }
+  if (!readindex()) {
+    noindex = true;
+    scanblocks();
+  }
+  return true;
+}
+
+/*!
+ * Reads the index via the trailer.
+ * @return false if there is no valid index
+ */
+bool canblockreader::readindex() {
+  qint64 size = device->size();
+  if (size < canblockcodec::HeaderSize + canblockcodec::TrailerSize) return false;
+
+  quint64 indexoffset;
+  quint32 magic;
+  device->seek(size - canblockcodec::TrailerSize);
+  QDataStream in(device);
+  in.setVersion(QDataStream::Qt_4_4);
+  in >> indexoffset >> magic;
+  if (in.status() != QDataStream::Ok || magic != (quint32)canblockcodec::IndexMagic) return false;
+  qint64 indexsize = size - canblockcodec::TrailerSize - (qint64)indexoffset;
+  if (indexoffset < canblockcodec::HeaderSize || indexsize < 0 || indexsize % canblockcodec::IndexEntrySize) return false;
+
+  device->seek(indexoffset);
+  index.resize(indexsize / canblockcodec::IndexEntrySize);
+  quint64 packets = 0;
+  for (int i = 0; i < index.size(); i++) {
+    canblockindex &entry = index[i];
+    in >> entry.offset >> entry.firstpacket >> entry.count >> entry.firststamp >> entry.laststamp;
+    if (entry.offset >= indexoffset || entry.firstpacket != packets || entry.count > canblockcodec::BlockPackets) {
+      index.clear();
+      return false;
+    }
+    packets += entry.count;
+  }
+  return in.status() == QDataStream::Ok;
+}
+
+/*!
+ * Finds the blocks by walking their headers from the start, up to the
+ * first incomplete block. Blocks that have been written only partly are
+ * found by their CRC when they are read.
+ */
+void canblockreader::scanblocks() {
+  qint64 size = device->size();
+  qint64 offset = canblockcodec::HeaderSize;
+  quint64 packets = 0;
+  QDataStream in(device);
+  in.setVersion(QDataStream::Qt_4_4);
+
+  index.clear();
+  while (offset + canblockcodec::BlockHeaderSize <= size) {
+    quint32 magic;
+    quint8 codec;
+    quint32 rawsize;
+    quint32 storedsize;
+    canblockindex entry;
+
+    device->seek(offset);
+    in >> magic >> codec >> entry.count >> rawsize >> storedsize >> entry.firststamp >> entry.laststamp;
+    if (in.status() != QDataStream::Ok || magic != (quint32)canblockcodec::BlockMagic) break;
+    if (!canblockcodec::plausible(entry.count, rawsize, storedsize)) break;
+    qint64 next = offset + canblockcodec::BlockHeaderSize + storedsize + canblockcodec::BlockTrailerSize;
+    if (next > size) break;
+    entry.offset = offset;
+    entry.firstpacket = packets;
+    index.append(entry);
+    packets += entry.count;
+    offset = next;
+  }
+}
+
+/*!
+ * Number of blocks.
+ * @return number of blocks
+ */
+int canblockreader::blockcount() const {
+  return index.size();
+}
+
+/*!
+ * Index entry of a block.
+ * @param number Block number
+ * @return the entry
+ */
+const canblockindex &canblockreader::blockat(int number) const {
+  return index.at(number);
+}
+
+/*!
+ * Number of canpackets in the file.
+ * @return number of canpackets
+ */
+quint64 canblockreader::packetcount() const {
+  if (index.isEmpty()) return 0;
+  return index.last().firstpacket + index.last().count;
+}
+
+/*!
+ * Whether the index was missing (e.g. the writing program was killed) and
+ * the blocks have been found by walking them.
+ * @return true if the file has not been finished
+ */
+bool canblockreader::truncated() const {
+  return noindex;
+}
+
+/*!
+ * Appends the canpackets of a block.
+ * @param number Block number
+ * @param packets The canpackets are appended here
+ * @return false if the block is damaged or cannot be decompressed
+ */
+bool canblockreader::readblock(int number, QVector<canpacket> *packets) {
+  const canblockindex &entry = index.at(number);
+  quint32 magic;
+  quint8 codec;
+  quint32 count;
+  quint32 rawsize;
+  quint32 storedsize;
+  qint64 firststamp;
+  qint64 laststamp;
+
+  device->seek(entry.offset);
+  QByteArray header = device->read(canblockcodec::BlockHeaderSize);
+  QDataStream in(header);
+  in.setVersion(QDataStream::Qt_4_4);
+  in >> magic >> codec >> count >> rawsize >> storedsize >> firststamp >> laststamp;
+  if (in.status() != QDataStream::Ok || magic != (quint32)canblockcodec::BlockMagic || count != entry.count) {
+    error = QObject::tr("Block %1 is damaged.").arg(number);
+    return false;
+  }
+  if (!canblockcodec::plausible(count, rawsize, storedsize)
+      || entry.offset + canblockcodec::BlockHeaderSize + storedsize + canblockcodec::BlockTrailerSize > (quint64)device->size()) {
+    error = QObject::tr("Block %1 is damaged.").arg(number);
+    return false;
+  }
+  QByteArray stored = device->read(storedsize);
+  QByteArray trailer = device->read(canblockcodec::BlockTrailerSize);
+  if ((quint32)stored.size() != storedsize || trailer.size() != canblockcodec::BlockTrailerSize) {
+    error = QObject::tr("Block %1 is incomplete.").arg(number);
+    return false;
+  }
+  quint32 crc = canblockcodec::crc32(header.constData(), header.size());
+  crc = canblockcodec::crc32(stored.constData(), stored.size(), crc);
+  if (crc != (((quint32)(quint8)trailer.at(0) << 24) | ((quint32)(quint8)trailer.at(1) << 16)
+              | ((quint32)(quint8)trailer.at(2) << 8) | (quint8)trailer.at(3))) {
+    error = QObject::tr("Block %1 has been written only partly or is damaged.").arg(number);
+    return false;
+  }
+
+  QByteArray raw;
+  if (codec == canblockcodec::Raw) {
+    raw = stored;
+  } else if (codec == canblockcodec::LZ4) {
+#ifdef HAVE_LZ4
+    raw.resize(rawsize);
+    if (LZ4_decompress_safe(stored.constData(), raw.data(), stored.size(), rawsize) != (int)rawsize) {
+      error = QObject::tr("Block %1 cannot be decompressed.").arg(number);
+      return false;
+    }
+#else
+    error = QObject::tr("The file is compressed with LZ4, which has not been compiled in.");
+    return false;
+#endif
+  } else {
+    error = QObject::tr("Block %1 uses an unknown compression.").arg(number);
+    return false;
+  }
+
+  int size = packets->size();
+  if (!canblockcodec::decode(raw, count, firststamp, packets)) {
+    packets->resize(size);
+    error = QObject::tr("Block %1 is damaged.").arg(number);
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * Description of the last error.
+ * @return description
+ */
+QString canblockreader::errorstring() const {
+  return error;
+}
@@ -0,0 +1,144 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANLOGBLOCK_H
+#define CANLOGBLOCK_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+
+/*!
+ * Index entry of one block of a block encoded file.
+ */
+struct canblockindex {
+  quint64 offset;             //!< File position of the block header
+  quint64 firstpacket;        //!< Number of the first canpacket in the block (counted from 0)
+  quint32 count;              //!< canpackets in the block
+  qint64 firststamp;          //!< Timestamp of the first canpacket (microseconds since the epoch)
+  qint64 laststamp;           //!< Timestamp of the last canpacket (microseconds since the epoch)
+};
+
+/*!
+ * Encoding of canpackets in blocks of up to BlockPackets packets.
+ *
+ * File layout (numbers in QDataStream byte order, i.e. big endian):
+ *   quint32 magic ("clf" + 0x05), quint32 flags (0)
+ *   blocks: header (quint32 BlockMagic, quint8 codec, quint32 count,
+ *           quint32 raw size, quint32 stored size, qint64 first and last
+ *           timestamp), the stored bytes and a quint32 CRC-32 of header
+ *           and stored bytes
+ *   index:  one entry per block (quint64 offset, quint64 first packet,
+ *           quint32 count, qint64 first and last timestamp)
+ *   trailer: quint64 offset of the index, quint32 IndexMagic
+ *
+ * The raw bytes of a block start with a dictionary of the IDs in the block
+ * (varint count, then one varint per ID: identifier << 3 | ide << 2 |
+ * rtr << 1 | err). Every canpacket then takes
+ *   varint   number of its ID in the dictionary
+ *   byte     dlc (bits 0-3), direction (4), bookmark (5), payload as
+ *            delta (6), extra byte follows (7)
+ *   [byte]   extra: interface follows (0), crc follows (1), marker (2)
+ *   [varint] interface (zigzag), [2 bytes] crc
+ *   varint   timestamp minus the previous one in microseconds (zigzag;
+ *            the first one relative to the first timestamp of the block)
+ *   payload  dlc bytes, or as delta to the previous canpacket with the same
+ *            ID and dlc: a mask of the changed bytes and the changed bytes
+ * so a periodic frame with a counter takes about 6 bytes instead of 36.
+ * With codec LZ4 the raw bytes are compressed with LZ4 (if it is smaller).
+ *
+ * Without the trailer (e.g. an aborted write or a capture journal) the
+ * blocks are found by walking their headers from the start; the CRC-32
+ * finds a block that has been written only partly.
+ */
+class canblockcodec {
+
+public:
+  enum {
+    MagicNumber = 0x636C6605,   /*!< = "clf" + versionbyte; block encoded canpackets */
+    BlockMagic = 0x434C4642,    /*!< = "CLFB"; start of a block */
+    IndexMagic = 0x434C4649,    /*!< = "CLFI"; end of the file */
+    BlockPackets = 4096,        /*!< canpackets per block */
+    BlockRawSize = 10 + BlockPackets * (10 + 43), /*!< bytes of an encoded block at most (see encode()) */
+    HeaderSize = 8,             /*!< bytes of the file header */
+    BlockHeaderSize = 4 + 1 + 3 * 4 + 2 * 8, /*!< bytes of a block header (magic, codec, count, raw and stored size, first and last timestamp) */
+    BlockTrailerSize = 4,       /*!< bytes of a block trailer (CRC-32) */
+    IndexEntrySize = 36,        /*!< bytes of an index entry */
+    TrailerSize = 12            /*!< bytes of the trailer */
+  };
+  //! How the bytes of a block are stored
+  enum Codec {
+    Raw = 0,                    //!< Stored as encoded
+    LZ4 = 1                     //!< Compressed with LZ4
+  };
+
+  static QByteArray encode(const canpacket *packets, int count, qint64 firststamp); //!< Encodes canpackets
+  static bool decode(const QByteArray &raw, int count, qint64 firststamp, QVector<canpacket> *packets); //!< Decodes canpackets
+  static bool compressionavailable();     //!< Whether LZ4 has been compiled in
+  static quint32 crc32(const char *data, int size, quint32 crc = 0); //!< CRC-32 (as used by zlib)
+  static bool plausible(quint32 count, quint32 rawsize, quint32 storedsize); //!< Whether the sizes in a block header can be trusted
+
+  /*!
+   * Timestamp of a canpacket.
+   * @param packet The canpacket
+   * @return microseconds since the epoch
+   */
+  static inline qint64 stampof(const canpacket &packet) {
+    return (qint64)packet.tv.tv_sec * 1000000 + packet.tv.tv_usec;
+  }
+};
+
+/*!
+ * Writes canpackets block by block to a device (file format: see canblockcodec).
+ */
+class canblockwriter {
+
+public:
+  canblockwriter(QIODevice *newdevice, bool newcompress); //!< Constructor
+  bool begin();                           //!< Writes the file header
+  bool append(const canpacket &packet);   //!< Adds a canpacket, writing a block when it is full
+  bool flush();                           //!< Writes the pending canpackets as a (short) block
+  bool finish();                          //!< Writes the last block, the index and the trailer
+  bool writeindex(QIODevice *target) const; //!< Writes the index of the blocks so far and the trailer
+  int pendingcount() const;               //!< canpackets not written yet
+
+private:
+  QIODevice *device;                      //!< Device written to
+  bool compress;                          //!< Whether blocks are compressed with LZ4
+  QVector<canpacket> pending;             //!< canpackets of the block not written yet
+  QVector<canblockindex> index;           //!< Blocks written so far
+  quint64 written;                        //!< canpackets written so far
+};
+
+/*!
+ * Reads a block encoded file (file format: see canblockcodec). Thanks to
+ * the index every block can be read on its own.
+ */
+class canblockreader {
+
+public:
+  explicit canblockreader(QIODevice *newdevice); //!< Constructor
+  bool open();                            //!< Reads the file header and the index
+  int blockcount() const;                 //!< Number of blocks
+  const canblockindex &blockat(int number) const; //!< Index entry of a block
+  quint64 packetcount() const;            //!< Number of canpackets in the file
+  bool truncated() const;                 //!< Whether the index was missing and the blocks were walked
+  bool readblock(int number, QVector<canpacket> *packets); //!< Appends the canpackets of a block
+  QString errorstring() const;            //!< Description of the last error
+
+private:
+  QIODevice *device;                      //!< Device read from
+  QVector<canblockindex> index;           //!< All blocks
+  bool noindex;                           //!< The index was missing
+  QString error;                          //!< Last error
+
+  bool readindex();                       //!< Reads the index via the trailer
+  void scanblocks();                      //!< Finds the blocks by walking their headers
+};
+
+#endif // CANLOGBLOCK_H
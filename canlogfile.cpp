@@ -7,30 +7,120 @@
  */
 
 #include "canlogfile.h"
+#include "canpacketmodel.h"
+#include "canlatency.h"
+#include "canlogblock.h"
+#include "canjournal.h"
 
 #include <iostream>
 
 using namespace std;
 
+/*!
+ * Writes one canpacket to a stream (typed record of the file format).
+ * @param out Stream to write to
+ * @param packet Packet to be written
+ * @return the stream
+ */
+QDataStream &operator<<(QDataStream &out, const canpacket &packet) {
+  quint8 flags = (packet.direction ? 0x01 : 0) | (packet.rtr ? 0x02 : 0) | (packet.ide ? 0x04 : 0) | (packet.err ? 0x08 : 0) | (packet.bookmark ? 0x10 : 0) | (packet.marker ? 0x20 : 0);
+  out << qint32(packet.interface) << flags << quint32(packet.identifier) << quint8(packet.dlc);
+  out.writeRawData((const char *)packet.data, 8);
+  out << quint16(packet.crc) << qint64(packet.tv.tv_sec) << qint32(packet.tv.tv_usec);
+  return out;
+}
+
+/*!
+ * Reads one canpacket from a stream (typed record of the file format).
+ * @param in Stream to read from
+ * @param packet Packet to be filled
+ * @return the stream
+ */
+QDataStream &operator>>(QDataStream &in, canpacket &packet) {
+  qint32 interface;
+  quint8 flags;
+  quint32 identifier;
+  quint8 dlc;
+  quint16 crc;
+  qint64 sec;
+  qint32 usec;
+
+  in >> interface >> flags >> identifier >> dlc;
+  in.readRawData((char *)packet.data, 8);
+  in >> crc >> sec >> usec;
+
+  packet.interface = interface;
+  packet.direction = flags & 0x01;
+  packet.rtr = flags & 0x02;
+  packet.ide = flags & 0x04;
+  packet.err = flags & 0x08;
+  packet.bookmark = flags & 0x10;
+  packet.marker = flags & 0x20;
+  packet.identifier = identifier;
+  packet.dlc = dlc;
+  packet.crc = crc;
+  packet.tv.tv_sec = sec;
+  packet.tv.tv_usec = usec;
+  return in;
+}
+
+/*!
+ * Fills one field of a canpacket from a cell of the legacy (string) file format.
+ * @param packet Packet to be filled
+ * @param column Column the cell was displayed in
+ * @param str Content of the cell
+ */
+static void parselegacycell(canpacket &packet, qint64 column, const QString &str) {
+  bool ok;
+  switch (column) {
+  case canpacketmodel::ColTimestamp: {
+    QDateTime timestamp = QDateTime::fromString(str, "dd.MM.yyyy hh:mm:ss.zzz");
+    packet.tv.tv_sec = timestamp.toTime_t();
+    packet.tv.tv_usec = timestamp.time().msec() * 1000;
+    break;
+  }
+  case canpacketmodel::ColInterface: packet.interface = str.toInt(&ok); break;
+  case canpacketmodel::ColDirection: packet.direction = (str == "<"); break;
+  case canpacketmodel::ColRTR: packet.rtr = (str == "1"); break;
+  case canpacketmodel::ColEFF: packet.ide = (str == "1"); break;
+  case canpacketmodel::ColERR: packet.err = (str == "1"); break;
+  // The legacy format stored the ID as a decimal number
+  case canpacketmodel::ColID: packet.identifier = str.toUInt(&ok); break;
+  case canpacketmodel::ColDLC: packet.dlc = str.toUInt(&ok); break;
+  case canpacketmodel::ColData: {
+    QStringList bytes = str.split(" ", QString::SkipEmptyParts);
+    for (int i = 0; i < bytes.size() && i < 8; i++) packet.data[i] = bytes.at(i).toUInt(&ok, 16);
+    break;
+  }
+  case canpacketmodel::ColCRC: packet.crc = str.toUInt(&ok); break;
+  }
+}
+
 /*!
  * Constructor that initialises the model and sets the headers.
  * @param parent Parent of the canlogfile
  */
 canlogfile::canlogfile(QTreeView *parent) : QTreeView(parent) {
-  QStandardItemModel *mymodel = new QStandardItemModel(0, 10, parent);
-  mymodel->setHorizontalHeaderLabels(QStringList() << tr("#") << tr("Timestamp") << tr("Interface") << tr("Dir") << tr("RTR") << tr("EFF") << tr("ERR") << tr("CAN ID") << tr("DLC") << tr("Data") << tr("CRC"));
-
-  // Somehow, setModel() does not what I think it should, we need the assignment for it to work
-  setModel(mymodel);
-  model = mymodel;
+  store = QSharedPointer<canpacketstore>(new canpacketstore);
+  model = new canpacketmodel(store, this);
+  setModel(model);
+  latency = 0;
+  journal = 0;
+  unpainted = 0;
+  connect(store.data(), SIGNAL(triggered()), this, SIGNAL(triggered()));
+  connect(store.data(), SIGNAL(capturecomplete()), this, SIGNAL(capturecomplete()));
 
   // Hide yet unused columns
-  setColumnHidden(2, 1);  // Interface
-  setColumnHidden(10, 1); // CRC
+  setColumnHidden(canpacketmodel::ColInterface, 1);
+  setColumnHidden(canpacketmodel::ColCRC, 1);
 
   // Make the display tree view uneditable
   setEditTriggers(QAbstractItemView::NoEditTriggers);
 
+  // It is a flat list with rows of equal height; lets the view skip measuring every row
+  setRootIsDecorated(false);
+  setUniformRowHeights(true);
+
   // Clear the entries to resize the columns correctly
   clear();
 }
@@ -40,45 +130,60 @@ canlogfile::canlogfile(QTreeView *parent) : QTreeView(parent) {
  * @return number of canpackets in the file
  */
 int canlogfile::getdataitemcount() {
-  return model->rowCount();
+  return store->packetcount();
+}
+
+/*!
+ * Returns a canpacket by its position in the file (oldest first).
+ * @param index Position, 0 to getdataitemcount() - 1
+ * @return the canpacket
+ */
+const canpacket &canlogfile::getdataitem(int index) {
+  return store->packetat(index);
+}
+
+/*!
+ * Returns the number of canpackets dropped from the ring.
+ * @return number of canpackets dropped
+ */
+quint64 canlogfile::getevictedcount() {
+  return store->evictedcount();
+}
+
+/*!
+ * Returns the store holding the canpackets, e.g. to show them in further views.
+ * @return the store, shared with the views
+ */
+QSharedPointer<canpacketstore> canlogfile::getstore() {
+  return store;
 }
 
 /*!
  * Deletes all canpackets from the file
  */
 void canlogfile::clear() {
-  // May take some time, so let the user know we are working
-  QApplication::setOverrideCursor(Qt::WaitCursor);
+  store->clear();
+  if (journal) journal->restart();
 
-  // This takes extremely long with many elements :/
-  model->removeRows(0, model->rowCount());
-
-  // Insert one row with maximum data content and resize them
-  // to fit all the data in. Then, delete the row again
-  model->insertRow(0);
-  model->setData(model->index(0, 0), "888888 ");
-  model->setData(model->index(0, 1), QDateTime(QDate(2888, 12, 22), QTime(18, 58, 58, 888)).toString("dd.MM.yyyy hh:mm:ss.zzz"));
-  model->setData(model->index(0, 2), "can88 ");
-  model->setData(model->index(0, 3), "<");
-  model->setData(model->index(0, 4), "0");
-  model->setData(model->index(0, 5), "0");
-  model->setData(model->index(0, 6), "0");
-  model->setData(model->index(0, 7), "ABCDEFGHI ");
-  model->setData(model->index(0, 8), "8 ");
-  model->setData(model->index(0, 9), "BB BB BB BB BB BB BB BB ");
-  model->setData(model->index(0, 10), "0000 ");
-  for (int i = 0; i <= model->columnCount(); i++) {
-    resizeColumnToContents(i);
+  // Size the columns to fit the maximum data content
+  QStringList samples = QStringList() << "888888 "
+      << QDateTime(QDate(2888, 12, 22), QTime(18, 58, 58, 888)).toString("dd.MM.yyyy hh:mm:ss.zzz")
+      << "can88 " << "<" << "0" << "0" << "0" << "1FFFFFFF " << "8 " << "BB BB BB BB BB BB BB BB " << "0000 "
+      << "MessageName: SignalName=-8888.88 unit SignalName=8888 ";
+  for (int i = 0; i < samples.size(); i++) {
+    setColumnWidth(i, qMax(header()->sectionSizeHint(i), fontMetrics().width(samples.at(i)) + 8));
   }
   setSortingEnabled(true);
+  sortByColumn(canpacketmodel::ColNumber, Qt::AscendingOrder);
   setAlternatingRowColors(true);
-  model->removeRows(0, model->rowCount());
-
-  QApplication::restoreOverrideCursor();
+  emit reloaded();
 }
 
 /*!
  * Reads a file containing canpackets.
+ * Besides the block encoded files (see canblockcodec) the files with one
+ * typed record per canpacket and those with one string per cell (the
+ * legacy format) are read.
  * @param fileName Name of the file to be read
  * @return success of the operation
  */
@@ -97,7 +202,7 @@ bool canlogfile::readFile(const QString &fileName) {
   // Check the file magic (first 4 bytes)
   quint32 magic;
   in >> magic;
-  if (magic != MagicNumber) {
+  if (magic != canblockcodec::MagicNumber && magic != RecordMagicNumber && magic != LegacyMagicNumber) {
     QMessageBox::warning(this, tr("socketcangui"), tr("This is not a CAN logfile or the version does not match!"));
     return false;
   }
@@ -105,36 +210,84 @@ bool canlogfile::readFile(const QString &fileName) {
   // Start with no data
   clear();
 
-  qint64 row;
-  qint64 column;
-  QString str;
-  qint64 oldrow = 999;
-
-  // Now read the file and insert line by line
+  // Now read the file into a plain vector and hand it over at once
   QApplication::setOverrideCursor(Qt::WaitCursor);
-  while (!in.atEnd()) {
-    in >> row >> column >> str;
-    if (row != oldrow) {
-      model->insertRow(model->rowCount());
-      oldrow = row;
+  QVector<canpacket> packets;
+  canpacket packet;
+  bzero(&packet, sizeof(packet));
+
+  bool truncated = false;
+  if (magic == canblockcodec::MagicNumber) {
+    canblockreader reader(&file);
+    if (reader.open()) {
+      packets.reserve(reader.packetcount());
+      truncated = reader.truncated();
+      for (int i = 0; i < reader.blockcount(); i++) {
+        if (!reader.readblock(i, &packets)) {
+          truncated = true;
+          break;
+        }
+      }
     }
-    model->setData(model->index(row, column), str);
+  } else if (magic == RecordMagicNumber) {
+    quint64 count;
+    in >> count;
+    packets.reserve(count);
+    while (!in.atEnd() && (quint64)packets.size() < count) {
+      in >> packet;
+      packets.append(packet);
+    }
+  } else {
+    qint64 row;
+    qint64 column;
+    QString str;
+    qint64 oldrow = -1;
+
+    while (!in.atEnd()) {
+      in >> row >> column >> str;
+      if (row != oldrow) {
+        if (oldrow >= 0) packets.append(packet);
+        bzero(&packet, sizeof(packet));
+        oldrow = row;
+      }
+      parselegacycell(packet, column, str);
 #ifdef DEBUG
-    cerr << "Inserting into ROW" << row << " COL " << column << endl;
-    cerr.flush();
+      cerr << "Inserting into ROW" << row << " COL " << column << endl;
+      cerr.flush();
 #endif
+    }
+    if (oldrow >= 0) packets.append(packet);
   }
 
+  store->append(packets);
+  rejournal();
+  emit reloaded();
   QApplication::restoreOverrideCursor();
+
+  if (truncated || in.status() != QDataStream::Ok) {
+    QMessageBox::warning(this, tr("socketcangui"), tr("File %1 is truncated, read %2 packets.").arg(file.fileName()).arg(packets.size()));
+  }
   return true;
 }
 
 /*!
- * Writes all canpackets to a file.
+ * Writes all canpackets to a file, block encoded and, if LZ4 has been
+ * compiled in, compressed (see canblockcodec).
+ * If the journal holds exactly the canpackets of the file (nothing has been
+ * dropped from a ring), it is copied instead of encoding everything again.
+ * The packets are written in arrival order, no matter how the view is sorted.
  * @param fileName Name of the file to be written to
  * @return success of the operation
  */
 bool canlogfile::writeFile(const QString &fileName) {
+  // Saving the journal is cheap, fall back to writing everything
+  if (journal && journal->isactive() && journal->count() == (quint64)store->packetcount()) {
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool saved = journal->saveas(fileName);
+    QApplication::restoreOverrideCursor();
+    if (saved) return true;
+  }
+
   // Check wether the file name is ok
   QFile file(fileName);
   if (!file.open(QIODevice::WriteOnly)) {
@@ -142,23 +295,19 @@ bool canlogfile::writeFile(const QString &fileName) {
     return false;
   }
 
-  // Create the stream to handle the data
-  QDataStream out(&file);
-  out.setVersion(QDataStream::Qt_4_4);
-
-  // Write the file magic (first 4 bytes)
-  out << quint32(MagicNumber);
-
   // Now write the data to the file
   QApplication::setOverrideCursor(Qt::WaitCursor);
-  for (qint64 row = 0; row < model->rowCount(); ++row) {
-    for (qint64 column = 0; column < model->columnCount(); ++column) {
-      QString str = model->data(model->index(row, column)).toString();
-      if (!str.isEmpty())
-        out << qint64(row) << qint64(column) << str;
-    }
+  canblockwriter writer(&file, true);
+  bool ok = writer.begin();
+  for (int i = 0; ok && i < store->packetcount(); ++i) {
+    ok = writer.append(store->packetat(i));
   }
+  if (ok) ok = writer.finish();
   QApplication::restoreOverrideCursor();
+  if (!ok) {
+    QMessageBox::warning(this, tr("socketcangui"), tr("Cannot write file %1:\n%2.").arg(file.fileName()).arg(file.errorString()));
+    return false;
+  }
   return true;
 }
 
@@ -167,44 +316,137 @@ bool canlogfile::writeFile(const QString &fileName) {
  * @param packet Packet to be added
  */
 void canlogfile::adddataitem(canpacket packet) {
-  int msec = 0;
+  qint64 arrived = 0;
+  if (latency) {
+    arrived = canlatency::now();
+    latency->stage(canlatency::Queue).record((qint64)(quint32)(arrived / 1000 - packet.queuedstamp) * 1000);
+  }
 
-  // calculate the timestamp when the packet arrived
-  QDateTime timestamp = QDateTime::fromTime_t(packet.tv.tv_sec);
-  msec = packet.tv.tv_usec / 1000;
-#ifdef DEBUG
-    cerr << "usec: " << packet.tv.tv_usec << "msec: " << msec << endl;
-    cerr.flush();
-#endif
-  timestamp = timestamp.addMSecs(msec);
-
-  // construct the data string as hex-values-string
-  QString datadisplay;
-  QChar dataelem;
-  for (int i = 0; i < packet.dlc; i++) {
-    dataelem = dataelem.fromAscii(packet.data[i]);
-    datadisplay = datadisplay.append(QString("%1 ").arg((short)packet.data[i], 2, 16, QChar('0')));
-  }
-
-  // append the data packet
-  int rownum = model->rowCount();
-  model->insertRow(rownum);
-  model->setData(model->index(rownum, 0), rownum);
-  model->setData(model->index(rownum, 1), timestamp.toString(tr("dd.MM.yyyy hh:mm:ss.zzz")));
-  model->setData(model->index(rownum, 2), 0);
-  model->setData(model->index(rownum, 3), packet.direction ? tr("<") : tr(">"));
-  model->setData(model->index(rownum, 4), packet.rtr ? tr("1") : tr("0"));
-  model->setData(model->index(rownum, 5), packet.ide ? tr("1") : tr("0"));
-  model->setData(model->index(rownum, 6), packet.err ? tr("1") : tr("0"));
-  model->setData(model->index(rownum, 7), packet.identifier);
-  model->setData(model->index(rownum, 8), packet.dlc);
-  model->setData(model->index(rownum, 9), datadisplay);
-  model->setData(model->index(rownum, 10), 0); // CRC
+  if (store->append(packet)) {
+    if (journal) journal->append(packet);
+    emit dataitemstored(packet);
+  }
+
+  if (latency) {
+    latency->stage(canlatency::Model).record(canlatency::now() - arrived);
+    if (!unpainted) unpainted = arrived;
+  }
   scrollToBottom();
 
   somethingChanged();
 }
 
+/*!
+ * Shows only the canpackets passing the filter.
+ * The canpackets themselves are kept, changing the filter again brings them back.
+ * @param filter Display filter to be applied
+ */
+void canlogfile::setdisplayfilter(const canpacketfilter &filter) {
+  model->setfilter(filter);
+  scrollToBottom();
+}
+
+/*!
+ * Limits the file to a ring of canpackets. The oldest canpackets are dropped
+ * when it is full.
+ * @param capacity Maximum number of canpackets (0 = unlimited)
+ * @param posttrigger Canpackets to be recorded after the trigger has fired
+ */
+void canlogfile::setcapturebuffer(int capacity, int posttrigger) {
+  store->setring(capacity, posttrigger);
+  if (journal) journal->setrotation(store->ringslots());
+  scrollToBottom();
+}
+
+/*!
+ * Sets the canpackets that fire the trigger.
+ * @param filter Canpackets matching this filter fire the trigger
+ * @param enabled Whether canpackets fire the trigger at all
+ */
+void canlogfile::settrigger(const canpacketfilter &filter, bool enabled) {
+  store->settriggerfilter(filter, enabled);
+}
+
+/*!
+ * Fires the capture trigger.
+ */
+void canlogfile::trigger() {
+  store->trigger();
+}
+
+/*!
+ * Re-arms the capture trigger.
+ */
+void canlogfile::armtrigger() {
+  store->arm();
+}
+
+/*!
+ * Decodes the signals with this database.
+ * @param database Signal database (0 = none); it must stay alive while in use
+ */
+void canlogfile::setdatabase(const candbc *database) {
+  model->setdatabase(database);
+}
+
+/*!
+ * Records the queue, model and paint latencies in the given statistics.
+ * @param newlatency Latency statistics (0 = none)
+ */
+void canlogfile::setlatency(canlatency *newlatency) {
+  latency = newlatency;
+  unpainted = 0;
+}
+
+/*!
+ * Journals all canpackets in the given journal from now on; the canpackets
+ * already in the file are journaled right away.
+ * @param newjournal Journal, started already (0 = none)
+ */
+void canlogfile::setjournal(canjournal *newjournal) {
+  journal = newjournal;
+  if (journal) journal->setrotation(store->ringslots());
+  rejournal();
+}
+
+/*!
+ * Selects a canpacket and scrolls to it, e.g. one of the canpackets of a
+ * message shown in another view.
+ * @param arrival Arrival number of the canpacket
+ * @return false if the canpacket is not shown (display filter or dropped)
+ */
+bool canlogfile::showarrival(quint32 arrival) {
+  int row = model->rowofarrival(arrival);
+  if (row < 0) return false;
+  QModelIndex index = model->index(row, 0);
+  setCurrentIndex(index);
+  scrollTo(index, QAbstractItemView::PositionAtCenter);
+  return true;
+}
+
+/*!
+ * Starts the journal anew with all canpackets of the file, e.g. after a
+ * file has been read.
+ */
+void canlogfile::rejournal() {
+  if (!journal || !journal->restart()) return;
+  for (int i = 0; i < store->packetcount(); i++) journal->append(store->packetat(i));
+  journal->sync();
+}
+
+/*!
+ * Paints the view. The time from adding the oldest canpacket not painted yet
+ * to now is recorded once per paint.
+ * @param event Paint event
+ */
+void canlogfile::paintEvent(QPaintEvent *event) {
+  QTreeView::paintEvent(event);
+  if (latency && unpainted) {
+    latency->stage(canlatency::Paint).record(canlatency::now() - unpainted);
+    unpainted = 0;
+  }
+}
+
 /*!
  * SLOT to be called when an item changed or has been added.
  */
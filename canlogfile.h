@@ -17,17 +17,30 @@
  */
 struct canpacket {
   int interface;              //!< the can interface this paket was recvd or sent on (not used yet)
-  bool direction;             //!< 0 = we recvd that packet; 1 = we sent it
-  unsigned short identifier;  //!< CAN ID (only the identifier, no flags)
+  bool direction;             //!< 1 = we recvd that packet; 0 = we sent it
+  unsigned int identifier;    //!< CAN ID (only the identifier, no flags; 29 bit for EFF)
   bool rtr;                   //!< RTR bit
   bool ide;                   //!< IDE bit (1 if extended ID, 0 otherwise)
   bool err;                   //!< ERROR bit (1 if error frame, 0 otherwise)
   unsigned char dlc;          //!< Data length code
   unsigned char data[8];      //!< Payload (data)
   unsigned short crc;         //!< CRC (not used yet)
+  quint32 queuedstamp;        //!< Microseconds (low 32 bits) it was handed to the main thread; latency statistics only, not saved
   struct timeval tv;          //!< timeval it was recvd or sent
+  bool bookmark;              //!< set by a trigger to mark the packet
+  bool marker;                //!< marker a trigger inserted for a missing ID (bookmark set, dlc 0); not a frame from the bus
 };
 
+QDataStream &operator<<(QDataStream &out, const canpacket &packet);  //!< Writes one canpacket to a stream
+QDataStream &operator>>(QDataStream &in, canpacket &packet);         //!< Reads one canpacket from a stream
+
+class canpacketmodel;
+class canpacketstore;
+class canpacketfilter;
+class candbc;
+class canlatency;
+class canjournal;
+
 /*!
  * One "file" containing 0 to n CAN packets (and main widget of the program).
  */
@@ -37,22 +50,51 @@ Q_OBJECT
 public:
   explicit canlogfile(QTreeView *parent = 0);   //!< Constructor that initialises the model and sets the headers
   int getdataitemcount();                       //!< Returns the number of canpackets in the file
+  const canpacket &getdataitem(int index);      //!< Returns a canpacket by its position in the file
+  quint64 getevictedcount();                    //!< Returns the number of canpackets dropped from the ring
+  QSharedPointer<canpacketstore> getstore();    //!< Returns the store holding the canpackets
   void clear();                                 //!< Deletes all canpackets from the file
   bool readFile(const QString &fileName);       //!< Reads a file containing canpackets
   bool writeFile(const QString &fileName);      //!< Writes all canpackets to a file
 
 signals:
   void modified();                              //!< file has been modified since the last open or save
+  void triggered();                             //!< The capture trigger has fired
+  void capturecomplete();                       //!< All post-trigger packets have been recorded
+  void dataitemstored(canpacket);               //!< A new canpacket has been stored
+  void reloaded();                              //!< All canpackets have been replaced (cleared or read)
 
 public slots:
   void adddataitem(canpacket);                  //!< Adds one canpacket to the bottom of the file
+  void setdisplayfilter(const canpacketfilter &filter); //!< Shows only the canpackets passing the filter
+  void setcapturebuffer(int capacity, int posttrigger); //!< Limits the file to a ring of canpackets
+  void settrigger(const canpacketfilter &filter, bool enabled); //!< Sets the canpackets that fire the trigger
+  void trigger();                               //!< Fires the capture trigger
+  void armtrigger();                            //!< Re-arms the capture trigger
+  void setdatabase(const candbc *database);     //!< Decodes the signals with this database
+  void setlatency(canlatency *newlatency);      //!< Records the queue, model and paint latencies here
+  void setjournal(canjournal *newjournal);      //!< Journals all canpackets here
+  bool showarrival(quint32 arrival);            //!< Selects and scrolls to a canpacket
+
+protected:
+  void paintEvent(QPaintEvent *event);          //!< Paints the view and records the paint latency
 
 private slots:
   void somethingChanged();                      //!< SLOT to be called when an item changed or has been added
 
 private:
-  QAbstractItemModel *model;                    //!< Model to be displayed containing all canpackets
-  enum { MagicNumber = 0x636C6603 /*!< = "clf" + versionbyte */ };
+  void rejournal();                             //!< Starts the journal anew with all canpackets
+
+private:
+  QSharedPointer<canpacketstore> store;         //!< Store holding all canpackets, shared with further views
+  canpacketmodel *model;                        //!< Model displaying the canpackets of the store
+  canlatency *latency;                          //!< Latency statistics (0 = none)
+  canjournal *journal;                          //!< Journal of the canpackets (0 = none)
+  qint64 unpainted;                             //!< Time the oldest unpainted canpacket was added (0 = none)
+  enum {
+    RecordMagicNumber = 0x636C6604, /*!< = "clf" + versionbyte; typed canpacket records */
+    LegacyMagicNumber = 0x636C6603  /*!< = "clf" + versionbyte; one string per cell */
+  };
 };
 
 #endif // CANLOGFILE_H
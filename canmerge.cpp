@@ -0,0 +1,200 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canmerge.h"
+#include "cancapture.h"
+
+/*!
+ * Constructor, creates a merge without inputs.
+ */
+canmerge::canmerge() {
+  written = 0;
+}
+
+/*!
+ * Adds a file to be merged.
+ * @param filename Name of the file
+ * @param interface Interface number given to its canpackets (-1 = kept)
+ * @param offset Added to its timestamps in microseconds
+ */
+void canmerge::addinput(const QString &filename, int interface, qint64 offset) {
+  canmergeinput input;
+  input.filename = filename;
+  input.interface = interface;
+  input.offset = offset;
+  inputs.append(input);
+}
+
+/*!
+ * Removes all inputs.
+ */
+void canmerge::clear() {
+  inputs.clear();
+}
+
+/*!
+ * Merges the inputs into a file (block encoded, see canblockcodec). An
+ * input that ends early is merged as far as it could be read (see
+ * warnings()).
+ * @param output Name of the file to be written (must not be one of the inputs)
+ * @param compress Compress the blocks with LZ4 if it has been compiled in
+ * @return false if an input cannot be read or the output cannot be written
+ */
+bool canmerge::run(const QString &output, bool compress) {
+  written = 0;
+  problems.clear();
+  error.clear();
+
+  QString target = QFileInfo(output).absoluteFilePath();
+  foreach (const canmergeinput &input, inputs) {
+    if (QFileInfo(input.filename).absoluteFilePath() == target) {
+      error = QObject::tr("The merged file %1 is one of the files to be merged.").arg(output);
+      return false;
+    }
+  }
+
+  int count = inputs.size();
+  for (int i = 0; i < count; i++) {
+    readers.append(new cancapturereader(inputs.at(i).filename));
+    if (!readers.last()->open()) {
+      error = QObject::tr("Cannot read file %1:\n%2").arg(inputs.at(i).filename).arg(readers.last()->errorstring());
+      qDeleteAll(readers);
+      readers.clear();
+      return false;
+    }
+  }
+
+  QFile file(output);
+  if (!file.open(QIODevice::WriteOnly)) {
+    error = QObject::tr("Cannot write file %1:\n%2").arg(output).arg(file.errorString());
+    qDeleteAll(readers);
+    readers.clear();
+    return false;
+  }
+  canblockwriter writer(&file, compress);
+  bool ok = writer.begin();
+
+  // Every input with a canpacket left has its current one in the heap
+  current.resize(count);
+  stamps.resize(count);
+  backwards.fill(0, count);
+  heap.clear();
+  for (int i = 0; i < count; i++) {
+    if (readnext(i)) {
+      heap.append(i);
+      siftup(heap.size() - 1);
+    }
+  }
+  while (ok && !heap.isEmpty()) {
+    int input = heap.at(0);
+    ok = writer.append(current.at(input));
+    if (!ok) break;
+    written++;
+    if (!readnext(input)) {
+      heap[0] = heap.last();
+      heap.resize(heap.size() - 1);
+    }
+    if (!heap.isEmpty()) siftdown(0);
+  }
+  if (ok) ok = writer.finish();
+  if (!ok) error = QObject::tr("Cannot write file %1 after %2 packets:\n%3").arg(output).arg(written).arg(file.errorString());
+
+  for (int i = 0; i < count; i++) {
+    if (readers.at(i)->truncated()) {
+      problems += QObject::tr("File %1 is truncated, merged %2 packets.\n").arg(inputs.at(i).filename).arg(readers.at(i)->packetsread());
+    }
+    if (backwards.at(i)) {
+      problems += QObject::tr("File %1 is not ordered by time, %2 packets go back in time.\n").arg(inputs.at(i).filename).arg(backwards.at(i));
+    }
+  }
+  qDeleteAll(readers);
+  readers.clear();
+  return ok;
+}
+
+/*!
+ * canpackets written by the last run.
+ * @return number of canpackets
+ */
+quint64 canmerge::packetcount() const {
+  return written;
+}
+
+/*!
+ * Problems found while reading, e.g. truncated or unordered files (one per
+ * line).
+ * @return empty if there were none
+ */
+QString canmerge::warnings() const {
+  return problems;
+}
+
+/*!
+ * Description of the last error.
+ * @return error message
+ */
+QString canmerge::errorstring() const {
+  return error;
+}
+
+/*!
+ * Reads the next canpacket of an input, relabels its interface and corrects
+ * its timestamp by the clock offset.
+ * @param input Number of the input
+ * @return false at the end of the input
+ */
+bool canmerge::readnext(int input) {
+  canpacket &packet = current[input];
+  if (!readers.at(input)->next(&packet)) return false;
+
+  const canmergeinput &settings = inputs.at(input);
+  if (settings.interface >= 0) packet.interface = settings.interface;
+  qint64 stamp = canblockcodec::stampof(packet) + settings.offset;
+  if (settings.offset) {
+    packet.tv.tv_sec = stamp / 1000000;
+    packet.tv.tv_usec = stamp % 1000000;
+  }
+
+  if (readers.at(input)->packetsread() > 1 && stamp < stamps.at(input)) backwards[input]++;
+  stamps[input] = stamp;
+  return true;
+}
+
+/*!
+ * Moves the input at a position down the heap until both children come
+ * later.
+ * @param position Position in the heap
+ */
+void canmerge::siftdown(int position) {
+  int size = heap.size();
+  int input = heap.at(position);
+  for (;;) {
+    int child = 2 * position + 1;
+    if (child >= size) break;
+    if (child + 1 < size && before(heap.at(child + 1), heap.at(child))) child++;
+    if (!before(heap.at(child), input)) break;
+    heap[position] = heap.at(child);
+    position = child;
+  }
+  heap[position] = input;
+}
+
+/*!
+ * Moves the input at a position up the heap until its parent comes earlier.
+ * @param position Position in the heap
+ */
+void canmerge::siftup(int position) {
+  int input = heap.at(position);
+  while (position > 0) {
+    int parent = (position - 1) / 2;
+    if (!before(input, heap.at(parent))) break;
+    heap[position] = heap.at(parent);
+    position = parent;
+  }
+  heap[position] = input;
+}
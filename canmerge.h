@@ -0,0 +1,80 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANMERGE_H
+#define CANMERGE_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+
+class cancapturereader;
+
+/*!
+ * One file to be merged.
+ */
+struct canmergeinput {
+  QString filename;           //!< Name of the file
+  int interface;              //!< Interface number given to its canpackets (-1 = kept)
+  qint64 offset;              //!< Added to its timestamps in microseconds (clock offset of the recording machine)
+};
+
+/*!
+ * Merges N CAN logfiles (e.g. one per bus, recorded on different machines)
+ * into one file ordered by timestamp.
+ *
+ * Every input is read canpacket by canpacket (see cancapturereader); the
+ * current canpacket of each input sits in a binary min-heap ordered by the
+ * corrected timestamp, so each canpacket written costs O(log N)
+ * comparisons. The output is written block by block (see canblockwriter).
+ * Only one block per input and one output block are held, so the memory
+ * does not depend on the size of the files.
+ *
+ * The inputs are expected to be ordered by timestamp each, as captured;
+ * canpackets going back in time within an input are written as they come
+ * and counted (see warnings()).
+ */
+class canmerge {
+
+public:
+  canmerge();                             //!< Constructor, creates a merge without inputs
+
+  void addinput(const QString &filename, int interface, qint64 offset); //!< Adds a file to be merged
+  void clear();                           //!< Removes all inputs
+  bool run(const QString &output, bool compress); //!< Merges the inputs into a file
+  quint64 packetcount() const;            //!< canpackets written by the last run
+  QString warnings() const;               //!< Problems found while reading (one per line)
+  QString errorstring() const;            //!< Description of the last error
+
+private:
+  QList<canmergeinput> inputs;            //!< Files to be merged
+  QList<cancapturereader *> readers;      //!< Readers of the inputs (while running)
+  QVector<canpacket> current;             //!< Current canpacket per input
+  QVector<qint64> stamps;                 //!< Corrected timestamp of the current canpacket per input
+  QVector<quint64> backwards;             //!< canpackets going back in time per input
+  QVector<int> heap;                      //!< Inputs with a current canpacket, min-heap by stamps
+  quint64 written;                        //!< canpackets written
+  QString problems;                       //!< Problems found while reading
+  QString error;                          //!< Last error
+
+  bool readnext(int input);               //!< Reads the next canpacket of an input and corrects it
+  void siftdown(int position);            //!< Restores the heap below a position
+  void siftup(int position);              //!< Restores the heap above a position
+
+  /*!
+   * Heap order: earlier timestamp first, on a tie the input added first.
+   * @param a First input
+   * @param b Second input
+   * @return true if the canpacket of a is to be written before that of b
+   */
+  inline bool before(int a, int b) const {
+    return stamps.at(a) < stamps.at(b) || (stamps.at(a) == stamps.at(b) && a < b);
+  }
+};
+
+#endif // CANMERGE_H
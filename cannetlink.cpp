@@ -0,0 +1,384 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "cannetlink.h"
+
+#include <iostream>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+using namespace std;
+
+/*!
+ * Constructor, opens a netlink socket subscribed to the link changes.
+ * If that fails there is no monitoring, but links() still works.
+ * @param parent Parent object
+ */
+cannetlink::cannetlink(QObject *parent) :
+        QObject(parent) {
+  struct sockaddr_nl addr;
+
+  sequence = 0;
+  notifier = 0;
+  monitorfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+  if (monitorfd < 0) {
+    cerr << "Cannot open netlink socket: " << strerror(errno) << endl;
+    return;
+  }
+  bzero(&addr, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = RTMGRP_LINK;
+  if (bind(monitorfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    cerr << "Cannot subscribe to link changes: " << strerror(errno) << endl;
+    close(monitorfd);
+    monitorfd = -1;
+    return;
+  }
+  notifier = new QSocketNotifier(monitorfd, QSocketNotifier::Read, this);
+  connect(notifier, SIGNAL(activated(int)), this, SLOT(readevents()));
+}
+
+/*!
+ * Destructor, closes the netlink socket.
+ */
+cannetlink::~cannetlink() {
+  delete notifier;
+  if (monitorfd >= 0) close(monitorfd);
+}
+
+/*!
+ * Reads the controller settings and state from the IFLA_INFO_DATA of a
+ * CAN interface.
+ * @param data The IFLA_INFO_DATA attribute
+ * @param link Receives settings and state
+ */
+static void parsecaninfo(const struct rtattr *data, canlink *link) {
+  int len = RTA_PAYLOAD(data);
+  for (struct rtattr *rta = (struct rtattr *)RTA_DATA(data); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+    switch (rta->rta_type) {
+    case IFLA_CAN_BITTIMING:
+      if (RTA_PAYLOAD(rta) < sizeof(struct can_bittiming)) break;
+      link->configurable = true;
+      link->config.bitrate = ((struct can_bittiming *)RTA_DATA(rta))->bitrate;
+      link->config.samplepoint = ((struct can_bittiming *)RTA_DATA(rta))->sample_point;
+      break;
+    case IFLA_CAN_DATA_BITTIMING:
+      if (RTA_PAYLOAD(rta) < sizeof(struct can_bittiming)) break;
+      link->config.databitrate = ((struct can_bittiming *)RTA_DATA(rta))->bitrate;
+      link->config.datasamplepoint = ((struct can_bittiming *)RTA_DATA(rta))->sample_point;
+      break;
+    case IFLA_CAN_CTRLMODE:
+      if (RTA_PAYLOAD(rta) < sizeof(struct can_ctrlmode)) break;
+      link->config.fd = ((struct can_ctrlmode *)RTA_DATA(rta))->flags & CAN_CTRLMODE_FD;
+      break;
+    case IFLA_CAN_RESTART_MS:
+      if (RTA_PAYLOAD(rta) < sizeof(quint32)) break;
+      link->config.restartms = *(quint32 *)RTA_DATA(rta);
+      break;
+    case IFLA_CAN_STATE:
+      if (RTA_PAYLOAD(rta) < sizeof(quint32)) break;
+      link->status.state = *(quint32 *)RTA_DATA(rta);
+      break;
+    case IFLA_CAN_BERR_COUNTER:
+      if (RTA_PAYLOAD(rta) < sizeof(struct can_berr_counter)) break;
+      link->status.txerrors = ((struct can_berr_counter *)RTA_DATA(rta))->txerr;
+      link->status.rxerrors = ((struct can_berr_counter *)RTA_DATA(rta))->rxerr;
+      break;
+    }
+  }
+}
+
+/*!
+ * Reads a CAN interface from a RTM_NEWLINK or RTM_DELLINK message.
+ * @param nlh The netlink message
+ * @param link Receives the interface
+ * @return false if the message is not about a CAN interface
+ */
+bool cannetlink::parselink(const struct nlmsghdr *nlh, canlink *link) {
+  if (nlh->nlmsg_type != RTM_NEWLINK && nlh->nlmsg_type != RTM_DELLINK) return false;
+  if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg))) return false;
+  struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(nlh);
+  if (ifi->ifi_type != ARPHRD_CAN) return false;
+
+  link->ifindex = ifi->ifi_index;
+  link->up = ifi->ifi_flags & IFF_UP;
+  link->running = ifi->ifi_flags & IFF_RUNNING;
+  link->configurable = false;
+  link->name.clear();
+  link->kind.clear();
+  bzero(&link->config, sizeof(link->config));
+  bzero(&link->status, sizeof(link->status));
+  link->status.state = -1;
+
+  int len = IFLA_PAYLOAD(nlh);
+  for (struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+    if (rta->rta_type == IFLA_IFNAME) link->name = QString::fromLocal8Bit((const char *)RTA_DATA(rta));
+    if (rta->rta_type != IFLA_LINKINFO) continue;
+    int infolen = RTA_PAYLOAD(rta);
+    for (struct rtattr *info = (struct rtattr *)RTA_DATA(rta); RTA_OK(info, infolen); info = RTA_NEXT(info, infolen)) {
+      if (info->rta_type == IFLA_INFO_KIND) link->kind = QString::fromAscii((const char *)RTA_DATA(info));
+      if (info->rta_type == IFLA_INFO_DATA) parsecaninfo(info, link);
+      if (info->rta_type == IFLA_INFO_XSTATS && RTA_PAYLOAD(info) >= sizeof(struct can_device_stats)) {
+        memcpy(&link->status.xstats, RTA_DATA(info), sizeof(struct can_device_stats));
+        link->status.hasxstats = true;
+      }
+    }
+  }
+  return !link->name.isEmpty();
+}
+
+/*!
+ * All CAN interfaces of the host, read with one RTM_GETLINK dump on a
+ * socket of its own (so the dump does not mix with the events). Bit timing,
+ * controller state, error counters and statistics come with the dump.
+ * @return the interfaces in the order of their index
+ */
+QList<canlink> cannetlink::links() {
+  QList<canlink> result;
+  struct {
+    struct nlmsghdr nlh;
+    struct ifinfomsg ifi;
+  } request;
+  char buffer[32768];
+  canlink link;
+
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0) {
+    cerr << "Cannot open netlink socket: " << strerror(errno) << endl;
+    return result;
+  }
+
+  bzero(&request, sizeof(request));
+  request.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  request.nlh.nlmsg_type = RTM_GETLINK;
+  request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.nlh.nlmsg_seq = ++sequence;
+  request.ifi.ifi_family = AF_UNSPEC;
+  if (send(fd, &request, request.nlh.nlmsg_len, 0) < 0) {
+    cerr << "Cannot request the interface list: " << strerror(errno) << endl;
+    close(fd);
+    return result;
+  }
+
+  bool done = false;
+  while (!done) {
+    int len = recv(fd, buffer, sizeof(buffer), 0);
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      cerr << "Cannot read the interface list: " << strerror(errno) << endl;
+      break;
+    }
+    if (len == 0) break;
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+      if (nlh->nlmsg_seq != sequence) continue;
+      if (nlh->nlmsg_type == NLMSG_DONE || nlh->nlmsg_type == NLMSG_ERROR) {
+        done = true;
+        break;
+      }
+      if (parselink(nlh, &link)) result.append(link);
+    }
+  }
+  close(fd);
+  return result;
+}
+
+/*!
+ * Reads the pending link change events and reports those about CAN
+ * interfaces. If the kernel had to drop events (ENOBUFS) the list is out
+ * of date and resync() is emitted.
+ */
+void cannetlink::readevents() {
+  char buffer[32768];
+  canlink link;
+
+  while (true) {
+    int len = recv(monitorfd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      if (errno == ENOBUFS) emit resync();
+      break;
+    }
+    if (len == 0) break;
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+      if (!parselink(nlh, &link)) continue;
+      if (nlh->nlmsg_type == RTM_DELLINK) emit linkremoved(link);
+      else emit linkchanged(link);
+    }
+  }
+}
+
+/*!
+ * Appends an attribute to a netlink message.
+ * @param nlh The message (with room for the attribute)
+ * @param type Attribute type
+ * @param data Payload (0 for a nested attribute filled afterwards)
+ * @param len Length of the payload
+ * @return the attribute, to be passed to endnest() for a nested one
+ */
+static struct rtattr *addattr(struct nlmsghdr *nlh, int type, const void *data, int len) {
+  struct rtattr *rta = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+  rta->rta_type = type;
+  rta->rta_len = RTA_LENGTH(len);
+  if (data) memcpy(RTA_DATA(rta), data, len);
+  nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+  return rta;
+}
+
+/*!
+ * Closes a nested attribute: it spans everything appended since.
+ * @param nlh The message
+ * @param nest The nested attribute returned by addattr()
+ */
+static void endnest(struct nlmsghdr *nlh, struct rtattr *nest) {
+  nest->rta_len = (char *)nlh + nlh->nlmsg_len - (char *)nest;
+}
+
+/*!
+ * Sends a request and waits for its acknowledgement.
+ * @param nlh The request (NLM_F_ACK is added)
+ * @param error Receives the reason if the kernel refused the request
+ * @return whether the request has been carried out
+ */
+bool cannetlink::request(struct nlmsghdr *nlh, QString *error) {
+  char buffer[8192];
+
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0) {
+    *error = QString::fromLocal8Bit(strerror(errno));
+    return false;
+  }
+  nlh->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+  nlh->nlmsg_seq = ++sequence;
+  if (send(fd, nlh, nlh->nlmsg_len, 0) < 0) {
+    *error = QString::fromLocal8Bit(strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  int result = EIO;
+  bool done = false;
+  while (!done) {
+    int len = recv(fd, buffer, sizeof(buffer), 0);
+    if (len < 0 && errno == EINTR) continue;
+    if (len <= 0) break;
+    for (struct nlmsghdr *answer = (struct nlmsghdr *)buffer; NLMSG_OK(answer, (unsigned int)len); answer = NLMSG_NEXT(answer, len)) {
+      if (answer->nlmsg_seq != sequence || answer->nlmsg_type != NLMSG_ERROR) continue;
+      result = -((struct nlmsgerr *)NLMSG_DATA(answer))->error;
+      done = true;
+      break;
+    }
+  }
+  close(fd);
+
+  if (result) *error = QString::fromLocal8Bit(strerror(result));
+  return result == 0;
+}
+
+/*!
+ * Sets an interface up or down.
+ * @param ifindex Interface index
+ * @param up Whether it shall be up
+ * @param error Receives the reason if it failed
+ * @return success of the operation
+ */
+bool cannetlink::setup(int ifindex, bool up, QString *error) {
+  struct {
+    struct nlmsghdr nlh;
+    struct ifinfomsg ifi;
+  } req;
+
+  bzero(&req, sizeof(req));
+  req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.nlh.nlmsg_type = RTM_NEWLINK;
+  req.ifi.ifi_family = AF_UNSPEC;
+  req.ifi.ifi_index = ifindex;
+  req.ifi.ifi_change = IFF_UP;
+  req.ifi.ifi_flags = up ? IFF_UP : 0;
+  return request(&req.nlh, error);
+}
+
+/*!
+ * Sets bitrate, sample point, restart-ms and the CAN FD data bitrate of an
+ * interface. The kernel only takes bit timing while the interface is down,
+ * so an interface that is up is set down and up again around it.
+ * Needs CAP_NET_ADMIN.
+ * @param ifindex Interface index
+ * @param config The settings (the data bitrate only counts with fd set)
+ * @param error Receives the reason if it failed
+ * @return success of the operation
+ */
+bool cannetlink::configure(int ifindex, const canlinkconfig &config, QString *error) {
+  struct {
+    struct nlmsghdr nlh;
+    struct ifinfomsg ifi;
+    char attributes[512];
+  } req;
+  struct can_bittiming bittiming;
+  struct can_ctrlmode ctrlmode;
+
+  bzero(&req, sizeof(req));
+  req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.nlh.nlmsg_type = RTM_NEWLINK;
+  req.ifi.ifi_family = AF_UNSPEC;
+  req.ifi.ifi_index = ifindex;
+
+  struct rtattr *linkinfo = addattr(&req.nlh, IFLA_LINKINFO, 0, 0);
+  addattr(&req.nlh, IFLA_INFO_KIND, "can", strlen("can"));
+  struct rtattr *data = addattr(&req.nlh, IFLA_INFO_DATA, 0, 0);
+  bzero(&bittiming, sizeof(bittiming));
+  bittiming.bitrate = config.bitrate;
+  bittiming.sample_point = config.samplepoint;
+  addattr(&req.nlh, IFLA_CAN_BITTIMING, &bittiming, sizeof(bittiming));
+  addattr(&req.nlh, IFLA_CAN_RESTART_MS, &config.restartms, sizeof(config.restartms));
+  ctrlmode.mask = CAN_CTRLMODE_FD;
+  ctrlmode.flags = config.fd ? CAN_CTRLMODE_FD : 0;
+  addattr(&req.nlh, IFLA_CAN_CTRLMODE, &ctrlmode, sizeof(ctrlmode));
+  if (config.fd) {
+    bzero(&bittiming, sizeof(bittiming));
+    bittiming.bitrate = config.databitrate;
+    bittiming.sample_point = config.datasamplepoint;
+    addattr(&req.nlh, IFLA_CAN_DATA_BITTIMING, &bittiming, sizeof(bittiming));
+  }
+  endnest(&req.nlh, data);
+  endnest(&req.nlh, linkinfo);
+
+  bool wasup = false;
+  foreach (const canlink &link, links()) {
+    if (link.ifindex == ifindex) wasup = link.up;
+  }
+  if (wasup && !setup(ifindex, false, error)) return false;
+  bool ok = request(&req.nlh, error);
+  QString uperror;
+  if (wasup && !setup(ifindex, true, ok ? error : &uperror)) return false;
+  return ok;
+}
+
+/*!
+ * Description of a controller state.
+ * @param state CAN_STATE_* (-1 = not reported)
+ * @return description
+ */
+QString cannetlink::statename(int state) {
+  switch (state) {
+  case CAN_STATE_ERROR_ACTIVE: return tr("error active");
+  case CAN_STATE_ERROR_WARNING: return tr("error warning");
+  case CAN_STATE_ERROR_PASSIVE: return tr("error passive");
+  case CAN_STATE_BUS_OFF: return tr("bus-off");
+  case CAN_STATE_STOPPED: return tr("stopped");
+  case CAN_STATE_SLEEPING: return tr("sleeping");
+  }
+  return QString("-");
+}
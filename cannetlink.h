@@ -0,0 +1,94 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANNETLINK_H
+#define CANNETLINK_H
+
+#include <QtCore>
+
+#include <linux/can/netlink.h>
+
+struct nlmsghdr;
+
+/*!
+ * Bit timing and controller settings of a CAN interface (IFLA_CAN_*).
+ * Only bitrates and sample points are given; the driver computes the
+ * time quanta from them.
+ */
+struct canlinkconfig {
+  quint32 bitrate;            //!< Nominal bitrate in bit/s (0 = not configured)
+  quint32 samplepoint;        //!< Sample point in tenths of a percent (0 = driver default)
+  quint32 restartms;          //!< Automatic restart after bus-off in ms (0 = off)
+  bool fd;                    //!< CAN FD mode (CAN_CTRLMODE_FD)
+  quint32 databitrate;        //!< Data phase bitrate of CAN FD in bit/s
+  quint32 datasamplepoint;    //!< Data phase sample point in tenths of a percent
+};
+
+/*!
+ * State and error counters of a CAN controller.
+ */
+struct canlinkstatus {
+  int state;                  //!< CAN_STATE_* (-1 = not reported, e.g. vcan)
+  quint16 txerrors;           //!< Transmit error counter
+  quint16 rxerrors;           //!< Receive error counter
+  bool hasxstats;             //!< Whether xstats has been reported (IFLA_INFO_XSTATS)
+  struct can_device_stats xstats; //!< Bus errors, state changes, bus-offs and restarts
+};
+
+/*!
+ * A CAN network interface as reported by rtnetlink.
+ */
+struct canlink {
+  int ifindex;                //!< Interface index (stays the same when renamed)
+  QString name;               //!< Interface name, e.g. "can0"
+  QString kind;               //!< Link kind, "can" for real controllers, "vcan", ...
+  bool up;                    //!< Administratively up (IFF_UP)
+  bool running;               //!< Operationally up (IFF_RUNNING), e.g. not bus-off
+  bool configurable;          //!< Whether the interface has bit timing (IFLA_CAN_BITTIMING)
+  canlinkconfig config;       //!< Bit timing and controller settings
+  canlinkstatus status;       //!< State and error counters
+};
+
+/*!
+ * Discovery and monitoring of the CAN interfaces via rtnetlink.
+ * links() lists all interfaces of type ARPHRD_CAN with one RTM_GETLINK
+ * dump; a socket subscribed to RTMGRP_LINK reports every change of an
+ * interface (added, removed, renamed, up or down) as soon as the kernel
+ * sends it, through the main event loop. The same dump carries the bit
+ * timing, controller state and statistics of every interface, so polling
+ * them costs one netlink round trip no matter how many interfaces exist.
+ */
+class cannetlink: public QObject {
+Q_OBJECT
+
+public:
+  cannetlink(QObject *parent = 0);        //!< Constructor, subscribes to link changes
+  ~cannetlink();                          //!< Destructor, closes the netlink socket
+  QList<canlink> links();                 //!< All CAN interfaces of the host with settings and statistics
+  bool configure(int ifindex, const canlinkconfig &config, QString *error); //!< Sets bit timing and restart-ms
+  static QString statename(int state);    //!< Description of a CAN_STATE_*
+
+signals:
+  void linkchanged(canlink link);         //!< A CAN interface has been added or changed
+  void linkremoved(canlink link);         //!< A CAN interface has been removed
+  void resync();                          //!< Events have been lost; links() has to be read again
+
+private slots:
+  void readevents();                      //!< Reads the pending link change events
+
+private:
+  int monitorfd;                          //!< Netlink socket subscribed to RTMGRP_LINK (-1 = none)
+  quint32 sequence;                       //!< Sequence number of the last request
+  QSocketNotifier *notifier;              //!< Calls readevents() when events are pending
+
+  static bool parselink(const struct nlmsghdr *nlh, canlink *link); //!< Reads a CAN interface from a link message
+  bool request(struct nlmsghdr *nlh, QString *error); //!< Sends a request and waits for its acknowledgement
+  bool setup(int ifindex, bool up, QString *error); //!< Sets an interface up or down
+};
+
+#endif // CANNETLINK_H
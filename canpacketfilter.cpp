@@ -0,0 +1,135 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canpacketfilter.h"
+
+#include <linux/can.h>
+
+#include <algorithm>
+
+using namespace std;
+
+/*!
+ * Constructor, creates a filter that matches everything.
+ */
+canpacketfilter::canpacketfilter() {
+  direction = AnyDirection;
+  errors = AnyFrame;
+  payloadlength = 0;
+  memset(payloadvalue, 0, sizeof(payloadvalue));
+  memset(payloadmask, 0, sizeof(payloadmask));
+}
+
+/*!
+ * Set the IDs to be shown.
+ * IDs are hexadecimal, separated by commas or spaces; ranges are given as
+ * "first-last". Example: "123, 200-2FF, 18DAF110"
+ * @param idlist List of IDs and ranges; empty to show all IDs
+ * @return false if the list could not be parsed (the filter is unchanged then)
+ */
+bool canpacketfilter::setids(const QString &idlist) {
+  QVector<idrange> ranges;
+  bool ok;
+
+  QStringList items = idlist.split(QRegExp("[,;\\s]+"), QString::SkipEmptyParts);
+  foreach (const QString &item, items) {
+    idrange range;
+    QStringList bounds = item.split("-");
+    if (bounds.size() > 2) return false;
+    range.first = bounds.at(0).toULong(&ok, 16);
+    if (!ok || range.first > CAN_EFF_MASK) return false;
+    range.last = range.first;
+    if (bounds.size() == 2) {
+      range.last = bounds.at(1).toULong(&ok, 16);
+      if (!ok || range.last > CAN_EFF_MASK || range.last < range.first) return false;
+    }
+    ranges.append(range);
+  }
+
+  // Sort and merge overlapping ranges so that matches() can do a binary search
+  std::sort(ranges.begin(), ranges.end(), rangeless);
+  idranges.clear();
+  foreach (const idrange &range, ranges) {
+    if (!idranges.isEmpty() && range.first <= idranges.last().last + 1) {
+      idranges.last().last = qMax(idranges.last().last, range.last);
+    } else {
+      idranges.append(range);
+    }
+  }
+  return true;
+}
+
+/*!
+ * Orders ranges by their first ID.
+ * @param a First range
+ * @param b Second range
+ * @return true if a starts before b
+ */
+bool canpacketfilter::rangeless(const idrange &a, const idrange &b) {
+  return a.first < b.first;
+}
+
+/*!
+ * Set the payload pattern.
+ * The pattern is a list of hexadecimal bytes, "??" (or "xx") matches any byte
+ * and a single "?" matches any nibble. Example: "02 ?? 7F 1?"
+ * Packets with less bytes than the pattern do not match.
+ * @param pattern Payload pattern; empty to match any payload
+ * @return false if the pattern could not be parsed (the filter is unchanged then)
+ */
+bool canpacketfilter::setpayload(const QString &pattern) {
+  quint8 value[8];
+  quint8 mask[8];
+  bool ok;
+
+  QStringList bytes = pattern.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+  if (bytes.size() > 8) return false;
+  for (int i = 0; i < bytes.size(); i++) {
+    QString byte = bytes.at(i).toUpper().replace('X', '?');
+    if (byte.size() != 2) return false;
+    value[i] = 0;
+    mask[i] = 0;
+    for (int nibble = 0; nibble < 2; nibble++) {
+      int shift = nibble ? 0 : 4;
+      if (byte.at(nibble) == QChar('?')) continue;
+      quint8 digit = QString(byte.at(nibble)).toUInt(&ok, 16);
+      if (!ok) return false;
+      value[i] |= digit << shift;
+      mask[i] |= 0x0F << shift;
+    }
+  }
+
+  payloadlength = bytes.size();
+  memcpy(payloadvalue, value, sizeof(value));
+  memcpy(payloadmask, mask, sizeof(mask));
+  return true;
+}
+
+/*!
+ * Set which directions are shown.
+ * @param newdirection Directions to be shown
+ */
+void canpacketfilter::setdirection(Direction newdirection) {
+  direction = newdirection;
+}
+
+/*!
+ * Set how error frames are handled.
+ * @param newerrors Whether error frames, data frames or both are shown
+ */
+void canpacketfilter::seterrors(Errors newerrors) {
+  errors = newerrors;
+}
+
+/*!
+ * True if the filter matches every packet.
+ * @return whether the filter is empty
+ */
+bool canpacketfilter::isempty() const {
+  return idranges.isEmpty() && direction == AnyDirection && errors == AnyFrame && payloadlength == 0;
+}
@@ -0,0 +1,91 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANPACKETFILTER_H
+#define CANPACKETFILTER_H
+
+#include <QtGui>
+
+#include "canlogfile.h"
+
+/*!
+ * Display filter deciding which canpackets are shown in a canlogfile.
+ * Unlike the CAN hardware filters it does not touch the capture, so it can be
+ * changed at any time. An empty filter matches everything.
+ */
+class canpacketfilter {
+
+public:
+  //! Which directions are shown
+  enum Direction {
+    AnyDirection = 0,   //!< Received and sent packets
+    ReceivedOnly,       //!< Only received packets
+    SentOnly            //!< Only sent packets
+  };
+  //! How error frames are handled
+  enum Errors {
+    AnyFrame = 0,       //!< Error and data frames
+    ErrorsOnly,         //!< Only error frames
+    NoErrors            //!< Only data frames
+  };
+
+  canpacketfilter();                          //!< Constructor, creates a filter that matches everything
+  bool setids(const QString &idlist);         //!< Set the IDs to be shown ("123, 200-2FF, ...")
+  bool setpayload(const QString &pattern);    //!< Set the payload pattern ("11 ?? 22 ...")
+  void setdirection(Direction newdirection);  //!< Set which directions are shown
+  void seterrors(Errors newerrors);           //!< Set how error frames are handled
+  bool isempty() const;                       //!< True if the filter matches every packet
+
+  /*!
+   * Checks whether a packet passes the filter. Called for every packet on a
+   * rescan, so it is kept inline and does not allocate.
+   * @param packet Packet to be checked
+   * @return true if the packet shall be shown
+   */
+  inline bool matches(const canpacket &packet) const {
+    if (direction == ReceivedOnly && !packet.direction) return false;
+    if (direction == SentOnly && packet.direction) return false;
+    if (errors == ErrorsOnly && !packet.err) return false;
+    if (errors == NoErrors && packet.err) return false;
+    if (payloadlength) {
+      if (packet.dlc < payloadlength) return false;
+      for (int i = 0; i < payloadlength; i++) {
+        if ((packet.data[i] & payloadmask[i]) != payloadvalue[i]) return false;
+      }
+    }
+    if (!idranges.isEmpty()) {
+      // binary search in the sorted, non-overlapping ranges
+      int low = 0;
+      int high = idranges.size();
+      while (low < high) {
+        int mid = (low + high) / 2;
+        if (idranges.at(mid).last < packet.identifier) low = mid + 1; else high = mid;
+      }
+      if (low == idranges.size() || idranges.at(low).first > packet.identifier) return false;
+    }
+    return true;
+  }
+
+private:
+  //! Inclusive range of CAN IDs
+  struct idrange {
+    quint32 first;                  //!< first ID of the range
+    quint32 last;                   //!< last ID of the range
+  };
+
+  QVector<idrange> idranges;        //!< Sorted, merged ID ranges (empty = all IDs)
+  Direction direction;              //!< Which directions are shown
+  Errors errors;                    //!< How error frames are handled
+  int payloadlength;                //!< Number of payload bytes to compare (0 = no pattern)
+  quint8 payloadvalue[8];           //!< Expected payload bytes (already masked)
+  quint8 payloadmask[8];            //!< Bits of the payload bytes to compare
+
+  static bool rangeless(const idrange &a, const idrange &b);  //!< Orders ranges by their first ID
+};
+
+#endif // CANPACKETFILTER_H
@@ -0,0 +1,588 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canpacketmodel.h"
+#include "candbc.h"
+
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+/*!
+ * One element to be sorted: the typed key of a cell and the packet it belongs to.
+ */
+struct sortentry {
+  quint64 key;                //!< Typed sort key of the cell
+  quint32 index;              //!< Index of the packet in arrival order
+};
+
+/*!
+ * A part of the sortentry array that is handled by one worker.
+ */
+struct sortrange {
+  sortentry *begin;           //!< First element
+  sortentry *middle;          //!< Start of the second half (merging only)
+  sortentry *end;             //!< Behind the last element
+};
+
+/*!
+ * Strict weak ordering of two sortentries. Equal keys keep the arrival order.
+ */
+static bool entryless(const sortentry &a, const sortentry &b) {
+  return a.key < b.key || (a.key == b.key && a.index < b.index);
+}
+
+/*!
+ * Worker: sort one chunk of sortentries.
+ */
+static void sortchunk(sortrange &range) {
+  std::sort(range.begin, range.end, entryless);
+}
+
+/*!
+ * Worker: merge two adjacent, sorted chunks.
+ */
+static void mergechunks(sortrange &range) {
+  std::inplace_merge(range.begin, range.middle, range.end, entryless);
+}
+
+/*!
+ * A part of the packets that is checked against the display filter by one worker.
+ */
+struct scanrange {
+  const canpacketstore *store;      //!< Store holding the packets
+  const canpacketfilter *filter;    //!< Filter to check against
+  int first;                        //!< Storage index of the first packet to check
+  int end;                          //!< Behind the last packet to check
+  quint32 firstarrival;             //!< Arrival number of storage index 0
+  QVector<quint32> rows;            //!< Result: arrival numbers of the matching packets
+};
+
+/*!
+ * Worker: check one chunk of packets against the display filter.
+ */
+static void scanchunk(scanrange &range) {
+  for (int i = range.first; i < range.end; i++) {
+    if (range.filter->matches(range.store->packetat(i))) range.rows.append(range.firstarrival + i);
+  }
+}
+
+/*!
+ * Sort the entries using all available cores.
+ * The array is cut into one chunk per core, the chunks are sorted in parallel
+ * and then merged pairwise (also in parallel) until only one chunk is left.
+ * @param entries Entries to be sorted
+ */
+static void parallelsort(QVector<sortentry> &entries) {
+  const int minchunk = 65536;
+  int count = entries.size();
+  int threads = qMax(1, QThread::idealThreadCount());
+  int chunksize = qMax(minchunk, (count + threads - 1) / threads);
+  sortentry *base = entries.data();
+
+  QVector<sortrange> ranges;
+  for (int start = 0; start < count; start += chunksize) {
+    sortrange range = { base + start, base + start, base + qMin(count, start + chunksize) };
+    ranges.append(range);
+  }
+  if (ranges.size() == 1) {
+    sortchunk(ranges[0]);
+    return;
+  }
+  QtConcurrent::blockingMap(ranges, sortchunk);
+
+  while (ranges.size() > 1) {
+    QVector<sortrange> merges;
+    for (int i = 0; i + 1 < ranges.size(); i += 2) {
+      sortrange merge = { ranges.at(i).begin, ranges.at(i).end, ranges.at(i + 1).end };
+      merges.append(merge);
+    }
+    if (ranges.size() % 2) merges.append(ranges.last());
+    QVector<sortrange> work = merges;
+    if (ranges.size() % 2) work.remove(work.size() - 1);
+    QtConcurrent::blockingMap(work, mergechunks);
+    ranges = merges;
+  }
+}
+
+/*!
+ * Constructor, creates a view of the store showing all its packets.
+ * @param newstore Store holding the packets, shared with the other views
+ * @param parent Parent of the model
+ */
+canpacketmodel::canpacketmodel(QSharedPointer<canpacketstore> newstore, QObject *parent) :
+        QAbstractTableModel(parent), store(newstore) {
+  database = 0;
+  sortcolumn = ColNumber;
+  sortorder = Qt::AscendingOrder;
+  connect(store.data(), SIGNAL(appended(quint32)), this, SLOT(packetappended(quint32)));
+  connect(store.data(), SIGNAL(evicting(int)), this, SLOT(packetsevicting(int)));
+  connect(store.data(), SIGNAL(abouttoreload()), this, SLOT(storeabouttoreload()));
+  connect(store.data(), SIGNAL(reloaded()), this, SLOT(storereloaded()));
+  order = scan(0);
+}
+
+/*!
+ * Number of rows (packets).
+ * @param parent Only the invisible root has children
+ * @return number of rows
+ */
+int canpacketmodel::rowCount(const QModelIndex &parent) const {
+  if (parent.isValid()) return 0;
+  return order.size();
+}
+
+/*!
+ * Number of columns.
+ * @param parent Only the invisible root has children
+ * @return number of columns
+ */
+int canpacketmodel::columnCount(const QModelIndex &parent) const {
+  if (parent.isValid()) return 0;
+  return ColumnCount;
+}
+
+/*!
+ * Formats one cell. Only called for the rows the view actually shows.
+ * @param index Cell to be formatted
+ * @param role Qt::DisplayRole or Qt::BackgroundRole (bookmarked packets)
+ * @return display string of the cell
+ */
+QVariant canpacketmodel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid()) return QVariant();
+  if (index.row() >= order.size() || index.column() >= ColumnCount) return QVariant();
+
+  quint32 arrival = order.at(index.row());
+  const canpacket &packet = store->packetbyarrival(arrival);
+  if (role == Qt::BackgroundRole && packet.bookmark) return QBrush(QColor(255, 255, 160));
+  if (role != Qt::DisplayRole) return QVariant();
+  if (index.column() == ColSignals) return database ? database->describe(packet) : QString();
+  return celltext(packet, arrival, index.column());
+}
+
+/*!
+ * Header labels.
+ * @param section Column number
+ * @param orientation Only horizontal headers are provided
+ * @param role Only Qt::DisplayRole is provided
+ * @return Label of the column
+ */
+QVariant canpacketmodel::headerData(int section, Qt::Orientation orientation, int role) const {
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return QVariant();
+  switch (section) {
+  case ColNumber: return tr("#");
+  case ColTimestamp: return tr("Timestamp");
+  case ColInterface: return tr("Interface");
+  case ColDirection: return tr("Dir");
+  case ColRTR: return tr("RTR");
+  case ColEFF: return tr("EFF");
+  case ColERR: return tr("ERR");
+  case ColID: return tr("CAN ID");
+  case ColDLC: return tr("DLC");
+  case ColData: return tr("Data");
+  case ColCRC: return tr("CRC");
+  case ColSignals: return tr("Signals");
+  }
+  return QVariant();
+}
+
+/*!
+ * Sorts the rows by a typed column.
+ * The packets are not touched, only the row permutation is computed (in
+ * parallel). Sorting the same column again in the other direction only
+ * reverses the groups of equal keys; within a group the packets stay in
+ * arrival order, just as sortedrows() leaves them.
+ * @param column Column to sort by
+ * @param neworder Direction of the sorting
+ */
+void canpacketmodel::sort(int column, Qt::SortOrder neworder) {
+  if (column < 0 || column >= ColumnCount) return;
+  if (column == sortcolumn && neworder == sortorder) return;
+
+  QVector<quint32> permutation;
+  if (column == sortcolumn) {
+    // Cheap case: the groups of equal keys in reverse order
+    permutation.reserve(order.size());
+    int end = order.size();
+    while (end > 0) {
+      int begin = end - 1;
+      quint64 key = keyofarrival(order.at(begin), column);
+      while (begin > 0 && keyofarrival(order.at(begin - 1), column) == key) begin--;
+      for (int row = begin; row < end; row++) permutation.append(order.at(row));
+      end = begin;
+    }
+  } else {
+    permutation = sortedrows(order, column, neworder);
+  }
+
+  sortcolumn = column;
+  sortorder = neworder;
+  reorder(permutation);
+}
+
+/*!
+ * Sets the display filter. All packets are checked again (in parallel), the
+ * packets themselves are not touched.
+ * @param newfilter Filter deciding which packets get a row
+ */
+void canpacketmodel::setfilter(const canpacketfilter &newfilter) {
+  // May take some time, so let the user know we are working
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+
+  filter = newfilter;
+  QVector<quint32> rows = scan(0);
+  if (!isidentity()) rows = sortedrows(rows, sortcolumn, sortorder);
+
+  beginResetModel();
+  order = rows;
+  endResetModel();
+
+  QApplication::restoreOverrideCursor();
+}
+
+/*!
+ * Sets the signal database used for decoding. The signals are decoded when a
+ * row is shown, so only the signal column has to be redrawn.
+ * @param newdatabase Signal database (0 = none); it must stay alive while in use
+ */
+void canpacketmodel::setdatabase(const candbc *newdatabase) {
+  database = newdatabase;
+  if (!order.isEmpty()) emit dataChanged(index(0, ColSignals), index(order.size() - 1, ColSignals));
+}
+
+/*!
+ * Packet displayed in a row.
+ * @param row Row in the current sort order
+ * @return the packet
+ */
+const canpacket &canpacketmodel::packetatrow(int row) const {
+  return store->packetbyarrival(order.at(row));
+}
+
+/*!
+ * Arrival number of the packet displayed in a row.
+ * @param row Row in the current sort order
+ * @return arrival number
+ */
+quint32 canpacketmodel::arrivalatrow(int row) const {
+  return order.at(row);
+}
+
+/*!
+ * Row displaying a packet. Binary search while the rows are sorted by
+ * arrival number, otherwise the rows are searched one by one.
+ * @param arrival Arrival number of the packet
+ * @return row (-1 if the packet is not shown)
+ */
+int canpacketmodel::rowofarrival(quint32 arrival) const {
+  if (sortcolumn != ColNumber) return order.indexOf(arrival);
+  quint32 offset = arrival - store->oldestarrival();
+  int low = 0;
+  int high = order.size();
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    bool before = (order.at(mid) - store->oldestarrival()) < offset;
+    if (sortorder == Qt::DescendingOrder) before = (order.at(mid) - store->oldestarrival()) > offset;
+    if (before) low = mid + 1; else high = mid;
+  }
+  return (low < order.size() && order.at(low) == arrival) ? low : -1;
+}
+
+/*!
+ * Store holding the packets.
+ * @return the store, shared with the other views
+ */
+QSharedPointer<canpacketstore> canpacketmodel::packetstore() const {
+  return store;
+}
+
+/*!
+ * Called when the store has stored one packet. If it passes the display
+ * filter, it gets a row; if the rows are sorted, it is inserted at the row
+ * it belongs to.
+ * @param arrival Arrival number of the packet
+ */
+void canpacketmodel::packetappended(quint32 arrival) {
+  const canpacket &packet = store->packetbyarrival(arrival);
+  if (!filter.matches(packet)) return;
+
+  int row = insertposition(packet);
+  beginInsertRows(QModelIndex(), row, row);
+  order.insert(row, arrival);
+  endInsertRows();
+}
+
+/*!
+ * Typed sort key of one cell. Sorting on these keys gives numeric order for
+ * IDs, chronological order for timestamps and bytewise order for the payload.
+ * @param packet Packet the cell belongs to
+ * @param column Column of the cell
+ * @return key that compares like the typed value
+ */
+quint64 canpacketmodel::sortkey(const canpacket &packet, int column) {
+  switch (column) {
+  case ColTimestamp:
+    return (quint64)packet.tv.tv_sec * 1000000 + packet.tv.tv_usec;
+  case ColInterface: return packet.interface;
+  case ColDirection: return packet.direction;
+  case ColRTR: return packet.rtr;
+  case ColEFF: return packet.ide;
+  case ColERR: return packet.err;
+  case ColID: return packet.identifier;
+  case ColDLC: return packet.dlc;
+  case ColData: {
+    // Payload bytes big endian, so that the first byte is the most significant
+    quint64 key = 0;
+    for (int i = 0; i < 8; i++) {
+      key <<= 8;
+      if (i < packet.dlc) key |= packet.data[i];
+    }
+    return key;
+  }
+  case ColCRC: return packet.crc;
+  }
+  return 0;
+}
+
+/*!
+ * Display string of one cell.
+ * @param packet Packet the cell belongs to
+ * @param number Arrival number of the packet
+ * @param column Column of the cell
+ * @return string to be displayed
+ */
+QString canpacketmodel::celltext(const canpacket &packet, quint32 number, int column) {
+  switch (column) {
+  case ColNumber: return QString::number(number);
+  case ColTimestamp: {
+    // calculate the timestamp when the packet arrived
+    QDateTime timestamp = QDateTime::fromTime_t(packet.tv.tv_sec);
+    timestamp = timestamp.addMSecs(packet.tv.tv_usec / 1000);
+    return timestamp.toString(tr("dd.MM.yyyy hh:mm:ss.zzz"));
+  }
+  case ColInterface: return QString::number(packet.interface);
+  case ColDirection: return packet.direction ? tr("<") : tr(">");
+  case ColRTR: return packet.rtr ? tr("1") : tr("0");
+  case ColEFF: return packet.ide ? tr("1") : tr("0");
+  case ColERR: return packet.err ? tr("1") : tr("0");
+  case ColID: return QString("%1").arg(packet.identifier, packet.ide ? 8 : 3, 16, QChar('0')).toUpper();
+  case ColDLC: return QString::number(packet.dlc);
+  case ColData: {
+    // construct the data string as hex-values-string
+    QString datadisplay;
+    for (int i = 0; i < packet.dlc && i < 8; i++) {
+      datadisplay.append(QString("%1 ").arg((short)packet.data[i], 2, 16, QChar('0')));
+    }
+    return datadisplay;
+  }
+  case ColCRC: return QString::number(packet.crc);
+  }
+  return QString();
+}
+
+/*!
+ * Called when the store is about to drop its oldest packets from the ring;
+ * removes their rows.
+ * @param count Number of packets to be dropped
+ */
+void canpacketmodel::packetsevicting(int count) {
+  quint32 oldfirst = store->oldestarrival();
+  if (order.isEmpty()) return;
+
+  if (sortcolumn == ColNumber) {
+    // The dropped packets are the first (or last) rows
+    int rows = 0;
+    if (sortorder == Qt::AscendingOrder) {
+      while (rows < order.size() && (quint32)(order.at(rows) - oldfirst) < (quint32)count) rows++;
+      if (!rows) return;
+      beginRemoveRows(QModelIndex(), 0, rows - 1);
+      order.remove(0, rows);
+    } else {
+      while (rows < order.size() && (quint32)(order.at(order.size() - 1 - rows) - oldfirst) < (quint32)count) rows++;
+      if (!rows) return;
+      beginRemoveRows(QModelIndex(), order.size() - rows, order.size() - 1);
+      order.remove(order.size() - rows, rows);
+    }
+    endRemoveRows();
+    return;
+  }
+
+  // The dropped packets are spread over the rows: compact them in one pass
+  emit layoutAboutToBeChanged();
+  QVector<int> newrow(order.size());
+  QVector<quint32> neworder;
+  neworder.reserve(order.size());
+  for (int row = 0; row < order.size(); row++) {
+    if ((quint32)(order.at(row) - oldfirst) < (quint32)count) {
+      newrow[row] = -1;
+    } else {
+      newrow[row] = neworder.size();
+      neworder.append(order.at(row));
+    }
+  }
+  QModelIndexList oldlist = persistentIndexList();
+  QModelIndexList newlist;
+  foreach (const QModelIndex &oldindex, oldlist) {
+    int row = newrow.at(oldindex.row());
+    newlist << (row < 0 ? QModelIndex() : index(row, oldindex.column()));
+  }
+  changePersistentIndexList(oldlist, newlist);
+  order = neworder;
+  emit layoutChanged();
+}
+
+/*!
+ * Called when the store is about to replace all packets.
+ */
+void canpacketmodel::storeabouttoreload() {
+  beginResetModel();
+  order.clear();
+}
+
+/*!
+ * Called when the store has replaced all packets (cleared, resized or
+ * loaded); the rows are checked and sorted again.
+ */
+void canpacketmodel::storereloaded() {
+  order = scan(0);
+  if (!isidentity()) order = sortedrows(order, sortcolumn, sortorder);
+  endResetModel();
+}
+
+/*!
+ * Checks the packets from first to the end against the display filter.
+ * The packets are cut into one chunk per core which are checked in parallel.
+ * @param first Storage index of the first packet to check
+ * @return arrival numbers of the matching packets, ascending
+ */
+QVector<quint32> canpacketmodel::scan(int first) const {
+  QVector<quint32> rows;
+  if (filter.isempty()) {
+    rows.resize(store->packetcount() - first);
+    for (int i = 0; i < rows.size(); i++) rows[i] = store->oldestarrival() + first + i;
+    return rows;
+  }
+
+  const int minchunk = 65536;
+  int stored = store->packetcount();
+  int count = stored - first;
+  int threads = qMax(1, QThread::idealThreadCount());
+  int chunksize = qMax(minchunk, (count + threads - 1) / threads);
+
+  QVector<scanrange> ranges;
+  for (int start = first; start < stored; start += chunksize) {
+    scanrange range;
+    range.store = store.data();
+    range.filter = &filter;
+    range.first = start;
+    range.end = qMin(stored, start + chunksize);
+    range.firstarrival = store->oldestarrival();
+    ranges.append(range);
+  }
+  if (ranges.size() == 1) scanchunk(ranges[0]); else QtConcurrent::blockingMap(ranges, scanchunk);
+
+  foreach (const scanrange &range, ranges) rows += range.rows;
+  return rows;
+}
+
+/*!
+ * Sorts packets by a typed column (in parallel).
+ * @param rows Arrival numbers of the packets to be sorted
+ * @param column Column to sort by
+ * @param direction Direction of the sorting
+ * @return the arrival numbers in sorted order
+ */
+QVector<quint32> canpacketmodel::sortedrows(const QVector<quint32> &rows, int column, Qt::SortOrder direction) const {
+  // May take some time, so let the user know we are working
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+
+  quint32 firstarrival = store->oldestarrival();
+  QVector<sortentry> entries(rows.size());
+  for (int i = 0; i < rows.size(); i++) {
+    quint32 index = rows.at(i) - firstarrival;
+    entries[i].key = (column == ColNumber) ? index : sortkey(store->packetat(index), column);
+    if (direction == Qt::DescendingOrder) entries[i].key = ~entries[i].key;
+    entries[i].index = index;
+  }
+  parallelsort(entries);
+
+  QVector<quint32> result(entries.size());
+  for (int i = 0; i < entries.size(); i++) result[i] = firstarrival + entries.at(i).index;
+
+  QApplication::restoreOverrideCursor();
+  return result;
+}
+
+/*!
+ * True if the rows are in arrival order.
+ * @return whether the rows are sorted ascending by arrival number
+ */
+bool canpacketmodel::isidentity() const {
+  return sortcolumn == ColNumber && sortorder == Qt::AscendingOrder;
+}
+
+/*!
+ * Sort key of a stored packet, the arrival number for ColNumber.
+ * @param arrival Arrival number of the packet
+ * @param column Column to sort by
+ * @return the key
+ */
+quint64 canpacketmodel::keyofarrival(quint32 arrival, int column) const {
+  if (column == ColNumber) return arrival;
+  return sortkey(store->packetbyarrival(arrival), column);
+}
+
+/*!
+ * Row where a new packet belongs in the current sort order (binary search).
+ * Packets with equal keys stay in arrival order in both directions, as
+ * sortedrows() leaves them, so a new packet goes behind them.
+ * @param packet The new packet
+ * @return row to insert the packet at
+ */
+int canpacketmodel::insertposition(const canpacket &packet) const {
+  if (isidentity()) return order.size();
+  if (sortcolumn == ColNumber) return 0;
+
+  quint64 key = sortkey(packet, sortcolumn);
+  int low = 0;
+  int high = order.size();
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    quint64 midkey = sortkey(store->packetbyarrival(order.at(mid)), sortcolumn);
+    bool before = (sortorder == Qt::AscendingOrder) ? (midkey <= key) : (midkey >= key);
+    if (before) low = mid + 1; else high = mid;
+  }
+  return low;
+}
+
+/*!
+ * Installs a new permutation and keeps the persistent indexes (selection,
+ * current item) on the packets they pointed to.
+ * @param neworder The new permutation (row -> arrival number)
+ */
+void canpacketmodel::reorder(const QVector<quint32> &neworder) {
+  emit layoutAboutToBeChanged();
+
+  QModelIndexList oldlist = persistentIndexList();
+  if (!oldlist.isEmpty()) {
+    quint32 firstarrival = store->oldestarrival();
+    QVector<quint32> inverse(store->packetcount());
+    for (int row = 0; row < neworder.size(); row++) inverse[neworder.at(row) - firstarrival] = row;
+    QModelIndexList newlist;
+    foreach (const QModelIndex &oldindex, oldlist) {
+      newlist << index(inverse.at(order.at(oldindex.row()) - firstarrival), oldindex.column());
+    }
+    changePersistentIndexList(oldlist, newlist);
+  }
+  order = neworder;
+
+  emit layoutChanged();
+}
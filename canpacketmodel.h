@@ -0,0 +1,89 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANPACKETMODEL_H
+#define CANPACKETMODEL_H
+
+#include <QtGui>
+
+#include "canlogfile.h"
+#include "canpacketfilter.h"
+#include "canpacketstore.h"
+
+class candbc;
+
+/*!
+ * Table model showing the raw canpackets of a canpacketstore.
+ * The model keeps no packets, only an index vector (row -> arrival number)
+ * that is used when the view asks for data; any number of models can show
+ * the same store side by side, each costing just its index. Sorting and the
+ * display filter only compute a new index. The display strings are built on
+ * demand.
+ */
+class canpacketmodel: public QAbstractTableModel {
+Q_OBJECT
+
+public:
+  //! Columns of the model as displayed by the canlogfile
+  enum Column {
+    ColNumber = 0,    //!< Arrival number of the packet
+    ColTimestamp,     //!< Timestamp
+    ColInterface,     //!< Interface (not used yet)
+    ColDirection,     //!< Direction
+    ColRTR,           //!< RTR bit
+    ColEFF,           //!< EFF/IDE bit
+    ColERR,           //!< ERROR bit
+    ColID,            //!< CAN ID
+    ColDLC,           //!< Data length code
+    ColData,          //!< Payload
+    ColCRC,           //!< CRC (not used yet)
+    ColSignals,       //!< Signals decoded with the signal database
+    ColumnCount       //!< Number of columns
+  };
+
+  explicit canpacketmodel(QSharedPointer<canpacketstore> newstore, QObject *parent = 0); //!< Constructor, creates a view of the store
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const;    //!< Number of rows (packets)
+  int columnCount(const QModelIndex &parent = QModelIndex()) const; //!< Number of columns
+  QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;  //!< Formats one cell
+  QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const; //!< Header labels
+  void sort(int column, Qt::SortOrder order = Qt::AscendingOrder); //!< Sorts the rows by a typed column
+
+  void setfilter(const canpacketfilter &newfilter); //!< Sets the display filter
+  void setdatabase(const candbc *newdatabase);    //!< Sets the signal database used for decoding
+  const canpacket &packetatrow(int row) const;    //!< Packet displayed in a row
+  quint32 arrivalatrow(int row) const;            //!< Arrival number of the packet displayed in a row
+  int rowofarrival(quint32 arrival) const;        //!< Row displaying a packet
+  QSharedPointer<canpacketstore> packetstore() const; //!< Store holding the packets
+
+  static quint64 sortkey(const canpacket &packet, int column);  //!< Typed sort key of one cell
+  static QString celltext(const canpacket &packet, quint32 number, int column); //!< Display string of one cell
+
+private slots:
+  void packetappended(quint32 arrival);           //!< The store has stored one packet
+  void packetsevicting(int count);                //!< The store is about to drop its oldest packets
+  void storeabouttoreload();                      //!< The store is about to replace all packets
+  void storereloaded();                           //!< The store has replaced all packets
+
+private:
+  QSharedPointer<canpacketstore> store; //!< Store holding the packets, shared with the other views
+  QVector<quint32> order;         //!< Shown rows: row -> arrival number of the packet
+  canpacketfilter filter;         //!< Display filter deciding which packets get a row
+  const candbc *database;         //!< Signal database used for decoding (0 = none)
+  int sortcolumn;                 //!< Column the rows are sorted by
+  Qt::SortOrder sortorder;        //!< Direction of the sorting
+
+  bool isidentity() const;        //!< True if the rows are in arrival order
+  quint64 keyofarrival(quint32 arrival, int column) const; //!< Sort key of a stored packet
+  int insertposition(const canpacket &packet) const;  //!< Row where a new packet belongs
+  QVector<quint32> scan(int first) const;         //!< Arrival numbers of the packets passing the filter
+  QVector<quint32> sortedrows(const QVector<quint32> &rows, int column, Qt::SortOrder direction) const; //!< Sorts packets
+  void reorder(const QVector<quint32> &neworder); //!< Installs a new permutation
+};
+
+#endif // CANPACKETMODEL_H
@@ -0,0 +1,262 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canpacketstore.h"
+
+#include <climits>
+
+/*!
+ * Constructor, creates an empty store.
+ * @param parent Parent of the store (usually none, it is owned by the QSharedPointers of its views)
+ */
+canpacketstore::canpacketstore(QObject *parent) : QObject(parent) {
+  ringcapacity = 0;
+  evictbatch = 0;
+  ringsize = 0;
+  ringstart = 0;
+  stored = 0;
+  firstarrival = 0;
+  loading = false;
+  state = Armed;
+  autotrigger = false;
+  posttrigger = 0;
+  postremaining = 0;
+  evicted = 0;
+  discarded = 0;
+}
+
+/*!
+ * Removes all packets and re-arms the trigger.
+ * The arrival numbers start at 0 again.
+ */
+void canpacketstore::clear() {
+  emit abouttoreload();
+  packets = QVector<canpacket>();
+  ringstart = 0;
+  stored = 0;
+  firstarrival = 0;
+  evicted = 0;
+  discarded = 0;
+  state = Armed;
+  emit reloaded();
+}
+
+/*!
+ * Appends one packet and tells the views about it.
+ * The packet also drives the trigger: it may fire it or be one of the
+ * post-trigger packets. Packets arriving while frozen are discarded.
+ * @param packet Packet to be added
+ * @return false if the packet has been discarded
+ */
+bool canpacketstore::append(const canpacket &packet) {
+  if (!store(packet)) return false;
+  emit appended(firstarrival + stored - 1);
+
+  if (state == Armed && autotrigger && triggerfilter.matches(packet)) trigger();
+  return true;
+}
+
+/*!
+ * Appends many packets at once (e.g. when loading a file).
+ * The ring limit applies, the trigger does not fire. The views are rebuilt
+ * once afterwards instead of following every packet.
+ * @param newpackets Packets to be added
+ */
+void canpacketstore::append(const QVector<canpacket> &newpackets) {
+  if (newpackets.isEmpty()) return;
+
+  emit abouttoreload();
+  loading = true;
+  foreach (const canpacket &packet, newpackets) store(packet);
+  loading = false;
+  emit reloaded();
+}
+
+/*!
+ * Number of stored packets.
+ * @return number of packets
+ */
+int canpacketstore::packetcount() const {
+  return stored;
+}
+
+/*!
+ * Arrival number of the oldest stored packet (storage index 0).
+ * @return arrival number
+ */
+quint32 canpacketstore::oldestarrival() const {
+  return firstarrival;
+}
+
+/*!
+ * Limits the storage to a ring of packets.
+ * The newest packets that fit are kept, they keep their arrival numbers.
+ * The trigger is re-armed.
+ * @param capacity Maximum number of stored packets (0 = unlimited)
+ * @param postpackets Packets to be recorded after the trigger
+ */
+void canpacketstore::setring(int capacity, int postpackets) {
+  // May take some time, so let the user know we are working
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+
+  if (capacity && postpackets >= capacity) postpackets = capacity - 1;
+  posttrigger = qMax(0, postpackets);
+  state = Armed;
+
+  // Copy the newest packets into a linear storage of the new size
+  int keep = stored;
+  if (capacity) keep = qMin(stored, capacity - posttrigger);
+  QVector<canpacket> newpackets;
+  int batch = capacity ? qMax(1, capacity / 64) : 0;
+  newpackets.reserve(capacity ? capacity + batch : keep);
+  for (int i = stored - keep; i < stored; i++) newpackets.append(packetat(i));
+
+  emit abouttoreload();
+  evicted += stored - keep;
+  firstarrival += stored - keep;
+  packets = newpackets;
+  ringcapacity = capacity;
+  evictbatch = batch;
+  ringsize = capacity ? capacity + batch : 0;
+  ringstart = 0;
+  stored = keep;
+  emit reloaded();
+
+  QApplication::restoreOverrideCursor();
+}
+
+/*!
+ * Sets the packets that fire the trigger.
+ * @param newfilter Packets matching this filter fire the trigger
+ * @param enabled Whether packets fire the trigger at all
+ */
+void canpacketstore::settriggerfilter(const canpacketfilter &newfilter, bool enabled) {
+  triggerfilter = newfilter;
+  autotrigger = enabled;
+}
+
+/*!
+ * Fires the trigger. The packets stored so far are kept, the configured
+ * number of post-trigger packets is recorded and then the capture freezes.
+ */
+void canpacketstore::trigger() {
+  if (state != Armed) return;
+  state = Triggered;
+  postremaining = posttrigger;
+  emit triggered();
+  if (postremaining == 0) {
+    state = Frozen;
+    emit capturecomplete();
+  }
+}
+
+/*!
+ * Re-arms the trigger. Recording continues with the packets stored so far.
+ */
+void canpacketstore::arm() {
+  state = Armed;
+}
+
+/*!
+ * State of the capture trigger.
+ * @return the state
+ */
+canpacketstore::TriggerState canpacketstore::triggerstate() const {
+  return state;
+}
+
+/*!
+ * Packets dropped from the ring.
+ * @return number of packets
+ */
+quint64 canpacketstore::evictedcount() const {
+  return evicted;
+}
+
+/*!
+ * Most packets the ring ever holds, its capacity plus one batch.
+ * @return number of packets (0 = unlimited)
+ */
+int canpacketstore::ringslots() const {
+  return ringsize;
+}
+
+/*!
+ * Packets discarded while frozen.
+ * @return number of packets
+ */
+quint64 canpacketstore::discardedcount() const {
+  return discarded;
+}
+
+/*!
+ * Ring capacity using the given memory (storage plus one row per packet in
+ * the main view; further views add up to one row each), leaving room for
+ * the batch of packets beyond the capacity.
+ * @param megabytes Memory to be used
+ * @return number of packets
+ */
+int canpacketstore::capacityformegabytes(int megabytes) {
+  return (qint64)megabytes * 1024 * 1024 / (sizeof(canpacket) + sizeof(quint32)) * 64 / 65;
+}
+
+/*!
+ * Number of packets that may be stored right now. While waiting for the
+ * trigger, the ring keeps room for the post-trigger packets so that they do
+ * not push out the packets before the trigger. A batch is dropped on
+ * reaching the limit, so the packets before the trigger never fall below
+ * the capacity minus the post-trigger packets.
+ * @return maximum number of stored packets
+ */
+int canpacketstore::limit() const {
+  if (!ringcapacity) return INT_MAX;
+  if (state == Armed) return ringsize - posttrigger;
+  return ringsize;
+}
+
+/*!
+ * Puts a packet into the storage, dropping the oldest packets if the ring is
+ * full. Counts the post-trigger packets and freezes the capture after the
+ * last one.
+ * @param packet Packet to be stored
+ * @return false if the packet has been discarded (capture frozen)
+ */
+bool canpacketstore::store(const canpacket &packet) {
+  if (state == Frozen) {
+    discarded++;
+    return false;
+  }
+
+  // Drop a batch of old packets at once, so that the views need fixing rarely
+  if (stored >= limit()) evict(qMax(stored - limit() + 1, evictbatch));
+
+  int slot = ringstart + stored;
+  if (ringsize && slot >= ringsize) slot -= ringsize;
+  if (slot == packets.size()) packets.append(packet); else packets[slot] = packet;
+  stored++;
+
+  if (state == Triggered && --postremaining <= 0) {
+    state = Frozen;
+    emit capturecomplete();
+  }
+  return true;
+}
+
+/*!
+ * Drops the oldest packets from the ring (O(1) for the storage). The views
+ * are told before, while the packets can still be read.
+ * @param count Number of packets to be dropped
+ */
+void canpacketstore::evict(int count) {
+  count = qMin(count, stored);
+  if (!loading) emit evicting(count);
+  ringstart = (ringstart + count) % ringsize;
+  stored -= count;
+  evicted += count;
+  firstarrival += count;
+}
@@ -0,0 +1,125 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANPACKETSTORE_H
+#define CANPACKETSTORE_H
+
+#include <QtGui>
+
+#include "canlogfile.h"
+#include "canpacketfilter.h"
+
+/*!
+ * Storage of the raw canpackets of one canlogfile, shared by all views.
+ * The packets are stored typed and in the order they arrived, they are never
+ * moved and never copied into a view. Every packet gets an arrival number
+ * (counted from 0 since the last clear()); the views (canpacketmodel,
+ * canidsummarymodel, ...) keep nothing but their own index of arrival
+ * numbers and follow the store through its signals. The views hold the
+ * store through a QSharedPointer, so it lives as long as the last of them.
+ *
+ * The storage can be limited to a ring of a fixed number of packets. When the
+ * ring is full, the oldest packets are dropped in batches of 1/64 of the
+ * capacity, so the views need fixing rarely; the ring has room for one
+ * batch beyond the capacity, so it never keeps fewer packets than that
+ * (nor fewer than the pre-trigger packets while armed). A trigger (manual or by a
+ * packet matching the trigger filter) freezes the packets before it and keeps
+ * recording the configured number of packets after it; then the capture is
+ * complete and further packets are discarded until the trigger is re-armed.
+ */
+class canpacketstore: public QObject {
+Q_OBJECT
+
+public:
+  //! State of the capture trigger
+  enum TriggerState {
+    Armed = 0,        //!< Waiting for the trigger, the ring keeps room for the post-trigger packets
+    Triggered,        //!< Trigger seen, recording the post-trigger packets
+    Frozen            //!< Post-trigger packets recorded, new packets are discarded
+  };
+
+  explicit canpacketstore(QObject *parent = 0);  //!< Constructor, creates an empty store
+
+  void clear();                                   //!< Removes all packets
+  bool append(const canpacket &packet);           //!< Appends one packet (false = not stored)
+  void append(const QVector<canpacket> &newpackets); //!< Appends many packets at once
+  int packetcount() const;                        //!< Number of stored packets
+  quint32 oldestarrival() const;                  //!< Arrival number of the oldest stored packet
+
+  /*!
+   * Packet by storage index (0 is the oldest stored packet).
+   * @param index Storage index of the packet
+   * @return the packet
+   */
+  inline const canpacket &packetat(int index) const {
+    int slot = ringstart + index;
+    if (ringsize && slot >= ringsize) slot -= ringsize;
+    return packets.at(slot);
+  }
+
+  /*!
+   * Packet by arrival number.
+   * @param arrival Arrival number of a stored packet
+   * @return the packet
+   */
+  inline const canpacket &packetbyarrival(quint32 arrival) const {
+    return packetat(arrival - firstarrival);
+  }
+
+  /*!
+   * Whether a packet is (still) stored.
+   * @param arrival Arrival number of the packet
+   * @return false if it has been dropped from the ring or has not arrived yet
+   */
+  inline bool isstored(quint32 arrival) const {
+    return (quint32)(arrival - firstarrival) < (quint32)stored;
+  }
+
+  void setring(int capacity, int posttrigger);    //!< Limits the storage to a ring of packets
+  void settriggerfilter(const canpacketfilter &newfilter, bool enabled); //!< Packets that fire the trigger
+  void trigger();                                 //!< Fires the trigger
+  void arm();                                     //!< Re-arms the trigger
+  TriggerState triggerstate() const;              //!< State of the capture trigger
+  quint64 evictedcount() const;                   //!< Packets dropped from the ring
+  int ringslots() const;                          //!< Most packets the ring ever holds
+  quint64 discardedcount() const;                 //!< Packets discarded while frozen
+
+  static int capacityformegabytes(int megabytes); //!< Ring capacity using the given memory
+
+signals:
+  void appended(quint32 arrival);                 //!< One packet has been stored
+  void evicting(int count);                       //!< The oldest packets are about to be dropped (still readable)
+  void abouttoreload();                           //!< All packets are about to be replaced
+  void reloaded();                                //!< All packets have been replaced (clear, ring or many appended)
+  void triggered();                               //!< The trigger has fired
+  void capturecomplete();                         //!< All post-trigger packets have been recorded
+
+private:
+  QVector<canpacket> packets;     //!< Storage of the packets (a ring if ringcapacity is set)
+  int ringcapacity;               //!< Packets the ring keeps at least (0 = unlimited)
+  int evictbatch;                 //!< Packets dropped from a full ring at once
+  int ringsize;                   //!< Slots of the ring: the capacity plus one batch (0 = unlimited)
+  int ringstart;                  //!< Slot of the oldest stored packet
+  int stored;                     //!< Number of stored packets
+  quint32 firstarrival;           //!< Arrival number of the oldest stored packet
+  bool loading;                   //!< Many packets are appended, the views are rebuilt afterwards
+
+  TriggerState state;             //!< State of the capture trigger
+  canpacketfilter triggerfilter;  //!< Packets matching this fire the trigger
+  bool autotrigger;               //!< Whether triggerfilter is used
+  int posttrigger;                //!< Packets to record after the trigger
+  int postremaining;              //!< Post-trigger packets still to be recorded
+  quint64 evicted;                //!< Packets dropped from the ring
+  quint64 discarded;              //!< Packets discarded while frozen
+
+  int limit() const;              //!< Number of packets that may be stored right now
+  bool store(const canpacket &packet);  //!< Puts a packet into the storage
+  void evict(int count);          //!< Drops the oldest packets
+};
+
+#endif // CANPACKETSTORE_H
@@ -0,0 +1,542 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canpipeline.h"
+#include "canpacketmodel.h"
+
+/*!
+ * Constructor, creates a worker without decoders.
+ * @param parent Parent object
+ */
+candecoderworker::candecoderworker(QObject *parent) :
+        QThread(parent) {
+  mask = 0;
+  inputgeneration = 0;
+  outputgeneration = 0;
+  stopping = false;
+}
+
+/*!
+ * Destructor, stops the thread and deletes the decoders.
+ */
+candecoderworker::~candecoderworker() {
+  stop();
+  qDeleteAll(decoders);
+}
+
+/*!
+ * Runs a decoder in this worker. Must be called before start().
+ * @param decoder The decoder, owned by the worker from now on
+ * @param number Its number in the pipeline (0 .. canpipeline::MaxDecoders - 1)
+ */
+void candecoderworker::adddecoder(candecoder *decoder, int number) {
+  candecoderstats zero = { 0, 0, 0 };
+  decoders.append(decoder);
+  numbers.append(number);
+  stats.append(zero);
+  mask |= 1u << number;
+}
+
+/*!
+ * Bit mask of the decoders run by this worker.
+ * @return bit mask of their numbers
+ */
+quint32 candecoderworker::decodermask() const {
+  return mask;
+}
+
+/*!
+ * Hands over a batch of canpackets. canpackets of an older generation that
+ * have not been decoded yet are dropped.
+ * @param batch canpackets in arrival order; emptied
+ * @param generation Generation of the canpackets
+ */
+void candecoderworker::submit(QVector<candecoderinput> &batch, quint32 generation) {
+  lock.lock();
+  if (generation != inputgeneration) {
+    input.clear();
+    inputgeneration = generation;
+  }
+  if (input.isEmpty()) input = batch; else input += batch;
+  wake.wakeOne();
+  lock.unlock();
+  batch.clear();
+}
+
+/*!
+ * Takes the annotations made so far; those of another generation are
+ * dropped.
+ * @param results Receives the annotations
+ * @param generation Current generation
+ */
+void candecoderworker::collect(QVector<candecoded> &results, quint32 generation) {
+  lock.lock();
+  if (outputgeneration == generation) results += output;
+  output.clear();
+  lock.unlock();
+}
+
+/*!
+ * Counters of a decoder run by this worker.
+ * @param number Number of the decoder in the pipeline
+ * @return its counters (all 0 for a decoder run elsewhere)
+ */
+candecoderstats candecoderworker::statistics(int number) {
+  candecoderstats result = { 0, 0, 0 };
+  lock.lock();
+  int index = numbers.indexOf(number);
+  if (index >= 0) result = stats.at(index);
+  lock.unlock();
+  return result;
+}
+
+/*!
+ * Stops the thread; canpackets not decoded yet are dropped.
+ */
+void candecoderworker::stop() {
+  lock.lock();
+  stopping = true;
+  wake.wakeAll();
+  lock.unlock();
+  wait();
+}
+
+/*!
+ * Decodes the batches handed over. Each decoder walks the batch for its
+ * canpackets in one go, so its CPU time is measured once per batch.
+ */
+void candecoderworker::run() {
+  QVector<candecoderinput> batch;
+  QVector<candecoded> made;
+  QVector<candecoderstats> spent(decoders.size());
+  quint32 generation = 0;
+
+  forever {
+    lock.lock();
+    while (input.isEmpty() && !stopping) wake.wait(&lock);
+    if (stopping) {
+      lock.unlock();
+      return;
+    }
+    batch = input;
+    input.clear();
+    quint32 batchgeneration = inputgeneration;
+    lock.unlock();
+
+    // The capture starts anew
+    if (batchgeneration != generation) {
+      foreach (candecoder *decoder, decoders) decoder->reset();
+      generation = batchgeneration;
+    }
+
+    for (int d = 0; d < decoders.size(); d++) {
+      candecoder *decoder = decoders.at(d);
+      quint32 bit = 1u << numbers.at(d);
+      int before = made.size();
+      quint64 frames = 0;
+      qint64 start = threadcputime();
+      for (int i = 0; i < batch.size(); i++) {
+        const candecoderinput &item = batch.at(i);
+        if (!(item.decoders & bit)) continue;
+        decoder->decode(item.packet, item.arrival, made);
+        frames++;
+      }
+      spent[d].cputime = threadcputime() - start;
+      spent[d].frames = frames;
+      spent[d].annotations = made.size() - before;
+      for (int i = before; i < made.size(); i++) made[i].decoder = numbers.at(d);
+    }
+
+    lock.lock();
+    if (outputgeneration != generation) {
+      output.clear();
+      outputgeneration = generation;
+    }
+    output += made;
+    for (int d = 0; d < decoders.size(); d++) {
+      stats[d].frames += spent.at(d).frames;
+      stats[d].annotations += spent.at(d).annotations;
+      stats[d].cputime += spent.at(d).cputime;
+    }
+    lock.unlock();
+    batch.clear();
+    made.clear();
+  }
+}
+
+/*!
+ * Constructor, creates a pipeline without decoders.
+ * @param newstore Store holding the packets, shared with the other views
+ * @param parent Parent object
+ */
+canpipeline::canpipeline(QSharedPointer<canpacketstore> newstore, QObject *parent) :
+        QObject(parent), store(newstore) {
+  generation = 0;
+  model = new candecodedmodel(this, this);
+  flushtimer = new QTimer(this);
+  connect(flushtimer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+/*!
+ * Destructor, stops the workers and deletes the decoders.
+ */
+canpipeline::~canpipeline() {
+  if (workers.isEmpty()) qDeleteAll(decoders);
+  qDeleteAll(workers);
+}
+
+/*!
+ * Adds a decoder. Must be called before start().
+ * @param decoder The decoder, owned by the pipeline from now on
+ * @return false if the pipeline is running or full (the decoder is deleted)
+ */
+bool canpipeline::adddecoder(candecoder *decoder) {
+  if (!workers.isEmpty() || decoders.size() >= MaxDecoders) {
+    delete decoder;
+    return false;
+  }
+  decoders.append(decoder);
+  names.append(decoder->name());
+  return true;
+}
+
+/*!
+ * Adds the decoders of all plugins (see candecoderplugin) in a directory.
+ * Must be called before start(). The plugins stay loaded.
+ * @param directory Directory holding the plugins (need not exist)
+ * @return number of decoders added
+ */
+int canpipeline::loadplugins(const QString &directory) {
+  int added = 0;
+  QDir plugins(directory);
+  foreach (const QString &file, plugins.entryList(QDir::Files)) {
+    QPluginLoader loader(plugins.absoluteFilePath(file));
+    candecoderplugin *plugin = qobject_cast<candecoderplugin *>(loader.instance());
+    if (!plugin) continue;
+    foreach (candecoder *decoder, plugin->createdecoders()) {
+      if (adddecoder(decoder)) added++;
+    }
+  }
+  return added;
+}
+
+/*!
+ * Builds the dispatch table, spreads the decoders over the workers and
+ * starts them; the packets already stored are decoded first.
+ * @param threads Number of worker threads (at most one per decoder)
+ */
+void canpipeline::start(int threads) {
+  if (!workers.isEmpty() || decoders.isEmpty()) return;
+  buildtables();
+
+  threads = qBound(1, threads, decoders.size());
+  for (int t = 0; t < threads; t++) workers.append(new candecoderworker);
+  threadof.resize(decoders.size());
+  for (int d = 0; d < decoders.size(); d++) {
+    threadof[d] = d % threads;
+    workers.at(d % threads)->adddecoder(decoders.at(d), d);
+  }
+  pending.resize(threads);
+  foreach (candecoderworker *worker, workers) worker->start(QThread::LowPriority);
+
+  connect(store.data(), SIGNAL(appended(quint32)), this, SLOT(packetappended(quint32)));
+  connect(store.data(), SIGNAL(evicting(int)), this, SLOT(packetsevicting(int)));
+  connect(store.data(), SIGNAL(reloaded()), this, SLOT(storereloaded()));
+  for (int i = 0; i < store->packetcount(); i++) dispatch(store->packetat(i), store->oldestarrival() + i);
+  flushtimer->start(FlushInterval);
+}
+
+/*!
+ * Number of decoders.
+ * @return number of decoders
+ */
+int canpipeline::decodercount() const {
+  return names.size();
+}
+
+/*!
+ * Name of a decoder.
+ * @param number Number of the decoder
+ * @return its name
+ */
+QString canpipeline::decodername(int number) const {
+  return names.value(number);
+}
+
+/*!
+ * Worker running a decoder.
+ * @param number Number of the decoder
+ * @return number of the worker thread (-1 = not started)
+ */
+int canpipeline::decoderthread(int number) const {
+  return threadof.value(number, -1);
+}
+
+/*!
+ * Counters of a decoder.
+ * @param number Number of the decoder
+ * @return its counters
+ */
+candecoderstats canpipeline::statistics(int number) const {
+  int thread = decoderthread(number);
+  if (thread < 0) {
+    candecoderstats zero = { 0, 0, 0 };
+    return zero;
+  }
+  return workers.at(thread)->statistics(number);
+}
+
+/*!
+ * Model of the annotations.
+ * @return the model, owned by the pipeline
+ */
+candecodedmodel *canpipeline::results() const {
+  return model;
+}
+
+/*!
+ * Called when the store has stored one packet; queues it for the decoders
+ * consuming its ID.
+ * @param arrival Arrival number of the packet
+ */
+void canpipeline::packetappended(quint32 arrival) {
+  dispatch(store->packetbyarrival(arrival), arrival);
+}
+
+/*!
+ * Called when the store is about to drop its oldest packets from the ring;
+ * their annotations are dropped as well.
+ * @param count Number of packets to be dropped
+ */
+void canpipeline::packetsevicting(int count) {
+  model->evict(store->oldestarrival(), count);
+}
+
+/*!
+ * Called when the store has replaced all packets; they are decoded anew.
+ */
+void canpipeline::storereloaded() {
+  generation++;
+  for (int w = 0; w < pending.size(); w++) pending[w].clear();
+  model->clear();
+  for (int i = 0; i < store->packetcount(); i++) dispatch(store->packetat(i), store->oldestarrival() + i);
+}
+
+/*!
+ * Hands the batches over to the workers and adds the annotations they made
+ * to the model, in arrival order. Called every FlushInterval.
+ */
+void canpipeline::flush() {
+  QVector<candecoded> collected;
+  for (int w = 0; w < workers.size(); w++) {
+    if (!pending.at(w).isEmpty()) workers.at(w)->submit(pending[w], generation);
+    workers.at(w)->collect(collected, generation);
+  }
+
+  // Annotations of packets the ring has dropped meanwhile are not shown
+  QVector<candecoded> results;
+  results.reserve(collected.size());
+  foreach (const candecoded &result, collected) {
+    if (store->isstored(result.arrival)) results.append(result);
+  }
+  if (results.isEmpty()) return;
+  quint32 oldest = store->oldestarrival();
+  QVector<QPair<quint32, int> > order(results.size());
+  for (int i = 0; i < results.size(); i++) order[i] = qMakePair(results.at(i).arrival - oldest, i);
+  qSort(order);
+  QVector<candecoded> sorted(results.size());
+  for (int i = 0; i < order.size(); i++) sorted[i] = results.at(order.at(i).second);
+  model->append(sorted);
+}
+
+/*!
+ * Builds the dispatch table from the IDs the decoders declare: a bit mask
+ * per 11 bit ID, and for 29 bit IDs the ranges between all range limits,
+ * each with the mask of the decoders covering it.
+ */
+void canpipeline::buildtables() {
+  standardtable.fill(0, StandardIDs);
+  QList<quint32> limits;
+  QList<QPair<candecoderids, int> > extended;
+  for (int d = 0; d < decoders.size(); d++) {
+    foreach (const candecoderids &range, decoders.at(d)->ids()) {
+      if (!range.extended) {
+        for (quint32 id = range.first; id <= range.last && id < (quint32)StandardIDs; id++) standardtable[id] |= 1u << d;
+        continue;
+      }
+      quint32 last = qMin(range.last, (quint32)0x1FFFFFFF);
+      if (range.first > last) continue;
+      extended.append(qMakePair(range, d));
+      limits.append(range.first);
+      if (last < 0x1FFFFFFF) limits.append(last + 1);
+    }
+  }
+
+  qSort(limits);
+  extendedtable.clear();
+  for (int i = 0; i < limits.size(); i++) {
+    if (i && limits.at(i) == limits.at(i - 1)) continue;
+    idsegment segment;
+    segment.first = limits.at(i);
+    segment.last = 0x1FFFFFFF;
+    for (int j = i + 1; j < limits.size(); j++) {
+      if (limits.at(j) != limits.at(i)) {
+        segment.last = limits.at(j) - 1;
+        break;
+      }
+    }
+    segment.decoders = 0;
+    for (int e = 0; e < extended.size(); e++) {
+      const candecoderids &range = extended.at(e).first;
+      if (range.first <= segment.first && segment.last <= range.last) segment.decoders |= 1u << extended.at(e).second;
+    }
+    if (!segment.decoders) continue;
+    // Neighbours with the same decoders become one range
+    if (!extendedtable.isEmpty() && extendedtable.last().decoders == segment.decoders
+        && extendedtable.last().last + 1 == segment.first) {
+      extendedtable.last().last = segment.last;
+    } else {
+      extendedtable.append(segment);
+    }
+  }
+}
+
+/*!
+ * Queues a canpacket for the workers running decoders that consume it.
+ * A full batch is handed over at once.
+ * @param packet The canpacket
+ * @param arrival Its arrival number
+ */
+void canpipeline::dispatch(const canpacket &packet, quint32 arrival) {
+  if (packet.marker) return;
+  quint32 consumers = decodersof(packet);
+  if (!consumers) return;
+  for (int w = 0; w < workers.size(); w++) {
+    quint32 here = consumers & workers.at(w)->decodermask();
+    if (!here) continue;
+    candecoderinput item;
+    item.packet = packet;
+    item.arrival = arrival;
+    item.decoders = here;
+    pending[w].append(item);
+    if (pending.at(w).size() >= BatchSize) workers.at(w)->submit(pending[w], generation);
+  }
+}
+
+/*!
+ * Constructor, creates an empty model.
+ * @param newpipeline Pipeline naming the decoders
+ * @param parent Parent of the model
+ */
+candecodedmodel::candecodedmodel(const canpipeline *newpipeline, QObject *parent) :
+        QAbstractTableModel(parent), pipeline(newpipeline) {
+}
+
+/*!
+ * Number of rows (annotations).
+ * @param parent Only the invisible root has children
+ * @return number of rows
+ */
+int candecodedmodel::rowCount(const QModelIndex &parent) const {
+  if (parent.isValid()) return 0;
+  return rows.size();
+}
+
+/*!
+ * Number of columns.
+ * @param parent Only the invisible root has children
+ * @return number of columns
+ */
+int candecodedmodel::columnCount(const QModelIndex &parent) const {
+  if (parent.isValid()) return 0;
+  return ColumnCount;
+}
+
+/*!
+ * Formats one cell.
+ * @param index Cell to be formatted
+ * @param role Only Qt::DisplayRole is provided
+ * @return display string of the cell
+ */
+QVariant candecodedmodel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || role != Qt::DisplayRole) return QVariant();
+  if (index.row() >= rows.size() || index.column() >= ColumnCount) return QVariant();
+
+  const candecoded &result = rows.at(index.row());
+  switch (index.column()) {
+  case ColNumber: return canpacketmodel::celltext(result.packet, result.arrival, canpacketmodel::ColNumber);
+  case ColTimestamp: return canpacketmodel::celltext(result.packet, result.arrival, canpacketmodel::ColTimestamp);
+  case ColID: return canpacketmodel::celltext(result.packet, result.arrival, canpacketmodel::ColID);
+  case ColDecoder: return pipeline->decodername(result.decoder);
+  case ColText: return result.text;
+  }
+  return QVariant();
+}
+
+/*!
+ * Header labels.
+ * @param section Column number
+ * @param orientation Only horizontal headers are provided
+ * @param role Only Qt::DisplayRole is provided
+ * @return Label of the column
+ */
+QVariant candecodedmodel::headerData(int section, Qt::Orientation orientation, int role) const {
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return QVariant();
+  switch (section) {
+  case ColNumber: return tr("#");
+  case ColTimestamp: return tr("Timestamp");
+  case ColID: return tr("CAN ID");
+  case ColDecoder: return tr("Decoder");
+  case ColText: return tr("Decoded");
+  }
+  return QVariant();
+}
+
+/*!
+ * Adds annotations at the bottom.
+ * @param newresults Annotations in arrival order
+ */
+void candecodedmodel::append(const QVector<candecoded> &newresults) {
+  if (newresults.isEmpty()) return;
+  beginInsertRows(QModelIndex(), rows.size(), rows.size() + newresults.size() - 1);
+  foreach (const candecoded &result, newresults) rows.append(result);
+  endInsertRows();
+}
+
+/*!
+ * Drops the annotations of packets leaving the ring. The annotations are
+ * in arrival order, so only the oldest ones are checked.
+ * @param oldest Arrival number of the oldest stored packet
+ * @param count Number of packets leaving
+ */
+void candecodedmodel::evict(quint32 oldest, int count) {
+  int remove = 0;
+  while (remove < rows.size() && rows.at(remove).arrival - oldest < (quint32)count) remove++;
+  if (!remove) return;
+  beginRemoveRows(QModelIndex(), 0, remove - 1);
+  rows.erase(rows.begin(), rows.begin() + remove);
+  endRemoveRows();
+}
+
+/*!
+ * Drops all annotations.
+ */
+void candecodedmodel::clear() {
+  beginResetModel();
+  rows.clear();
+  endResetModel();
+}
+
+/*!
+ * Arrival number of the packet annotated in a row.
+ * @param row Row
+ * @return arrival number
+ */
+quint32 candecodedmodel::arrivalatrow(int row) const {
+  return rows.at(row).arrival;
+}
@@ -0,0 +1,210 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANPIPELINE_H
+#define CANPIPELINE_H
+
+#include <QtGui>
+
+#include <time.h>
+
+#include "candecoder.h"
+#include "canpacketstore.h"
+
+class candecodedmodel;
+
+/*!
+ * One canpacket handed to a decoder worker.
+ */
+struct candecoderinput {
+  canpacket packet;           //!< The canpacket
+  quint32 arrival;            //!< Its arrival number
+  quint32 decoders;           //!< Bit mask of the pipeline's decoders consuming it
+};
+
+/*!
+ * Counters of one decoder, kept by its worker.
+ */
+struct candecoderstats {
+  quint64 frames;             //!< canpackets decoded
+  quint64 annotations;        //!< Annotations made
+  qint64 cputime;             //!< CPU time spent in decode() in nanoseconds
+};
+
+/*!
+ * Worker thread running some decoders of a canpipeline. The pipeline hands
+ * over batches of canpackets and collects the annotations; the only lock is
+ * taken once per batch. Every decoder sees its canpackets in order and only
+ * from this thread.
+ */
+class candecoderworker: public QThread {
+Q_OBJECT
+
+public:
+  candecoderworker(QObject *parent = 0);          //!< Constructor, creates a worker without decoders
+  ~candecoderworker();                            //!< Destructor, stops the thread and deletes the decoders
+
+  void adddecoder(candecoder *decoder, int number); //!< Runs a decoder here (before start())
+  quint32 decodermask() const;                    //!< Bit mask of the decoders run here
+  void submit(QVector<candecoderinput> &batch, quint32 generation); //!< Hands over a batch of canpackets
+  void collect(QVector<candecoded> &results, quint32 generation); //!< Takes the annotations made so far
+  candecoderstats statistics(int number);         //!< Counters of a decoder run here
+  void stop();                                    //!< Stops the thread
+
+protected:
+  void run();                                     //!< Decodes the batches handed over
+
+private:
+  QList<candecoder *> decoders;   //!< Decoders run here
+  QList<int> numbers;             //!< Their numbers in the pipeline
+  quint32 mask;                   //!< Bit mask of numbers
+  QMutex lock;                    //!< Protects everything below
+  QWaitCondition wake;            //!< Signalled when a batch arrives or the thread has to stop
+  QVector<candecoderinput> input; //!< canpackets not decoded yet
+  quint32 inputgeneration;        //!< Generation of the canpackets in input
+  QVector<candecoded> output;     //!< Annotations not collected yet
+  quint32 outputgeneration;       //!< Generation of the annotations in output
+  QVector<candecoderstats> stats; //!< Counters per decoder run here
+  bool stopping;                  //!< The thread has to stop
+
+  /*!
+   * CPU time of the calling thread.
+   * @return nanoseconds
+   */
+  static inline qint64 threadcputime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (qint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  }
+};
+
+/*!
+ * Protocol decoder pipeline: the canpackets stored in a canpacketstore flow
+ * through the decoders on worker threads into a candecodedmodel.
+ *
+ * Every decoder declares the CAN IDs it consumes. From that a dispatch table
+ * is built once (a bit mask of decoders per 11 bit ID, and sorted ranges
+ * with a mask each for 29 bit IDs), so dispatching a canpacket in the GUI
+ * thread is one table lookup; canpackets no decoder consumes cost nothing
+ * more. The decoders are spread over the workers, and the canpackets are
+ * handed to them in batches of BatchSize or every FlushInterval. The
+ * annotations are collected on the same timer.
+ *
+ * When the store is reloaded, all stored canpackets are decoded again; a
+ * generation number makes the workers reset their decoders and drops the
+ * annotations made before.
+ */
+class canpipeline: public QObject {
+Q_OBJECT
+
+public:
+  enum {
+    MaxDecoders = 32,         /*!< Decoders per pipeline (bits of the dispatch mask) */
+    BatchSize = 1024,         /*!< canpackets handed to a worker at once */
+    FlushInterval = 50,       /*!< milliseconds between two hand-overs and collections */
+    StandardIDs = 2048        /*!< Entries of the table of 11 bit IDs */
+  };
+
+  explicit canpipeline(QSharedPointer<canpacketstore> newstore, QObject *parent = 0); //!< Constructor, creates a pipeline without decoders
+  ~canpipeline();                                 //!< Destructor, stops the workers
+
+  bool adddecoder(candecoder *decoder);           //!< Adds a decoder (before start())
+  int loadplugins(const QString &directory);      //!< Adds the decoders of all plugins in a directory
+  void start(int threads);                        //!< Builds the dispatch table and starts the workers
+  int decodercount() const;                       //!< Number of decoders
+  QString decodername(int number) const;          //!< Name of a decoder
+  int decoderthread(int number) const;            //!< Worker running a decoder
+  candecoderstats statistics(int number) const;   //!< Counters of a decoder
+  candecodedmodel *results() const;               //!< Model of the annotations
+
+private slots:
+  void packetappended(quint32 arrival);           //!< The store has stored one packet
+  void packetsevicting(int count);                //!< The store is about to drop its oldest packets
+  void storereloaded();                           //!< The store has replaced all packets
+  void flush();                                   //!< Hands over the batches and collects the annotations
+
+private:
+  /*!
+   * Range of 29 bit IDs with the same decoders.
+   */
+  struct idsegment {
+    quint32 first;            //!< First identifier
+    quint32 last;             //!< Last identifier (inclusive)
+    quint32 decoders;         //!< Bit mask of the decoders
+  };
+
+  QSharedPointer<canpacketstore> store; //!< Store holding the packets, shared with the other views
+  QList<candecoder *> decoders;   //!< Decoders (owned by the workers once started)
+  QStringList names;              //!< Names of the decoders
+  QList<candecoderworker *> workers; //!< Worker threads
+  QVector<int> threadof;          //!< Worker of each decoder
+  QVector<quint32> standardtable; //!< Decoders per 11 bit ID
+  QVector<idsegment> extendedtable; //!< Decoders per 29 bit ID range, sorted
+  QVector<QVector<candecoderinput> > pending; //!< Batch per worker not handed over yet
+  quint32 generation;             //!< Incremented whenever the decoding starts anew
+  candecodedmodel *model;         //!< Annotations
+  QTimer *flushtimer;             //!< Calls flush()
+
+  void buildtables();             //!< Builds the dispatch table from the IDs of the decoders
+  void dispatch(const canpacket &packet, quint32 arrival); //!< Queues a canpacket for the workers
+
+  /*!
+   * Decoders consuming a canpacket (table lookup).
+   * @param packet The canpacket
+   * @return bit mask of the decoders
+   */
+  inline quint32 decodersof(const canpacket &packet) const {
+    if (packet.err || packet.rtr) return 0;
+    if (!packet.ide) return standardtable.at(packet.identifier & 0x7FF);
+    int low = 0;
+    int high = extendedtable.size();
+    while (low < high) {
+      int mid = low + (high - low) / 2;
+      if (extendedtable.at(mid).last < packet.identifier) low = mid + 1; else high = mid;
+    }
+    if (low < extendedtable.size() && extendedtable.at(low).first <= packet.identifier) return extendedtable.at(low).decoders;
+    return 0;
+  }
+};
+
+/*!
+ * Table model of the annotations of a canpipeline, in the order they were
+ * collected. An annotation leaves the model when the ring drops its packet.
+ */
+class candecodedmodel: public QAbstractTableModel {
+Q_OBJECT
+
+public:
+  //! Columns of the model
+  enum Column {
+    ColNumber = 0,    //!< Arrival number of the packet
+    ColTimestamp,     //!< Timestamp of the packet
+    ColID,            //!< CAN ID
+    ColDecoder,       //!< Decoder that made the annotation
+    ColText,          //!< Annotation
+    ColumnCount       //!< Number of columns
+  };
+
+  explicit candecodedmodel(const canpipeline *newpipeline, QObject *parent = 0); //!< Constructor, creates an empty model
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const;    //!< Number of rows (annotations)
+  int columnCount(const QModelIndex &parent = QModelIndex()) const; //!< Number of columns
+  QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;  //!< Formats one cell
+  QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const; //!< Header labels
+
+  void append(const QVector<candecoded> &newresults); //!< Adds annotations
+  void evict(quint32 oldest, int count);          //!< Drops the annotations of packets leaving the ring
+  void clear();                                   //!< Drops all annotations
+  quint32 arrivalatrow(int row) const;            //!< Arrival number of the packet annotated in a row
+
+private:
+  const canpipeline *pipeline;    //!< Pipeline naming the decoders
+  QList<candecoded> rows;         //!< Annotations, oldest first
+};
+
+#endif // CANPIPELINE_H
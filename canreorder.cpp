@@ -0,0 +1,191 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canreorder.h"
+#include "canlogblock.h"
+
+#include <limits.h>
+#include <sys/time.h>
+
+/*!
+ * Constructor, creates a buffer that is switched off.
+ * @param parent Parent object
+ */
+canreorder::canreorder(QObject *parent) : QObject(parent) {
+  windowus = 0;
+  held = 0;
+  late = 0;
+  lastreleased = 0;
+  anyreleased = false;
+  due = 0;
+  timer = new QTimer(this);
+  timer->setSingleShot(true);
+  connect(timer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+/*!
+ * Reorder window.
+ * @return milliseconds (0 = off)
+ */
+int canreorder::window() const {
+  return windowus / 1000;
+}
+
+/*!
+ * canpackets that came later than the window and were released out of
+ * order, since the window was set.
+ * @return number of canpackets
+ */
+quint64 canreorder::latecount() const {
+  return late;
+}
+
+/*!
+ * canpackets held right now.
+ * @return number of canpackets
+ */
+int canreorder::heldcount() const {
+  return held;
+}
+
+/*!
+ * Sets the reorder window. The canpackets held are released first and the
+ * late counter starts anew.
+ * @param msec Reorder window in milliseconds (0 = off)
+ */
+void canreorder::setwindow(int msec) {
+  flush();
+  windowus = (qint64)qMax(0, msec) * 1000;
+  late = 0;
+  anyreleased = false;
+}
+
+/*!
+ * Adds a canpacket. It is released once it is older than the window (or
+ * right away if it is already older than a canpacket released).
+ * @param packet The canpacket
+ */
+void canreorder::add(canpacket packet) {
+  if (!windowus) {
+    emit released(packet);
+    return;
+  }
+
+  qint64 stamp = canblockcodec::stampof(packet);
+  if (anyreleased && stamp < lastreleased) {
+    late++;
+    emit released(packet);
+    return;
+  }
+
+  // A source is ordered by itself; otherwise the canpacket is put in place
+  QQueue<canpacket> &queue = queues[queueof(packet)];
+  int position = queue.size();
+  while (position > 0 && canblockcodec::stampof(queue.at(position - 1)) > stamp) position--;
+  queue.insert(position, packet);
+  held++;
+
+  releaseupto(now() - windowus);
+  while (held > MaxHeld) releaseupto(canblockcodec::stampof(queues.at(oldest()).head()));
+  schedule();
+}
+
+/*!
+ * Releases all canpackets held, e.g. when the capture stops.
+ */
+void canreorder::flush() {
+  releaseupto(LLONG_MAX);
+  timer->stop();
+}
+
+/*!
+ * Releases the canpackets that have waited for the window.
+ */
+void canreorder::timeout() {
+  releaseupto(now() - windowus);
+  schedule();
+}
+
+/*!
+ * Queue of the source of a canpacket, added if the source is new.
+ * @param packet The canpacket
+ * @return number of the queue
+ */
+int canreorder::queueof(const canpacket &packet) {
+  int key = (packet.interface << 1) | (packet.direction ? 1 : 0);
+  int number = sources.indexOf(key);
+  if (number < 0) {
+    number = sources.size();
+    sources.append(key);
+    queues.resize(number + 1);
+  }
+  return number;
+}
+
+/*!
+ * Queue whose front is the oldest canpacket held. There are only a few
+ * sources, so their fronts are simply compared.
+ * @return number of the queue (-1 = nothing held)
+ */
+int canreorder::oldest() const {
+  int number = -1;
+  qint64 stamp = 0;
+  for (int i = 0; i < queues.size(); i++) {
+    if (queues.at(i).isEmpty()) continue;
+    qint64 front = canblockcodec::stampof(queues.at(i).head());
+    if (number < 0 || front < stamp) {
+      number = i;
+      stamp = front;
+    }
+  }
+  return number;
+}
+
+/*!
+ * Releases the canpackets up to a timestamp, oldest first.
+ * @param limit Timestamp in microseconds (inclusive)
+ */
+void canreorder::releaseupto(qint64 limit) {
+  for (;;) {
+    int number = oldest();
+    if (number < 0) break;
+    qint64 stamp = canblockcodec::stampof(queues.at(number).head());
+    if (stamp > limit) break;
+    canpacket packet = queues[number].dequeue();
+    held--;
+    lastreleased = stamp;
+    anyreleased = true;
+    emit released(packet);
+  }
+}
+
+/*!
+ * Sets the timer for the time the oldest canpacket held has waited for the
+ * window, unless it is set for that time already.
+ */
+void canreorder::schedule() {
+  int number = oldest();
+  if (number < 0) {
+    timer->stop();
+    return;
+  }
+  qint64 deadline = canblockcodec::stampof(queues.at(number).head()) + windowus;
+  if (timer->isActive() && due <= deadline) return;
+  due = deadline;
+  timer->start((int)qMax((qint64)0, (deadline - now() + 999) / 1000));
+}
+
+/*!
+ * Current time on the clock of the timestamps of the canpackets.
+ * @return microseconds since the epoch
+ */
+qint64 canreorder::now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (qint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
@@ -0,0 +1,77 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANREORDER_H
+#define CANREORDER_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+
+/*!
+ * Bounded reorder buffer putting the captured canpackets into timestamp
+ * order before they are stored.
+ *
+ * The canpackets reach the main thread from several sources whose
+ * timestamps interleave: frames received by the capture thread (kernel
+ * timestamps, queued across threads), frames sent from the GUI (stored
+ * right away) and those sent or marked by triggers. Every source (interface
+ * and direction) has its own queue, in which the canpackets are already
+ * ordered; a canpacket is released once it is older than the reorder
+ * window, always the oldest front of all queues first. So a canpacket is
+ * held at most about the window, and the released stream is ordered as
+ * long as no canpacket arrives more than the window late.
+ *
+ * A canpacket older than one already released cannot be put in order any
+ * more: it is released right away and counted as late. At most MaxHeld
+ * canpackets are held; beyond that the oldest ones are released early.
+ * With a window of 0 (the default) canpackets pass through unchanged.
+ */
+class canreorder: public QObject {
+Q_OBJECT
+
+public:
+  enum {
+    MaxHeld = 65536           /*!< canpackets held at most */
+  };
+
+  explicit canreorder(QObject *parent = 0);  //!< Constructor, creates a buffer that is switched off
+  int window() const;                     //!< Reorder window in milliseconds (0 = off)
+  quint64 latecount() const;              //!< canpackets that came later than the window
+  int heldcount() const;                  //!< canpackets held right now
+
+signals:
+  void released(canpacket packet);        //!< A canpacket leaves the buffer, in timestamp order
+
+public slots:
+  void setwindow(int msec);               //!< Sets the reorder window (0 = off)
+  void add(canpacket packet);             //!< Adds a canpacket
+  void flush();                           //!< Releases all canpackets held
+
+private slots:
+  void timeout();                         //!< Releases the canpackets that have waited for the window
+
+private:
+  QVector<int> sources;                   //!< Key (interface and direction) per queue
+  QVector<QQueue<canpacket> > queues;     //!< canpackets per source, ordered by timestamp
+  qint64 windowus;                        //!< Reorder window in microseconds (0 = off)
+  int held;                               //!< canpackets in all queues
+  quint64 late;                           //!< canpackets that came later than the window
+  qint64 lastreleased;                    //!< Timestamp of the latest canpacket released
+  bool anyreleased;                       //!< Whether lastreleased is valid
+  QTimer *timer;                          //!< Fires when the oldest canpacket has waited for the window
+  qint64 due;                             //!< Time the timer fires (microseconds)
+
+  int queueof(const canpacket &packet);   //!< Queue of the source of a canpacket
+  int oldest() const;                     //!< Queue with the oldest front (-1 = all empty)
+  void releaseupto(qint64 limit);         //!< Releases the canpackets up to a timestamp
+  void schedule();                        //!< Sets the timer for the oldest canpacket held
+  static qint64 now();                    //!< Current time in microseconds (clock of the timestamps)
+};
+
+#endif // CANREORDER_H
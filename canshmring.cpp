@@ -0,0 +1,294 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canshmring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/*!
+ * Constructor, creates a writer without ring.
+ */
+canshmwriter::canshmwriter() {
+  ringname[0] = 0;
+  header = 0;
+  slots = 0;
+  size = 0;
+  next = 0;
+}
+
+/*!
+ * Destructor, closes and removes the ring.
+ */
+canshmwriter::~canshmwriter() {
+  close();
+}
+
+/*!
+ * Creates the ring. A ring of the same name (e.g. left behind by a crash)
+ * is removed first; readers that still map it see it closed.
+ * @param name Name of the shared memory, starting with "/"
+ * @param slotcount Number of slots, rounded up to a power of two
+ * @return success of the operation (errno tells why it failed)
+ */
+bool canshmwriter::create(const char *name, uint32_t slotcount) {
+  close();
+  uint32_t count = 1;
+  while (count < slotcount && count < 0x80000000u) count <<= 1;
+
+  // Tell readers of an old ring that it is gone
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd >= 0) {
+    canshmheader *old = (canshmheader *)mmap(0, sizeof(canshmheader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (old != MAP_FAILED) {
+      __atomic_store_n(&old->closed, 1, __ATOMIC_RELEASE);
+      munmap(old, sizeof(canshmheader));
+    }
+    ::close(fd);
+    shm_unlink(name);
+  }
+
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) return false;
+  size = sizeof(canshmheader) + (size_t)count * sizeof(canshmslot);
+  void *base = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int error = errno;
+  ::close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name);
+    errno = error;
+    return false;
+  }
+
+  // ftruncate() gave zeroed memory, so every slot is "being written" until used
+  header = (canshmheader *)base;
+  slots = (canshmslot *)((char *)base + sizeof(canshmheader));
+  struct timeval now;
+  gettimeofday(&now, 0);
+  header->version = canshmring::Version;
+  header->slotsize = sizeof(canshmslot);
+  header->slotcount = count;
+  header->headersize = sizeof(canshmheader);
+  header->created = (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+  header->writerpid = getpid();
+  __atomic_store_n(&header->magic, (uint32_t)canshmring::MagicNumber, __ATOMIC_RELEASE);
+  snprintf(ringname, sizeof(ringname), "%s", name);
+  next = 0;
+  return true;
+}
+
+/*!
+ * Marks the ring closed for the readers and removes it. Readers keep their
+ * mapping until they close it.
+ */
+void canshmwriter::close() {
+  if (!header) return;
+  __atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+  munmap(header, size);
+  shm_unlink(ringname);
+  header = 0;
+  slots = 0;
+}
+
+/*!
+ * Whether a ring has been created.
+ * @return true if frames can be published
+ */
+bool canshmwriter::isopen() const {
+  return header;
+}
+
+/*!
+ * Sets the capture interface shown in the header.
+ * @param name Interface name, e.g. "can0" (cut to 15 characters)
+ */
+void canshmwriter::setinterface(const char *name) {
+  if (!header) return;
+  char buffer[sizeof(header->interface)];
+  memset(buffer, 0, sizeof(buffer));
+  strncpy(buffer, name, sizeof(buffer) - 1);
+  memcpy(header->interface, buffer, sizeof(buffer));
+}
+
+/*!
+ * Writes one frame, overwriting the oldest one when the ring is full.
+ * Never waits.
+ * @param frame The frame
+ */
+void canshmwriter::publish(const canshmframe &frame) {
+  if (!header) return;
+  canshmslot *slot = &slots[next & (header->slotcount - 1)];
+  __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot->frame = frame;
+  next++;
+  __atomic_store_n(&slot->seq, next, __ATOMIC_RELEASE);
+  __atomic_store_n(&header->writeseq, next, __ATOMIC_RELEASE);
+}
+
+/*!
+ * Frames written since the ring has been created.
+ * @return number of frames
+ */
+uint64_t canshmwriter::writtencount() const {
+  return next;
+}
+
+/*!
+ * Constructor, creates a reader without ring.
+ */
+canshmreader::canshmreader() {
+  header = 0;
+  slots = 0;
+  size = 0;
+  next = 0;
+  lost = 0;
+}
+
+/*!
+ * Destructor, unmaps the ring.
+ */
+canshmreader::~canshmreader() {
+  close();
+}
+
+/*!
+ * Maps an existing ring read-only and checks its header. Reading starts
+ * with the oldest frame still in the ring.
+ * @param name Name of the shared memory, starting with "/"
+ * @return success of the operation (errno is EPROTO for an unknown layout)
+ */
+bool canshmreader::open(const char *name) {
+  close();
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return false;
+  struct stat info;
+  void *base = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(canshmheader)) {
+    base = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  int error = errno;
+  ::close(fd);
+  if (base == MAP_FAILED) {
+    errno = error;
+    return false;
+  }
+
+  const canshmheader *head = (const canshmheader *)base;
+  size_t slotcount = head->slotcount;
+  if (__atomic_load_n(&head->magic, __ATOMIC_ACQUIRE) != (uint32_t)canshmring::MagicNumber
+      || head->version != canshmring::Version || head->slotsize != sizeof(canshmslot)
+      || !slotcount || (slotcount & (slotcount - 1))
+      || (size_t)info.st_size < head->headersize + slotcount * sizeof(canshmslot)) {
+    munmap(base, info.st_size);
+    errno = EPROTO;
+    return false;
+  }
+
+  header = head;
+  slots = (const canshmslot *)((const char *)base + head->headersize);
+  size = info.st_size;
+  lost = 0;
+  uint64_t written = __atomic_load_n(&header->writeseq, __ATOMIC_ACQUIRE);
+  next = written > slotcount ? written - slotcount : 0;
+  return true;
+}
+
+/*!
+ * Unmaps the ring.
+ */
+void canshmreader::close() {
+  if (!header) return;
+  munmap((void *)header, size);
+  header = 0;
+  slots = 0;
+}
+
+/*!
+ * Header of the ring.
+ * @return the header (0 if no ring is open)
+ */
+const canshmheader *canshmreader::ringheader() const {
+  return header;
+}
+
+/*!
+ * Skips all frames written so far; the next read returns only newer ones.
+ */
+void canshmreader::seekend() {
+  if (header) next = __atomic_load_n(&header->writeseq, __ATOMIC_ACQUIRE);
+}
+
+/*!
+ * Copies the next frames that are complete. Frames the writer has
+ * overwritten before they could be read are skipped and counted as lost,
+ * so the seq of the returned slots (minus 1) tells their numbers.
+ * @param out Room for the frames
+ * @param max Number of frames out has room for
+ * @return number of frames copied (0 = nothing new)
+ */
+int canshmreader::read(canshmslot *out, int max) {
+  if (!header) return 0;
+  uint64_t slotcount = header->slotcount;
+  uint64_t written = __atomic_load_n(&header->writeseq, __ATOMIC_ACQUIRE);
+  int count = 0;
+  while (count < max && next < written) {
+    // Fell behind by more than the ring: jump to the oldest frame still there
+    if (written - next > slotcount) {
+      lost += written - slotcount - next;
+      next = written - slotcount;
+    }
+    const canshmslot *slot = &slots[next & (slotcount - 1)];
+    uint64_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    out[count].frame = slot->frame;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t after = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    if (before == next + 1 && after == before) {
+      out[count].seq = before;
+      count++;
+    } else {
+      // The frame was complete when writeseq was loaded, so it has been overwritten since
+      lost++;
+      written = __atomic_load_n(&header->writeseq, __ATOMIC_ACQUIRE);
+    }
+    next++;
+  }
+  return count;
+}
+
+/*!
+ * Number of the next frame to be read.
+ * @return frame number (counted from 0 since the ring has been created)
+ */
+uint64_t canshmreader::position() const {
+  return next;
+}
+
+/*!
+ * Frames overwritten before they could be read.
+ * @return number of frames
+ */
+uint64_t canshmreader::lostcount() const {
+  return lost;
+}
+
+/*!
+ * Whether the writer has stopped (or replaced the ring). A reader should
+ * read what is left, close and open the ring again.
+ * @return true if no more frames will arrive
+ */
+bool canshmreader::writerclosed() const {
+  return header && __atomic_load_n(&header->closed, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,143 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANSHMRING_H
+#define CANSHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Capture ring in POSIX shared memory (shm_open(), e.g. /dev/shm/socketcangui).
+ * This header does not need Qt, so other programs can use it as it is
+ * together with canshmring.cpp (link with -lrt on older glibc).
+ *
+ * Layout: a canshmheader (headersize bytes) followed by slotcount slots of
+ * slotsize bytes (a canshmslot each). slotcount is a power of two. All
+ * numbers are in the byte order of the machine.
+ *
+ * Protocol: there is exactly one writer. Frame number n (counted from 0)
+ * goes to slot n & (slotcount - 1). The writer
+ *   1. stores 0 in the seq of the slot,
+ *   2. writes the frame,
+ *   3. stores n + 1 in the seq of the slot,
+ *   4. stores n + 1 in writeseq of the header
+ * (release ordering after 1 and for 3 and 4). A reader keeps the number of
+ * the next frame it wants and
+ *   1. loads writeseq (acquire); frames below writeseq - slotcount are
+ *      gone, the reader skips them and counts them as lost,
+ *   2. loads the seq of the slot (acquire), copies the frame and loads the
+ *      seq again (after an acquire fence),
+ *   3. takes the frame if both seq equal n + 1; otherwise the writer has
+ *      overwritten it meanwhile and it is lost.
+ * Readers never write to the ring and never make the writer wait; a reader
+ * that is too slow loses frames and knows how many. Reading takes no system
+ * call, a reader that finds nothing new polls again later.
+ */
+
+/*!
+ * One captured frame (24 bytes).
+ */
+struct canshmframe {
+  int64_t timestamp;          //!< Microseconds since the epoch
+  uint32_t canid;             //!< CAN ID with the flags of struct can_frame (EFF 0x80000000, RTR 0x40000000, ERR 0x20000000)
+  uint8_t dlc;                //!< Data length code
+  uint8_t flags;              //!< canshmring::FlagSent
+  uint16_t interface;         //!< Interface (not used yet)
+  uint8_t data[8];            //!< Payload
+};
+
+/*!
+ * One slot of the ring (32 bytes).
+ */
+struct canshmslot {
+  uint64_t seq;               //!< Number of the frame in the slot + 1 (0 = being written)
+  canshmframe frame;          //!< The frame
+};
+
+/*!
+ * Header at the start of the shared memory (64 bytes).
+ */
+struct canshmheader {
+  uint32_t magic;             //!< canshmring::MagicNumber
+  uint16_t version;           //!< canshmring::Version
+  uint16_t slotsize;          //!< sizeof(canshmslot)
+  uint32_t slotcount;         //!< Number of slots (a power of two)
+  uint32_t headersize;        //!< Offset of the first slot
+  uint64_t writeseq;          //!< Frames written so far (= number of the next frame)
+  int64_t created;            //!< Time the ring was created (microseconds since the epoch)
+  int32_t writerpid;          //!< Process id of the writer
+  uint32_t closed;            //!< 1 once the writer has stopped
+  char interface[16];         //!< Capture interface (informational)
+  uint8_t reserved[8];        //!< Always 0
+};
+
+/*!
+ * Constants of the shared-memory ring.
+ */
+class canshmring {
+
+public:
+  enum {
+    MagicNumber = 0x4353484D,   /*!< = "CSHM" */
+    Version = 1,                /*!< Layout version */
+    FlagSent = 0x01,            /*!< canshmframe::flags: the frame has been sent, not received */
+    DefaultSlots = 65536        /*!< Slots of a new ring (2 MiB) */
+  };
+  static const char *defaultname() { return "/socketcangui"; } //!< Name used by socketcangui by default
+};
+
+/*!
+ * Writing end of the ring (socketcangui).
+ */
+class canshmwriter {
+
+public:
+  canshmwriter();                         //!< Constructor, creates a writer without ring
+  ~canshmwriter();                        //!< Destructor, closes and removes the ring
+  bool create(const char *name, uint32_t slots); //!< Creates the ring (an existing one is replaced)
+  void close();                           //!< Marks the ring closed and removes it
+  bool isopen() const;                    //!< Whether a ring has been created
+  void setinterface(const char *name);    //!< Sets the interface shown in the header
+  void publish(const canshmframe &frame); //!< Writes one frame
+  uint64_t writtencount() const;          //!< Frames written so far
+
+private:
+  char ringname[256];                     //!< Name of the shared memory
+  canshmheader *header;                   //!< Mapped ring (0 = none)
+  canshmslot *slots;                      //!< First slot
+  size_t size;                            //!< Bytes mapped
+  uint64_t next;                          //!< Number of the next frame
+};
+
+/*!
+ * Reading end of the ring (any number of processes).
+ */
+class canshmreader {
+
+public:
+  canshmreader();                         //!< Constructor, creates a reader without ring
+  ~canshmreader();                        //!< Destructor, unmaps the ring
+  bool open(const char *name);            //!< Maps an existing ring read-only
+  void close();                           //!< Unmaps the ring
+  const canshmheader *ringheader() const; //!< Header of the ring (0 = not open)
+  void seekend();                         //!< Skips all frames written so far
+  int read(canshmslot *out, int max);     //!< Copies the next frames
+  uint64_t position() const;              //!< Number of the next frame to be read
+  uint64_t lostcount() const;             //!< Frames overwritten before they could be read
+  bool writerclosed() const;              //!< Whether the writer has stopped
+
+private:
+  const canshmheader *header;             //!< Mapped ring (0 = none)
+  const canshmslot *slots;                //!< First slot
+  size_t size;                            //!< Bytes mapped
+  uint64_t next;                          //!< Number of the next frame to be read
+  uint64_t lost;                          //!< Frames lost so far
+};
+
+#endif // CANSHMRING_H
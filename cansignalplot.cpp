@@ -0,0 +1,544 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "cansignalplot.h"
+
+#include <algorithm>
+
+/*!
+ * Constructor, creates an empty pyramid.
+ */
+cansignalpyramid::cansignalpyramid() {
+}
+
+/*!
+ * Removes all samples.
+ */
+void cansignalpyramid::clear() {
+  times.clear();
+  values.clear();
+  levels.clear();
+}
+
+/*!
+ * Appends one sample and updates the last bucket of every level.
+ * A level is created (from the level below) as soon as it gets its first
+ * complete bucket, which happens log8(n) times in total.
+ * Times going backwards (e.g. frames of different interfaces) are clamped to
+ * the previous time so the samples stay sorted.
+ * @param time Time of the sample (microseconds)
+ * @param value Value of the sample
+ */
+void cansignalpyramid::append(qint64 time, double value) {
+  if (!times.isEmpty() && time < times.last()) time = times.last();
+  times.append(time);
+  values.append(value);
+  int n = values.size();
+
+  qint64 size = Fanout;
+  for (int level = 0; ; level++, size *= Fanout) {
+    if (level == levels.size()) {
+      if (n < size) break;
+
+      // New level: its buckets are built from the buckets (or samples) below
+      QVector<bucket> buckets((n + size - 1) / size);
+      for (int i = 0; i < buckets.size(); i++) {
+        bucket b;
+        b.min = b.max = values.at(i * size);
+        for (int j = 0; j < Fanout; j++) {
+          if (level == 0) {
+            int sample = i * Fanout + j;
+            if (sample >= n) break;
+            b.min = qMin(b.min, values.at(sample));
+            b.max = qMax(b.max, values.at(sample));
+          } else {
+            int below = i * Fanout + j;
+            if (below >= levels.at(level - 1).size()) break;
+            b.min = qMin(b.min, levels.at(level - 1).at(below).min);
+            b.max = qMax(b.max, levels.at(level - 1).at(below).max);
+          }
+        }
+        buckets[i] = b;
+      }
+      levels.append(buckets);
+    } else {
+      QVector<bucket> &buckets = levels[level];
+      int index = (n - 1) / size;
+      if (index == buckets.size()) {
+        bucket b;
+        b.min = b.max = value;
+        buckets.append(b);
+      } else {
+        bucket &b = buckets[index];
+        if (value < b.min) b.min = value;
+        if (value > b.max) b.max = value;
+      }
+    }
+  }
+}
+
+/*!
+ * Number of samples.
+ * @return number of samples
+ */
+int cansignalpyramid::count() const {
+  return values.size();
+}
+
+/*!
+ * Time of a sample.
+ * @param index Index of the sample
+ * @return time in microseconds
+ */
+qint64 cansignalpyramid::timeat(int index) const {
+  return times.at(index);
+}
+
+/*!
+ * Value of a sample.
+ * @param index Index of the sample
+ * @return value
+ */
+double cansignalpyramid::valueat(int index) const {
+  return values.at(index);
+}
+
+/*!
+ * First sample at or after a time (binary search).
+ * @param time Time in microseconds
+ * @return index of the sample (count() if there is none)
+ */
+int cansignalpyramid::lowerbound(qint64 time) const {
+  return std::lower_bound(times.constBegin(), times.constEnd(), time) - times.constBegin();
+}
+
+/*!
+ * Min and max of the samples first to end - 1.
+ * The range is covered by the largest aligned buckets fitting into it, so at
+ * most 2 * Fanout buckets per level are looked at.
+ * @param first Index of the first sample
+ * @param end Index behind the last sample
+ * @param min Receives the smallest value
+ * @param max Receives the largest value
+ * @return false if the range is empty
+ */
+bool cansignalpyramid::minmax(int first, int end, double &min, double &max) const {
+  if (first < 0) first = 0;
+  if (end > values.size()) end = values.size();
+  if (first >= end) return false;
+
+  min = max = values.at(first);
+  int i = first;
+  while (i < end) {
+    // Largest bucket starting at i and ending before end
+    qint64 size = 1;
+    int level = -1;
+    while (level + 1 < levels.size()) {
+      qint64 next = size * Fanout;
+      if (i % next || i + next > end) break;
+      size = next;
+      level++;
+    }
+
+    if (level < 0) {
+      min = qMin(min, values.at(i));
+      max = qMax(max, values.at(i));
+    } else {
+      const bucket &b = levels.at(level).at(i / size);
+      min = qMin(min, b.min);
+      max = qMax(max, b.max);
+    }
+    i += size;
+  }
+  return true;
+}
+
+/*!
+ * Constructor.
+ * @param parent Parent widget
+ */
+cansignalcanvas::cansignalcanvas(QWidget *parent) :
+        QWidget(parent) {
+  series = 0;
+  viewstart = 0;
+  viewlength = 0;
+  follow = true;
+  dragx = 0;
+  origin = 0;
+  setMinimumSize(200, 120);
+  setBackgroundRole(QPalette::Base);
+  setAutoFillBackground(true);
+}
+
+/*!
+ * Sets the series to be drawn.
+ * @param newseries List of series (owned by the caller)
+ */
+void cansignalcanvas::setseries(const QList<cansignalseries *> *newseries) {
+  series = newseries;
+  update();
+}
+
+/*!
+ * Keep the newest samples in view.
+ * @param enabled Whether the view follows the newest samples
+ */
+void cansignalcanvas::setfollow(bool enabled) {
+  follow = enabled;
+  update();
+}
+
+/*!
+ * Zoom to show all samples.
+ */
+void cansignalcanvas::showall() {
+  qint64 first, last;
+  if (!timerange(first, last)) return;
+  viewstart = first;
+  viewlength = qMax(last - first, (qint64)1000);
+  update();
+}
+
+/*!
+ * Draws the curves. Every series costs O(width) lookups in its pyramid: one
+ * min/max per pixel column, or a plain polyline if there are fewer samples
+ * than pixels in view.
+ * @param event Paint event
+ */
+void cansignalcanvas::paintEvent(QPaintEvent *) {
+  QPainter painter(this);
+  QRect r = plotrect();
+  painter.setPen(palette().color(QPalette::Mid));
+  painter.drawRect(r.adjusted(0, 0, -1, -1));
+
+  qint64 first, last;
+  if (!series || !timerange(first, last) || r.width() < 2 || r.height() < 2) return;
+  if (viewlength <= 0) {
+    viewstart = first;
+    viewlength = qMax(last - first, (qint64)1000);
+  }
+  if (follow) viewstart = last - viewlength;
+  origin = first;
+  qint64 viewend = viewstart + viewlength;
+
+  // Common value range of everything in view
+  bool any = false;
+  double ymin = 0, ymax = 0;
+  foreach (const cansignalseries *s, *series) {
+    double min, max;
+    if (!s->samples.minmax(s->samples.lowerbound(viewstart) - 1, s->samples.lowerbound(viewend + 1) + 1, min, max)) continue;
+    ymin = any ? qMin(ymin, min) : min;
+    ymax = any ? qMax(ymax, max) : max;
+    any = true;
+  }
+  if (!any) return;
+  if (ymax - ymin < 1e-9) {
+    ymin -= 1;
+    ymax += 1;
+  }
+  double yscale = (r.height() - 1) / (ymax - ymin);
+  double xscale = (double)r.width() / viewlength;
+
+  // Axes
+  painter.setPen(palette().color(QPalette::Text));
+  painter.drawText(QRect(0, r.top(), r.left() - 4, fontMetrics().height()), Qt::AlignRight, QString::number(ymax, 'g', 6));
+  painter.drawText(QRect(0, r.bottom() - fontMetrics().height(), r.left() - 4, fontMetrics().height()), Qt::AlignRight, QString::number(ymin, 'g', 6));
+  painter.drawText(QRect(r.left(), r.bottom() + 2, r.width(), fontMetrics().height()), Qt::AlignLeft,
+                   QString("%1 s").arg((viewstart - origin) / 1e6, 0, 'f', 3));
+  painter.drawText(QRect(r.left(), r.bottom() + 2, r.width(), fontMetrics().height()), Qt::AlignRight,
+                   QString("%1 s").arg((viewend - origin) / 1e6, 0, 'f', 3));
+
+  painter.setClipRect(r);
+  int legendy = r.top() + fontMetrics().ascent() + 2;
+  foreach (const cansignalseries *s, *series) {
+    const cansignalpyramid &samples = s->samples;
+    painter.setPen(s->color);
+    painter.drawText(r.left() + 4, legendy, s->name);
+    legendy += fontMetrics().height();
+
+    // One sample left and right of the view so the curve reaches the edges
+    int from = qMax(samples.lowerbound(viewstart) - 1, 0);
+    int to = qMin(samples.lowerbound(viewend + 1) + 1, samples.count());
+    if (from >= to) continue;
+
+    if (to - from <= 2 * r.width()) {
+      QVector<QPointF> points;
+      points.reserve(to - from);
+      for (int i = from; i < to; i++) {
+        points.append(QPointF(r.left() + (samples.timeat(i) - viewstart) * xscale,
+                              r.bottom() - (samples.valueat(i) - ymin) * yscale));
+      }
+      painter.drawPolyline(points.constData(), points.size());
+      continue;
+    }
+
+    // One vertical line per pixel column from min to max; including the last
+    // sample of the previous column connects the columns
+    QVector<QLineF> lines;
+    lines.reserve(r.width());
+    int end = samples.lowerbound(viewstart);
+    for (int x = 0; x < r.width(); x++) {
+      int begin = end;
+      end = samples.lowerbound(viewstart + (qint64)((x + 1) / xscale));
+      double min, max;
+      if (!samples.minmax(begin > 0 ? begin - 1 : begin, end, min, max)) continue;
+      lines.append(QLineF(r.left() + x, r.bottom() - (min - ymin) * yscale,
+                          r.left() + x, r.bottom() - (max - ymin) * yscale));
+    }
+    painter.drawLines(lines);
+  }
+}
+
+/*!
+ * Starts panning.
+ * @param event Mouse event
+ */
+void cansignalcanvas::mousePressEvent(QMouseEvent *event) {
+  dragx = event->x();
+}
+
+/*!
+ * Pans the view with the mouse.
+ * @param event Mouse event
+ */
+void cansignalcanvas::mouseMoveEvent(QMouseEvent *event) {
+  if (!(event->buttons() & Qt::LeftButton) || viewlength <= 0) return;
+  viewstart -= (qint64)((double)(event->x() - dragx) * viewlength / qMax(plotrect().width(), 1));
+  dragx = event->x();
+  if (follow) {
+    follow = false;
+    emit followstopped();
+  }
+  update();
+}
+
+/*!
+ * Shows everything.
+ * @param event Mouse event
+ */
+void cansignalcanvas::mouseDoubleClickEvent(QMouseEvent *) {
+  showall();
+}
+
+/*!
+ * Zooms around the mouse position.
+ * @param event Wheel event
+ */
+void cansignalcanvas::wheelEvent(QWheelEvent *event) {
+  if (viewlength <= 0) return;
+  QRect r = plotrect();
+  double position = qBound(0.0, (double)(event->x() - r.left()) / qMax(r.width(), 1), 1.0);
+  qint64 center = viewstart + (qint64)(position * viewlength);
+  viewlength = (qint64)(viewlength * (event->delta() > 0 ? 0.8 : 1.25));
+  if (viewlength < 100) viewlength = 100;
+  viewstart = center - (qint64)(position * viewlength);
+  update();
+}
+
+/*!
+ * Times of the oldest and newest sample of all series.
+ * @param first Receives the oldest time
+ * @param last Receives the newest time
+ * @return false if there are no samples
+ */
+bool cansignalcanvas::timerange(qint64 &first, qint64 &last) const {
+  bool any = false;
+  if (!series) return false;
+  foreach (const cansignalseries *s, *series) {
+    if (!s->samples.count()) continue;
+    qint64 oldest = s->samples.timeat(0);
+    qint64 newest = s->samples.timeat(s->samples.count() - 1);
+    first = any ? qMin(first, oldest) : oldest;
+    last = any ? qMax(last, newest) : newest;
+    any = true;
+  }
+  return any;
+}
+
+/*!
+ * Area inside the axes.
+ * @return rectangle in widget coordinates
+ */
+QRect cansignalcanvas::plotrect() const {
+  int left = fontMetrics().width("-8.88888e+88") + 8;
+  return QRect(left, 4, width() - left - 4, height() - fontMetrics().height() - 8);
+}
+
+/*!
+ * Constructor.
+ * @param logfile Logfile the packets come from
+ * @param parent Parent widget
+ */
+cansignalplot::cansignalplot(canlogfile *logfile, QWidget *parent) :
+        QWidget(parent) {
+  clf = logfile;
+  database = 0;
+  dirty = false;
+
+  QVBoxLayout *layout = new QVBoxLayout;
+  setLayout(layout);
+  QHBoxLayout *header = new QHBoxLayout;
+  layout->addLayout(header);
+  signalcombo = new QComboBox;
+  signalcombo->setMinimumContentsLength(24);
+  header->addWidget(signalcombo, 1);
+  QPushButton *addpb = new QPushButton(tr("Add"));
+  header->addWidget(addpb);
+  QPushButton *removepb = new QPushButton(tr("Remove all"));
+  header->addWidget(removepb);
+  QCheckBox *followcb = new QCheckBox(tr("Follow"));
+  followcb->setChecked(true);
+  header->addWidget(followcb);
+
+  canvas = new cansignalcanvas;
+  canvas->setseries(&series);
+  layout->addWidget(canvas, 1);
+
+  refreshtimer = new QTimer(this);
+  refreshtimer->start(100);
+
+  connect(addpb, SIGNAL(clicked()), this, SLOT(addseries()));
+  connect(removepb, SIGNAL(clicked()), this, SLOT(removeall()));
+  connect(followcb, SIGNAL(toggled(bool)), this, SLOT(followchanged(bool)));
+  connect(canvas, SIGNAL(followstopped()), followcb, SLOT(toggle()));
+  connect(refreshtimer, SIGNAL(timeout()), this, SLOT(refresh()));
+  connect(clf, SIGNAL(dataitemstored(canpacket)), this, SLOT(adddataitem(canpacket)));
+  connect(clf, SIGNAL(reloaded()), this, SLOT(reload()));
+}
+
+/*!
+ * Destructor, frees the series.
+ */
+cansignalplot::~cansignalplot() {
+  qDeleteAll(series);
+}
+
+/*!
+ * Sets the signal database. All series are removed, the combobox lists the
+ * signals of the new database.
+ * @param newdatabase Signal database (0 = none)
+ */
+void cansignalplot::setdatabase(const candbc *newdatabase) {
+  removeall();
+  database = newdatabase;
+  signalcombo->clear();
+  if (!database) return;
+  for (int m = 0; m < database->messagecount(); m++) {
+    const candbcmessage &msg = database->messageat(m);
+    for (int s = 0; s < msg.siglist.size(); s++) {
+      signalcombo->addItem(msg.name + "." + msg.siglist.at(s).name, QPoint(m, s));
+    }
+  }
+}
+
+/*!
+ * Adds the signals of one new canpacket to the series.
+ * @param packet The new canpacket
+ */
+void cansignalplot::adddataitem(canpacket packet) {
+  if (series.isEmpty() || packet.err || packet.marker || !database) return;
+  const candbcmessage *msg = database->message(packet.identifier, packet.ide);
+  if (!msg) return;
+
+  qint64 time = (qint64)packet.tv.tv_sec * 1000000 + packet.tv.tv_usec;
+  foreach (cansignalseries *s, series) {
+    if (s->identifier != msg->identifier || s->ide != msg->ide) continue;
+    if (!database->ispresent(*msg, s->sig, packet)) continue;
+    s->samples.append(time, candbc::value(msg->siglist.at(s->sig), packet));
+    dirty = true;
+  }
+}
+
+/*!
+ * Decodes all series again from the stored canpackets (after the file has
+ * been cleared or read).
+ */
+void cansignalplot::reload() {
+  foreach (cansignalseries *s, series) fill(s);
+  canvas->showall();
+}
+
+/*!
+ * Adds the signal selected in the combobox.
+ */
+void cansignalplot::addseries() {
+  static const Qt::GlobalColor colors[] = {Qt::blue, Qt::red, Qt::darkGreen, Qt::magenta, Qt::darkCyan, Qt::darkYellow, Qt::black};
+  if (!database || signalcombo->currentIndex() < 0) return;
+  QPoint selection = signalcombo->itemData(signalcombo->currentIndex()).toPoint();
+  const candbcmessage &msg = database->messageat(selection.x());
+
+  cansignalseries *newseries = new cansignalseries;
+  newseries->name = signalcombo->currentText();
+  newseries->identifier = msg.identifier;
+  newseries->ide = msg.ide;
+  newseries->sig = selection.y();
+  newseries->color = colors[series.size() % (sizeof(colors) / sizeof(colors[0]))];
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  fill(newseries);
+  QApplication::restoreOverrideCursor();
+  series.append(newseries);
+  canvas->showall();
+}
+
+/*!
+ * Removes all series.
+ */
+void cansignalplot::removeall() {
+  qDeleteAll(series);
+  series.clear();
+  canvas->update();
+}
+
+/*!
+ * Called when "Follow" has been toggled.
+ * @param enabled Whether the view follows the newest samples
+ */
+void cansignalplot::followchanged(bool enabled) {
+  canvas->setfollow(enabled);
+}
+
+/*!
+ * Redraws if new samples arrived since the last redraw.
+ */
+void cansignalplot::refresh() {
+  if (!dirty) return;
+  dirty = false;
+  canvas->update();
+}
+
+/*!
+ * Decodes a signal from all stored packets. The payloads of the matching
+ * frames are gathered into blocks and decoded with candbc::decodeseries.
+ * @param newseries Series to be filled (its samples are replaced)
+ */
+void cansignalplot::fill(cansignalseries *newseries) {
+  enum { BlockSize = 4096 };
+  newseries->samples.clear();
+  const candbcmessage *msg = database ? database->message(newseries->identifier, newseries->ide) : 0;
+  if (!msg) return;
+  const candbcsignal &sig = msg->siglist.at(newseries->sig);
+
+  QVector<quint64> payloads(BlockSize);
+  QVector<qint64> times(BlockSize);
+  QVector<double> values(BlockSize);
+  int count = clf->getdataitemcount();
+  int index = 0;
+  while (index < count) {
+    int gathered = 0;
+    for (; index < count && gathered < BlockSize; index++) {
+      const canpacket &packet = clf->getdataitem(index);
+      if (packet.err || packet.marker || packet.identifier != newseries->identifier || packet.ide != newseries->ide) continue;
+      if (!database->ispresent(*msg, newseries->sig, packet)) continue;
+      payloads[gathered] = qFromLittleEndian<quint64>(packet.data);
+      times[gathered] = (qint64)packet.tv.tv_sec * 1000000 + packet.tv.tv_usec;
+      gathered++;
+    }
+    candbc::decodeseries(sig, payloads.constData(), gathered, values.data());
+    for (int i = 0; i < gathered; i++) newseries->samples.append(times.at(i), values.at(i));
+  }
+}
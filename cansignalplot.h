@@ -0,0 +1,133 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANSIGNALPLOT_H
+#define CANSIGNALPLOT_H
+
+#include <QtGui>
+
+#include "canlogfile.h"
+#include "candbc.h"
+
+/*!
+ * Samples of one signal with a min/max pyramid on top.
+ * Level 0 of the pyramid holds min/max of 8 samples, level 1 of 64 samples
+ * and so on. The min/max of any range is found with a few buckets per level,
+ * so drawing costs O(pixels) no matter how many samples there are. Appending
+ * a sample updates one bucket per level.
+ */
+class cansignalpyramid {
+
+public:
+  cansignalpyramid();                         //!< Constructor, creates an empty pyramid
+  void clear();                               //!< Removes all samples
+  void append(qint64 time, double value);     //!< Appends one sample (times must not decrease)
+  int count() const;                          //!< Number of samples
+  qint64 timeat(int index) const;             //!< Time of a sample
+  double valueat(int index) const;            //!< Value of a sample
+  int lowerbound(qint64 time) const;          //!< First sample at or after a time
+  bool minmax(int first, int end, double &min, double &max) const; //!< Min and max of a range of samples
+
+private:
+  enum { Fanout = 8 /*!< samples (or buckets) per bucket of the next level */ };
+
+  //! Min and max of a bucket
+  struct bucket {
+    double min;                               //!< smallest value in the bucket
+    double max;                               //!< largest value in the bucket
+  };
+
+  QVector<qint64> times;                      //!< Time of every sample (microseconds)
+  QVector<double> values;                     //!< Value of every sample
+  QVector<QVector<bucket> > levels;           //!< The pyramid, finest level first
+};
+
+/*!
+ * One plotted signal.
+ */
+struct cansignalseries {
+  QString name;                               //!< "Message.Signal"
+  quint32 identifier;                         //!< CAN ID of the message
+  bool ide;                                   //!< Whether the ID is an extended one
+  int sig;                                    //!< Index of the signal in the message
+  QColor color;                               //!< Color of the curve
+  cansignalpyramid samples;                   //!< Decoded samples
+};
+
+/*!
+ * Drawing area of the signal plot. Drag to pan, wheel to zoom, double click
+ * to show everything.
+ */
+class cansignalcanvas : public QWidget {
+Q_OBJECT
+
+public:
+  explicit cansignalcanvas(QWidget *parent = 0);  //!< Constructor
+  void setseries(const QList<cansignalseries *> *newseries);  //!< Sets the series to be drawn
+  void setfollow(bool enabled);               //!< Keep the newest samples in view
+  void showall();                             //!< Zoom to show all samples
+
+signals:
+  void followstopped();                       //!< The user has moved the view away from the newest samples
+
+protected:
+  void paintEvent(QPaintEvent *event);        //!< Draws the curves
+  void mousePressEvent(QMouseEvent *event);   //!< Starts panning
+  void mouseMoveEvent(QMouseEvent *event);    //!< Pans
+  void mouseDoubleClickEvent(QMouseEvent *event); //!< Shows everything
+  void wheelEvent(QWheelEvent *event);        //!< Zooms around the mouse position
+
+private:
+  const QList<cansignalseries *> *series;     //!< Series to be drawn
+  qint64 viewstart;                           //!< Left edge of the view (microseconds)
+  qint64 viewlength;                          //!< Width of the view (microseconds)
+  bool follow;                                //!< Keep the newest samples in view
+  int dragx;                                  //!< Last mouse position while panning
+  qint64 origin;                              //!< Time shown as 0 on the axis
+
+  bool timerange(qint64 &first, qint64 &last) const;  //!< Times of the oldest and newest sample
+  QRect plotrect() const;                     //!< Area inside the axes
+};
+
+/*!
+ * Dock content plotting decoded signals over the whole capture.
+ * The series are decoded from the canlogfile once when they are added and
+ * then grow with every stored canpacket; a redraw happens at most 10 times a
+ * second during a live capture.
+ */
+class cansignalplot : public QWidget {
+Q_OBJECT
+
+public:
+  cansignalplot(canlogfile *logfile, QWidget *parent = 0);  //!< Constructor
+  ~cansignalplot();                           //!< Destructor, frees the series
+  void setdatabase(const candbc *newdatabase);  //!< Sets the signal database (removes all series)
+
+public slots:
+  void adddataitem(canpacket packet);         //!< Adds the signals of one new canpacket
+  void reload();                              //!< Decodes all series again from the stored canpackets
+
+private slots:
+  void addseries();                           //!< Adds the signal selected in the combobox
+  void removeall();                           //!< Removes all series
+  void followchanged(bool enabled);           //!< Called when "Follow" has been toggled
+  void refresh();                             //!< Redraws if new samples arrived
+
+private:
+  canlogfile *clf;                            //!< Logfile the packets come from
+  const candbc *database;                     //!< Signal database (0 = none)
+  QList<cansignalseries *> series;            //!< Plotted signals
+  QComboBox *signalcombo;                     //!< All signals of the database
+  cansignalcanvas *canvas;                    //!< Drawing area
+  QTimer *refreshtimer;                       //!< Limits redraws during live capture
+  bool dirty;                                 //!< New samples since the last redraw
+
+  void fill(cansignalseries *newseries);      //!< Decodes the signal from all stored packets
+};
+
+#endif // CANSIGNALPLOT_H
@@ -0,0 +1,310 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "canstreamserver.h"
+
+#include <stdio.h>
+
+/*!
+ * Constructor, creates a server that is not listening yet.
+ * @param parent Parent object
+ */
+canstreamserver::canstreamserver(QObject *parent) :
+        QObject(parent) {
+  dropped = 0;
+  flushtimer = new QTimer(this);
+  connect(flushtimer, SIGNAL(timeout()), this, SLOT(flush()));
+  connect(&tcpserver, SIGNAL(newConnection()), this, SLOT(newconnection()));
+  connect(&localserver, SIGNAL(newConnection()), this, SLOT(newconnection()));
+}
+
+/*!
+ * Destructor, disconnects all clients.
+ */
+canstreamserver::~canstreamserver() {
+  close();
+}
+
+/*!
+ * Listens on a TCP port of localhost (other hosts cannot connect).
+ * @param port TCP port (DefaultPort is the one of socketcand)
+ * @param error Set to the reason if listening fails
+ * @return success of the operation
+ */
+bool canstreamserver::listentcp(quint16 port, QString *error) {
+  close();
+  if (!tcpserver.listen(QHostAddress::LocalHost, port)) {
+    if (error) *error = tcpserver.errorString();
+    return false;
+  }
+  flushtimer->start(FlushInterval);
+  return true;
+}
+
+/*!
+ * Listens on a Unix socket. A socket file left behind by a crashed
+ * instance is removed first.
+ * @param path File name of the socket
+ * @param error Set to the reason if listening fails
+ * @return success of the operation
+ */
+bool canstreamserver::listenlocal(const QString &path, QString *error) {
+  close();
+  QLocalServer::removeServer(path);
+  if (!localserver.listen(path)) {
+    if (error) *error = localserver.errorString();
+    return false;
+  }
+  flushtimer->start(FlushInterval);
+  return true;
+}
+
+/*!
+ * Stops listening and disconnects all clients.
+ */
+void canstreamserver::close() {
+  flushtimer->stop();
+  tcpserver.close();
+  localserver.close();
+  foreach (streamclient *client, clients) {
+    client->socket->disconnect(this);
+    client->socket->close();
+    client->socket->deleteLater();
+    delete client;
+  }
+  clients.clear();
+}
+
+/*!
+ * Whether the server is listening.
+ * @return true if listening on a TCP port or a Unix socket
+ */
+bool canstreamserver::islistening() const {
+  return tcpserver.isListening() || localserver.isListening();
+}
+
+/*!
+ * Connected clients.
+ * @return number of clients
+ */
+int canstreamserver::clientcount() const {
+  return clients.size();
+}
+
+/*!
+ * canpackets dropped because a client did not keep up, summed over all
+ * clients (including those disconnected already).
+ * @return number of canpackets
+ */
+quint64 canstreamserver::droppedcount() const {
+  return dropped;
+}
+
+/*!
+ * Queues a canpacket for all streaming clients whose filter it passes.
+ * A client whose queue is full loses the canpacket. Each message is built
+ * at most once per format.
+ * @param packet The canpacket
+ */
+void canstreamserver::publish(canpacket packet) {
+  if (packet.marker) return;
+  QByteArray text;
+  QByteArray record;
+  foreach (streamclient *client, clients) {
+    if (client->state != Raw && client->state != Binary) continue;
+    if (!client->filter.matches(packet)) continue;
+
+    QByteArray &message = (client->state == Raw) ? text : record;
+    if (message.isEmpty()) message = (client->state == Raw) ? frametext(packet) : framerecord(packet);
+    if (client->pending.size() + client->socket->bytesToWrite() + message.size() > QueueLimit) {
+      client->dropped++;
+      dropped++;
+      continue;
+    }
+    client->pending.append(message);
+    if (client->pending.size() >= BatchSize) write(client);
+  }
+}
+
+/*!
+ * Sets the name of the capture interface. Clients have to open it by this
+ * name; with an empty name any name is accepted.
+ * @param name Interface name, e.g. "can0"
+ */
+void canstreamserver::setinterface(const QString &name) {
+  interface = name;
+}
+
+/*!
+ * Accepts the waiting clients of both servers.
+ */
+void canstreamserver::newconnection() {
+  while (tcpserver.hasPendingConnections()) addclient(tcpserver.nextPendingConnection());
+  while (localserver.hasPendingConnections()) addclient(localserver.nextPendingConnection());
+}
+
+/*!
+ * Reads the commands of a client (sender()). A message is everything from
+ * "<" to ">".
+ */
+void canstreamserver::readclient() {
+  streamclient *client = clientof(sender());
+  if (!client) return;
+  client->input.append(client->socket->readAll());
+
+  int end;
+  while ((end = client->input.indexOf('>')) >= 0) {
+    int start = client->input.indexOf('<');
+    if (start >= 0 && start < end) command(client, QString::fromAscii(client->input.mid(start + 1, end - start - 1)));
+    client->input.remove(0, end + 1);
+  }
+  // Garbage without a complete message
+  if (client->input.size() > 4096) client->input.clear();
+}
+
+/*!
+ * Removes a disconnected client (sender()).
+ */
+void canstreamserver::clientgone() {
+  streamclient *client = clientof(sender());
+  if (!client) return;
+  clients.removeAll(client);
+  client->socket->deleteLater();
+  delete client;
+}
+
+/*!
+ * Writes the queued canpackets of all clients. Called every FlushInterval.
+ */
+void canstreamserver::flush() {
+  foreach (streamclient *client, clients) write(client);
+}
+
+/*!
+ * Greets a new client.
+ * @param socket Socket of the client, owned by the server from now on
+ */
+void canstreamserver::addclient(QIODevice *socket) {
+  streamclient *client = new streamclient;
+  client->socket = socket;
+  client->state = Greeted;
+  client->dropped = 0;
+  client->reported = 0;
+  clients.append(client);
+  connect(socket, SIGNAL(readyRead()), this, SLOT(readclient()));
+  connect(socket, SIGNAL(disconnected()), this, SLOT(clientgone()));
+  socket->write("< hi >");
+}
+
+/*!
+ * Client of a socket.
+ * @param socket The socket
+ * @return the client (0 if unknown)
+ */
+canstreamserver::streamclient *canstreamserver::clientof(QObject *socket) const {
+  foreach (streamclient *client, clients) {
+    if (client->socket == socket) return client;
+  }
+  return 0;
+}
+
+/*!
+ * Handles one command of a client. In binary mode nothing but binary
+ * records is sent, so commands are not answered there.
+ * @param client The client
+ * @param message Text between "<" and ">"
+ */
+void canstreamserver::command(streamclient *client, const QString &message) {
+  QStringList words = message.split(' ', QString::SkipEmptyParts);
+  if (words.isEmpty()) return;
+  QString reply = "< ok >";
+
+  if (words.at(0) == "echo") {
+    reply = "< echo >";
+  } else if (words.at(0) == "open" && client->state == Greeted) {
+    if (words.size() == 2 && (interface.isEmpty() || words.at(1) == interface)) {
+      client->state = Opened;
+    } else {
+      reply = "< error could not open bus >";
+    }
+  } else if (words.at(0) == "rawmode" && (client->state == Opened || client->state == Raw)) {
+    client->state = Raw;
+  } else if (words.at(0) == "binarymode" && (client->state == Opened || client->state == Raw)) {
+    write(client);
+    client->socket->write(reply.toAscii());
+    client->state = Binary;
+    return;
+  } else if (words.at(0) == "filter" && client->state != Greeted) {
+    canpacketfilter filter;
+    if (words.size() > 1 && !filter.setids(words.at(1))) reply = "< error invalid ids >";
+    else if (words.size() > 2 && !filter.setpayload(QStringList(words.mid(2)).join(" "))) reply = "< error invalid payload >";
+    else client->filter = filter;
+  } else {
+    reply = "< error unknown command >";
+  }
+
+  if (client->state == Binary) return;
+  write(client);
+  client->socket->write(reply.toAscii());
+}
+
+/*!
+ * Writes the queue of one client in one go, after a report of the
+ * canpackets dropped since the last write (if any).
+ * @param client The client
+ */
+void canstreamserver::write(streamclient *client) {
+  if (client->dropped != client->reported) {
+    if (client->state == Binary) {
+      QByteArray report;
+      QDataStream out(&report, QIODevice::WriteOnly);
+      out << (qint64)0 << (quint32)0 << (quint8)0 << (quint8)FlagDropReport << (quint16)0 << (quint64)client->dropped;
+      client->pending.append(report);
+    } else {
+      client->pending.append(QString("< dropped %1 >").arg(client->dropped).toAscii());
+    }
+    client->reported = client->dropped;
+  }
+  if (client->pending.isEmpty()) return;
+  client->socket->write(client->pending);
+  client->pending.clear();
+}
+
+/*!
+ * canpacket as < frame > message of socketcand: ID (hex), timestamp
+ * (seconds.microseconds) and the payload as hex without spaces.
+ * @param packet The canpacket
+ * @return message
+ */
+QByteArray canstreamserver::frametext(const canpacket &packet) {
+  char buffer[64];
+  int length = snprintf(buffer, sizeof(buffer), packet.ide ? "< frame %08X %ld.%06ld " : "< frame %03X %ld.%06ld ",
+                        packet.identifier, (long)packet.tv.tv_sec, (long)packet.tv.tv_usec);
+  for (int i = 0; i < packet.dlc && i < 8; i++) length += snprintf(buffer + length, sizeof(buffer) - length, "%02X", packet.data[i]);
+  length += snprintf(buffer + length, sizeof(buffer) - length, " >");
+  return QByteArray(buffer, length);
+}
+
+/*!
+ * canpacket as binary record (see canstreamserver).
+ * @param packet The canpacket
+ * @return record of RecordSize bytes
+ */
+QByteArray canstreamserver::framerecord(const canpacket &packet) {
+  QByteArray record;
+  record.reserve(RecordSize);
+  QDataStream out(&record, QIODevice::WriteOnly);
+  quint32 id = packet.identifier;
+  if (packet.ide) id |= 0x80000000;
+  if (packet.rtr) id |= 0x40000000;
+  if (packet.err) id |= 0x20000000;
+  out << (qint64)((qint64)packet.tv.tv_sec * 1000000 + packet.tv.tv_usec) << id << (quint8)packet.dlc
+      << (quint8)(packet.direction ? 0 : FlagSent) << (quint16)packet.interface;
+  out.writeRawData((const char *)packet.data, 8);
+  return record;
+}
@@ -0,0 +1,117 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANSTREAMSERVER_H
+#define CANSTREAMSERVER_H
+
+#include <QtCore>
+#include <QtNetwork>
+
+#include "canlogfile.h"
+#include "canpacketfilter.h"
+
+/*!
+ * Serves the captured canpackets to other processes on the same machine,
+ * on a TCP port of localhost or on a Unix socket.
+ *
+ * The protocol is the raw mode of socketcand:
+ *   server: < hi >
+ *   client: < open can0 >            server: < ok >
+ *   client: < rawmode >              server: < ok >
+ *   server: < frame 123 1262304000.123456 11223344 > ...
+ * plus these extensions:
+ *   < filter 123,200-2FF [11 ?? 22] >  only canpackets matching the IDs
+ *                                      (and payload pattern) are sent;
+ *                                      < filter > sends all again
+ *   < binarymode >                     instead of rawmode: binary records
+ *   < dropped 42 >                     (server) canpackets dropped so far
+ *   < echo >                           answered with < echo >
+ *
+ * A binary record has RecordSize bytes (big endian): qint64 timestamp in
+ * microseconds since the epoch, quint32 CAN ID with the flags of struct
+ * can_frame (EFF 0x80000000, RTR 0x40000000, ERR 0x20000000), quint8 dlc,
+ * quint8 flags (FlagSent, FlagDropReport), quint16 interface and 8 data
+ * bytes. A record with FlagDropReport carries the number of canpackets
+ * dropped so far as quint64 in the data bytes.
+ *
+ * The canpackets are queued per client and written in batches every
+ * FlushInterval. A client that does not keep up loses canpackets once its
+ * queue (plus what the socket has not sent yet) reaches QueueLimit; the
+ * capture never waits for a client.
+ */
+class canstreamserver: public QObject {
+Q_OBJECT
+
+public:
+  enum {
+    DefaultPort = 29536,        /*!< TCP port of socketcand */
+    RecordSize = 24,            /*!< bytes of a binary record */
+    FlagSent = 0x01,            /*!< binary record: the canpacket has been sent, not received */
+    FlagDropReport = 0x02,      /*!< binary record: number of dropped canpackets, no canpacket */
+    QueueLimit = 262144,        /*!< bytes queued per client before canpackets are dropped */
+    BatchSize = 16384,          /*!< bytes queued per client that are written at once */
+    FlushInterval = 10          /*!< milliseconds between two batched writes */
+  };
+
+  explicit canstreamserver(QObject *parent = 0); //!< Constructor, creates a server not listening
+  ~canstreamserver();                     //!< Destructor, disconnects all clients
+  bool listentcp(quint16 port, QString *error); //!< Listens on a TCP port of localhost
+  bool listenlocal(const QString &path, QString *error); //!< Listens on a Unix socket
+  void close();                           //!< Stops listening and disconnects all clients
+  bool islistening() const;               //!< Whether the server is listening
+  int clientcount() const;                //!< Connected clients
+  quint64 droppedcount() const;           //!< canpackets dropped for slow clients so far
+
+public slots:
+  void publish(canpacket packet);         //!< Queues a canpacket for all clients it passes the filter of
+  void setinterface(const QString &name); //!< Name of the capture interface clients may open
+
+private slots:
+  void newconnection();                   //!< Accepts waiting clients
+  void readclient();                      //!< Reads the commands of a client
+  void clientgone();                      //!< Removes a disconnected client
+  void flush();                           //!< Writes the queued canpackets of all clients
+
+private:
+  //! Protocol state of a client
+  enum ClientState {
+    Greeted = 0,      //!< < hi > sent, waiting for < open >
+    Opened,           //!< Waiting for < rawmode > or < binarymode >
+    Raw,              //!< Receiving canpackets as < frame > messages
+    Binary            //!< Receiving canpackets as binary records
+  };
+
+  /*!
+   * One connected client.
+   */
+  struct streamclient {
+    QIODevice *socket;        //!< QTcpSocket or QLocalSocket
+    ClientState state;        //!< Protocol state
+    canpacketfilter filter;   //!< canpackets sent to this client
+    QByteArray input;         //!< Received bytes not parsed yet
+    QByteArray pending;       //!< Queued canpackets not written yet
+    quint64 dropped;          //!< canpackets dropped for this client
+    quint64 reported;         //!< Dropped canpackets the client has been told about
+  };
+
+  QTcpServer tcpserver;                   //!< Listens on localhost
+  QLocalServer localserver;               //!< Listens on a Unix socket
+  QList<streamclient *> clients;          //!< Connected clients
+  QTimer *flushtimer;                     //!< Calls flush()
+  QString interface;                      //!< Capture interface (empty = any name may be opened)
+  quint64 dropped;                        //!< canpackets dropped for slow clients so far
+
+  void addclient(QIODevice *socket);      //!< Greets a new client
+  streamclient *clientof(QObject *socket) const; //!< Client of a socket
+  void command(streamclient *client, const QString &message); //!< Handles one command of a client
+  void write(streamclient *client);       //!< Writes the queue of one client
+  static QByteArray frametext(const canpacket &packet);   //!< canpacket as < frame > message
+  static QByteArray framerecord(const canpacket &packet); //!< canpacket as binary record
+};
+
+#endif // CANSTREAMSERVER_H
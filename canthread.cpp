@@ -10,6 +10,18 @@
 
 #include <iostream>
 
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+// Not defined by older C library headers
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
 using namespace std;
 
 /*!
@@ -17,21 +29,117 @@ using namespace std;
  */
 canthread::canthread() {
   stopped = true;
+  sockfd = -1;
+  dropbase = 0;
+  recording = true;
+  triggers = 0;
+  pendingtriggers = 0;
+  latency = 0;
+  cycles = 0;
+  rcvbufsize = 0;
+  rcvbufforce = false;
+  errmask = 0;
+  schedpolicy = SCHED_OTHER;
+  schedpriority = 0;
+  schedlock = false;
+  memorylocked = false;
+  bzero(&mystatus, sizeof(mystatus));
+
+  controlfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (controlfd < 0) {
+    cerr << "ERROR creating eventfd" << endl; cerr.flush();
+  }
+}
+
+/*!
+ * Destructor, frees the triggers.
+ */
+canthread::~canthread() {
+  if (controlfd >= 0) close(controlfd);
+  delete triggers;
+  delete pendingtriggers;
+}
+
+/*!
+ * Start the thread. It counts as running from now on, so a stop() right
+ * after is not lost, even before run() has begun.
+ * @param priority Priority of the thread (see QThread::start())
+ */
+void canthread::start(Priority priority) {
+  stopped = false;
+  QThread::start(priority);
 }
 
 /*!
- * Stop the thread.
+ * Stop the thread. It wakes up and leaves its loop right away.
  */
 void canthread::stop() {
   stopped = true;
+  wakeup();
 }
 
 /*!
  * Set the name of the interface to use.
+ * A running thread rebinds its socket to the new interface right away.
  * @param ifnametobeset Name of the interface to be used
  */
 void canthread::setifname (QString ifnametobeset) {
+  QMutexLocker locker(&controlmutex);
   ifname = ifnametobeset;
+  ifchanged = 1;
+  locker.unlock();
+  wakeup();
+}
+
+/*!
+ * Wake the thread up from ppoll() so it looks at the stop flag and the
+ * changed settings. The eventfd is signalled in any case; a thread not
+ * running yet drains it when it starts, so the wakeup is not seen twice.
+ */
+void canthread::wakeup() {
+  quint64 one = 1;
+  if (controlfd >= 0 && write(controlfd, &one, sizeof(one)) != sizeof(one)) {
+    cerr << "Problem while waking up the thread!" << endl; cerr.flush();
+  }
+}
+
+/*!
+ * Record the kernel and thread latencies in the given statistics.
+ * Must be called while the thread is not running.
+ * @param newlatency Latency statistics (0 = none)
+ */
+void canthread::setlatency(canlatency *newlatency) {
+  latency = newlatency;
+}
+
+/*!
+ * Measure the cycle times of the received frames in the given analysis.
+ * Must be called while the thread is not running.
+ * @param newcycles Cycle time analysis (0 = none)
+ */
+void canthread::setcycles(cancycleanalyzer *newcycles) {
+  cycles = newcycles;
+}
+
+/*!
+ * Take over the nominal periods or the reset of the cycle time analysis
+ * right away. Otherwise they wait for the next frame while the bus is quiet.
+ */
+void canthread::cycleschanged() {
+  wakeup();
+}
+
+/*!
+ * Receive buffer size that holds a burst of frames twice over. The kernel
+ * doubles the value set (for its bookkeeping) and charges about FrameMemory
+ * bytes per queued frame.
+ * @param burst Most frames seen queued at once
+ * @return buffer size in bytes for setreceivebuffer()
+ */
+int canthread::recommendedreceivebuffer(quint64 burst) {
+  quint64 bytes = burst * FrameMemory;
+  bytes = qMax(bytes, (quint64)65536);
+  return (int)qMin(bytes, (quint64)(256 * 1024 * 1024));
 }
 
 /*!
@@ -39,12 +147,22 @@ void canthread::setifname (QString ifnametobeset) {
  * @param sendpacket Packet-data to be sent
  */
 void canthread::sendmsg(canpacket sendpacket) {
-  struct can_frame frame;
-  int nbytes;
-
   // Do nothing if the thread is not running
   if (stopped) return;
 
+  QMutexLocker locker(&socketmutex);
+  sendframe(sendpacket);
+}
+
+/*!
+ * Write one frame to the socket, count it and pass it to the main thread.
+ * Used for frames from the GUI as well as frames sent by a trigger.
+ * @param sendpacket Packet-data to be sent
+ */
+void canthread::sendframe(canpacket sendpacket) {
+  struct can_frame frame;
+  int nbytes;
+
   // Construct the canpacket to be sent away
   frame.can_id = sendpacket.identifier;
   if (sendpacket.ide) frame.can_id = frame.can_id | CAN_EFF_FLAG;
@@ -54,6 +172,8 @@ void canthread::sendmsg(canpacket sendpacket) {
   sendpacket.crc = 0;             // not used yet
   sendpacket.direction = false;   // we sent it
   sendpacket.rtr = false;         // not used yet
+  sendpacket.bookmark = false;
+  sendpacket.marker = false;
   gettimeofday(&sendpacket.tv, NULL);
 
 #ifdef DEBUG
@@ -69,12 +189,27 @@ void canthread::sendmsg(canpacket sendpacket) {
     mystatus.outbcounter = mystatus.outbcounter + frame.can_dlc;
 
     statusChanged(mystatus);
-    dataarrived(sendpacket);
+    if (recording) handover(sendpacket);
   }
 }
 
+/*!
+ * Stamp a packet with the handover time (for the queue latency) and pass it
+ * to the main thread.
+ * @param packet The packet
+ * @return handover time in nanoseconds (0 if no latencies are recorded)
+ */
+qint64 canthread::handover(canpacket &packet) {
+  qint64 now = latency ? canlatency::now() : 0;
+  packet.queuedstamp = now / 1000;
+  dataarrived(packet);
+  return now;
+}
+
 /*!
  * Set the CAN hardware filters for the socket.
+ * The filters are parsed here and applied by the thread right away (or when
+ * the capture starts).
  * @param hwfilter List of the filters to be applied
  */
 void canthread::setfilter(QStringList hwfilter) {
@@ -116,24 +251,302 @@ void canthread::setfilter(QStringList hwfilter) {
   cerr.flush();
 #endif
 
-  // Now apply the filters to the socket
-  if (err_mask) setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
-  if (numfilter) setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, rfilter, numfilter * sizeof(struct can_filter));
+  // Now hand the filters over to the thread
+  QMutexLocker locker(&controlmutex);
+  filters.resize(numfilter);
+  if (numfilter) memcpy(filters.data(), rfilter, numfilter * sizeof(struct can_filter));
+  errmask = err_mask;
+  filterchanged = 1;
+  locker.unlock();
+  wakeup();
 
   free(rfilter);
 }
 
+/*!
+ * Apply the CAN filters to the socket. Called by the thread itself.
+ */
+void canthread::applyfilter() {
+  QMutexLocker locker(&controlmutex);
+  QVector<struct can_filter> newfilters = filters;
+  can_err_mask_t newerrmask = errmask;
+  filterchanged = 0;
+  locker.unlock();
+
+  if (newerrmask) setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &newerrmask, sizeof(newerrmask));
+  if (newfilters.size()) setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, newfilters.constData(), newfilters.size() * sizeof(struct can_filter));
+}
+
+/*!
+ * Open the socket, bind it to the interface and apply the settings. An open
+ * socket is replaced (the interface has been changed). Called by the thread
+ * itself.
+ * @return false if the new socket could not be opened
+ */
+bool canthread::opensocket() {
+  struct sockaddr_can addr;
+  struct ifreq ifr;
+  const int on = 1;
+
+  QMutexLocker locker(&controlmutex);
+  QString name = ifname;
+  ifchanged = 0;
+  locker.unlock();
+
+  int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (fd < 0) {
+    cerr << "ERROR opening socket" << endl; cerr.flush();
+    return false;
+  }
+  addr.can_family = AF_CAN;
+#ifdef DEBUG
+  cerr << "I shall use interface \"" << name.toLocal8Bit().constData() << "\"" << endl;
+  cerr.flush();
+#endif
+  strncpy(ifr.ifr_name, name.toLocal8Bit().constData(), IFNAMSIZ - 1);
+  ifr.ifr_name[IFNAMSIZ - 1] = 0;
+  ioctl(fd, SIOCGIFINDEX, &ifr);
+  addr.can_ifindex = ifr.ifr_ifindex;
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    cerr << "Error binding" << endl; cerr.flush();
+  }
+
+  // Timestamp and kernel drop counter come with every frame as ancillary data
+  setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+  setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+
+  // SO_RXQ_OVFL counts per socket, the new one starts from 0 again
+  dropbase = mystatus.dropcounter;
+  QMutexLocker socketlocker(&socketmutex);
+  if (sockfd >= 0) close(sockfd);
+  sockfd = fd;
+  socketlocker.unlock();
+
+  applyfilter();
+  applyreceivebuffer();
+  return true;
+}
+
+/*!
+ * Set the size of the socket receive buffer. It is applied by the thread
+ * before it reads the next frames, or when the capture starts.
+ * @param bytes Size in bytes (0 = system default)
+ * @param force Use SO_RCVBUFFORCE (needs CAP_NET_ADMIN) to exceed net.core.rmem_max
+ */
+void canthread::setreceivebuffer(int bytes, bool force) {
+  QMutexLocker locker(&controlmutex);
+  rcvbufsize = bytes;
+  rcvbufforce = force;
+  rcvbufchanged = 1;
+  locker.unlock();
+  wakeup();
+}
+
+/*!
+ * Apply the receive buffer size to the socket and read back the size in
+ * effect. Called by the thread itself. If SO_RCVBUFFORCE is not permitted,
+ * SO_RCVBUF is used, which the kernel limits to net.core.rmem_max.
+ */
+void canthread::applyreceivebuffer() {
+  QMutexLocker locker(&controlmutex);
+  int bytes = rcvbufsize;
+  bool force = rcvbufforce;
+  rcvbufchanged = 0;
+  locker.unlock();
+
+  if (bytes > 0) {
+    if (!force || setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) < 0) {
+      if (force) {
+        cerr << "SO_RCVBUFFORCE not permitted, using SO_RCVBUF" << endl; cerr.flush();
+      }
+      setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+    }
+  }
+
+  int size = 0;
+  socklen_t len = sizeof(size);
+  if (getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, &len) == 0) mystatus.rcvbuf = size;
+}
+
+/*!
+ * Set the scheduling of the capture thread. It is applied by the thread
+ * right away (or when the capture starts); whatever is not permitted is
+ * skipped and reported by schedulingwarning().
+ * @param policy SCHED_OTHER, SCHED_FIFO or SCHED_RR
+ * @param priority Real-time priority 1-99 (ignored for SCHED_OTHER)
+ * @param cpus CPUs the thread may run on (empty = all)
+ * @param lockmemory Lock all memory of the process to avoid page faults
+ */
+void canthread::setscheduling(int policy, int priority, QList<int> cpus, bool lockmemory) {
+  QMutexLocker locker(&controlmutex);
+  schedpolicy = policy;
+  schedpriority = priority;
+  schedcpus = cpus;
+  schedlock = lockmemory;
+  schedchanged = 1;
+  locker.unlock();
+  wakeup();
+}
+
+/*!
+ * Apply priority, CPU affinity and memory locking to the calling (capture)
+ * thread. Called by the thread itself. Missing capabilities are not fatal:
+ * the capture goes on with what could be applied.
+ */
+void canthread::applyscheduling() {
+  QMutexLocker locker(&controlmutex);
+  int policy = schedpolicy;
+  int priority = schedpriority;
+  QList<int> cpus = schedcpus;
+  bool lockmemory = schedlock;
+  schedchanged = 0;
+  locker.unlock();
+
+  QStringList problems;
+
+  struct sched_param param;
+  param.sched_priority = (policy == SCHED_OTHER) ? 0 : priority;
+  int err = pthread_setschedparam(pthread_self(), policy, &param);
+  if (err) {
+    problems << tr("Real-time priority not applied (%1); it needs CAP_SYS_NICE or an RLIMIT_RTPRIO of %2.")
+                .arg(strerror(err)).arg(priority);
+  }
+
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  if (cpus.isEmpty()) {
+    for (int i = 0; i < CPU_SETSIZE; i++) CPU_SET(i, &cpuset);
+  } else {
+    foreach (int cpu, cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &cpuset);
+    }
+  }
+  err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+  if (err && !cpus.isEmpty()) {
+    problems << tr("CPU affinity not applied (%1); check the CPU numbers.").arg(strerror(err));
+  }
+
+  if (lockmemory && !memorylocked) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+      memorylocked = true;
+    } else {
+      problems << tr("Memory not locked (%1); it needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK.").arg(strerror(errno));
+    }
+  } else if (!lockmemory && memorylocked) {
+    munlockall();
+    memorylocked = false;
+  }
+
+  if (!problems.isEmpty()) schedulingwarning(problems.join("\n"));
+}
+
+/*!
+ * Set the triggers evaluated on every frame.
+ * The triggers are parsed here and taken over by the thread before it
+ * handles the next frame; invalid definitions are skipped.
+ * @param definitions One trigger definition per entry (see cantriggerengine::add())
+ */
+void canthread::settriggers(QStringList definitions) {
+  cantriggerengine *newtriggers = new cantriggerengine;
+  foreach (const QString &definition, definitions) {
+    if (definition.trimmed().isEmpty() || definition.trimmed().startsWith("#")) continue;
+    if (!newtriggers->add(definition)) {
+      cerr << "Error parsing trigger \"" << definition.toAscii().constData() << "\"" << endl;
+      cerr.flush();
+    }
+  }
+  if (!newtriggers->count()) {
+    delete newtriggers;
+    newtriggers = 0;
+  }
+
+  QMutexLocker locker(&controlmutex);
+  delete pendingtriggers;
+  pendingtriggers = newtriggers;
+  triggerschanged = 1;
+  locker.unlock();
+  wakeup();
+}
+
+/*!
+ * Take over the triggers set by the GUI. Called by the thread itself.
+ */
+void canthread::installtriggers() {
+  QMutexLocker locker(&controlmutex);
+  delete triggers;
+  triggers = pendingtriggers;
+  pendingtriggers = 0;
+  triggerschanged = 0;
+  locker.unlock();
+
+  resettriggers();
+}
+
+/*!
+ * Restart the triggers when the capture starts: the "missing" timers start
+ * now and recording waits for a start trigger if there is one.
+ */
+void canthread::resettriggers() {
+  fired.resize(triggers ? triggers->count() : 0);
+  recording = !(triggers && triggers->startsstopped());
+  if (triggers) triggers->start(cantriggerengine::monotonicnow());
+}
+
+/*!
+ * Take the action of a fired trigger.
+ * @param number Number of the trigger
+ * @param packet Frame that fired the trigger (0 for a "missing" trigger)
+ */
+void canthread::dotrigger(int number, canpacket *packet) {
+  const cantrigger &trigger = triggers->at(number);
+  mystatus.triggercounter++;
+
+  switch (trigger.action) {
+  case cantrigger::StartRecording:
+    recording = true;
+    break;
+  case cantrigger::StopRecording:
+    recording = false;
+    break;
+  case cantrigger::Bookmark:
+    if (packet) {
+      packet->bookmark = true;
+    } else if (recording) {
+      // Nothing to mark, insert a marker for the missing ID
+      canpacket marker;
+      bzero(&marker, sizeof(marker));
+      marker.identifier = trigger.identifier;
+      marker.ide = trigger.ide;
+      marker.direction = true;
+      marker.bookmark = true;
+      marker.marker = true;
+      gettimeofday(&marker.tv, NULL);
+      handover(marker);
+    }
+    break;
+  case cantrigger::CaptureTrigger:
+    capturetrigger();
+    break;
+  case cantrigger::SendFrame:
+    sendframe(trigger.sendpacket);
+    break;
+  }
+
+  triggerfired(trigger.definition);
+}
+
 /*!
  * Start the thread and enter it's main loop.
  * To stop the thread, call the stop()-function.
  */
 void canthread::run() {
   struct sockaddr_can addr;
-  struct ifreq ifr;
   int ret;
   struct timeval tv; //timeval of canframe just recvd
   canpacket mypacket;
-  struct pollfd rdfs;
+  struct pollfd rdfs[2];
+  quint64 control;
 
   // "new" (revmsg)-method
   struct can_frame frame;
@@ -141,7 +554,12 @@ void canthread::run() {
   struct msghdr msg;
   char ctrlmsg[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(__u32))];
   int nbytes;
-  //struct cmsghdr *cmsg; //see below
+  struct cmsghdr *cmsg;
+  struct timespec timeout;
+  int numfired;
+  int burst;
+  bool gotstamp;
+  __u32 drops;
 
   // Better safe than sorry
   bzero(&mypacket, sizeof(mypacket));
@@ -151,30 +569,26 @@ void canthread::run() {
   mystatus.outcounter = 0;
   mystatus.inbcounter = 0;
   mystatus.outbcounter = 0;
+  mystatus.triggercounter = 0;
+  mystatus.dropcounter = 0;
+  mystatus.maxburst = 0;
+  mystatus.rcvbuf = 0;
+
+  // Triggers start from scratch with every capture
+  if (triggerschanged) installtriggers(); else resettriggers();
+  if (cycles) cycles->restart();
+
+  // Wake-ups requested before the start are covered by opening the socket
+  while (read(controlfd, &control, sizeof(control)) == sizeof(control));
+  opensocket();
+  applyscheduling();
   statusChanged(mystatus);
 
-  sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
-  if (sockfd < 0) {
-    cerr << "ERROR opening socket" << endl; cerr.flush();
-  }
-  addr.can_family = AF_CAN;
-#ifdef DEBUG
-  cerr << "I shall use interface \"" << ifname.toLocal8Bit().constData() << "\"" << endl;
-  cerr.flush();
-#endif
-  strcpy(ifr.ifr_name, ifname.toLocal8Bit().constData());
-  ioctl(sockfd, SIOCGIFINDEX, &ifr);
-  addr.can_ifindex = ifr.ifr_ifindex;
-
-  if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    cerr << "Error binding" << endl; cerr.flush();
-  }
-
-  // Get ready to poll()
-  rdfs.fd = sockfd;
-  rdfs.events = POLLIN;
-
-  stopped = false;
+  // Get ready to poll() the socket and the control eventfd
+  rdfs[0].fd = sockfd;
+  rdfs[0].events = POLLIN;
+  rdfs[1].fd = controlfd;
+  rdfs[1].events = POLLIN;
 
   // "new" method, taken from can-utils/candump.c
   /* these settings are static and can be held out of the hot path */
@@ -185,47 +599,124 @@ void canthread::run() {
   msg.msg_control = &ctrlmsg;
 
   while (!stopped) {
-     // poll() waits until data arrives or 100msec have passed
-    ret = poll(&rdfs, 1, 100);
+    // Take over triggers, filters, buffer size and interface changed by the GUI
+    if (triggerschanged) installtriggers();
+    if (filterchanged) applyfilter();
+    if (schedchanged) applyscheduling();
+    if (rcvbufchanged) {
+      applyreceivebuffer();
+      statusChanged(mystatus);
+    }
+    if (ifchanged) {
+      opensocket();
+      rdfs[0].fd = sockfd;
+      statusChanged(mystatus);
+    }
+
+    // ppoll() waits until data arrives, the GUI wakes us up, the next
+    // "missing" trigger is due or the next ID of the cycle times becomes
+    // missing; without either it waits forever
+    struct timespec *wait = NULL;
+    qint64 usec = -1;
+    if (triggers && triggers->nextdeadline() >= 0) {
+      usec = qMax((qint64)0, triggers->nextdeadline() - cantriggerengine::monotonicnow());
+    }
+    if (cycles && cycles->nextsweep() >= 0) {
+      qint64 sweepusec = qMax((qint64)0, cycles->nextsweep() - cancycleanalyzer::realtimenow());
+      if (usec < 0 || sweepusec < usec) usec = sweepusec;
+    }
+    if (usec >= 0) {
+      timeout.tv_sec = usec / 1000000;
+      timeout.tv_nsec = (usec % 1000000) * 1000;
+      wait = &timeout;
+    }
+    ret = ppoll(rdfs, 2, wait, NULL);
+    if (ret > 0 && (rdfs[1].revents & POLLIN)) {
+      while (read(controlfd, &control, sizeof(control)) == sizeof(control));
+    }
+
+    if (triggers) {
+      numfired = triggers->checkdeadlines(cantriggerengine::monotonicnow(), fired.data());
+      for (int i = 0; i < numfired; i++) dotrigger(fired.at(i), 0);
+      if (numfired) statusChanged(mystatus);
+    }
+
+    if (cycles && cycles->nextsweep() >= 0) {
+      qint64 now = cancycleanalyzer::realtimenow();
+      if (now >= cycles->nextsweep()) cycles->sweep(now);
+    }
+
     if (ret < 0) {
-      cerr << "poll() error >_<" << endl; cerr.flush();
-    } else if (ret != 0) {
-      // "new" (recvmsg)-method
-      iov.iov_len = sizeof(frame);
-      msg.msg_namelen = sizeof(addr);
-      msg.msg_controllen = sizeof(ctrlmsg);
-      msg.msg_flags = 0;
-
-      nbytes = recvmsg(sockfd, &msg, 0);
-
-      // Get the CAN frame's timestamp
-      // From candump.c but the thing below works better
-      //for (cmsg = CMSG_FIRSTHDR(&msg); cmsg && (cmsg->cmsg_level == SOL_SOCKET); cmsg = CMSG_NXTHDR(&msg,cmsg)) {
-      //  if (cmsg->cmsg_type == SO_TIMESTAMP) tv = *(struct timeval *)CMSG_DATA(cmsg);
-      //}
-      if (ioctl(sockfd, SIOCGSTAMP, &tv) < 0) perror("SIOCGSTAMP");
-
-      // Update the counters
-      mystatus.incounter++;
-      mystatus.inbcounter = mystatus.inbcounter + frame.can_dlc;
-
-      mypacket.dlc = frame.can_dlc;
-      mypacket.direction = true; // we recvd that packet
-      // omit EFF, RTR, ERR flags so that only the CAN ID remains
-      mypacket.identifier = frame.can_id & CAN_EFF_MASK;
-      mypacket.rtr = frame.can_id & CAN_RTR_FLAG;
-      mypacket.ide = frame.can_id & CAN_EFF_FLAG;
-      mypacket.err = frame.can_id & CAN_ERR_FLAG;
-      memcpy(mypacket.data, frame.data, 8);
-      memcpy(&mypacket.tv, &tv, sizeof(struct timeval));
-
-      // Pass the packet to the main thread
-      dataarrived(mypacket);
+      if (errno != EINTR) {
+        cerr << "poll() error >_<" << endl; cerr.flush();
+      }
+    } else if (rdfs[0].revents & POLLIN) {
+      // Read everything that is queued; the number of frames is the burst depth
+      for (burst = 0; burst < MaxBurst; burst++) {
+        // "new" (recvmsg)-method
+        iov.iov_len = sizeof(frame);
+        msg.msg_namelen = sizeof(addr);
+        msg.msg_controllen = sizeof(ctrlmsg);
+        msg.msg_flags = 0;
+
+        nbytes = recvmsg(sockfd, &msg, MSG_DONTWAIT);
+        if (nbytes < 0) break;
+        qint64 received = latency ? canlatency::now() : 0;
+
+        // Get the CAN frame's timestamp and the kernel drop counter
+        gotstamp = false;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+          if (cmsg->cmsg_level != SOL_SOCKET) continue;
+          if (cmsg->cmsg_type == SO_TIMESTAMP) {
+            memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+            gotstamp = true;
+          } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            mystatus.dropcounter = dropbase + drops;
+          }
+        }
+        if (!gotstamp && ioctl(sockfd, SIOCGSTAMP, &tv) < 0) perror("SIOCGSTAMP");
+        if (latency) latency->stage(canlatency::KernelToRecv).record(received - ((qint64)tv.tv_sec * 1000000 + tv.tv_usec) * 1000);
+
+        // Update the counters
+        mystatus.incounter++;
+        mystatus.inbcounter = mystatus.inbcounter + frame.can_dlc;
+
+        mypacket.dlc = frame.can_dlc;
+        mypacket.direction = true; // we recvd that packet
+        // omit EFF, RTR, ERR flags so that only the CAN ID remains
+        mypacket.identifier = frame.can_id & CAN_EFF_MASK;
+        mypacket.rtr = frame.can_id & CAN_RTR_FLAG;
+        mypacket.ide = frame.can_id & CAN_EFF_FLAG;
+        mypacket.err = frame.can_id & CAN_ERR_FLAG;
+        memcpy(mypacket.data, frame.data, 8);
+        memcpy(&mypacket.tv, &tv, sizeof(struct timeval));
+        mypacket.bookmark = false;
+        mypacket.marker = false;
+
+        // Cycle times are measured on every received frame, recorded or not
+        if (cycles) cycles->record(mypacket);
+
+        // Evaluate the triggers for this frame right here, without the main thread
+        if (triggers) {
+          numfired = triggers->checkframe(mypacket, cantriggerengine::monotonicnow(), fired.data());
+          for (int i = 0; i < numfired; i++) dotrigger(fired.at(i), &mypacket);
+        }
+
+        // Pass the packet to the main thread
+        if (recording) {
+          qint64 handed = handover(mypacket);
+          if (latency) latency->stage(canlatency::RecvToEmit).record(handed - received);
+        }
+      }
+
+      if ((quint64)burst > mystatus.maxburst) mystatus.maxburst = burst;
       statusChanged(mystatus);
     }
   }
 
   // Thread shall be stopped here
+  QMutexLocker socketlocker(&socketmutex);
   close(sockfd);
-  stopped = true;
+  sockfd = -1;
 }
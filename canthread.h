@@ -10,6 +10,7 @@
 #define CANTHREAD_H
 
 #include <QThread>
+#include <QMutex>
 
 #include <poll.h>
 
@@ -23,6 +24,9 @@
 #include <linux/can/raw.h>
 
 #include "canlogfile.h"
+#include "cantrigger.h"
+#include "canlatency.h"
+#include "cancycle.h"
 
 /*!
  * Holds the thread's internal status (packet counters, byte counters, error counters)
@@ -32,6 +36,10 @@ struct threadstatus {
   quint64 outcounter;                     //!< packets going out
   quint64 inbcounter;                     //!< bytes coming in
   quint64 outbcounter;                    //!< bytes going out
+  quint64 triggercounter;                 //!< triggers fired
+  quint64 dropcounter;                    //!< frames dropped by the kernel because the socket queue was full
+  quint64 maxburst;                       //!< most frames found queued at one wakeup
+  quint64 rcvbuf;                         //!< receive buffer size in effect (bytes, as reported by the kernel)
 };
 
 /*!
@@ -42,25 +50,78 @@ Q_OBJECT
 
 public:
   canthread();                            //!< Constructor, initialising the thread as stopped
+  ~canthread();                           //!< Destructor, frees the triggers
+  void start(Priority priority = InheritPriority); //!< Start the thread
   void stop();                            //!< Stop the thread
-  void setifname(QString ifnametobeset);  //!< Set the name of the interface to use
+  void setifname(QString ifnametobeset);  //!< Set the name of the interface to use (rebinds a running thread)
   void sendmsg(canpacket sendpacket);     //!< Send away one packet
+  void setlatency(canlatency *newlatency);  //!< Record the kernel and thread latencies here (before start())
+  void setcycles(cancycleanalyzer *newcycles);  //!< Measure the cycle times here (before start())
+  void cycleschanged();                   //!< Take over changed cycle time settings (also on a quiet bus)
+  static int recommendedreceivebuffer(quint64 burst); //!< Receive buffer size for a burst depth
 
 signals:
+  void schedulingwarning(QString message);  //!< Scheduling, affinity or memory locking could not be applied
   void dataarrived(canpacket mypacket);   //!< We have new data fetched
   void statusChanged(threadstatus mystatus);  //!< The status has changed
+  void triggerfired(QString definition);  //!< A trigger has fired
+  void capturetrigger();                  //!< A trigger wants to fire the trigger of the capture buffer
 
 public slots:
   void setfilter(QStringList hwfilter);   //!< Set the CAN hardware filters for the socket
+  void settriggers(QStringList definitions);  //!< Set the triggers evaluated on every frame
+  void setreceivebuffer(int bytes, bool force);  //!< Set the size of the socket receive buffer
+  void setscheduling(int policy, int priority, QList<int> cpus, bool lockmemory); //!< Set priority, CPU affinity and memory locking
 
 protected:
   void run();                             //!< Start the thread and enter it's main loop
 
 private:
+  enum {
+    MaxBurst = 4096,                      /*!< frames read at most per wakeup */
+    FrameMemory = 1024                    /*!< approximate kernel memory of one queued frame (bytes) */
+  };
+
   volatile bool stopped;                  //!< Keep our status here internally
   QString ifname;                         //!< Name of network interface to be used
   int sockfd;                             //!< File descriptor of the socket we are working with
   struct threadstatus mystatus;           //!< Status of this thread
+  quint64 dropbase;                       //!< Kernel drops counted on the sockets before the current one
+
+  bool recording;                         //!< Whether frames are passed to the main thread
+  cantriggerengine *triggers;             //!< Triggers in use by the thread (0 = none)
+  cantriggerengine *pendingtriggers;      //!< Triggers set by the GUI, taken over by the thread
+  QAtomicInt triggerschanged;             //!< Set when pendingtriggers is to be taken over
+  QMutex controlmutex;                    //!< Protects the settings handed over to the thread
+  QMutex socketmutex;                     //!< Keeps sockfd from being replaced while the GUI sends
+  int controlfd;                          //!< eventfd waking the thread up for stop and setting changes
+  QAtomicInt filterchanged;               //!< Set when the filters are to be applied
+  QAtomicInt ifchanged;                   //!< Set when the socket is to be bound to another interface
+  int schedpolicy;                        //!< SCHED_OTHER, SCHED_FIFO or SCHED_RR
+  int schedpriority;                      //!< Real-time priority (1-99, FIFO and RR only)
+  QList<int> schedcpus;                   //!< CPUs the thread may run on (empty = all)
+  bool schedlock;                         //!< Lock all memory of the process (mlockall)
+  bool memorylocked;                      //!< Whether mlockall() is in effect
+  QAtomicInt schedchanged;                //!< Set when the scheduling is to be applied
+  QVector<struct can_filter> filters;     //!< CAN ID filters to be applied
+  can_err_mask_t errmask;                 //!< Error frame mask to be applied (0 = unchanged)
+  QVector<int> fired;                     //!< Numbers of the triggers fired by one frame
+  canlatency *latency;                    //!< Latency statistics (0 = none)
+  cancycleanalyzer *cycles;               //!< Cycle time analysis (0 = none)
+  int rcvbufsize;                         //!< Requested receive buffer size (0 = system default)
+  bool rcvbufforce;                       //!< Use SO_RCVBUFFORCE to exceed rmem_max
+  QAtomicInt rcvbufchanged;               //!< Set when the receive buffer is to be applied
+
+  void installtriggers();                 //!< Take over the triggers set by the GUI
+  void resettriggers();                   //!< Restart the triggers when the capture starts
+  void dotrigger(int number, canpacket *packet);  //!< Take the action of a fired trigger
+  void sendframe(canpacket sendpacket);   //!< Write one frame to the socket
+  void applyreceivebuffer();              //!< Apply the receive buffer size to the socket
+  void applyfilter();                     //!< Apply the CAN filters to the socket
+  void applyscheduling();                 //!< Apply priority, CPU affinity and memory locking
+  bool opensocket();                      //!< Open the socket and bind it to the interface
+  void wakeup();                          //!< Signal the eventfd, waking the thread up from ppoll()
+  qint64 handover(canpacket &packet);     //!< Stamp a packet and pass it to the main thread
 };
 
 #endif // CANTHREAD_H
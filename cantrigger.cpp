@@ -0,0 +1,318 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "cantrigger.h"
+
+#include <time.h>
+
+#include <linux/can.h>
+
+/*!
+ * Parses a hexadecimal CAN ID.
+ * @param str String to be parsed
+ * @param identifier Parsed ID
+ * @param ide Set if the ID is an extended one (more than 3 digits or > 0x7FF)
+ * @return success of the operation
+ */
+static bool parseid(const QString &str, quint32 &identifier, bool &ide) {
+  bool ok;
+  identifier = str.toULong(&ok, 16);
+  if (!ok || identifier > CAN_EFF_MASK) return false;
+  ide = str.length() > 3 || identifier > CAN_SFF_MASK;
+  return true;
+}
+
+/*!
+ * Parses a time like "200ms", "500us", "2s" or "200" (milliseconds).
+ * @param str String to be parsed
+ * @param usec Parsed time in microseconds
+ * @return success of the operation
+ */
+static bool parsetime(QString str, qint64 &usec) {
+  bool ok;
+  qint64 factor = 1000;
+  if (str.endsWith("us")) {
+    factor = 1;
+    str.chop(2);
+  } else if (str.endsWith("ms")) {
+    str.chop(2);
+  } else if (str.endsWith("s")) {
+    factor = 1000000;
+    str.chop(1);
+  }
+  usec = str.toLongLong(&ok) * factor;
+  return ok && usec > 0;
+}
+
+/*!
+ * Parses a frame in cansend syntax: <can_id>#{data}, e.g. "7E0#0210010000000000"
+ * @param str String to be parsed
+ * @param packet Packet to be filled
+ * @return success of the operation
+ */
+static bool parseframe(const QString &str, canpacket &packet) {
+  bool ok;
+  QStringList parts = str.split("#");
+  if (parts.size() != 2 || parts.at(1).length() % 2 || parts.at(1).length() > 16) return false;
+  if (!parseid(parts.at(0), packet.identifier, packet.ide)) return false;
+  packet.dlc = parts.at(1).length() / 2;
+  for (int i = 0; i < packet.dlc; i++) {
+    packet.data[i] = parts.at(1).mid(i * 2, 2).toUInt(&ok, 16);
+    if (!ok) return false;
+  }
+  return true;
+}
+
+/*!
+ * Constructor, creates an engine without triggers.
+ */
+cantriggerengine::cantriggerengine() {
+  sfftable.resize(CAN_SFF_MASK + 1);
+  deadline = -1;
+  haswaitforstart = false;
+}
+
+/*!
+ * Parses a trigger definition and adds it.
+ * Syntax: <condition> -> <action>
+ * Conditions:
+ *   id <can_id> [b<n>=<value> | b<n>&<mask>=<value> ...]  frame with that ID (and payload bytes)
+ *   error                                                  any error frame
+ *   missing <can_id> <time>                                ID not seen for <time> (e.g. 200ms, 500us)
+ * Actions: start, stop, mark, trigger, send <can_id>#<data>
+ * Example: "id 7E8 b0=7F -> mark"
+ * @param definition Trigger definition
+ * @return false if the definition could not be parsed
+ */
+bool cantriggerengine::add(const QString &definition) {
+  bool ok;
+  cantrigger trigger;
+  memset(trigger.datamask, 0, sizeof(trigger.datamask));
+  memset(trigger.datavalue, 0, sizeof(trigger.datavalue));
+  bzero(&trigger.sendpacket, sizeof(trigger.sendpacket));
+  trigger.identifier = 0;
+  trigger.ide = false;
+  trigger.timeout = 0;
+  trigger.lastseen = 0;
+  trigger.expired = false;
+  trigger.definition = definition.simplified();
+
+  QStringList sides = trigger.definition.split("->");
+  if (sides.size() != 2) return false;
+  QStringList condition = sides.at(0).split(" ", QString::SkipEmptyParts);
+  QStringList action = sides.at(1).split(" ", QString::SkipEmptyParts);
+  if (condition.isEmpty() || action.isEmpty()) return false;
+
+  // The condition
+  QString keyword = condition.takeFirst().toLower();
+  if (keyword == "id") {
+    trigger.condition = cantrigger::FrameMatch;
+    if (condition.isEmpty() || !parseid(condition.takeFirst(), trigger.identifier, trigger.ide)) return false;
+    foreach (const QString &byte, condition) {
+      // b<n>=<value> or b<n>&<mask>=<value>
+      QRegExp rx("b([0-7])(?:&([0-9a-fA-F]{1,2}))?=([0-9a-fA-F]{1,2})");
+      if (!rx.exactMatch(byte)) return false;
+      int n = rx.cap(1).toInt(&ok);
+      quint8 mask = rx.cap(2).isEmpty() ? 0xFF : rx.cap(2).toUInt(&ok, 16);
+      trigger.datamask[n] = mask;
+      trigger.datavalue[n] = rx.cap(3).toUInt(&ok, 16) & mask;
+    }
+  } else if (keyword == "error") {
+    trigger.condition = cantrigger::ErrorFrame;
+    if (!condition.isEmpty()) return false;
+  } else if (keyword == "missing") {
+    trigger.condition = cantrigger::Missing;
+    if (condition.size() != 2) return false;
+    if (!parseid(condition.at(0), trigger.identifier, trigger.ide)) return false;
+    if (!parsetime(condition.at(1), trigger.timeout)) return false;
+  } else {
+    return false;
+  }
+
+  // The action
+  keyword = action.takeFirst().toLower();
+  if (keyword == "start") {
+    trigger.action = cantrigger::StartRecording;
+  } else if (keyword == "stop") {
+    trigger.action = cantrigger::StopRecording;
+  } else if (keyword == "mark") {
+    trigger.action = cantrigger::Bookmark;
+  } else if (keyword == "trigger") {
+    trigger.action = cantrigger::CaptureTrigger;
+  } else if (keyword == "send") {
+    trigger.action = cantrigger::SendFrame;
+    if (action.size() != 1 || !parseframe(action.at(0), trigger.sendpacket)) return false;
+    action.clear();
+  } else {
+    return false;
+  }
+  if (!action.isEmpty()) return false;
+
+  // Put it into the tables
+  int number = triggers.size();
+  triggers.append(trigger);
+  if (trigger.condition == cantrigger::ErrorFrame) {
+    errortriggers.append(number);
+  } else if (trigger.ide) {
+    efftable[trigger.identifier].append(number);
+  } else {
+    sfftable[trigger.identifier].append(number);
+  }
+  if (trigger.condition == cantrigger::Missing) missingtriggers.append(number);
+  if (trigger.action == cantrigger::StartRecording) haswaitforstart = true;
+  return true;
+}
+
+/*!
+ * Number of triggers.
+ * @return number of triggers
+ */
+int cantriggerengine::count() const {
+  return triggers.size();
+}
+
+/*!
+ * Trigger by number.
+ * @param number Number of the trigger
+ * @return the trigger
+ */
+const cantrigger &cantriggerengine::at(int number) const {
+  return triggers.at(number);
+}
+
+/*!
+ * True if recording waits for a start trigger.
+ * @return whether a trigger starts recording
+ */
+bool cantriggerengine::startsstopped() const {
+  return haswaitforstart;
+}
+
+/*!
+ * Starts the "missing" timers: an ID that is never seen fires its trigger
+ * one timeout after the start.
+ * @param now Monotonic time in microseconds
+ */
+void cantriggerengine::start(qint64 now) {
+  foreach (int number, missingtriggers) {
+    triggers[number].lastseen = now;
+    triggers[number].expired = false;
+  }
+  updatedeadline();
+}
+
+/*!
+ * Checks one frame against the triggers for its ID (and the error triggers).
+ * @param packet The frame
+ * @param now Monotonic time in microseconds
+ * @param fired Array (count() entries) receiving the numbers of the fired triggers
+ * @return number of fired triggers
+ */
+int cantriggerengine::checkframe(const canpacket &packet, qint64 now, int *fired) {
+  int numfired = 0;
+
+  if (packet.err) {
+    for (int i = 0; i < errortriggers.size(); i++) fired[numfired++] = errortriggers.at(i);
+    return numfired;
+  }
+
+  const QVector<int> *candidates;
+  if (packet.ide) {
+    if (efftable.isEmpty()) return 0;
+    QHash<quint32, QVector<int> >::const_iterator it = efftable.constFind(packet.identifier);
+    if (it == efftable.constEnd()) return 0;
+    candidates = &it.value();
+  } else {
+    candidates = &sfftable.at(packet.identifier & CAN_SFF_MASK);
+  }
+
+  for (int i = 0; i < candidates->size(); i++) {
+    int number = candidates->at(i);
+    if (check(number, packet, now)) fired[numfired++] = number;
+  }
+  return numfired;
+}
+
+/*!
+ * Checks the "missing" triggers. Cheap if the cached deadline has not passed.
+ * @param now Monotonic time in microseconds
+ * @param fired Array (count() entries) receiving the numbers of the fired triggers
+ * @return number of fired triggers
+ */
+int cantriggerengine::checkdeadlines(qint64 now, int *fired) {
+  if (deadline < 0 || now < deadline) return 0;
+
+  int numfired = 0;
+  foreach (int number, missingtriggers) {
+    cantrigger &trigger = triggers[number];
+    if (!trigger.expired && trigger.lastseen + trigger.timeout <= now) {
+      trigger.expired = true;
+      fired[numfired++] = number;
+    }
+  }
+  updatedeadline();
+  return numfired;
+}
+
+/*!
+ * Earliest time a "missing" trigger may fire. IDs seen in the meantime only
+ * move their deadline later, so waking up at this time is never too late.
+ * @return monotonic time in microseconds (-1 = no missing trigger pending)
+ */
+qint64 cantriggerengine::nextdeadline() const {
+  return deadline;
+}
+
+/*!
+ * Monotonic time in microseconds.
+ * @return current time
+ */
+qint64 cantriggerengine::monotonicnow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (qint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*!
+ * Checks one trigger against a frame with its ID.
+ * @param number Number of the trigger
+ * @param packet The frame
+ * @param now Monotonic time in microseconds
+ * @return true if the trigger fires
+ */
+bool cantriggerengine::check(int number, const canpacket &packet, qint64 now) {
+  cantrigger &trigger = triggers[number];
+
+  if (trigger.condition == cantrigger::Missing) {
+    // Seen again: restart the timer
+    trigger.lastseen = now;
+    if (trigger.expired) {
+      trigger.expired = false;
+      if (deadline < 0 || now + trigger.timeout < deadline) deadline = now + trigger.timeout;
+    }
+    return false;
+  }
+
+  for (int i = 0; i < 8; i++) {
+    if (!trigger.datamask[i]) continue;
+    if (i >= packet.dlc || (packet.data[i] & trigger.datamask[i]) != trigger.datavalue[i]) return false;
+  }
+  return true;
+}
+
+/*!
+ * Recomputes the earliest deadline of the "missing" triggers.
+ */
+void cantriggerengine::updatedeadline() {
+  deadline = -1;
+  foreach (int number, missingtriggers) {
+    const cantrigger &trigger = triggers.at(number);
+    if (trigger.expired) continue;
+    if (deadline < 0 || trigger.lastseen + trigger.timeout < deadline) deadline = trigger.lastseen + trigger.timeout;
+  }
+}
@@ -0,0 +1,83 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef CANTRIGGER_H
+#define CANTRIGGER_H
+
+#include <QtCore>
+
+#include "canlogfile.h"
+
+/*!
+ * One trigger: a condition and the action to be taken when it is met.
+ */
+struct cantrigger {
+  //! What has to happen for the trigger to fire
+  enum Condition {
+    FrameMatch = 0,   //!< A frame with the ID (and payload bytes) has been seen
+    ErrorFrame,       //!< An error frame has been seen
+    Missing           //!< The ID has not been seen for timeout microseconds
+  };
+  //! What is done when the trigger fires
+  enum Action {
+    StartRecording = 0, //!< Pass frames to the canlogfile from now on
+    StopRecording,    //!< Stop passing frames to the canlogfile
+    Bookmark,         //!< Mark the frame (or insert a marker) in the canlogfile
+    CaptureTrigger,   //!< Fire the trigger of the capture buffer
+    SendFrame         //!< Send a frame right away from the capture thread
+  };
+
+  Condition condition;        //!< What has to happen for the trigger to fire
+  Action action;              //!< What is done when the trigger fires
+  quint32 identifier;         //!< CAN ID the condition is about
+  bool ide;                   //!< Whether identifier is an extended ID
+  quint8 datamask[8];         //!< Bits of the payload to compare (FrameMatch)
+  quint8 datavalue[8];        //!< Expected payload bits (FrameMatch, already masked)
+  qint64 timeout;             //!< Allowed gap in microseconds (Missing)
+  qint64 lastseen;            //!< Monotonic time the ID was seen last (Missing)
+  bool expired;               //!< Fired since the ID was seen last (Missing)
+  canpacket sendpacket;       //!< Frame to be sent (SendFrame)
+  QString definition;         //!< Text the trigger was created from
+};
+
+/*!
+ * Table driven evaluation of many triggers in the capture thread.
+ * Triggers are indexed by CAN ID, so a frame costs one table lookup no matter
+ * how many triggers exist; only the triggers for its ID are checked. The
+ * "missing" triggers are checked against a single cached deadline.
+ * Nothing here allocates after the triggers have been added.
+ */
+class cantriggerengine {
+
+public:
+  cantriggerengine();                       //!< Constructor, creates an engine without triggers
+  bool add(const QString &definition);      //!< Parses a trigger definition and adds it
+  int count() const;                        //!< Number of triggers
+  const cantrigger &at(int number) const;   //!< Trigger by number
+  bool startsstopped() const;               //!< True if recording waits for a start trigger
+  void start(qint64 now);                   //!< Starts the "missing" timers
+  int checkframe(const canpacket &packet, qint64 now, int *fired); //!< Checks one frame
+  int checkdeadlines(qint64 now, int *fired);  //!< Checks the "missing" triggers
+  qint64 nextdeadline() const;              //!< Earliest time a "missing" trigger may fire (-1 = none)
+
+  static qint64 monotonicnow();             //!< Monotonic time in microseconds
+
+private:
+  QVector<cantrigger> triggers;             //!< All triggers
+  QVector<QVector<int> > sfftable;          //!< Trigger numbers per standard ID (direct lookup)
+  QHash<quint32, QVector<int> > efftable;   //!< Trigger numbers per extended ID
+  QVector<int> errortriggers;               //!< Triggers on error frames
+  QVector<int> missingtriggers;             //!< Triggers on missing IDs
+  qint64 deadline;                          //!< Cached earliest deadline of the missing triggers (-1 = none)
+  bool haswaitforstart;                     //!< Whether a trigger starts recording
+
+  bool check(int number, const canpacket &packet, qint64 now); //!< Checks one trigger against a frame
+  void updatedeadline();                    //!< Recomputes the earliest deadline
+};
+
+#endif // CANTRIGGER_H
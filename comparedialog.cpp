@@ -0,0 +1,194 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "comparedialog.h"
+
+/*!
+ * Initialise the dialog.
+ * @param parent Parent for the dialog window
+ */
+CompareDialog::CompareDialog(QWidget *parent)
+    : QDialog(parent)
+{
+  QVBoxLayout *mainlayout = new QVBoxLayout;
+  QGroupBox *files = new QGroupBox;
+  QGridLayout *fileslayout = new QGridLayout;
+  files->setLayout(fileslayout);
+  files->setTitle(tr("Captures"));
+  mainlayout->addWidget(files);
+  summary = new QLabel;
+  mainlayout->addWidget(summary);
+  resulttable = new QTreeWidget;
+  mainlayout->addWidget(resulttable);
+  QPushButton *closebutton = new QPushButton(tr("Close"));
+  mainlayout->addWidget(closebutton);
+  connect(closebutton, SIGNAL(clicked()), this, SLOT(accept()));
+
+  // Layout for the files and the alignment
+  referencefile = new QLineEdit;
+  referencefile->setToolTip(tr("Capture compared against, e.g. a good run"));
+  comparedfile = new QLineEdit;
+  comparedfile->setToolTip(tr("Capture compared with the reference, e.g. a bad run"));
+  QPushButton *referencebrowse = new QPushButton(tr("..."));
+  QPushButton *comparedbrowse = new QPushButton(tr("..."));
+  alignment = new QComboBox;
+  alignment->addItem(tr("By sequence"));
+  alignment->addItem(tr("By time window"));
+  alignment->setToolTip(tr("Align the n-th frame of an ID with the n-th one of the other capture, "
+                           "or with a frame within the time window (times count from the first frame of each capture)"));
+  window = new QSpinBox;
+  window->setRange(1, 60000);
+  window->setValue(5);
+  window->setSuffix(" ms");
+  window->setEnabled(false);
+  QPushButton *comparebutton = new QPushButton(tr("Compare"));
+  fileslayout->addWidget(new QLabel(tr("Reference:")), 0, 0);
+  fileslayout->addWidget(referencefile, 0, 1, 1, 3);
+  fileslayout->addWidget(referencebrowse, 0, 4);
+  fileslayout->addWidget(new QLabel(tr("Compared:")), 1, 0);
+  fileslayout->addWidget(comparedfile, 1, 1, 1, 3);
+  fileslayout->addWidget(comparedbrowse, 1, 4);
+  fileslayout->addWidget(new QLabel(tr("Align frames:")), 2, 0);
+  fileslayout->addWidget(alignment, 2, 1);
+  fileslayout->addWidget(window, 2, 2);
+  fileslayout->addWidget(comparebutton, 2, 4);
+  connect(referencebrowse, SIGNAL(clicked()), this, SLOT(browsereference()));
+  connect(comparedbrowse, SIGNAL(clicked()), this, SLOT(browsecompared()));
+  connect(alignment, SIGNAL(currentIndexChanged(int)), this, SLOT(alignmentchanged(int)));
+  connect(comparebutton, SIGNAL(clicked()), this, SLOT(compare()));
+
+  // Layout for the result
+  resulttable->setRootIsDecorated(false);
+  resulttable->setSortingEnabled(true);
+  resulttable->setColumnCount(13);
+  resulttable->setHeaderLabels(QStringList() << tr("CAN ID") << tr("Status") << tr("Frames ref.") << tr("Frames comp.")
+                               << tr("Cycle ref. [ms]") << tr("Cycle comp. [ms]") << tr("Cycle diff. [%]")
+                               << tr("Aligned") << tr("Differing") << tr("Unaligned ref.") << tr("Unaligned comp.")
+                               << tr("Differing bits") << tr("First difference [s]"));
+  resulttable->sortByColumn(0, Qt::AscendingOrder);
+
+  setLayout(mainlayout);
+  setWindowTitle(tr("Compare CAN logfiles"));
+  resize(900, 500);
+}
+
+/*!
+ * Puts a file into the reference field, e.g. the file currently open.
+ * @param fileName Name of the file
+ */
+void CompareDialog::setreference(const QString &fileName) {
+  if (!fileName.isEmpty()) referencefile->setText(fileName);
+}
+
+/*!
+ * Picks the reference file.
+ */
+void CompareDialog::browsereference() {
+  QString fileName = QFileDialog::getOpenFileName(this, tr("Reference CAN logfile"), ".", tr("CAN logfiles (*.clf)"));
+  if (!fileName.isEmpty()) referencefile->setText(fileName);
+}
+
+/*!
+ * Picks the compared file.
+ */
+void CompareDialog::browsecompared() {
+  QString fileName = QFileDialog::getOpenFileName(this, tr("Compared CAN logfile"), ".", tr("CAN logfiles (*.clf)"));
+  if (!fileName.isEmpty()) comparedfile->setText(fileName);
+}
+
+/*!
+ * Enables the time window for alignment by time.
+ * @param index Index of the alignment selected
+ */
+void CompareDialog::alignmentchanged(int index) {
+  window->setEnabled(index == cancompare::ByTime);
+}
+
+/*!
+ * Compares the files and shows one row per CAN ID.
+ */
+void CompareDialog::compare() {
+  engine.setalignment(alignment->currentIndex(), (qint64)window->value() * 1000);
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  bool ok = engine.run(referencefile->text(), comparedfile->text());
+  QApplication::restoreOverrideCursor();
+  resulttable->clear();
+  if (!ok) {
+    summary->clear();
+    QMessageBox::warning(this, tr("socketcangui"), engine.errorstring());
+    return;
+  }
+
+  int added = 0;
+  int missing = 0;
+  int differing = 0;
+  QList<QTreeWidgetItem *> items;
+  foreach (const cancompareid &id, engine.results()) {
+    QStringList texts;
+    texts << idtext(id.key);
+    if (!id.count[1]) {
+      texts << tr("Missing");
+      missing++;
+    } else if (!id.count[0]) {
+      texts << tr("Added");
+      added++;
+    } else if (id.differing) {
+      texts << tr("Payload differs");
+      differing++;
+    } else if (id.unmatched[0] || id.unmatched[1]) {
+      texts << tr("Frames unaligned");
+      differing++;
+    } else {
+      texts << tr("Equal");
+    }
+    texts << QString::number(id.count[0]) << QString::number(id.count[1]);
+    qint64 cycle[2] = {id.meaninterval(0), id.meaninterval(1)};
+    texts << mstext(cycle[0]) << mstext(cycle[1]);
+    texts << ((cycle[0] > 0 && cycle[1] >= 0) ? QString::number((cycle[1] - cycle[0]) * 100.0 / cycle[0], 'f', 1) : QString("-"));
+    texts << QString::number(id.matched) << QString::number(id.differing);
+    texts << QString::number(id.unmatched[0]) << QString::number(id.unmatched[1]);
+    QStringList mask;
+    for (int i = 0; i < 8; i++) mask << QString("%1").arg(id.mask[i], 2, 16, QChar('0')).toUpper();
+    texts << (id.matched ? mask.join(" ") : QString("-"));
+    texts << (id.firstdifference < 0 ? QString("-") : QString::number(id.firstdifference / 1000000.0, 'f', 6));
+    items.append(new QTreeWidgetItem(texts));
+  }
+  resulttable->addTopLevelItems(items);
+  for (int i = 0; i < resulttable->columnCount(); i++) resulttable->resizeColumnToContents(i);
+
+  summary->setText(tr("%1 and %2 frames, %3 IDs: %4 missing, %5 added, %6 differing.")
+                   .arg(engine.framecount(0)).arg(engine.framecount(1)).arg(engine.results().size())
+                   .arg(missing).arg(added).arg(differing));
+  if (!engine.warnings().isEmpty()) {
+    QMessageBox::warning(this, tr("socketcangui"), engine.warnings().trimmed());
+  }
+}
+
+/*!
+ * CAN ID of a key as text: hex, 8 digits for 29 bit IDs, with RTR and ERR
+ * flags.
+ * @param key Key of a cancompareid
+ * @return text
+ */
+QString CompareDialog::idtext(quint32 key) {
+  bool extended = key & 0x80000000;
+  QString text = QString("%1").arg(key & 0x1FFFFFFF, extended ? 8 : 3, 16, QChar('0')).toUpper();
+  if (key & 0x40000000) text += " RTR";
+  if (key & 0x20000000) text += " ERR";
+  return text;
+}
+
+/*!
+ * Time in milliseconds as text.
+ * @param usec Time in microseconds (negative = unknown)
+ * @return text
+ */
+QString CompareDialog::mstext(qint64 usec) {
+  if (usec < 0) return QString("-");
+  return QString::number(usec / 1000.0, 'f', 3);
+}
@@ -0,0 +1,46 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef COMPAREDIALOG_H_
+#define COMPAREDIALOG_H_
+
+#include <QtGui>
+
+#include "cancompare.h"
+
+/*!
+ * Dialog to compare two CAN logfiles per CAN ID (see cancompare)
+ */
+class CompareDialog : public QDialog
+{
+  Q_OBJECT
+
+public:
+  CompareDialog(QWidget *parent = 0);     //!< Initialize the dialog
+  void setreference(const QString &fileName); //!< Puts a file into the reference field
+
+private slots:
+  void browsereference();                 //!< Picks the reference file
+  void browsecompared();                  //!< Picks the compared file
+  void alignmentchanged(int index);       //!< Enables the time window for alignment by time
+  void compare();                         //!< Compares the files and shows the result
+
+private:
+  QLineEdit *referencefile;               //!< Reference capture (e.g. the good run)
+  QLineEdit *comparedfile;                //!< Capture compared with it
+  QComboBox *alignment;                   //!< Align by sequence or by time
+  QSpinBox *window;                       //!< Time window of the alignment by time in ms
+  QLabel *summary;                        //!< Frames read and IDs found
+  QTreeWidget *resulttable;               //!< Result per CAN ID
+  cancompare engine;                      //!< Does the comparison
+
+  static QString idtext(quint32 key);     //!< CAN ID of a key as text
+  static QString mstext(qint64 usec);     //!< Time in milliseconds as text
+};
+
+#endif /* COMPAREDIALOG_H_ */
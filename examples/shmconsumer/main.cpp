@@ -0,0 +1,125 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "canshmring.h"
+
+/*!
+ * Monotonic time.
+ * @return microseconds
+ */
+static int64_t now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*!
+ * Prints one frame like candump -ta: (seconds.microseconds) interface id#data
+ * @param frame The frame
+ * @param interface Interface name from the ring header
+ */
+static void printframe(const canshmframe &frame, const char *interface) {
+  char id[16];
+  if (frame.canid & 0x80000000) snprintf(id, sizeof(id), "%08X", frame.canid & 0x1FFFFFFF);
+  else snprintf(id, sizeof(id), "%03X", frame.canid & 0x7FF);
+  printf("(%" PRId64 ".%06" PRId64 ") %s %s#", frame.timestamp / 1000000, frame.timestamp % 1000000, interface, id);
+  if (frame.canid & 0x40000000) {
+    printf("R");
+  } else {
+    for (int i = 0; i < frame.dlc && i < 8; i++) printf("%02X", frame.data[i]);
+  }
+  printf("\n");
+}
+
+/*!
+ * Sample consumer of the shared-memory capture ring of socketcangui.
+ * Usage: shmconsumer [-q] [-e] [name]
+ *   -q    do not print the frames, only the statistics
+ *   -e    start with the newest frame instead of the oldest one in the ring
+ *   name  shared memory of the ring (default /socketcangui)
+ * Once a second it prints (to stderr) the frames read, the rate, the frames
+ * lost and whether the sequence numbers were consistent with the losses,
+ * which validates the reader protocol. It stops when the writer closes the
+ * ring.
+ * @param argc Command line parameter count
+ * @param argv Vector to the command line arguments
+ * @return 0 on success, 1 if the ring cannot be opened, 2 if the sequence was inconsistent
+ */
+int main(int argc, char *argv[])
+{
+  bool quiet = false;
+  bool fromend = false;
+  const char *name = canshmring::defaultname();
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-q")) quiet = true;
+    else if (!strcmp(argv[i], "-e")) fromend = true;
+    else name = argv[i];
+  }
+
+  canshmreader reader;
+  if (!reader.open(name)) {
+    fprintf(stderr, "Cannot open %s: %s\n", name, strerror(errno));
+    return 1;
+  }
+  const canshmheader *header = reader.ringheader();
+  char interface[sizeof(header->interface) + 1];
+  memcpy(interface, header->interface, sizeof(header->interface));
+  interface[sizeof(header->interface)] = 0;
+  fprintf(stderr, "%s: %u slots, writer pid %d, interface %s\n", name, header->slotcount, header->writerpid,
+          interface[0] ? interface : "-");
+  if (fromend) reader.seekend();
+
+  enum { Batch = 256 };
+  canshmslot slots[Batch];
+  uint64_t expected = reader.position();
+  uint64_t received = 0;
+  uint64_t gaps = 0;
+  uint64_t backwards = 0;
+  uint64_t lastreceived = 0;
+  int64_t lastreport = now();
+
+  for (;;) {
+    int count = reader.read(slots, Batch);
+    for (int i = 0; i < count; i++) {
+      uint64_t number = slots[i].seq - 1;
+      if (number > expected) gaps += number - expected;
+      if (number < expected) backwards++;
+      expected = number + 1;
+      if (!quiet) printframe(slots[i].frame, interface);
+    }
+    received += count;
+
+    int64_t time = now();
+    if (time - lastreport >= 1000000) {
+      bool consistent = !backwards && gaps == reader.lostcount();
+      fprintf(stderr, "frames %" PRIu64 "  rate %.0f/s  lost %" PRIu64 "  sequence %s\n", received,
+              (received - lastreceived) * 1e6 / (time - lastreport), reader.lostcount(), consistent ? "ok" : "INCONSISTENT");
+      lastreceived = received;
+      lastreport = time;
+    }
+
+    if (!count) {
+      if (reader.writerclosed()) break;
+      // Nothing new: poll again shortly (no system call while frames flow)
+      usleep(1000);
+    }
+  }
+
+  bool consistent = !backwards && gaps == reader.lostcount();
+  fprintf(stderr, "writer closed: frames %" PRIu64 "  lost %" PRIu64 "  sequence %s\n", received, reader.lostcount(),
+          consistent ? "ok" : "INCONSISTENT");
+  return consistent ? 0 : 2;
+}
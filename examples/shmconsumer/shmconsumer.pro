@@ -0,0 +1,10 @@
+TARGET = shmconsumer
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+INCLUDEPATH += ../..
+DEPENDPATH += ../..
+SOURCES += main.cpp \
+    ../../canshmring.cpp
+HEADERS += ../../canshmring.h
+LIBS += -lrt
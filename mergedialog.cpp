@@ -0,0 +1,139 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#include "mergedialog.h"
+
+/*!
+ * Initialise the dialog.
+ * @param parent Parent for the dialog window
+ */
+MergeDialog::MergeDialog(QWidget *parent)
+    : QDialog(parent)
+{
+  QVBoxLayout *mainlayout = new QVBoxLayout;
+  QGroupBox *inputs = new QGroupBox;
+  QVBoxLayout *inputslayout = new QVBoxLayout;
+  inputs->setLayout(inputslayout);
+  inputs->setTitle(tr("Files to be merged"));
+  mainlayout->addWidget(inputs);
+  QGroupBox *output = new QGroupBox;
+  QGridLayout *outputlayout = new QGridLayout;
+  output->setLayout(outputlayout);
+  output->setTitle(tr("Merged file"));
+  mainlayout->addWidget(output);
+  QPushButton *closebutton = new QPushButton(tr("Close"));
+  mainlayout->addWidget(closebutton);
+  connect(closebutton, SIGNAL(clicked()), this, SLOT(accept()));
+
+  // Layout for the files to be merged
+  inputlist = new QTreeWidget;
+  inputlist->setRootIsDecorated(false);
+  inputlist->setSelectionMode(QAbstractItemView::ExtendedSelection);
+  inputlist->setColumnCount(3);
+  inputlist->setHeaderLabels(QStringList() << tr("File") << tr("Interface") << tr("Clock offset [ms]"));
+  inputlist->setToolTip(tr("Double-click the interface to relabel the packets of a file (empty = kept), "
+                           "or the clock offset to add to its timestamps"));
+  inputslayout->addWidget(inputlist);
+  QHBoxLayout *inputbuttons = new QHBoxLayout;
+  QPushButton *addbutton = new QPushButton(tr("Add..."));
+  QPushButton *removebutton = new QPushButton(tr("Remove"));
+  inputbuttons->addWidget(addbutton);
+  inputbuttons->addWidget(removebutton);
+  inputbuttons->addStretch();
+  inputslayout->addLayout(inputbuttons);
+  connect(addbutton, SIGNAL(clicked()), this, SLOT(addinputs()));
+  connect(removebutton, SIGNAL(clicked()), this, SLOT(removeinputs()));
+
+  // Layout for the merged file
+  outputfile = new QLineEdit;
+  QPushButton *outputbrowse = new QPushButton(tr("..."));
+  openmerged = new QCheckBox(tr("Open the merged file"));
+  openmerged->setChecked(true);
+  QPushButton *mergebutton = new QPushButton(tr("Merge"));
+  outputlayout->addWidget(outputfile, 0, 0, 1, 2);
+  outputlayout->addWidget(outputbrowse, 0, 2);
+  outputlayout->addWidget(openmerged, 1, 0);
+  outputlayout->addWidget(mergebutton, 1, 2);
+  connect(outputbrowse, SIGNAL(clicked()), this, SLOT(browseoutput()));
+  connect(mergebutton, SIGNAL(clicked()), this, SLOT(merge()));
+
+  setLayout(mainlayout);
+  setWindowTitle(tr("Merge CAN logfiles"));
+  resize(700, 400);
+}
+
+/*!
+ * Adds files to be merged, keeping their interfaces and without offset.
+ */
+void MergeDialog::addinputs() {
+  QStringList fileNames = QFileDialog::getOpenFileNames(this, tr("CAN logfiles to be merged"), ".", tr("CAN logfiles (*.clf)"));
+  foreach (const QString &fileName, fileNames) {
+    QTreeWidgetItem *item = new QTreeWidgetItem(QStringList() << fileName << "" << "0");
+    item->setFlags(item->flags() | Qt::ItemIsEditable);
+    inputlist->addTopLevelItem(item);
+  }
+  inputlist->resizeColumnToContents(0);
+}
+
+/*!
+ * Removes the selected files.
+ */
+void MergeDialog::removeinputs() {
+  qDeleteAll(inputlist->selectedItems());
+}
+
+/*!
+ * Picks the merged file.
+ */
+void MergeDialog::browseoutput() {
+  QString fileName = QFileDialog::getSaveFileName(this, tr("Merged CAN logfile"), ".", tr("CAN logfiles (*.clf)"));
+  if (!fileName.isEmpty()) outputfile->setText(fileName);
+}
+
+/*!
+ * Merges the files and, if asked for, has the merged file opened.
+ */
+void MergeDialog::merge() {
+  if (!inputlist->topLevelItemCount() || outputfile->text().isEmpty()) {
+    QMessageBox::warning(this, tr("socketcangui"), tr("Add the files to be merged and choose the merged file."));
+    return;
+  }
+
+  engine.clear();
+  for (int i = 0; i < inputlist->topLevelItemCount(); i++) {
+    QTreeWidgetItem *item = inputlist->topLevelItem(i);
+    QString interfacetext = item->text(1).trimmed();
+    QString offsettext = item->text(2).trimmed();
+    bool interfaceok = true;
+    bool offsetok = true;
+    int interface = interfacetext.isEmpty() ? -1 : interfacetext.toInt(&interfaceok);
+    double offset = offsettext.isEmpty() ? 0 : offsettext.toDouble(&offsetok);
+    if (!interfaceok || interface < -1 || !offsetok) {
+      QMessageBox::warning(this, tr("socketcangui"), tr("Interface or clock offset of %1 is invalid.").arg(item->text(0)));
+      return;
+    }
+    engine.addinput(item->text(0), interface, qRound64(offset * 1000));
+  }
+
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  bool ok = engine.run(outputfile->text(), true);
+  QApplication::restoreOverrideCursor();
+  if (!ok) {
+    QMessageBox::warning(this, tr("socketcangui"), engine.errorstring());
+    return;
+  }
+  if (!engine.warnings().isEmpty()) {
+    QMessageBox::warning(this, tr("socketcangui"), engine.warnings().trimmed());
+  }
+
+  if (openmerged->isChecked()) {
+    emit openfile(outputfile->text());
+  } else {
+    QMessageBox::information(this, tr("socketcangui"), tr("%1 packets merged.").arg(engine.packetcount()));
+  }
+}
@@ -0,0 +1,42 @@
+/* written 2009, 2010 by Jannis Achstetter
+ * contact: kripton@kripserver.net
+ *
+ * developed at Hochschule Aschaffenburg
+ * licensed under the terms of the General Public
+ * License (GPL) version 3.0
+ */
+
+#ifndef MERGEDIALOG_H_
+#define MERGEDIALOG_H_
+
+#include <QtGui>
+
+#include "canmerge.h"
+
+/*!
+ * Dialog to merge several CAN logfiles into one ordered by timestamp (see canmerge)
+ */
+class MergeDialog : public QDialog
+{
+  Q_OBJECT
+
+public:
+  MergeDialog(QWidget *parent = 0);       //!< Initialize the dialog
+
+signals:
+  void openfile(QString fileName);        //!< Will be emitted when the merged file shall be opened
+
+private slots:
+  void addinputs();                       //!< Adds files to be merged
+  void removeinputs();                    //!< Removes the selected files
+  void browseoutput();                    //!< Picks the merged file
+  void merge();                           //!< Merges the files
+
+private:
+  QTreeWidget *inputlist;                 //!< Files to be merged with interface and clock offset
+  QLineEdit *outputfile;                  //!< Merged file
+  QCheckBox *openmerged;                  //!< Open the merged file afterwards
+  canmerge engine;                        //!< Does the merge
+};
+
+#endif /* MERGEDIALOG_H_ */
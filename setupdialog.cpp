@@ -7,6 +7,13 @@
  */
 
 #include "setupdialog.h"
+#include "canpacketstore.h"
+#include "canstreamserver.h"
+#include "canshmring.h"
+#include "cantrigger.h"
+#include "canthread.h"
+
+#include <sched.h>
 
 using namespace std;
 
@@ -21,65 +28,124 @@ SetupDialog::SetupDialog(QWidget *parent)
   QVBoxLayout *mainlayout = new QVBoxLayout;
   QHBoxLayout *listlayout = new QHBoxLayout;
   QGroupBox *filterlist = new QGroupBox;
-  QGroupBox *peakbitrate = new QGroupBox;
+  QGroupBox *deviceconfig = new QGroupBox;
   QVBoxLayout *filterlayout = new QVBoxLayout;
-  QVBoxLayout *peaklayout = new QVBoxLayout;
+  QVBoxLayout *devicelayout = new QVBoxLayout;
   filterlist->setLayout(filterlayout);
-  peakbitrate->setLayout(peaklayout);
+  deviceconfig->setLayout(devicelayout);
   filterlist->setTitle(tr("CAN hardware filters"));
-  peakbitrate->setTitle(tr("Set bitrate for PEAK adapters"));
+  deviceconfig->setTitle(tr("CAN device configuration"));
   listlayout->addWidget(filterlist);
-  listlayout->addWidget(peakbitrate);
+  listlayout->addWidget(deviceconfig);
   QPushButton *closebutton = new QPushButton(tr("Close"));
   mainlayout->addLayout(listlayout);
+  QGroupBox *capturebuffer = new QGroupBox;
+  QGridLayout *capturebufferlayout = new QGridLayout;
+  capturebuffer->setLayout(capturebufferlayout);
+  capturebuffer->setTitle(tr("Capture buffer and trigger"));
+  mainlayout->addWidget(capturebuffer);
+  QGroupBox *threadtriggers = new QGroupBox;
+  QVBoxLayout *threadtriggerslayout = new QVBoxLayout;
+  threadtriggers->setLayout(threadtriggerslayout);
+  threadtriggers->setTitle(tr("Capture thread triggers"));
+  mainlayout->addWidget(threadtriggers);
+  QGroupBox *receivebuffer = new QGroupBox;
+  QHBoxLayout *receivebufferlayout = new QHBoxLayout;
+  receivebuffer->setLayout(receivebufferlayout);
+  receivebuffer->setTitle(tr("Socket receive buffer"));
+  mainlayout->addWidget(receivebuffer);
+  QGroupBox *scheduling = new QGroupBox;
+  QHBoxLayout *schedulinglayout = new QHBoxLayout;
+  scheduling->setLayout(schedulinglayout);
+  scheduling->setTitle(tr("Capture thread scheduling"));
+  mainlayout->addWidget(scheduling);
+  QGroupBox *streamserver = new QGroupBox;
+  QHBoxLayout *streamserverlayout = new QHBoxLayout;
+  streamserver->setLayout(streamserverlayout);
+  streamserver->setTitle(tr("Streaming server"));
+  mainlayout->addWidget(streamserver);
+  QGroupBox *shmring = new QGroupBox;
+  QHBoxLayout *shmringlayout = new QHBoxLayout;
+  shmring->setLayout(shmringlayout);
+  shmring->setTitle(tr("Shared-memory ring"));
+  mainlayout->addWidget(shmring);
+  QGroupBox *ordering = new QGroupBox;
+  QHBoxLayout *orderinglayout = new QHBoxLayout;
+  ordering->setLayout(orderinglayout);
+  ordering->setTitle(tr("Time ordering"));
+  mainlayout->addWidget(ordering);
   mainlayout->addWidget(closebutton);
   connect(closebutton, SIGNAL(clicked()), this, SLOT(accept()));
 
-  // Layout for the "PEAK adapter bitrate"-thingy
-  QLabel *ifacelabel = new QLabel(tr("PEAK adapters:"));
+  // Layout for the CAN device configuration
   QPushButton *updateifaces = new QPushButton(tr("Update"));
-  QHBoxLayout *ifacesheader = new QHBoxLayout;
-  ifacesheader->addWidget(ifacelabel);
-  ifacesheader->addWidget(updateifaces);
-  peaklayout->addLayout(ifacesheader);
   ifacelist = new QTreeWidget;
-  ifacelist->setColumnCount(3);
-  ifacelist->setHeaderLabels(QStringList() << "#" << "Type" << "Iface name" << "Bitrate");
-  peaklayout->addWidget(ifacelist);
-  QLabel *bitratelabel = new QLabel(tr("Bitrate:"));
+  ifacelist->setRootIsDecorated(false);
+  ifacelist->setSelectionMode(QAbstractItemView::ExtendedSelection);
+  ifacelist->setColumnCount(6);
+  ifacelist->setHeaderLabels(QStringList() << tr("Interface") << tr("Type") << tr("Bitrate") << tr("Sample point")
+                             << tr("Restart [ms]") << tr("FD data bitrate"));
+  devicelayout->addWidget(ifacelist);
+  QGridLayout *bitratelayout = new QGridLayout;
   bitratecombo = new QComboBox;
+  bitratecombo->setEditable(true);
+  bitratecombo->setValidator(new QIntValidator(1, 1000000, this));
+  bitratecombo->addItems(QStringList() << "10000" << "20000" << "50000" << "83333" << "100000" << "125000"
+                         << "250000" << "500000" << "800000" << "1000000");
+  bitratecombo->setCurrentIndex(bitratecombo->findText("500000"));
+  samplepoint = new QDoubleSpinBox;
+  samplepoint->setRange(0, 99.9);
+  samplepoint->setDecimals(1);
+  samplepoint->setSuffix(" %");
+  samplepoint->setSpecialValueText(tr("Driver default"));
+  restartms = new QSpinBox;
+  restartms->setRange(0, 60000);
+  restartms->setSuffix(" ms");
+  restartms->setSpecialValueText(tr("Off"));
+  fdmode = new QCheckBox(tr("CAN FD, data bitrate:"));
+  databitratecombo = new QComboBox;
+  databitratecombo->setEditable(true);
+  databitratecombo->setValidator(new QIntValidator(1, 15000000, this));
+  databitratecombo->addItems(QStringList() << "1000000" << "2000000" << "4000000" << "5000000" << "8000000");
+  databitratecombo->setCurrentIndex(databitratecombo->findText("2000000"));
+  datasamplepoint = new QDoubleSpinBox;
+  datasamplepoint->setRange(0, 99.9);
+  datasamplepoint->setDecimals(1);
+  datasamplepoint->setSuffix(" %");
+  datasamplepoint->setSpecialValueText(tr("Driver default"));
   QPushButton *bitrateset = new QPushButton(tr("Set"));
-  QHBoxLayout *bitratelayout = new QHBoxLayout;
-  bitratelayout->addWidget(bitratelabel);
-  bitratelayout->addWidget(bitratecombo);
-  bitratelayout->addWidget(bitrateset);
-  peaklayout->addLayout(bitratelayout);
-  connect(updateifaces, SIGNAL(clicked()), this, SLOT(updatepeaklist()));
+  bitratelayout->addWidget(new QLabel(tr("Bitrate [bit/s]:")), 0, 0);
+  bitratelayout->addWidget(bitratecombo, 0, 1);
+  bitratelayout->addWidget(new QLabel(tr("Sample point:")), 0, 2);
+  bitratelayout->addWidget(samplepoint, 0, 3);
+  bitratelayout->addWidget(fdmode, 1, 0);
+  bitratelayout->addWidget(databitratecombo, 1, 1);
+  bitratelayout->addWidget(new QLabel(tr("Sample point:")), 1, 2);
+  bitratelayout->addWidget(datasamplepoint, 1, 3);
+  bitratelayout->addWidget(new QLabel(tr("Restart after bus-off:")), 2, 0);
+  bitratelayout->addWidget(restartms, 2, 1);
+  bitratelayout->addWidget(updateifaces, 2, 2);
+  bitratelayout->addWidget(bitrateset, 2, 3);
+  devicelayout->addLayout(bitratelayout);
+  QHBoxLayout *polllayout = new QHBoxLayout;
+  statspoll = new QSpinBox;
+  statspoll->setRange(0, 60000);
+  statspoll->setSingleStep(100);
+  statspoll->setValue(1000);
+  statspoll->setSuffix(" ms");
+  statspoll->setSpecialValueText(tr("Never"));
+  QPushButton *statspollapply = new QPushButton(tr("Apply"));
+  polllayout->addWidget(new QLabel(tr("Poll controller statistics every:")));
+  polllayout->addWidget(statspoll);
+  polllayout->addWidget(statspollapply);
+  devicelayout->addLayout(polllayout);
+  connect(updateifaces, SIGNAL(clicked()), this, SLOT(updatedevicelist()));
   connect(bitrateset, SIGNAL(clicked()), this, SLOT(setbitrate()));
-
-  bitratecombo->addItem(tr("5 kBit/s"));
-  bitratecombo->addItem(tr("10 kBit/s"));
-  bitratecombo->addItem(tr("20 kBit/s"));
-  bitratecombo->addItem(tr("33.33 kbit/s"));
-  bitratecombo->addItem(tr("50 kBit/s"));
-  bitratecombo->addItem(tr("95.2 kbit/s"));
-  bitratecombo->addItem(tr("100 kBit/s"));
-  bitratecombo->addItem(tr("125 kBit/s"));
-  bitratecombo->addItem(tr("250 kBit/s"));
-  bitratecombo->addItem(tr("500 kBit/s"));
-  bitratecombo->addItem(tr("1 Mbit/s"));
-
-  bitratearray[0] = CAN_BAUD_5K;
-  bitratearray[1] = CAN_BAUD_10K;
-  bitratearray[2] = CAN_BAUD_20K;
-  bitratearray[3] = CAN_BAUD_33K;
-  bitratearray[4] = CAN_BAUD_50K;
-  bitratearray[5] = CAN_BAUD_95K;
-  bitratearray[6] = CAN_BAUD_100K;
-  bitratearray[7] = CAN_BAUD_125K;
-  bitratearray[8] = CAN_BAUD_250K;
-  bitratearray[9] = CAN_BAUD_500K;
-  bitratearray[10] = CAN_BAUD_1M;
+  connect(ifacelist, SIGNAL(itemSelectionChanged()), this, SLOT(deviceselected()));
+  connect(statspollapply, SIGNAL(clicked()), this, SLOT(applystatspoll()));
+  connect(&netlink, SIGNAL(linkchanged(canlink)), this, SLOT(updatedevicelist()));
+  connect(&netlink, SIGNAL(linkremoved(canlink)), this, SLOT(updatedevicelist()));
+  connect(&netlink, SIGNAL(resync()), this, SLOT(updatedevicelist()));
 
   // Everything that has to to with the CAN filters
   QLabel *hw0label = new QLabel(tr("Hardware filter 1:"));
@@ -130,109 +196,259 @@ Examples:<br />\
 
   filterlayout->addWidget(filterhelp);
 
+  // Everything that has to do with the capture buffer and the trigger
+  ringmode = new QComboBox;
+  ringmode->addItem(tr("Keep all packets"));
+  ringmode->addItem(tr("Keep the last n packets"));
+  ringmode->addItem(tr("Keep the last n MB"));
+  ringsize = new QSpinBox;
+  ringsize->setRange(1, 100000000);
+  ringsize->setValue(100000);
+  postpackets = new QSpinBox;
+  postpackets->setRange(0, 100000000);
+  postpackets->setValue(1000);
+  triggerenable = new QCheckBox(tr("Trigger on packets matching"));
+  triggerids = new QLineEdit;
+  triggerids->setToolTip(tr("CAN IDs (hex), e.g. \"7E8, 700-7FF\". Empty matches all IDs."));
+  triggerpayload = new QLineEdit;
+  triggerpayload->setToolTip(tr("Payload bytes (hex) to match, \"??\" matches any byte, e.g. \"03 7F\""));
+  triggererrors = new QCheckBox(tr("Error frames only"));
+  QPushButton *capturebufferapply = new QPushButton(tr("Apply buffer and trigger"));
+  capturebufferlayout->addWidget(new QLabel(tr("Buffer:")), 0, 0);
+  capturebufferlayout->addWidget(ringmode, 0, 1);
+  capturebufferlayout->addWidget(new QLabel(tr("n:")), 0, 2);
+  capturebufferlayout->addWidget(ringsize, 0, 3);
+  capturebufferlayout->addWidget(new QLabel(tr("Packets after trigger:")), 0, 4);
+  capturebufferlayout->addWidget(postpackets, 0, 5);
+  capturebufferlayout->addWidget(triggerenable, 1, 0, 1, 2);
+  capturebufferlayout->addWidget(new QLabel(tr("CAN IDs:")), 1, 2);
+  capturebufferlayout->addWidget(triggerids, 1, 3);
+  capturebufferlayout->addWidget(new QLabel(tr("Payload:")), 1, 4);
+  capturebufferlayout->addWidget(triggerpayload, 1, 5);
+  capturebufferlayout->addWidget(triggererrors, 2, 0, 1, 2);
+  capturebufferlayout->addWidget(capturebufferapply, 2, 5);
+  connect(capturebufferapply, SIGNAL(clicked()), this, SLOT(applycapturebuffer()));
+
+  // Everything that has to do with the capture thread triggers
+  triggerdefinitions = new QPlainTextEdit;
+  triggerdefinitions->setMaximumHeight(80);
+  threadtriggerslayout->addWidget(triggerdefinitions);
+  QHBoxLayout *threadtriggersbuttons = new QHBoxLayout;
+  QLabel *triggerhelp = new QLabel(tr("\
+One trigger per line: &lt;condition&gt; -&gt; &lt;action&gt;<br />\
+Conditions: id &lt;can_id&gt; [b&lt;n&gt;=&lt;value&gt; | b&lt;n&gt;&amp;&lt;mask&gt;=&lt;value&gt;], error, missing &lt;can_id&gt; &lt;time&gt;<br />\
+Actions: start, stop, mark, trigger, send &lt;can_id&gt;#&lt;data&gt;<br />\
+Examples: id 7E8 b0=7F -&gt; mark, error -&gt; stop, missing 123 200ms -&gt; trigger"));
+  QPushButton *threadtriggersapply = new QPushButton(tr("Apply triggers"));
+  threadtriggersbuttons->addWidget(triggerhelp);
+  threadtriggersbuttons->addWidget(threadtriggersapply);
+  threadtriggerslayout->addLayout(threadtriggersbuttons);
+  connect(threadtriggersapply, SIGNAL(clicked()), this, SLOT(applytriggers()));
+
+  // Everything that has to do with the socket receive buffer
+  burstdepth = 0;
+  rcvbufsize = new QSpinBox;
+  rcvbufsize->setRange(0, 262144);
+  rcvbufsize->setSuffix(tr(" KiB"));
+  rcvbufsize->setSpecialValueText(tr("System default"));
+  rcvbufforce = new QCheckBox(tr("Force (needs CAP_NET_ADMIN)"));
+  rcvbufforce->setToolTip(tr("Use SO_RCVBUFFORCE to exceed net.core.rmem_max"));
+  rcvbufhint = new QLabel;
+  QPushButton *rcvbufrecommended = new QPushButton(tr("Use recommended"));
+  QPushButton *rcvbufapply = new QPushButton(tr("Apply buffer"));
+  receivebufferlayout->addWidget(new QLabel(tr("Size:")));
+  receivebufferlayout->addWidget(rcvbufsize);
+  receivebufferlayout->addWidget(rcvbufforce);
+  receivebufferlayout->addWidget(rcvbufhint, 1);
+  receivebufferlayout->addWidget(rcvbufrecommended);
+  receivebufferlayout->addWidget(rcvbufapply);
+  connect(rcvbufrecommended, SIGNAL(clicked()), this, SLOT(userecommended()));
+  connect(rcvbufapply, SIGNAL(clicked()), this, SLOT(applyreceivebuffer()));
+  setburstdepth(0);
+
+  // Everything that has to do with the capture thread scheduling
+  schedpolicy = new QComboBox;
+  schedpolicy->addItem(tr("Normal"), SCHED_OTHER);
+  schedpolicy->addItem(tr("Real-time FIFO"), SCHED_FIFO);
+  schedpolicy->addItem(tr("Real-time round robin"), SCHED_RR);
+  schedpriority = new QSpinBox;
+  schedpriority->setRange(1, 99);
+  schedpriority->setValue(50);
+  schedcpus = new QLineEdit;
+  schedcpus->setToolTip(tr("CPU numbers the capture thread may run on, e.g. \"2\" or \"2,3\". Empty means all CPUs."));
+  schedlock = new QCheckBox(tr("Lock memory"));
+  schedlock->setToolTip(tr("Keep all memory of the program in RAM (mlockall) so the capture never waits for a page fault"));
+  QPushButton *schedulingapply = new QPushButton(tr("Apply scheduling"));
+  schedulinglayout->addWidget(new QLabel(tr("Policy:")));
+  schedulinglayout->addWidget(schedpolicy);
+  schedulinglayout->addWidget(new QLabel(tr("Priority:")));
+  schedulinglayout->addWidget(schedpriority);
+  schedulinglayout->addWidget(new QLabel(tr("CPUs:")));
+  schedulinglayout->addWidget(schedcpus);
+  schedulinglayout->addWidget(schedlock);
+  schedulinglayout->addWidget(schedulingapply);
+  connect(schedulingapply, SIGNAL(clicked()), this, SLOT(applyscheduling()));
+
+  // Serving the captured packets to other processes
+  streamenable = new QCheckBox(tr("Serve captured packets"));
+  streamenable->setToolTip(tr("Other programs on this machine receive the captured packets (socketcand raw mode)"));
+  streamkind = new QComboBox;
+  streamkind->addItem(tr("TCP on localhost"));
+  streamkind->addItem(tr("Unix socket"));
+  streamport = new QSpinBox;
+  streamport->setRange(1, 65535);
+  streamport->setValue(canstreamserver::DefaultPort);
+  streampath = new QLineEdit(QDir::temp().absoluteFilePath("socketcangui.sock"));
+  QPushButton *streamapply = new QPushButton(tr("Apply server"));
+  streamserverlayout->addWidget(streamenable);
+  streamserverlayout->addWidget(streamkind);
+  streamserverlayout->addWidget(new QLabel(tr("Port:")));
+  streamserverlayout->addWidget(streamport);
+  streamserverlayout->addWidget(new QLabel(tr("Socket:")));
+  streamserverlayout->addWidget(streampath, 1);
+  streamserverlayout->addWidget(streamapply);
+  connect(streamapply, SIGNAL(clicked()), this, SLOT(applystreamserver()));
+
+  // Publishing the captured packets in shared memory
+  shmenable = new QCheckBox(tr("Publish captured packets"));
+  shmenable->setToolTip(tr("Other programs on this machine read the captured packets from a POSIX shared-memory ring (see canshmring.h)"));
+  shmname = new QLineEdit(canshmring::defaultname());
+  shmslots = new QComboBox;
+  for (int slots = 4096; slots <= 1048576; slots *= 4) shmslots->addItem(QString::number(slots), slots);
+  shmslots->setCurrentIndex(shmslots->findData((int)canshmring::DefaultSlots));
+  QPushButton *shmapply = new QPushButton(tr("Apply ring"));
+  shmringlayout->addWidget(shmenable);
+  shmringlayout->addWidget(new QLabel(tr("Name:")));
+  shmringlayout->addWidget(shmname, 1);
+  shmringlayout->addWidget(new QLabel(tr("Slots:")));
+  shmringlayout->addWidget(shmslots);
+  shmringlayout->addWidget(shmapply);
+  connect(shmapply, SIGNAL(clicked()), this, SLOT(applyshmring()));
+
+  // Putting received, sent and marked packets into timestamp order
+  reorderwindow = new QSpinBox;
+  reorderwindow->setRange(0, 10000);
+  reorderwindow->setSuffix(tr(" ms"));
+  reorderwindow->setSpecialValueText(tr("Off"));
+  reorderwindow->setToolTip(tr("Packets are held up to this long so that packets of all sources are stored in timestamp order "
+                               "(see canreorder.h)"));
+  QPushButton *reorderapply = new QPushButton(tr("Apply window"));
+  orderinglayout->addWidget(new QLabel(tr("Reorder window:")));
+  orderinglayout->addWidget(reorderwindow);
+  orderinglayout->addStretch();
+  orderinglayout->addWidget(reorderapply);
+  connect(reorderapply, SIGNAL(clicked()), this, SLOT(applyreorder()));
+
   setLayout(mainlayout);
   setWindowTitle(tr("Setup socketcangui"));
 
   // Scan for connected PEAK adpaters
-  updatepeaklist();
+  updatedevicelist();
 }
 
 /*!
- * Update the list of PEAK adapters and their bitrates.
+ * Formats a bitrate for the device list.
+ * @param bitrate bit/s (0 = not configured)
+ * @return e.g. "500 kbit/s"
  */
-void SetupDialog::updatepeaklist() {
-  bool ok;
-  // Open the device file that contains all the information we want
-  QFile peakdevfile("/proc/pcan");
-  if (!peakdevfile.exists()) return;
-
-  QTextStream stream(&peakdevfile);
-  QString line;
-  QString currentbitrate = QString("???");
-
-  // Read through the file
-  // If it is not empty and contains no dashes, it is an interface
-  // Hopefully, they don't change the format one day? :/
-  peakdevfile.open(QIODevice::ReadOnly);
+static QString bitratetext(quint32 bitrate) {
+  if (!bitrate) return QString("-");
+  if (bitrate % 1000000 == 0) return QString("%1 Mbit/s").arg(bitrate / 1000000);
+  return QString("%1 kbit/s").arg(bitrate / 1000.0);
+}
+
+/*!
+ * Update the list of CAN devices with their bit timing (one netlink dump).
+ */
+void SetupDialog::updatedevicelist() {
+  QList<int> selected;
+  foreach (QTreeWidgetItem *item, ifacelist->selectedItems()) selected.append(item->data(0, Qt::UserRole).toInt());
+
   ifacelist->clear();
   ifacelistitems.clear();
-  do {
-    line = stream.readLine();
-    if (!line.contains("-") && !line.isEmpty()) {
-      // This is an interface line
-      QStringList list = line.split(" ", QString::SkipEmptyParts);
-#ifdef DEBUG
-      cerr << "#: \"" << list.at(0).toAscii().constData() << "\" Type: \"" << list.at(1).toAscii().constData() << "\" IFname: \"" << list.at(2).toAscii().constData() << "\"" << endl;
-      cerr.flush();
-#endif
-      // Find out the current bitrate
-      for (quint16 i = 0; i < 11; i++) {
-        if (list.at(5).toUInt(&ok, 16) == bitratearray[i]) {
-          switch (i) {
-          case 0: currentbitrate = QString("5 kBit/s"); break;
-          case 1: currentbitrate = QString("10 kBit/s"); break;
-          case 2: currentbitrate = QString("20 kBit/s"); break;
-          case 3: currentbitrate = QString("33.33 kBit/s"); break;
-          case 4: currentbitrate = QString("50 kBit/s"); break;
-          case 5: currentbitrate = QString("95.2 kBit/s"); break;
-          case 6: currentbitrate = QString("100 kBit/s"); break;
-          case 7: currentbitrate = QString("125 kBit/s"); break;
-          case 8: currentbitrate = QString("250 kBit/s"); break;
-          case 9: currentbitrate = QString("500 kBit/s"); break;
-          case 10: currentbitrate = QString("1 MBit/s"); break;
-          }
-        }
-      }
-      // Add it to the list
-      ifacelistitems.append(new QTreeWidgetItem((QTreeWidget*)0, QStringList() << list.at(0) << list.at(1) << list.at(2) << currentbitrate));
-      ifacelist->addTopLevelItems(ifacelistitems);
+  foreach (const canlink &link, netlink.links()) {
+    QStringList columns;
+    columns << link.name << (link.kind.isEmpty() ? QString("-") : link.kind);
+    if (link.configurable) {
+      columns << bitratetext(link.config.bitrate)
+              << (link.config.samplepoint ? QString("%1 %").arg(link.config.samplepoint / 10.0) : QString("-"))
+              << (link.config.restartms ? QString::number(link.config.restartms) : tr("off"))
+              << (link.config.fd ? bitratetext(link.config.databitrate) : QString("-"));
+    } else {
+      columns << tr("n/a") << "-" << "-" << "-";
     }
-  } while (!line.isNull());
-  peakdevfile.close();
+    QTreeWidgetItem *item = new QTreeWidgetItem((QTreeWidget*)0, columns);
+    item->setData(0, Qt::UserRole, link.ifindex);
+    if (!link.configurable) item->setFlags(item->flags() & ~Qt::ItemIsSelectable);
+    ifacelistitems.append(item);
+  }
+  ifacelist->addTopLevelItems(ifacelistitems);
+  foreach (QTreeWidgetItem *item, ifacelistitems) {
+    if (selected.contains(item->data(0, Qt::UserRole).toInt())) item->setSelected(true);
+  }
   // Make the table look better
-  ifacelist->resizeColumnToContents(0);
-  ifacelist->resizeColumnToContents(1);
-  ifacelist->resizeColumnToContents(2);
-  ifacelist->resizeColumnToContents(3);
+  for (int i = 0; i < ifacelist->columnCount(); i++) ifacelist->resizeColumnToContents(i);
 }
 
 /*!
- * Set the bitrate of selected adapters.
+ * Called when the selection in the device list changed.
+ * Puts the settings of the (first) selected device into the fields.
+ */
+void SetupDialog::deviceselected() {
+  if (ifacelist->selectedItems().isEmpty()) return;
+  int ifindex = ifacelist->selectedItems().first()->data(0, Qt::UserRole).toInt();
+  foreach (const canlink &link, netlink.links()) {
+    if (link.ifindex != ifindex || !link.configurable) continue;
+    if (link.config.bitrate) bitratecombo->setEditText(QString::number(link.config.bitrate));
+    samplepoint->setValue(link.config.samplepoint / 10.0);
+    restartms->setValue(link.config.restartms);
+    fdmode->setChecked(link.config.fd);
+    if (link.config.databitrate) databitratecombo->setEditText(QString::number(link.config.databitrate));
+    datasamplepoint->setValue(link.config.datasamplepoint / 10.0);
+  }
+}
+
+/*!
+ * Set the bitrate, sample point, restart-ms and CAN FD data bitrate of
+ * the selected devices via netlink.
  */
 void SetupDialog::setbitrate() {
+  canlinkconfig config;
+  bzero(&config, sizeof(config));
+  config.bitrate = bitratecombo->currentText().toUInt();
+  config.samplepoint = qRound(samplepoint->value() * 10);
+  config.restartms = restartms->value();
+  config.fd = fdmode->isChecked();
+  config.databitrate = databitratecombo->currentText().toUInt();
+  config.datasamplepoint = qRound(datasamplepoint->value() * 10);
+  if (!config.bitrate || (config.fd && !config.databitrate)) {
+    QMessageBox::warning(this, tr("socketcangui"), tr("Please enter a bitrate."));
+    return;
+  }
+
   // This takes some time, so let the user know we are working
   QApplication::setOverrideCursor(Qt::WaitCursor);
-#ifdef DEBUG
-  cerr << "Bitrate shall be set to " << bitratearray[bitratecombo->currentIndex()] << endl;
-  cerr.flush();
-#endif
-  QString devname;
-  QFile *charfile = new QFile;
-  QTextStream stream;
+  QStringList problems;
   foreach (QTreeWidgetItem *item, ifacelist->selectedItems()) {
-#ifdef DEBUG
-    cerr << "Doing adapter " << item->text(0).toAscii().constData() << endl;
-    cerr.flush();
-  #endif
-    devname = QString("/dev/pcan");
-    devname.append(item->text(0));
-#ifdef DEBUG
-    cerr << "Charfile is \"" << devname.toAscii().constData() << "\"" << endl;
-    cerr.flush();
-  #endif
-    charfile->setFileName(devname);
-    if (!charfile->exists()) return;
-    charfile->open(QIODevice::WriteOnly);
-    stream.setDevice(charfile);
-    // Write the "magic string"
-    stream << "i " << bitratearray[bitratecombo->currentIndex()] << " e" << endl;
-    stream.flush();
-    charfile->close();
+    QString error;
+    if (!netlink.configure(item->data(0, Qt::UserRole).toInt(), config, &error)) {
+      problems << QString("%1: %2").arg(item->text(0)).arg(error);
+    }
   }
   QApplication::restoreOverrideCursor();
+  if (!problems.isEmpty()) {
+    QMessageBox::warning(this, tr("socketcangui"), tr("Cannot configure the device(s):\n%1").arg(problems.join("\n")));
+  }
+
+  // Update the modified bitrates in the list of devices
+  updatedevicelist();
+}
 
-  // Update the modified bitrates in the list of adapters
-  updatepeaklist();
+/*!
+ * Call this function to apply the controller statistics poll interval.
+ */
+void SetupDialog::applystatspoll() {
+  emit setstatspoll(statspoll->value());
 }
 
 /*!
@@ -254,3 +470,116 @@ void SetupDialog::applyfilter() {
   QStringList hwfilterlist = QStringList() << hwfilter[0]->text() << hwfilter[1]->text() << hwfilter[2]->text() << hwfilter[3]->text();
   emit setfilter(hwfilterlist);
 }
+
+/*!
+ * Call this function to apply the capture buffer and trigger.
+ * Invalid trigger fields are marked red and nothing is applied then.
+ */
+void SetupDialog::applycapturebuffer() {
+  canpacketfilter filter;
+  QPalette valid = triggerids->style()->standardPalette();
+  QPalette invalid = valid;
+  invalid.setColor(QPalette::Base, QColor(255, 192, 192));
+
+  bool idsok = filter.setids(triggerids->text());
+  triggerids->setPalette(idsok ? valid : invalid);
+  bool payloadok = filter.setpayload(triggerpayload->text());
+  triggerpayload->setPalette(payloadok ? valid : invalid);
+  if (!idsok || !payloadok) return;
+  if (triggererrors->isChecked()) filter.seterrors(canpacketfilter::ErrorsOnly);
+
+  int capacity = 0;
+  if (ringmode->currentIndex() == 1) capacity = ringsize->value();
+  if (ringmode->currentIndex() == 2) capacity = canpacketstore::capacityformegabytes(ringsize->value());
+
+  emit settrigger(filter, triggerenable->isChecked());
+  emit setcapturebuffer(capacity, postpackets->value());
+}
+
+/*!
+ * Call this function to apply the capture thread triggers.
+ * Nothing is applied if a line cannot be parsed.
+ */
+void SetupDialog::applytriggers() {
+  QStringList definitions = triggerdefinitions->toPlainText().split("\n", QString::SkipEmptyParts);
+  cantriggerengine check;
+  foreach (const QString &definition, definitions) {
+    if (definition.trimmed().isEmpty() || definition.trimmed().startsWith("#")) continue;
+    if (!check.add(definition)) {
+      QMessageBox::warning(this, tr("socketcangui"), tr("Cannot parse the trigger \"%1\".").arg(definition));
+      return;
+    }
+  }
+  emit settriggers(definitions);
+}
+
+/*!
+ * Shows the observed burst depth and the receive buffer recommended for it.
+ * @param burst Most frames the capture thread found queued at once
+ */
+void SetupDialog::setburstdepth(quint64 burst) {
+  if (burst <= burstdepth && !rcvbufhint->text().isEmpty()) return;
+  burstdepth = qMax(burst, burstdepth);
+  rcvbufhint->setText(tr("Largest burst: %1 frames, recommended: %2 KiB")
+                      .arg(burstdepth).arg(canthread::recommendedreceivebuffer(burstdepth) / 1024));
+}
+
+/*!
+ * Call this function to apply the socket receive buffer.
+ */
+void SetupDialog::applyreceivebuffer() {
+  emit setreceivebuffer(rcvbufsize->value() * 1024, rcvbufforce->isChecked());
+}
+
+/*!
+ * Puts the recommended receive buffer size into the spinbox.
+ */
+void SetupDialog::userecommended() {
+  rcvbufsize->setValue(canthread::recommendedreceivebuffer(burstdepth) / 1024);
+}
+
+/*!
+ * Call this function to apply the capture thread scheduling.
+ * Invalid CPU numbers are marked red and nothing is applied then.
+ */
+void SetupDialog::applyscheduling() {
+  QPalette valid = schedcpus->style()->standardPalette();
+  QPalette invalid = valid;
+  invalid.setColor(QPalette::Base, QColor(255, 192, 192));
+
+  QList<int> cpus;
+  bool ok = true;
+  foreach (const QString &cpu, schedcpus->text().split(",", QString::SkipEmptyParts)) {
+    int number = cpu.trimmed().toInt(&ok);
+    if (!ok || number < 0 || number >= CPU_SETSIZE) {
+      ok = false;
+      break;
+    }
+    cpus.append(number);
+  }
+  schedcpus->setPalette(ok ? valid : invalid);
+  if (!ok) return;
+
+  emit setscheduling(schedpolicy->itemData(schedpolicy->currentIndex()).toInt(), schedpriority->value(), cpus, schedlock->isChecked());
+}
+
+/*!
+ * Call this function to apply the streaming server settings.
+ */
+void SetupDialog::applystreamserver() {
+  emit setstreamserver(streamenable->isChecked(), streamkind->currentIndex() == 1, streamport->value(), streampath->text());
+}
+
+/*!
+ * Call this function to apply the shared-memory ring settings.
+ */
+void SetupDialog::applyshmring() {
+  emit setshmring(shmenable->isChecked(), shmname->text(), shmslots->itemData(shmslots->currentIndex()).toInt());
+}
+
+/*!
+ * Call this function to apply the reorder window.
+ */
+void SetupDialog::applyreorder() {
+  emit setreorderwindow(reorderwindow->value());
+}
@@ -13,24 +13,11 @@
 
 #include <iostream>
 
-// Taken from the PEAK CAN driver manual
-#define CAN_BAUD_1M     0x0014 //   1 Mbit/s
-#define CAN_BAUD_500K   0x001C // 500 kBit/s
-#define CAN_BAUD_250K   0x011C // 250 kBit/s
-#define CAN_BAUD_125K   0x031C // 125 kBit/s
-#define CAN_BAUD_100K   0x432F // 100 kBit/s
-#define CAN_BAUD_50K    0x472F //  50 kBit/s
-#define CAN_BAUD_20K    0x532F //  20 kBit/s
-#define CAN_BAUD_10K    0x672F //  10 kBit/s
-#define CAN_BAUD_5K     0x7F7F //   5 kBit/s
-
-// Other bitrates (calculated using PEAK's BRCAN-tool
-// ( http://www.peak-system.com/forum/viewtopic.php?f=125&t=87 )
-#define CAN_BAUD_33K    0x2F11 // 33.33 kBit/s
-#define CAN_BAUD_95K    0x0D12 // 95.2 kBit/s
+#include "canpacketfilter.h"
+#include "cannetlink.h"
 
 /*!
- * Dialog to set up the CAN hardware filters and set the bitrate for PEAK can adapters
+ * Dialog to set up the CAN hardware filters and the bit timing of the CAN devices
  */
 class SetupDialog : public QDialog
 {
@@ -41,20 +28,71 @@ public:
 
 signals:
   void setfilter(QStringList hwfilter);   //!< Will be emitted when the filters shall be applied
+  void setcapturebuffer(int capacity, int posttrigger); //!< Will be emitted when the capture buffer shall be applied
+  void settrigger(const canpacketfilter &filter, bool enabled); //!< Will be emitted when the trigger shall be applied
+  void settriggers(QStringList definitions); //!< Will be emitted when the capture thread triggers shall be applied
+  void setreceivebuffer(int bytes, bool force); //!< Will be emitted when the socket receive buffer shall be applied
+  void setscheduling(int policy, int priority, QList<int> cpus, bool lockmemory); //!< Will be emitted when the capture thread scheduling shall be applied
+  void setstatspoll(int msec);            //!< Will be emitted when the controller statistics poll interval shall be applied
+  void setstreamserver(bool enabled, bool local, int port, QString path); //!< Will be emitted when the streaming server settings shall be applied
+  void setshmring(bool enabled, QString name, int slots); //!< Will be emitted when the shared-memory ring settings shall be applied
+  void setreorderwindow(int msec);        //!< Will be emitted when the reorder window shall be applied
+
+public slots:
+  void setburstdepth(quint64 burst);      //!< Shows the observed burst depth and the recommended receive buffer
 
 private slots:
-  void updatepeaklist();                  //!< Update the list of PEAK adapters and their bitrates
-  void setbitrate();                      //!< Set the bitrate of selected adapters
+  void updatedevicelist();                //!< Update the list of CAN devices and their bit timing
+  void deviceselected();                  //!< Puts the settings of the selected device into the fields
+  void setbitrate();                      //!< Set the bit timing of the selected devices
   void clearfilter();                     //!< Reset the CAN filters to their default values
   void applyfilter();                     //!< Call this function to apply the filters
+  void applycapturebuffer();              //!< Call this function to apply the capture buffer and trigger
+  void applytriggers();                   //!< Call this function to apply the capture thread triggers
+  void applyreceivebuffer();              //!< Call this function to apply the socket receive buffer
+  void userecommended();                  //!< Puts the recommended receive buffer size into the spinbox
+  void applyscheduling();                 //!< Call this function to apply the capture thread scheduling
+  void applystatspoll();                  //!< Call this function to apply the controller statistics poll interval
+  void applystreamserver();               //!< Call this function to apply the streaming server settings
+  void applyshmring();                    //!< Call this function to apply the shared-memory ring settings
+  void applyreorder();                    //!< Call this function to apply the reorder window
 
 private:
   QTreeWidget *ifacelist;                 //!< widget to display network interfaces
   QList<QTreeWidgetItem *> ifacelistitems;  //!< list of network interface items
   QComboBox *bitratecombo;               //!< Combobox to select the bitrate to be set
+  QDoubleSpinBox *samplepoint;            //!< Sample point in percent (0 = driver default)
+  QSpinBox *restartms;                    //!< Restart after bus-off (0 = off)
+  QCheckBox *fdmode;                      //!< CAN FD mode
+  QComboBox *databitratecombo;            //!< Data phase bitrate of CAN FD
+  QDoubleSpinBox *datasamplepoint;        //!< Data phase sample point in percent (0 = driver default)
+  QSpinBox *statspoll;                    //!< Poll interval of the controller statistics (0 = never)
+  cannetlink netlink;                     //!< Reads and sets the bit timing
   QLineEdit *hwfilter[4];                 //!< The four QLineEdits containing the filter strings
-
-  quint16 bitratearray[9];               //!< array with possible bitrates
+  QComboBox *ringmode;                    //!< Unlimited, ring of n packets or ring of n MB
+  QSpinBox *ringsize;                     //!< Size of the ring (packets or MB)
+  QSpinBox *postpackets;                  //!< Packets to record after the trigger
+  QCheckBox *triggerenable;               //!< Whether packets fire the trigger
+  QLineEdit *triggerids;                  //!< IDs firing the trigger
+  QLineEdit *triggerpayload;              //!< Payload pattern firing the trigger
+  QCheckBox *triggererrors;               //!< Only error frames fire the trigger
+  QPlainTextEdit *triggerdefinitions;     //!< Capture thread triggers, one per line
+  QSpinBox *rcvbufsize;                   //!< Socket receive buffer in KiB (0 = system default)
+  QCheckBox *rcvbufforce;                 //!< Use SO_RCVBUFFORCE
+  QLabel *rcvbufhint;                     //!< Observed burst depth and recommendation
+  quint64 burstdepth;                     //!< Most frames queued at once so far
+  QComboBox *schedpolicy;                 //!< Normal, SCHED_FIFO or SCHED_RR
+  QSpinBox *schedpriority;                //!< Real-time priority
+  QLineEdit *schedcpus;                   //!< CPUs for the capture thread, e.g. "2,3"
+  QCheckBox *schedlock;                   //!< Lock memory with mlockall()
+  QCheckBox *streamenable;                //!< Whether the streaming server runs
+  QComboBox *streamkind;                  //!< TCP on localhost or Unix socket
+  QSpinBox *streamport;                   //!< TCP port of the streaming server
+  QLineEdit *streampath;                  //!< Unix socket of the streaming server
+  QCheckBox *shmenable;                   //!< Whether the shared-memory ring is published
+  QLineEdit *shmname;                     //!< Name of the shared-memory ring
+  QComboBox *shmslots;                    //!< Slots of the shared-memory ring
+  QSpinBox *reorderwindow;                //!< Reorder window in milliseconds (0 = off)
 };
 
 #endif /* SETUPDIALOG_H_ */
@@ -10,9 +10,20 @@
 
 #include <QFile>
 
+#include <errno.h>
+#include <string.h>
+
 #include "socketcangui.h"
 #include "canlogfile.h"
 #include "canthread.h"
+#include "candbc.h"
+#include "cansignalplot.h"
+#include "canlogblock.h"
+#include "canpacketmodel.h"
+#include "canidsummarymodel.h"
+#include "canisotpmodel.h"
+#include "canpipeline.h"
+#include "candecoders.h"
 
 using namespace std;
 
@@ -30,15 +41,46 @@ socketcangui::socketcangui(QWidget *parent) :
   // Instantiate the main object, the canlogfile
   myclf = new canlogfile;
   setCentralWidget(myclf);
+  database = 0;
   connect(myclf, SIGNAL(modified()), this, SLOT(fileModified()));
 
   // Initialize our canthread as beeing not active
   mycanthread.stop();
 
+  // Both record the latencies of their stages of the capture path
+  mycanthread.setlatency(&latency);
+  myclf->setlatency(&latency);
+  mycanthread.setcycles(&cycles);
+
   // Instantiate the setup dialog but keep it hidden until needed
   setupdialog = new SetupDialog(this);
   setupdialog->hide();
   connect(setupdialog, SIGNAL(setfilter(QStringList)), &mycanthread, SLOT(setfilter(QStringList)));
+  connect(setupdialog, SIGNAL(setcapturebuffer(int, int)), myclf, SLOT(setcapturebuffer(int, int)));
+  connect(setupdialog, SIGNAL(settrigger(const canpacketfilter &, bool)), myclf, SLOT(settrigger(const canpacketfilter &, bool)));
+  connect(myclf, SIGNAL(triggered()), this, SLOT(capturetriggered()));
+  connect(setupdialog, SIGNAL(settriggers(QStringList)), &mycanthread, SLOT(settriggers(QStringList)));
+  connect(setupdialog, SIGNAL(setreceivebuffer(int, bool)), &mycanthread, SLOT(setreceivebuffer(int, bool)));
+  connect(setupdialog, SIGNAL(setstatspoll(int)), this, SLOT(setstatspoll(int)));
+  connect(setupdialog, SIGNAL(setstreamserver(bool, bool, int, QString)), this, SLOT(setstreamserver(bool, bool, int, QString)));
+  connect(myclf, SIGNAL(dataitemstored(canpacket)), &streamserver, SLOT(publish(canpacket)));
+  connect(setupdialog, SIGNAL(setshmring(bool, QString, int)), this, SLOT(setshmring(bool, QString, int)));
+  connect(setupdialog, SIGNAL(setreorderwindow(int)), &reorder, SLOT(setwindow(int)));
+  connect(myclf, SIGNAL(dataitemstored(canpacket)), this, SLOT(shmpublish(canpacket)));
+  connect(setupdialog, SIGNAL(setscheduling(int, int, QList<int>, bool)), &mycanthread, SLOT(setscheduling(int, int, QList<int>, bool)));
+  // Latencies are measured anew with the new scheduling
+  connect(setupdialog, SIGNAL(setscheduling(int, int, QList<int>, bool)), this, SLOT(resetlatency()));
+  connect(&mycanthread, SIGNAL(schedulingwarning(QString)), this, SLOT(schedulingwarning(QString)));
+  connect(&mycanthread, SIGNAL(capturetrigger()), myclf, SLOT(trigger()));
+  connect(&mycanthread, SIGNAL(triggerfired(QString)), this, SLOT(threadtriggerfired(QString)));
+  connect(myclf, SIGNAL(capturecomplete()), this, SLOT(capturecomplete()));
+
+  // The compare and merge dialogs keep their files and result while hidden
+  comparedialog = new CompareDialog(this);
+  comparedialog->hide();
+  mergedialog = new MergeDialog(this);
+  mergedialog->hide();
+  connect(mergedialog, SIGNAL(openfile(QString)), this, SLOT(openmerged(QString)));
 
   // Set up the main parts of the GUI
   createActions();
@@ -53,6 +95,10 @@ socketcangui::socketcangui(QWidget *parent) :
   // Scan for network interfaces on the host
   updateinterfacelist();
 
+  // Journal the capture so it survives a crash, and recover what crashed instances left
+  if (journal.start(canjournal::journalname())) myclf->setjournal(&journal);
+  recoverjournals();
+
   // Let the counter display zeros
   struct threadstatus tmpstat;
   bzero(&tmpstat, sizeof(tmpstat));
@@ -62,6 +108,51 @@ socketcangui::socketcangui(QWidget *parent) :
   statusBar->showMessage(tr("socketcangui is ready"), 2000);
 }
 
+/*!
+ * Offer to recover the captures of instances that crashed (or lost power).
+ * A recovered capture is loaded as an unsaved file.
+ */
+void socketcangui::recoverjournals() {
+  foreach (const QString &orphan, canjournal::orphans()) {
+    QFile file(orphan);
+    if (!file.open(QIODevice::ReadOnly)) continue;
+    canblockreader reader(&file);
+    bool readable = reader.open();
+    quint64 count = readable ? reader.packetcount() : 0;
+    bool empty = file.size() <= canblockcodec::HeaderSize || (readable && count == 0);
+    file.close();
+    if (empty) {
+      QFile::remove(orphan);
+      continue;
+    }
+    if (!readable) {
+      QMessageBox::warning(this, tr("socketcangui"), tr("The unsaved capture %1 cannot be read:\n%2\nIt has been kept.")
+                           .arg(orphan).arg(reader.errorstring()));
+      continue;
+    }
+
+    int r = QMessageBox::question(this, tr("socketcangui"),
+        tr("A capture of %1 with about %2 packets has not been saved, socketcangui "
+           "did not exit regularly.\nDo you want to recover it?")
+        .arg(QFileInfo(orphan).lastModified().toString()).arg(count),
+        QMessageBox::Yes | QMessageBox::Default, QMessageBox::No, QMessageBox::Cancel | QMessageBox::Escape);
+    if (r == QMessageBox::Cancel) continue;
+    if (r == QMessageBox::Yes) {
+      if (!okToContinue() || !myclf->readFile(orphan)) continue;
+      setCurrentFile("");
+      setWindowModified(true);
+      // Only a complete recovery makes the journal dispensable
+      if ((quint64)myclf->getdataitemcount() != count) {
+        QMessageBox::warning(this, tr("socketcangui"), tr("Only %1 of %2 packets could be recovered. The unsaved capture "
+                             "has been kept as %3.").arg(myclf->getdataitemcount()).arg(count).arg(orphan));
+        continue;
+      }
+      statusBar->showMessage(tr("Capture recovered"), 2000);
+    }
+    QFile::remove(orphan);
+  }
+}
+
 /*!
  * Used when changing the language.
  * @param e Event that cause the function to be called
@@ -88,6 +179,8 @@ void socketcangui::closeEvent(QCloseEvent *event) {
     // Stop the thread and wait for graceful exit
     mycanthread.stop();
     mycanthread.wait();
+    // Nothing to recover after a regular exit
+    journal.stop(true);
     event->accept();
   } else {
     event->ignore();
@@ -101,6 +194,7 @@ void socketcangui::newFile() {
   // Check whether the file has been modified and prompt the user if so
   if (okToContinue()) {
     myclf->clear();
+    armtrigger();
     setCurrentFile("");
     statusBar->showMessage(tr("File cleared"), 2000);
   }
@@ -171,61 +265,19 @@ void socketcangui::fileModified() {
 
 /*!
  * Rescan for network interfaces.
+ * Lists all CAN interfaces with one netlink dump; changes after that
+ * arrive through linkchanged() and linkremoved().
  */
 void socketcangui::updateinterfacelist () {
   statusBar->showMessage(tr("Network interface list is beeing updated ..."), 2000);
 
-  // Open the file that has all the information
-  QFile netdevfile("/proc/net/dev");
-  QTextStream stream(&netdevfile);
-  QString line;
-  struct ifreq ifr;
-  struct sockaddr_can addr;
-  short i = 0;
-  int tmpsock = 0;
-
-  // Get all known network interfaces (from /proc/net/dev) and check
-  // whether they are CAN devices and if they are up or not
-  netdevfile.open(QIODevice::ReadOnly);
+  QString current = ifacecombo->currentText();
   ifacelist->clear();
   ifacelistitems.clear();
   ifacecombo->clear();
-  do {
-    line = stream.readLine();
-    if (line.contains("|") || line.length() == 0) continue; //Header or empty line
-    QStringList list = line.split(" ", QString::SkipEmptyParts);
-    list = list.at(0).split(":");
-
-    tmpsock = socket(AF_CAN, SOCK_RAW, CAN_RAW);
-    memset(&ifr.ifr_name, 0, sizeof(ifr.ifr_name));
-    strcpy(ifr.ifr_name, list.at(0).toAscii().constData());
-
-    addr.can_family = AF_CAN;
-
-    if (ioctl(tmpsock, SIOCGIFINDEX, &ifr) < 0) cerr << "INDEX ERROR WITH" << list.at(0).toAscii().constData() << endl; cerr.flush();
-    addr.can_ifindex = ifr.ifr_ifindex;
-    // If bind fails this means that the device cannot handle CAN frames
-    if (bind(tmpsock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-#ifdef DEBUG
-      cerr << list.at(0).toAscii().constData() << " is not a CAN device; skipping" << endl;
-      cerr.flush();
-#endif
-      continue;
-    }
-    // Run another ioctl to see whether the interface is up or not
-    if (ioctl(tmpsock, SIOCGIFFLAGS, &ifr) < 0) cerr << "FLAGS ERROR WITH" << list.at(0).toAscii().constData() << endl; cerr.flush();
-    if (ifr.ifr_flags & IFF_UP) {
-      ifacelistitems.append(new QTreeWidgetItem((QTreeWidget*)0, QStringList() << list.at(0) << tr("up")));
-      ifacelistitems.at(i)->setBackground(1, QBrush(LIGHTGREEN));
-    } else {
-      ifacelistitems.append(new QTreeWidgetItem((QTreeWidget*)0, QStringList() << list.at(0) << tr("down")));
-      ifacelistitems.at(i)->setBackground(1, QBrush(LIGHTRED));
-    }
-    ifacelist->addTopLevelItems(ifacelistitems);
-    ifacecombo->addItem(list.at(0));
-    i++;
-  } while (!line.isNull());
-  netdevfile.close();
+  foreach (const canlink &link, netlink.links()) linkchanged(link);
+  int index = ifacecombo->findText(current, Qt::MatchCaseSensitive);
+  if (index >= 0) ifacecombo->setCurrentIndex(index);
 #ifdef DEBUG
   cerr << "Updated interface list" << endl;
   cerr.flush();
@@ -233,6 +285,61 @@ void socketcangui::updateinterfacelist () {
   statusBar->showMessage(tr("Network interface list has been updated"), 2000);
 }
 
+/*!
+ * Position of an interface in the interface list.
+ * @param ifindex Interface index
+ * @return position in ifacelistitems (-1 if not listed)
+ */
+int socketcangui::ifacelistindex(int ifindex) {
+  for (int i = 0; i < ifacelistitems.size(); i++) {
+    if (ifacelistitems.at(i)->data(0, Qt::UserRole).toInt() == ifindex) return i;
+  }
+  return -1;
+}
+
+/*!
+ * Called when a CAN interface has been added or changed (renamed, up or
+ * down). Adds it to the lists or updates its entries.
+ * @param link The interface
+ */
+void socketcangui::linkchanged(canlink link) {
+  int i = ifacelistindex(link.ifindex);
+  QTreeWidgetItem *item;
+  if (i < 0) {
+    item = new QTreeWidgetItem((QTreeWidget*)0, QStringList() << link.name);
+    item->setData(0, Qt::UserRole, link.ifindex);
+    ifacelistitems.append(item);
+    ifacelist->addTopLevelItem(item);
+    ifacecombo->addItem(link.name, link.ifindex);
+  } else {
+    item = ifacelistitems.at(i);
+    item->setText(0, link.name);
+    ifacecombo->setItemText(ifacecombo->findData(link.ifindex), link.name);
+  }
+  if (!link.up) {
+    item->setText(1, tr("down"));
+    item->setBackground(1, QBrush(LIGHTRED));
+  } else if (!link.running) {
+    item->setText(1, tr("up, no carrier"));
+    item->setBackground(1, QBrush(LIGHTRED));
+  } else {
+    item->setText(1, tr("up"));
+    item->setBackground(1, QBrush(LIGHTGREEN));
+  }
+}
+
+/*!
+ * Called when a CAN interface has been removed. Removes it from the lists.
+ * @param link The interface
+ */
+void socketcangui::linkremoved(canlink link) {
+  int i = ifacelistindex(link.ifindex);
+  if (i < 0) return;
+  delete ifacelistitems.takeAt(i);
+  ifacecombo->removeItem(ifacecombo->findData(link.ifindex));
+  statusBar->showMessage(tr("Network interface %1 has been removed").arg(link.name), 2000);
+}
+
 /*!
  * Called when the list of network interfaces has been double-clicked.
  * Starts or stops the capture.
@@ -257,6 +364,18 @@ void socketcangui::updateStatus(struct threadstatus newstat) {
   statusoutcounter->setText(QString(tr("<table width=100%><tr><td>Packets out:</td><td align=right>%1</td></tr></table>")).arg(newstat.outcounter));
   statusinbcounter->setText(QString(tr("<table width=100%><tr><td>Bytes in:</td><td align=right>%1</td></tr></table>")).arg(newstat.inbcounter));
   statusoutbcounter->setText(QString(tr("<table width=100%><tr><td>Bytes out:</td><td align=right>%1</td></tr></table>")).arg(newstat.outbcounter));
+  statustriggercounter->setText(QString(tr("<table width=100%><tr><td>Triggers fired:</td><td align=right>%1</td></tr></table>")).arg(newstat.triggercounter));
+  statusevicted->setText(QString(tr("<table width=100%><tr><td>Dropped from ring:</td><td align=right>%1</td></tr></table>")).arg(myclf->getevictedcount()));
+  statusdropcounter->setText(QString(tr("<table width=100%><tr><td>Kernel drops:</td><td align=right>%1</td></tr></table>")).arg(newstat.dropcounter));
+  statusdropcounter->setStyleSheet(newstat.dropcounter ? HTMLLIGHTRED : "");
+  statusrcvbuf->setText(QString(tr("<table width=100%><tr><td>Receive buffer:</td><td align=right>%1 KiB</td></tr></table>")).arg(newstat.rcvbuf / 1024));
+  statusstream->setText(QString(tr("<table width=100%><tr><td>Stream clients / dropped:</td><td align=right>%1 / %2</td></tr></table>"))
+                        .arg(streamserver.clientcount()).arg(streamserver.droppedcount()));
+  statusstream->setVisible(streamserver.islistening());
+  statuslate->setText(QString(tr("<table width=100%><tr><td>Late packets:</td><td align=right>%1</td></tr></table>")).arg(reorder.latecount()));
+  statuslate->setStyleSheet(reorder.latecount() ? HTMLLIGHTRED : "");
+  statuslate->setVisible(reorder.window() > 0);
+  setupdialog->setburstdepth(newstat.maxburst);
 }
 
 /*!
@@ -389,6 +508,19 @@ void socketcangui::sendtimerfired(int id) {
   mycanthread.sendmsg(sendpacket);
 }
 
+/*!
+ * Called when the user picked an interface in the combobox.
+ * A running capture switches to that interface right away.
+ * @param ifacename Name of the interface
+ */
+void socketcangui::ifaceactivated(const QString &ifacename) {
+  if (!mycanthread.isRunning()) return;
+  mycanthread.setifname(ifacename);
+  streamserver.setinterface(ifacename);
+  shmring.setinterface(ifacename.toLocal8Bit().constData());
+  statusBar->showMessage(tr("Capturing on %1").arg(ifacename), 2000);
+}
+
 /*!
  * Start or stop a CAN interface-thread.
  */
@@ -415,6 +547,8 @@ void socketcangui::startorstopthread() {
     cerr << "Thread has finished" << endl;
     cerr.flush();
 #endif
+    // Nothing more to wait for
+    reorder.flush();
     capturepb->setText(tr("Start"));
     statusdisplaylabel->setText(tr("Idle"));
     statusdisplaylabel->setStyleSheet(HTMLLIGHTRED);
@@ -422,6 +556,8 @@ void socketcangui::startorstopthread() {
     QApplication::restoreOverrideCursor();
   } else {
     mycanthread.setifname(ifacename);
+    streamserver.setinterface(ifacename);
+    shmring.setinterface(ifacename.toLocal8Bit().constData());
     mycanthread.start();
     capturepb->setText(tr("Stop"));
     statusdisplaylabel->setText(tr("Running"));
@@ -430,6 +566,405 @@ void socketcangui::startorstopthread() {
   }
 }
 
+/*!
+ * Called when the user changed the display filter.
+ * Invalid fields are marked red and the filter is not applied then.
+ */
+void socketcangui::displayfilterchanged() {
+  canpacketfilter filter;
+  QPalette valid = displayfilterids->style()->standardPalette();
+  QPalette invalid = valid;
+  invalid.setColor(QPalette::Base, LIGHTRED);
+
+  bool idsok = filter.setids(displayfilterids->text());
+  displayfilterids->setPalette(idsok ? valid : invalid);
+  bool payloadok = filter.setpayload(displayfilterpayload->text());
+  displayfilterpayload->setPalette(payloadok ? valid : invalid);
+  if (!idsok || !payloadok) return;
+
+  filter.setdirection((canpacketfilter::Direction)displayfilterdirection->currentIndex());
+  filter.seterrors((canpacketfilter::Errors)displayfiltererrors->currentIndex());
+  myclf->setdisplayfilter(filter);
+  statusBar->showMessage(tr("Display filter applied"), 2000);
+}
+
+/*!
+ * Called when the user changed the filter of the filtered trace.
+ * Invalid fields are marked red and the filter is not applied then.
+ */
+void socketcangui::tracefilterchanged() {
+  canpacketfilter filter;
+  QPalette valid = tracefilterids->style()->standardPalette();
+  QPalette invalid = valid;
+  invalid.setColor(QPalette::Base, LIGHTRED);
+
+  bool idsok = filter.setids(tracefilterids->text());
+  tracefilterids->setPalette(idsok ? valid : invalid);
+  bool payloadok = filter.setpayload(tracefilterpayload->text());
+  tracefilterpayload->setPalette(payloadok ? valid : invalid);
+  if (!idsok || !payloadok) return;
+
+  tracemodel->setfilter(filter);
+}
+
+/*!
+ * Called when the user changed the IDs carrying ISO-TP. An invalid list is
+ * marked red and not applied.
+ */
+void socketcangui::isotpidschanged() {
+  canpacketfilter filter;
+  QPalette valid = isotpids->style()->standardPalette();
+  QPalette invalid = valid;
+  invalid.setColor(QPalette::Base, LIGHTRED);
+
+  bool idsok = filter.setids(isotpids->text());
+  isotpids->setPalette(idsok ? valid : invalid);
+  if (!idsok) return;
+
+  isotpmodel->setids(filter);
+}
+
+/*!
+ * Called when an ISO-TP message or one of its frames has been double-clicked;
+ * shows the (first) frame in the main view.
+ * @param index Double-clicked cell
+ */
+void socketcangui::isotpactivated(const QModelIndex &index) {
+  quint32 arrival;
+  if (!isotpmodel->arrivalat(index, &arrival)) return;
+  if (!myclf->showarrival(arrival)) {
+    statusBar->showMessage(tr("Frame %1 is hidden by the display filter or no longer stored").arg(arrival), 2000);
+  }
+}
+
+/*!
+ * Called when an annotation of a decoder has been double-clicked; shows its
+ * frame in the main view.
+ * @param index Double-clicked cell
+ */
+void socketcangui::decodedactivated(const QModelIndex &index) {
+  if (!index.isValid()) return;
+  quint32 arrival = pipeline->results()->arrivalatrow(index.row());
+  if (!myclf->showarrival(arrival)) {
+    statusBar->showMessage(tr("Frame %1 is hidden by the display filter or no longer stored").arg(arrival), 2000);
+  }
+}
+
+/*!
+ * Refresh the counters and CPU time of the protocol decoders in the GUI.
+ */
+void socketcangui::updatedecoders() {
+  for (int d = 0; d < pipeline->decodercount(); d++) {
+    QTreeWidgetItem *item = decodertable->topLevelItem(d);
+    candecoderstats stats = pipeline->statistics(d);
+    item->setText(2, QString::number(stats.frames));
+    item->setText(3, QString::number(stats.annotations));
+    item->setText(4, QString::number(stats.cputime / 1000000.0, 'f', 1));
+    item->setText(5, stats.frames ? QString::number(stats.cputime / 1000.0 / stats.frames, 'f', 2) : QString("-"));
+  }
+}
+
+/*!
+ * Called when the user changed the nominal cycle times. An invalid list is
+ * marked red and not applied.
+ */
+void socketcangui::cycleperiodschanged() {
+  QPalette valid = cycleperiods->style()->standardPalette();
+  QPalette invalid = valid;
+  invalid.setColor(QPalette::Base, LIGHTRED);
+
+  cycleperiods->setPalette(cycles.setnominals(cycleperiods->text()) ? valid : invalid);
+  mycanthread.cycleschanged();
+}
+
+/*!
+ * Refresh the cycle times in the GUI: one row per CAN ID, marked red while
+ * the ID is missing or if a frame came too early within the last second.
+ */
+void socketcangui::updatecycles() {
+  QVector<cancycleentry> entries;
+  cycles.snapshot(entries);
+  qint64 now = cancycleanalyzer::realtimenow();
+
+  while (cycletable->topLevelItemCount() > entries.size()) delete cycletable->takeTopLevelItem(cycletable->topLevelItemCount() - 1);
+  while (cycletable->topLevelItemCount() < entries.size()) cycletable->addTopLevelItem(new QTreeWidgetItem);
+
+  for (int i = 0; i < entries.size(); i++) {
+    const cancycleentry &entry = entries.at(i);
+    QTreeWidgetItem *item = cycletable->topLevelItem(i);
+    bool extended = entry.key & 0x80000000;
+    item->setText(0, QString("%1").arg(entry.key & 0x1FFFFFFF, extended ? 8 : 3, 16, QChar('0')).toUpper());
+    item->setText(1, QString::number(entry.count));
+    item->setText(2, entry.nominal ? QString::number(entry.nominal / 1000.0, 'f', 3) : QString("-"));
+    bool intervals = entry.count > 1;
+    item->setText(3, intervals ? QString::number(entry.sum / 1000.0 / (entry.count - 1), 'f', 3) : QString("-"));
+    item->setText(4, intervals ? QString::number(entry.minimum / 1000.0, 'f', 3) : QString("-"));
+    item->setText(5, intervals ? QString::number(entry.maximum / 1000.0, 'f', 3) : QString("-"));
+    for (int q = 0; q < cancycleentry::QuantileCount; q++) {
+      double jitter = entry.jitter[q].estimate(cancycleanalyzer::quantilefraction(q));
+      item->setText(6 + q, jitter < 0 ? QString("-") : QString::number(jitter / 1000.0, 'f', 3));
+    }
+    item->setText(9, QString::number(entry.toofast));
+    item->setText(10, QString::number(entry.missing));
+
+    bool alarm = entry.missingnow || (entry.lastfast && now - entry.lastfast < 1000000);
+    for (int c = 0; c < cycletable->columnCount(); c++) {
+      item->setBackground(c, QBrush(alarm ? LIGHTRED : TRANSPARENT));
+    }
+  }
+}
+
+/*!
+ * Measure the cycle times anew.
+ */
+void socketcangui::resetcycles() {
+  cycles.reset();
+  mycanthread.cycleschanged();
+  cycletable->clear();
+}
+
+/*!
+ * Called when the capture trigger has fired.
+ */
+void socketcangui::capturetriggered() {
+  statustrigger->setText(tr("Triggered"));
+  statustrigger->setStyleSheet(HTMLLIGHTRED);
+  statusBar->showMessage(tr("Capture trigger fired"), 2000);
+}
+
+/*!
+ * Called when all post-trigger packets have been recorded.
+ */
+void socketcangui::capturecomplete() {
+  statustrigger->setText(tr("Capture complete"));
+  statustrigger->setStyleSheet(HTMLLIGHTRED);
+  statusBar->showMessage(tr("Capture complete, new packets are discarded until the trigger is re-armed"), 5000);
+}
+
+/*!
+ * Called when a capture thread trigger has fired.
+ * @param definition Definition of the trigger
+ */
+void socketcangui::threadtriggerfired(QString definition) {
+  statusBar->showMessage(tr("Trigger fired: %1").arg(definition), 2000);
+}
+
+/*!
+ * Show the dialog comparing two files, with the file currently open as
+ * reference.
+ */
+void socketcangui::comparefiles() {
+  comparedialog->setreference(curFile);
+  comparedialog->show();
+  comparedialog->raise();
+}
+
+/*!
+ * Show the dialog merging several files into one ordered by timestamp.
+ */
+void socketcangui::mergefiles() {
+  mergedialog->show();
+  mergedialog->raise();
+}
+
+/*!
+ * Open the file just merged.
+ * @param fileName Name of the merged file
+ */
+void socketcangui::openmerged(QString fileName) {
+  // Check whether the file has been modified and prompt the user if so
+  if (okToContinue()) loadFile(fileName);
+}
+
+/*!
+ * Load a DBC signal database and decode the signals with it.
+ */
+void socketcangui::loaddatabase() {
+  QString fileName = QFileDialog::getOpenFileName(this, tr("Open signal database"), ".", tr("DBC files (*.dbc)"));
+  if (fileName.isEmpty()) return;
+
+  candbc *newdatabase = new candbc;
+  QString error;
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  bool ok = newdatabase->load(fileName, &error);
+  QApplication::restoreOverrideCursor();
+  if (!ok) {
+    QMessageBox::warning(this, tr("socketcangui"), tr("Cannot load signal database %1:\n%2.").arg(fileName).arg(error));
+    delete newdatabase;
+    return;
+  }
+
+  myclf->setdatabase(newdatabase);
+  tracemodel->setdatabase(newdatabase);
+  signalplot->setdatabase(newdatabase);
+  delete database;
+  database = newdatabase;
+  statusBar->showMessage(tr("Signal database loaded (%1 messages)").arg(database->messagecount()), 2000);
+}
+
+/*!
+ * Refresh the latency statistics in the GUI: count and percentiles per stage.
+ */
+void socketcangui::updatelatency() {
+  static const double fractions[] = {0.5, 0.9, 0.99, 0.999};
+  for (int s = 0; s < canlatency::StageCount; s++) {
+    QTreeWidgetItem *item = latencytable->topLevelItem(s);
+    QVector<quint64> counts = latency.stage(s).snapshot();
+    quint64 total = 0;
+    for (int i = 0; i < counts.size(); i++) total += counts.at(i);
+    item->setText(1, QString::number(total));
+    for (int f = 0; f < 4; f++) {
+      qint64 value = canhistogram::percentile(counts, fractions[f]);
+      item->setText(2 + f, value < 0 ? QString("-") : QString::number(value / 1000.0, 'f', 1));
+    }
+    item->setText(6, total ? QString::number(latency.stage(s).maximum() / 1000.0, 'f', 1) : QString("-"));
+  }
+}
+
+/*!
+ * Empty the latency statistics.
+ */
+void socketcangui::resetlatency() {
+  latency.reset();
+  updatelatency();
+}
+
+/*!
+ * Write the latency histograms to a file.
+ */
+void socketcangui::dumplatency() {
+  QString fileName = QFileDialog::getSaveFileName(this, tr("Save latency histograms"), ".", tr("Text files (*.txt)"));
+  if (fileName.isEmpty()) return;
+  if (!latency.dump(fileName)) {
+    QMessageBox::warning(this, tr("socketcangui"), tr("Cannot write file %1.").arg(fileName));
+    return;
+  }
+  statusBar->showMessage(tr("Latency histograms saved"), 2000);
+}
+
+/*!
+ * Refresh state and error counters of all CAN controllers in the GUI.
+ * One netlink dump covers all interfaces.
+ */
+void socketcangui::pollcontrollers() {
+  QList<canlink> links = netlink.links();
+  while (controllertable->topLevelItemCount() > links.size()) delete controllertable->topLevelItem(controllertable->topLevelItemCount() - 1);
+  for (int i = 0; i < links.size(); i++) {
+    const canlink &link = links.at(i);
+    QTreeWidgetItem *item = controllertable->topLevelItem(i);
+    if (!item) {
+      item = new QTreeWidgetItem;
+      controllertable->addTopLevelItem(item);
+    }
+    item->setText(0, link.name);
+    item->setText(1, cannetlink::statename(link.status.state));
+    if (link.status.state < 0) item->setBackground(1, QBrush(TRANSPARENT));
+    else if (link.status.state <= CAN_STATE_ERROR_WARNING) item->setBackground(1, QBrush(LIGHTGREEN));
+    else item->setBackground(1, QBrush(LIGHTRED));
+    if (link.status.state < 0) {
+      for (int c = 2; c < 4; c++) item->setText(c, "-");
+    } else {
+      item->setText(2, QString::number(link.status.txerrors));
+      item->setText(3, QString::number(link.status.rxerrors));
+    }
+    if (link.status.hasxstats) {
+      item->setText(4, QString::number(link.status.xstats.bus_off));
+      item->setText(5, QString::number(link.status.xstats.restarts));
+      item->setText(6, QString::number(link.status.xstats.error_passive));
+      item->setText(7, QString::number(link.status.xstats.bus_error));
+      item->setText(8, QString::number(link.status.xstats.arbitration_lost));
+    } else {
+      for (int c = 4; c < 9; c++) item->setText(c, "-");
+    }
+  }
+}
+
+/*!
+ * Set how often the controller statistics are polled.
+ * @param msec Interval in milliseconds (0 = never)
+ */
+void socketcangui::setstatspoll(int msec) {
+  controllertimer->stop();
+  pollcontrollers();
+  if (msec > 0) controllertimer->start(msec);
+}
+
+/*!
+ * Start or stop the streaming server.
+ * @param enabled Whether the server shall run
+ * @param local Listen on a Unix socket instead of a TCP port of localhost
+ * @param port TCP port
+ * @param path File name of the Unix socket
+ */
+void socketcangui::setstreamserver(bool enabled, bool local, int port, QString path) {
+  streamserver.close();
+  if (enabled) {
+    QString error;
+    bool ok = local ? streamserver.listenlocal(path, &error) : streamserver.listentcp(port, &error);
+    if (!ok) {
+      QMessageBox::warning(this, tr("socketcangui"), tr("Cannot start the streaming server:\n%1.").arg(error));
+    } else {
+      statusBar->showMessage(tr("Streaming server listening on %1").arg(local ? path : QString("localhost:%1").arg(port)), 2000);
+    }
+  }
+  statusstream->setVisible(streamserver.islistening());
+}
+
+/*!
+ * Create or remove the shared-memory ring. A new ring starts empty.
+ * @param enabled Whether the captured packets shall be published
+ * @param name Name of the shared memory, e.g. "/socketcangui"
+ * @param slots Frames the ring holds
+ */
+void socketcangui::setshmring(bool enabled, QString name, int slots) {
+  shmring.close();
+  if (!enabled) return;
+  if (!name.startsWith("/")) name.prepend("/");
+  if (!shmring.create(QFile::encodeName(name).constData(), slots)) {
+    QMessageBox::warning(this, tr("socketcangui"), tr("Cannot create the shared-memory ring %1:\n%2.").arg(name).arg(strerror(errno)));
+    return;
+  }
+  shmring.setinterface(ifacecombo->currentText().toLocal8Bit().constData());
+  statusBar->showMessage(tr("Publishing the capture in shared memory %1").arg(name), 2000);
+}
+
+/*!
+ * Writes a captured packet to the shared-memory ring (if there is one).
+ * @param packet The packet
+ */
+void socketcangui::shmpublish(canpacket packet) {
+  if (!shmring.isopen() || packet.marker) return;
+  canshmframe frame;
+  frame.timestamp = (qint64)packet.tv.tv_sec * 1000000 + packet.tv.tv_usec;
+  frame.canid = packet.identifier;
+  if (packet.ide) frame.canid |= 0x80000000;
+  if (packet.rtr) frame.canid |= 0x40000000;
+  if (packet.err) frame.canid |= 0x20000000;
+  frame.dlc = packet.dlc;
+  frame.flags = packet.direction ? 0 : canshmring::FlagSent;
+  frame.interface = packet.interface;
+  memcpy(frame.data, packet.data, sizeof(frame.data));
+  shmring.publish(frame);
+}
+
+/*!
+ * Called when the capture thread scheduling could not be applied (fully).
+ * The capture goes on with the default scheduling for what failed.
+ * @param message Description of what failed and why
+ */
+void socketcangui::schedulingwarning(QString message) {
+  QMessageBox::warning(this, tr("socketcangui"), message);
+}
+
+/*!
+ * Re-arm the capture trigger.
+ */
+void socketcangui::armtrigger() {
+  myclf->armtrigger();
+  statustrigger->setText(tr("Trigger armed"));
+  statustrigger->setStyleSheet(HTMLLIGHTGREEN);
+}
+
 /*!
  * INIT: create (menu) actions.
  */
@@ -457,6 +992,14 @@ void socketcangui::createActions() {
   saveAsAction->setStatusTip(tr("Save the CAN logfile under a new name"));
   connect(saveAsAction, SIGNAL(triggered()), this, SLOT(saveAs()));
 
+  compareAction = new QAction(tr("&Compare files..."), this);
+  compareAction->setStatusTip(tr("Compare two CAN logfiles per CAN ID"));
+  connect(compareAction, SIGNAL(triggered()), this, SLOT(comparefiles()));
+
+  mergeAction = new QAction(tr("&Merge files..."), this);
+  mergeAction->setStatusTip(tr("Merge several CAN logfiles into one ordered by timestamp"));
+  connect(mergeAction, SIGNAL(triggered()), this, SLOT(mergefiles()));
+
   for (int i = 0; i < MaxRecentFiles; ++i) {
     recentFileActions[i] = new QAction(this);
     recentFileActions[i]->setVisible(false);
@@ -484,6 +1027,11 @@ void socketcangui::createActions() {
   setupAction->setIcon(QIcon(":/icons/images/configure.png"));
   setupAction->setStatusTip(tr("Setup CAN filters and bitrate for PEAK adapters"));
   connect(setupAction, SIGNAL(triggered()), setupdialog, SLOT(show()));
+
+  loadDatabaseAction = new QAction(tr("Load signal &database..."), this);
+  loadDatabaseAction->setIcon(QIcon(":/icons/images/document-open.png"));
+  loadDatabaseAction->setStatusTip(tr("Load a DBC file to decode the signals"));
+  connect(loadDatabaseAction, SIGNAL(triggered()), this, SLOT(loaddatabase()));
 }
 
 /*!
@@ -495,6 +1043,8 @@ void socketcangui::createMenus() {
   fileMenu->addAction(openAction);
   fileMenu->addAction(saveAction);
   fileMenu->addAction(saveAsAction);
+  fileMenu->addAction(compareAction);
+  fileMenu->addAction(mergeAction);
   separatorAction = fileMenu->addSeparator();
   for (int i = 0; i < MaxRecentFiles; ++i)
     fileMenu->addAction(recentFileActions[i]);
@@ -503,6 +1053,7 @@ void socketcangui::createMenus() {
 
   optionsMenu = menuBar()->addMenu(tr("&Options"));
   optionsMenu->addAction(setupAction);
+  optionsMenu->addAction(loadDatabaseAction);
 
   menuBar()->addSeparator();
 
@@ -581,6 +1132,195 @@ void socketcangui::createDockWidgets() {
   // make the dock widget non-closeable
   sendwidgetDock->setFeatures(sendwidgetDock->features() & ~QDockWidget::DockWidgetClosable);
 
+  // Display filter widget (normally in the lower part)
+  QWidget *filterwidget = new QWidget;
+  QGridLayout *filterwidgetLayout = new QGridLayout;
+  filterwidget->setLayout(filterwidgetLayout);
+  displayfilterids = new QLineEdit;
+  displayfilterids->setToolTip(tr("CAN IDs (hex) to be shown, e.g. \"123, 200-2FF\". Empty shows all IDs."));
+  displayfilterdirection = new QComboBox;
+  displayfilterdirection->addItem(tr("All"));
+  displayfilterdirection->addItem(tr("Received"));
+  displayfilterdirection->addItem(tr("Sent"));
+  displayfiltererrors = new QComboBox;
+  displayfiltererrors->addItem(tr("All frames"));
+  displayfiltererrors->addItem(tr("Error frames only"));
+  displayfiltererrors->addItem(tr("No error frames"));
+  displayfilterpayload = new QLineEdit;
+  displayfilterpayload->setToolTip(tr("Payload bytes (hex) to match, \"??\" matches any byte, e.g. \"02 ?? 7F\""));
+  filterwidgetLayout->addWidget(new QLabel(tr("CAN IDs:")), 0, 0);
+  filterwidgetLayout->addWidget(displayfilterids, 0, 1);
+  filterwidgetLayout->addWidget(new QLabel(tr("Direction:")), 0, 2);
+  filterwidgetLayout->addWidget(displayfilterdirection, 0, 3);
+  filterwidgetLayout->addWidget(new QLabel(tr("Payload:")), 1, 0);
+  filterwidgetLayout->addWidget(displayfilterpayload, 1, 1);
+  filterwidgetLayout->addWidget(new QLabel(tr("Errors:")), 1, 2);
+  filterwidgetLayout->addWidget(displayfiltererrors, 1, 3);
+  connect(displayfilterids, SIGNAL(editingFinished()), this, SLOT(displayfilterchanged()));
+  connect(displayfilterpayload, SIGNAL(editingFinished()), this, SLOT(displayfilterchanged()));
+  connect(displayfilterdirection, SIGNAL(currentIndexChanged(int)), this, SLOT(displayfilterchanged()));
+  connect(displayfiltererrors, SIGNAL(currentIndexChanged(int)), this, SLOT(displayfilterchanged()));
+  QDockWidget *filterwidgetDock = new QDockWidget(tr("Display filter"));
+  filterwidgetDock->setWidget(filterwidget);
+  addDockWidget(Qt::BottomDockWidgetArea, filterwidgetDock);
+
+  // Signal plot widget (normally at the bottom)
+  signalplot = new cansignalplot(myclf);
+  QDockWidget *plotwidgetDock = new QDockWidget(tr("Signal plot"));
+  plotwidgetDock->setWidget(signalplot);
+  addDockWidget(Qt::BottomDockWidgetArea, plotwidgetDock);
+
+  // Filtered trace and ID summary: further views of the canpackets of myclf (normally at the bottom)
+  QWidget *tracewidget = new QWidget;
+  QGridLayout *tracewidgetLayout = new QGridLayout;
+  tracewidget->setLayout(tracewidgetLayout);
+  tracefilterids = new QLineEdit;
+  tracefilterids->setToolTip(tr("CAN IDs (hex) to be shown, e.g. \"123, 200-2FF\". Empty shows all IDs."));
+  tracefilterpayload = new QLineEdit;
+  tracefilterpayload->setToolTip(tr("Payload bytes (hex) to match, \"??\" matches any byte, e.g. \"02 ?? 7F\""));
+  tracemodel = new canpacketmodel(myclf->getstore(), this);
+  QTreeView *traceview = new QTreeView;
+  traceview->setModel(tracemodel);
+  traceview->setRootIsDecorated(false);
+  traceview->setUniformRowHeights(true);
+  traceview->setAlternatingRowColors(true);
+  traceview->setSortingEnabled(true);
+  traceview->sortByColumn(canpacketmodel::ColNumber, Qt::AscendingOrder);
+  traceview->setColumnHidden(canpacketmodel::ColInterface, 1);
+  traceview->setColumnHidden(canpacketmodel::ColCRC, 1);
+  tracewidgetLayout->addWidget(new QLabel(tr("CAN IDs:")), 0, 0);
+  tracewidgetLayout->addWidget(tracefilterids, 0, 1);
+  tracewidgetLayout->addWidget(new QLabel(tr("Payload:")), 0, 2);
+  tracewidgetLayout->addWidget(tracefilterpayload, 0, 3);
+  tracewidgetLayout->addWidget(traceview, 1, 0, 1, 4);
+  connect(tracefilterids, SIGNAL(editingFinished()), this, SLOT(tracefilterchanged()));
+  connect(tracefilterpayload, SIGNAL(editingFinished()), this, SLOT(tracefilterchanged()));
+  QDockWidget *tracewidgetDock = new QDockWidget(tr("Filtered trace"));
+  tracewidgetDock->setWidget(tracewidget);
+  addDockWidget(Qt::BottomDockWidgetArea, tracewidgetDock);
+
+  summarymodel = new canidsummarymodel(myclf->getstore(), this);
+  QTreeView *summaryview = new QTreeView;
+  summaryview->setModel(summarymodel);
+  summaryview->setRootIsDecorated(false);
+  summaryview->setUniformRowHeights(true);
+  summaryview->setAlternatingRowColors(true);
+  QDockWidget *summarywidgetDock = new QDockWidget(tr("ID summary"));
+  summarywidgetDock->setWidget(summaryview);
+  addDockWidget(Qt::BottomDockWidgetArea, summarywidgetDock);
+
+  // ISO-TP messages: one row per reassembled message, its frames as children
+  QWidget *isotpwidget = new QWidget;
+  QGridLayout *isotpwidgetLayout = new QGridLayout;
+  isotpwidget->setLayout(isotpwidgetLayout);
+  isotpids = new QLineEdit(canisotp::defaultids());
+  isotpids->setToolTip(tr("CAN IDs (hex) carrying ISO-TP, e.g. \"7E0-7EF\". Empty reassembles all IDs."));
+  isotpmodel = new canisotpmodel(myclf->getstore(), this);
+  QTreeView *isotpview = new QTreeView;
+  isotpview->setModel(isotpmodel);
+  isotpview->setUniformRowHeights(true);
+  isotpview->setAlternatingRowColors(true);
+  isotpview->setToolTip(tr("Double-click a message or frame to show it in the file"));
+  isotpwidgetLayout->addWidget(new QLabel(tr("CAN IDs:")), 0, 0);
+  isotpwidgetLayout->addWidget(isotpids, 0, 1);
+  isotpwidgetLayout->addWidget(isotpview, 1, 0, 1, 2);
+  connect(isotpids, SIGNAL(editingFinished()), this, SLOT(isotpidschanged()));
+  connect(isotpview, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(isotpactivated(QModelIndex)));
+  QDockWidget *isotpwidgetDock = new QDockWidget(tr("ISO-TP messages"));
+  isotpwidgetDock->setWidget(isotpwidget);
+  addDockWidget(Qt::BottomDockWidgetArea, isotpwidgetDock);
+
+  // Protocol decoders: the built-in ones and those of the plugins, on worker threads
+  pipeline = new canpipeline(myclf->getstore(), this);
+  pipeline->adddecoder(new canj1939decoder);
+  pipeline->adddecoder(new cancanopendecoder);
+  pipeline->adddecoder(new canudsdecoder);
+  pipeline->loadplugins(QCoreApplication::applicationDirPath() + "/decoders");
+  pipeline->loadplugins(QDesktopServices::storageLocation(QDesktopServices::DataLocation) + "/decoders");
+  pipeline->start(qMax(1, QThread::idealThreadCount() - 1));
+  QWidget *decoderwidget = new QWidget;
+  QVBoxLayout *decoderwidgetLayout = new QVBoxLayout;
+  decoderwidget->setLayout(decoderwidgetLayout);
+  QTreeView *decodedview = new QTreeView;
+  decodedview->setModel(pipeline->results());
+  decodedview->setRootIsDecorated(false);
+  decodedview->setUniformRowHeights(true);
+  decodedview->setAlternatingRowColors(true);
+  decodedview->setToolTip(tr("Double-click an annotation to show its frame in the file"));
+  decoderwidgetLayout->addWidget(decodedview);
+  decodertable = new QTreeWidget;
+  decodertable->setRootIsDecorated(false);
+  decodertable->setColumnCount(6);
+  decodertable->setHeaderLabels(QStringList() << tr("Decoder") << tr("Thread") << tr("Frames") << tr("Annotations")
+                                << tr("CPU [ms]") << tr("CPU/frame [us]"));
+  for (int d = 0; d < pipeline->decodercount(); d++) {
+    decodertable->addTopLevelItem(new QTreeWidgetItem(QStringList() << pipeline->decodername(d)
+                                                      << QString::number(pipeline->decoderthread(d))));
+  }
+  decoderwidgetLayout->addWidget(decodertable);
+  connect(decodedview, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(decodedactivated(QModelIndex)));
+  decodertimer = new QTimer(this);
+  connect(decodertimer, SIGNAL(timeout()), this, SLOT(updatedecoders()));
+  decodertimer->start(1000);
+  QDockWidget *decoderwidgetDock = new QDockWidget(tr("Protocol decoders"));
+  decoderwidgetDock->setWidget(decoderwidget);
+  addDockWidget(Qt::BottomDockWidgetArea, decoderwidgetDock);
+
+  // Cycle times: interval and jitter per CAN ID, measured by the capture thread
+  QWidget *cyclewidget = new QWidget;
+  QGridLayout *cyclewidgetLayout = new QGridLayout;
+  cyclewidget->setLayout(cyclewidgetLayout);
+  cycleperiods = new QLineEdit;
+  cycleperiods->setToolTip(tr("Nominal periods, e.g. \"123:10, 18FEF100:100ms\". IDs not listed are compared with their mean interval."));
+  QPushButton *cycleresetpb = new QPushButton(tr("Reset"));
+  cycletable = new QTreeWidget;
+  cycletable->setRootIsDecorated(false);
+  cycletable->setColumnCount(11);
+  cycletable->setHeaderLabels(QStringList() << tr("CAN ID") << tr("Frames") << tr("Nominal [ms]") << tr("Mean [ms]")
+                              << tr("Min [ms]") << tr("Max [ms]") << tr("Jitter p50 [ms]") << tr("p99 [ms]")
+                              << tr("p99.9 [ms]") << tr("Too fast") << tr("Missing"));
+  cyclewidgetLayout->addWidget(new QLabel(tr("Nominal periods:")), 0, 0);
+  cyclewidgetLayout->addWidget(cycleperiods, 0, 1);
+  cyclewidgetLayout->addWidget(cycleresetpb, 0, 2);
+  cyclewidgetLayout->addWidget(cycletable, 1, 0, 1, 3);
+  connect(cycleperiods, SIGNAL(editingFinished()), this, SLOT(cycleperiodschanged()));
+  connect(cycleresetpb, SIGNAL(clicked()), this, SLOT(resetcycles()));
+  cycletimer = new QTimer(this);
+  connect(cycletimer, SIGNAL(timeout()), this, SLOT(updatecycles()));
+  cycletimer->start(250);
+  QDockWidget *cyclewidgetDock = new QDockWidget(tr("Cycle times"));
+  cyclewidgetDock->setWidget(cyclewidget);
+  addDockWidget(Qt::BottomDockWidgetArea, cyclewidgetDock);
+
+  // Diagnostics widget (normally at the bottom)
+  QWidget *latencywidget = new QWidget;
+  QVBoxLayout *latencywidgetLayout = new QVBoxLayout;
+  latencywidget->setLayout(latencywidgetLayout);
+  latencytable = new QTreeWidget;
+  latencytable->setRootIsDecorated(false);
+  latencytable->setColumnCount(7);
+  latencytable->setHeaderLabels(QStringList() << tr("Stage") << tr("Frames") << tr("p50 [us]") << tr("p90 [us]")
+                                << tr("p99 [us]") << tr("p99.9 [us]") << tr("Max [us]"));
+  for (int s = 0; s < canlatency::StageCount; s++) {
+    latencytable->addTopLevelItem(new QTreeWidgetItem(QStringList() << canlatency::stagename(s)));
+  }
+  latencywidgetLayout->addWidget(latencytable);
+  QHBoxLayout *latencybuttons = new QHBoxLayout;
+  latencywidgetLayout->addLayout(latencybuttons);
+  QPushButton *latencyresetpb = new QPushButton(tr("Reset"));
+  latencybuttons->addWidget(latencyresetpb);
+  QPushButton *latencydumppb = new QPushButton(tr("Save..."));
+  latencybuttons->addWidget(latencydumppb);
+  latencybuttons->addStretch();
+  connect(latencyresetpb, SIGNAL(clicked()), this, SLOT(resetlatency()));
+  connect(latencydumppb, SIGNAL(clicked()), this, SLOT(dumplatency()));
+  latencytimer = new QTimer(this);
+  connect(latencytimer, SIGNAL(timeout()), this, SLOT(updatelatency()));
+  latencytimer->start(1000);
+  QDockWidget *latencywidgetDock = new QDockWidget(tr("Diagnostics"));
+  latencywidgetDock->setWidget(latencywidget);
+  addDockWidget(Qt::BottomDockWidgetArea, latencywidgetDock);
+
   // Control widget (normally on the right side)
   QWidget *controlwidget = new QWidget;
   QVBoxLayout *controlwidgetLayout = new QVBoxLayout;
@@ -602,6 +1342,9 @@ void socketcangui::createDockWidgets() {
   ifacelist->setHeaderLabels(QStringList() << tr("Interface") << tr("Status"));
   controlwidgetLayout->addWidget(ifacelist);
   connect(updateifaces, SIGNAL(clicked()), this, SLOT(updateinterfacelist()));
+  connect(&netlink, SIGNAL(linkchanged(canlink)), this, SLOT(linkchanged(canlink)));
+  connect(&netlink, SIGNAL(linkremoved(canlink)), this, SLOT(linkremoved(canlink)));
+  connect(&netlink, SIGNAL(resync()), this, SLOT(updateinterfacelist()));
   connect(ifacelist, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(ifacelistdclicked(QModelIndex)));
 
   QHBoxLayout *capturelayout = new QHBoxLayout;
@@ -611,13 +1354,25 @@ void socketcangui::createDockWidgets() {
 
   ifacecombo = new QComboBox;
   capturelayout->addWidget(ifacecombo);
+  connect(ifacecombo, SIGNAL(activated(QString)), this, SLOT(ifaceactivated(QString)));
   capturepb = new QPushButton(tr("Start"));
   capturelayout->addWidget(capturepb);
 
+  QHBoxLayout *triggerlayout = new QHBoxLayout;
+  controlwidgetLayout->addLayout(triggerlayout);
+  QPushButton *triggerpb = new QPushButton(tr("Trigger"));
+  triggerlayout->addWidget(triggerpb);
+  QPushButton *armpb = new QPushButton(tr("Re-arm"));
+  triggerlayout->addWidget(armpb);
+  connect(triggerpb, SIGNAL(clicked()), myclf, SLOT(trigger()));
+  connect(armpb, SIGNAL(clicked()), this, SLOT(armtrigger()));
+
   // Tell Qt that canpacket can be used with SLOTs and SIGNALs
   qRegisterMetaType<canpacket>("canpacket");
   connect(capturepb, SIGNAL(clicked()), this, SLOT(startorstopthread()));
-  connect(&mycanthread, SIGNAL(dataarrived(canpacket)), myclf, SLOT(adddataitem(canpacket)));
+  // Captured and sent packets pass the (optional) reorder buffer on their way to the file
+  connect(&mycanthread, SIGNAL(dataarrived(canpacket)), &reorder, SLOT(add(canpacket)));
+  connect(&reorder, SIGNAL(released(canpacket)), myclf, SLOT(adddataitem(canpacket)));
 
   // Tell Qt that threadstatus can be used with SLOTs and SIGNALs
   qRegisterMetaType<threadstatus>("threadstatus");
@@ -650,6 +1405,37 @@ void socketcangui::createDockWidgets() {
   statuswidgetLayout->addWidget(statusinbcounter);
   statusoutbcounter = new QLabel("");
   statuswidgetLayout->addWidget(statusoutbcounter);
+  statusdropcounter = new QLabel("");
+  statuswidgetLayout->addWidget(statusdropcounter);
+  statusrcvbuf = new QLabel("");
+  statuswidgetLayout->addWidget(statusrcvbuf);
+  statusstream = new QLabel("");
+  statuswidgetLayout->addWidget(statusstream);
+  statuslate = new QLabel("");
+  statuslate->setToolTip(tr("Packets that came later than the reorder window and were stored out of order"));
+  statuslate->setVisible(false);
+  statuswidgetLayout->addWidget(statuslate);
+  statustriggercounter = new QLabel("");
+  statuswidgetLayout->addWidget(statustriggercounter);
+  statusevicted = new QLabel("");
+  statuswidgetLayout->addWidget(statusevicted);
+
+  statustrigger = new QLabel(tr("Trigger armed"));
+  statustrigger->setStyleSheet(HTMLLIGHTGREEN);
+  statustrigger->setFrameShape(QFrame::Panel);
+  statustrigger->setFrameShadow(QLabel::Sunken);
+  statustrigger->setAlignment(Qt::AlignHCenter);
+  statuswidgetLayout->addWidget(statustrigger);
+
+  controllertable = new QTreeWidget;
+  controllertable->setRootIsDecorated(false);
+  controllertable->setColumnCount(9);
+  controllertable->setHeaderLabels(QStringList() << tr("Interface") << tr("State") << tr("TX err") << tr("RX err")
+                                   << tr("Bus-off") << tr("Restarts") << tr("Passive") << tr("Bus errors") << tr("Arb. lost"));
+  statuswidgetLayout->addWidget(controllertable);
+  controllertimer = new QTimer(this);
+  connect(controllertimer, SIGNAL(timeout()), this, SLOT(pollcontrollers()));
+  setstatspoll(1000);
 }
 
 /*!
@@ -11,17 +11,18 @@
 
 #include <QtGui>
 
-// Things needed to scan for interfaces and get their type and status
-#include <sys/socket.h>
-#include <linux/can.h>
-#include <linux/can/raw.h>
-#include <net/if.h>
-#include <sys/ioctl.h>
-
 #include <iostream>
 
 #include "canthread.h"
+#include "cannetlink.h"
+#include "canjournal.h"
+#include "canstreamserver.h"
+#include "canshmring.h"
+#include "canreorder.h"
 #include "setupdialog.h"
+#include "comparedialog.h"
+#include "mergedialog.h"
+#include "canpacketfilter.h"
 
 // Color definitions for the user interface
 #define LIGHTRED        QColor(255, 192, 192)           //!< Color used for tree view items
@@ -31,6 +32,12 @@
 #define HTMLLIGHTGREEN  "QLabel {background: #C0FFC0}"  //!< Color used for label elements
 
 class canlogfile;
+class candbc;
+class cansignalplot;
+class canpacketmodel;
+class canidsummarymodel;
+class canisotpmodel;
+class canpipeline;
 
 /*!
  * Main class of the software keeping all the GUI stuff together and hosting the canlogiles
@@ -50,10 +57,15 @@ private slots:
   void open();                          //!< Open and load a file
   bool save();                          //!< Save the current file under the same name
   bool saveAs();                        //!< Save the current file under a new name
+  void comparefiles();                  //!< Show the dialog comparing two files
+  void mergefiles();                    //!< Show the dialog merging several files
+  void openmerged(QString fileName);    //!< Open the file just merged
   void about();                         //!< Display the about dialog
   void openRecentFile();                //!< Open a recent opened file again
   void fileModified();                  //!< Called whenever the file has been modified since loading
   void updateinterfacelist();           //!< Rescan for network interfaces
+  void linkchanged(canlink link);       //!< Called when a CAN interface has been added or changed
+  void linkremoved(canlink link);       //!< Called when a CAN interface has been removed
   void ifacelistdclicked(const QModelIndex & index);  //!< Called when the list of network interfaces has been double-clicked
   void updateStatus(struct threadstatus newstat); //!< Refresh the thread's status in the GUI
   void sendtablechanged(QTreeWidgetItem * item, int column);  //!< Called when the user changed a value in the sendtable
@@ -70,6 +82,30 @@ private slots:
   void sendtimer9fired();               //!< to be called when timer9 has fired
   void sendtimerfired(int id);          //!< To be called when a timer has fired, id as parameter
   void startorstopthread();             //!< Start or stop a CAN interface-thread
+  void ifaceactivated(const QString &ifacename); //!< Called when the user picked an interface in the combobox
+  void displayfilterchanged();          //!< Called when the user changed the display filter
+  void tracefilterchanged();            //!< Called when the user changed the filter of the filtered trace
+  void isotpidschanged();               //!< Called when the user changed the IDs carrying ISO-TP
+  void isotpactivated(const QModelIndex &index); //!< Called when an ISO-TP message or frame has been double-clicked
+  void decodedactivated(const QModelIndex &index); //!< Called when an annotation of a decoder has been double-clicked
+  void updatedecoders();                //!< Refresh the CPU time of the protocol decoders in the GUI
+  void cycleperiodschanged();           //!< Called when the user changed the nominal cycle times
+  void updatecycles();                  //!< Refresh the cycle times in the GUI
+  void resetcycles();                   //!< Measure the cycle times anew
+  void capturetriggered();              //!< Called when the capture trigger has fired
+  void capturecomplete();               //!< Called when all post-trigger packets have been recorded
+  void armtrigger();                    //!< Re-arm the capture trigger
+  void threadtriggerfired(QString definition); //!< Called when a capture thread trigger has fired
+  void loaddatabase();                  //!< Load a DBC signal database
+  void updatelatency();                 //!< Refresh the latency statistics in the GUI
+  void resetlatency();                  //!< Empty the latency statistics
+  void dumplatency();                   //!< Write the latency histograms to a file
+  void schedulingwarning(QString message); //!< Called when the capture thread scheduling could not be applied
+  void pollcontrollers();               //!< Refresh state and error counters of all CAN controllers
+  void setstatspoll(int msec);          //!< Set how often the controller statistics are polled
+  void setstreamserver(bool enabled, bool local, int port, QString path); //!< Start or stop the streaming server
+  void setshmring(bool enabled, QString name, int slots); //!< Create or remove the shared-memory ring
+  void shmpublish(canpacket packet);    //!< Writes a captured packet to the shared-memory ring
 
 private:
   QTreeWidget *ifacelist;               //!< widget to display network interfaces
@@ -83,6 +119,38 @@ private:
   QLabel *statusoutcounter;             //!< Counter display packets out
   QLabel *statusinbcounter;             //!< Counter display bytes in
   QLabel *statusoutbcounter;            //!< Counter display bytes out
+  QLabel *statustrigger;                //!< Showing the state of the capture trigger
+  QLabel *statusevicted;                //!< Counter display packets dropped from the ring
+  QLabel *statustriggercounter;         //!< Counter display triggers fired
+  QLabel *statusdropcounter;            //!< Counter display frames dropped by the kernel
+  QLabel *statusrcvbuf;                 //!< Socket receive buffer size in effect
+  QLabel *statusstream;                 //!< Streaming server clients and packets dropped for them
+  QLabel *statuslate;                   //!< Packets that came later than the reorder window
+  QTreeWidget *controllertable;         //!< State and error counters per CAN controller
+  QTimer *controllertimer;              //!< Polls the controller statistics
+
+  QLineEdit *displayfilterids;          //!< Display filter: IDs and ID ranges to be shown
+  QComboBox *displayfilterdirection;    //!< Display filter: directions to be shown
+  QComboBox *displayfiltererrors;       //!< Display filter: error frames, data frames or both
+  QLineEdit *displayfilterpayload;      //!< Display filter: payload pattern
+
+  QLineEdit *tracefilterids;            //!< Filtered trace: IDs and ID ranges to be shown
+  QLineEdit *tracefilterpayload;        //!< Filtered trace: payload pattern
+  canpacketmodel *tracemodel;           //!< Filtered trace: second view of the canpackets of myclf
+  canidsummarymodel *summarymodel;      //!< One row per CAN ID of the canpackets of myclf
+  QLineEdit *isotpids;                  //!< ISO-TP messages: IDs and ID ranges carrying ISO-TP
+  canisotpmodel *isotpmodel;            //!< ISO-TP messages reassembled from the canpackets of myclf
+  canpipeline *pipeline;                //!< Protocol decoders running on the canpackets of myclf
+  QTreeWidget *decodertable;            //!< Counters and CPU time per protocol decoder
+  QTimer *decodertimer;                 //!< Refreshes the decoder table
+  QLineEdit *cycleperiods;              //!< Cycle times: nominal period per CAN ID
+  QTreeWidget *cycletable;              //!< Cycle times: interval and jitter per CAN ID
+  QTimer *cycletimer;                   //!< Refreshes the cycle time table
+
+  cansignalplot *signalplot;            //!< Plot of decoded signals
+
+  QTreeWidget *latencytable;            //!< Latency percentiles per stage of the capture path
+  QTimer *latencytimer;                 //!< Refreshes the latency table
 
   QTreeWidget *sendtable;               //!< Widget to show the 10 send timers
   QList<QTreeWidgetItem *> timerdisplaylist;  //!< List with send timer values
@@ -99,10 +167,20 @@ private:
   void setCurrentFile(const QString &fileName); //!< Set the current file name
   void updateRecentFileActions();       //!< Update the recent file list
   QString strippedName(const QString &fullFileName);  //!< Short file name (without leading path name)
+  int ifacelistindex(int ifindex);      //!< Position of an interface in the interface list
+  void recoverjournals();               //!< Offer to recover the captures of crashed instances
 
   canthread mycanthread;                //!< The canthread that does the work for us
+  cannetlink netlink;                   //!< Lists the CAN interfaces and reports their changes
+  canlatency latency;                   //!< Latency statistics of the capture path
+  cancycleanalyzer cycles;              //!< Cycle times measured by the capture thread
+  canjournal journal;                   //!< Crash-safe journal of the canlogfile
+  canstreamserver streamserver;         //!< Serves the captured packets to other processes
+  canshmwriter shmring;                 //!< Publishes the captured packets in shared memory
+  canreorder reorder;                   //!< Puts the captured packets into timestamp order
 
   canlogfile *myclf;                    //!< Logfile currently open
+  candbc *database;                     //!< Signal database used for decoding (0 = none)
   QStringList recentFiles;              //!< List of recently opened files
   QString curFile;                      //!< Currently opened file name
 
@@ -125,8 +203,13 @@ private:
   QAction *aboutAction;                 //!< action: about dialog
   QAction *aboutQtAction;               //!< action: about Qt
   QAction *setupAction;                 //!< action: setup dialog
+  QAction *loadDatabaseAction;          //!< action: load signal database
+  QAction *compareAction;               //!< action: compare two files
+  QAction *mergeAction;                 //!< action: merge several files
 
   SetupDialog *setupdialog;             //!< instance of the setup dialog we use
+  CompareDialog *comparedialog;         //!< instance of the compare dialog we use
+  MergeDialog *mergedialog;             //!< instance of the merge dialog we use
 };
 
 #endif // SOCKETCANGUI_H
@@ -1,12 +1,69 @@
 TARGET = socketcangui
 TEMPLATE = app
+QT += network
 SOURCES += setupdialog.cpp \
+    comparedialog.cpp \
+    mergedialog.cpp \
     canthread.cpp \
     main.cpp \
     socketcangui.cpp \
-    canlogfile.cpp
+    canlogfile.cpp \
+    canpacketmodel.cpp \
+    canpacketstore.cpp \
+    canidsummarymodel.cpp \
+    canisotp.cpp \
+    canisotpmodel.cpp \
+    candecoders.cpp \
+    canpipeline.cpp \
+    canpacketfilter.cpp \
+    cantrigger.cpp \
+    canlatency.cpp \
+    cancycle.cpp \
+    candbc.cpp \
+    cansignalplot.cpp \
+    cannetlink.cpp \
+    canlogblock.cpp \
+    cancapture.cpp \
+    cancompare.cpp \
+    canmerge.cpp \
+    canreorder.cpp \
+    canjournal.cpp \
+    canstreamserver.cpp \
+    canshmring.cpp
 HEADERS += setupdialog.h \
+    comparedialog.h \
+    mergedialog.h \
     canthread.h \
     socketcangui.h \
-    canlogfile.h
+    canlogfile.h \
+    canpacketmodel.h \
+    canpacketstore.h \
+    canidsummarymodel.h \
+    canisotp.h \
+    canisotpmodel.h \
+    candecoder.h \
+    candecoders.h \
+    canpipeline.h \
+    canpacketfilter.h \
+    cantrigger.h \
+    canlatency.h \
+    cancycle.h \
+    candbc.h \
+    cansignalplot.h \
+    cannetlink.h \
+    canlogblock.h \
+    cancapture.h \
+    cancompare.h \
+    canmerge.h \
+    canreorder.h \
+    canjournal.h \
+    canstreamserver.h \
+    canshmring.h
 RESOURCES += socketcangui.qrc
+# shm_open() of the shared-memory ring
+LIBS += -lrt
+# qmake CONFIG+=lz4 compresses the saved files with liblz4
+lz4 {
+    DEFINES += HAVE_LZ4
+    LIBS += -llz4
+}